@@ -49,8 +49,10 @@ extern const Command pickle_command;
 extern const Command repack_command;
 extern const Command retrace_command;
 extern const Command sed_command;
+extern const Command symbolize_command;
 extern const Command trace_command;
 extern const Command trim_command;
 extern const Command info_command;
+extern const Command verify_command;
 extern const Command version_command;
 extern const Command gltrim_command;
@@ -26,6 +26,7 @@
  **************************************************************************/
 
 
+#include <stdlib.h>
 #include <string.h>
 #include <limits.h> // for CHAR_MAX
 #include <getopt.h>
@@ -33,10 +34,17 @@
 #include <unistd.h> // for isatty()
 #endif
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <regex>
+#include <thread>
+#include <vector>
 
 #include "cxx_compat.hpp" // for std::to_string, std::make_unique
 
@@ -61,6 +69,14 @@ static bool verbose = false;
 
 static trace::CallSet calls(trace::FREQUENCY_ALL);
 
+static bool grep = false;
+
+static std::regex grepRegex;
+
+static trace::DumpFlags dumpFlags = 0;
+
+static bool blobs = false;
+
 static const char *synopsis = "Dump given trace(s) to standard output.";
 
 static void
@@ -82,6 +98,7 @@ usage(void)
         "    --arg-names[=BOOL]   dump argument names [default: yes]\n"
         "    --blobs              dump blobs into files\n"
         "    --multiline[=BOOL]   dump newline in strings literally [default: yes]\n"
+        "    -j, --jobs=N         format calls with N threads [default: 1]\n"
         "\n"
     ;
 }
@@ -98,7 +115,7 @@ enum {
 };
 
 const static char *
-shortOptions = "hv";
+shortOptions = "hvj:";
 
 const static struct option
 longOptions[] = {
@@ -113,6 +130,7 @@ longOptions[] = {
     {"arg-names", optional_argument, 0, ARG_NAMES_OPT},
     {"blobs", no_argument, 0, BLOBS_OPT},
     {"multiline", optional_argument, 0, MULTILINE_OPT},
+    {"jobs", required_argument, 0, 'j'},
     {0, 0, 0, 0}
 };
 
@@ -157,13 +175,272 @@ public:
 };
 
 
+static std::unique_ptr<trace::Dumper>
+createDumper(std::ostream &os)
+{
+    if (blobs) {
+        return std::make_unique<BlobDumper>(os, dumpFlags);
+    } else {
+        return std::make_unique<trace::Dumper>(os, dumpFlags);
+    }
+}
+
+
+// Skip the calls that won't be dumped without decoding them
+static trace::CallFilter
+createCallFilter(void)
+{
+    trace::CallFilter filter;
+    if (grep) {
+        filter.signature = [] (const trace::FunctionSig *sig, trace::CallFlags) {
+            return std::regex_search(sig->name, grepRegex);
+        };
+    }
+    filter.call = [] (const trace::FunctionSig *, unsigned, unsigned call_no, trace::CallFlags flags) {
+        return calls.contains(call_no, flags);
+    };
+    filter.last = calls.getLast();
+    return filter;
+}
+
+
+static bool
+dumpCall(trace::Dumper &dumper, std::ostream &os, trace::Call *call)
+{
+    if (calls.contains(*call) &&
+        (!grep ||
+         std::regex_search(call->sig->name, grepRegex))) {
+        if (verbose ||
+            !(call->flags & trace::CALL_FLAG_VERBOSE)) {
+            dumper.visit(call);
+            if (dumpFlags & trace::DUMP_FLAG_NO_MULTILINE) {
+                os << '\n';
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static void
+dumpSequential(trace::Parser &p, trace::Dumper &dumper)
+{
+    trace::Call *call;
+    while ((call = p.parse_call())) {
+        // Give a few calls of tolerance before bailing out to allow pending
+        // multi-threaded calls out of order to dump
+        const unsigned long long call_no_tol = 100;
+
+        if (call->no > calls.getLast() + call_no_tol) {
+            delete call;
+            break;
+        }
+        if (dumpCall(dumper, std::cout, call) && grep) {
+            std::cout << std::flush;
+        }
+        delete call;
+    }
+}
+
+
+/*
+ * Parallel dumping.
+ *
+ * The trace is scanned (not parsed) on the main thread, and split into
+ * chunks at points where no call is pending, preferably right after a frame
+ * boundary.  Each worker has its own parser, skips to the start of a chunk
+ * (which still requires reading the signatures on the way), and formats its
+ * calls into a string.  The main thread writes the chunks out
+ * in order, and stops scanning while too many are outstanding, so memory
+ * usage is bounded regardless of the trace size.
+ */
+
+// Minimum number of calls per chunk
+static const unsigned CHUNK_CALLS = 16384;
+
+struct DumpChunk
+{
+    trace::ParseBookmark start;
+
+    // Number of the first call of the next chunk
+    unsigned end = ~0U;
+
+    std::string output;
+    bool done = false;
+};
+
+
+class ParallelDump
+{
+    const char *filename;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    // Chunks waiting for a worker
+    std::deque<std::shared_ptr<DumpChunk>> queue;
+
+    // Chunks not yet written out, in call order
+    std::deque<std::shared_ptr<DumpChunk>> chunks;
+
+    size_t maxChunks;
+    bool finished = false;
+
+    std::vector<std::thread> workers;
+
+    void
+    work(trace::Dumper *dumper, std::ostringstream *os) {
+        trace::Parser p;
+        if (!p.open(filename)) {
+            // The file was already opened once, so this should not happen
+            exit(1);
+        }
+
+        for (;;) {
+            std::shared_ptr<DumpChunk> chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this] { return !queue.empty() || finished; });
+                if (queue.empty()) {
+                    break;
+                }
+                chunk = queue.front();
+                queue.pop_front();
+            }
+
+            // Have the parser stop once all calls of the chunk are returned
+            trace::CallFilter filter = createCallFilter();
+            if (chunk->end != ~0U) {
+                filter.last = std::min(filter.last, chunk->end - 1);
+            }
+            p.setCallFilter(filter);
+            p.skipTo(chunk->start);
+
+            trace::Call *call;
+            while ((call = p.parse_call())) {
+                dumpCall(*dumper, *os, call);
+                delete call;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                chunk->output = os->str();
+                chunk->done = true;
+            }
+            cond.notify_all();
+
+            os->str(std::string());
+        }
+
+        delete dumper;
+        delete os;
+    }
+
+    // Write out the finished chunks at the front, waiting until no more than
+    // `keep` chunks are outstanding
+    void
+    drain(size_t keep) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!chunks.empty()) {
+            if (!chunks.front()->done) {
+                if (chunks.size() <= keep) {
+                    break;
+                }
+                cond.wait(lock, [this] { return chunks.front()->done; });
+            }
+
+            std::shared_ptr<DumpChunk> chunk = chunks.front();
+            chunks.pop_front();
+
+            lock.unlock();
+            std::cout << chunk->output;
+            if (grep) {
+                std::cout << std::flush;
+            }
+            lock.lock();
+        }
+    }
+
+    void
+    submit(const trace::ParseBookmark &start, unsigned end) {
+        auto chunk = std::make_shared<DumpChunk>();
+        chunk->start = start;
+        chunk->end = end;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(chunk);
+            chunks.push_back(chunk);
+        }
+        cond.notify_all();
+
+        drain(maxChunks);
+    }
+
+public:
+    ParallelDump(const char *_filename, unsigned jobs) :
+        filename(_filename),
+        maxChunks(2 * jobs)
+    {
+        // Dumpers are created here as the highlighter is chosen lazily
+        for (unsigned i = 0; i < jobs; ++i) {
+            std::ostringstream *os = new std::ostringstream;
+            trace::Dumper *dumper = createDumper(*os).release();
+            workers.emplace_back(&ParallelDump::work, this, dumper, os);
+        }
+    }
+
+    void
+    run(trace::Parser &p) {
+        trace::ParseBookmark start;
+        p.getBookmark(start);
+        bool pending = false;
+
+        trace::Call *call;
+        while ((call = p.scan_call())) {
+            bool endFrame = call->flags & trace::CALL_FLAG_END_FRAME;
+            // Count the calls which were filtered out too
+            unsigned numCalls = call->no + 1 - start.next_call_no;
+            delete call;
+
+            if (numCalls >= CHUNK_CALLS &&
+                (endFrame || numCalls >= 4 * CHUNK_CALLS) &&
+                !p.hasPendingCalls()) {
+                trace::ParseBookmark end;
+                p.getBookmark(end);
+                submit(start, end.next_call_no);
+                start = end;
+                pending = false;
+            } else {
+                pending = true;
+            }
+        }
+
+        // The last chunk runs until the end of file, so that it includes
+        // incomplete calls
+        if (pending) {
+            submit(start, ~0U);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        cond.notify_all();
+
+        drain(0);
+
+        for (auto & worker : workers) {
+            worker.join();
+        }
+    }
+};
+
+
 static int
 command(int argc, char *argv[])
 {
-    trace::DumpFlags dumpFlags = 0;
-    bool blobs = false;
-    bool grep = false;
-    std::regex grepRegex;
+    unsigned jobs = 1;
 
     int opt;
     while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
@@ -225,6 +502,12 @@ command(int argc, char *argv[])
         case BLOBS_OPT:
             blobs = true;
             break;
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs < 1) {
+                jobs = 1;
+            }
+            break;
         default:
             std::cerr << "error: unexpected option `" << (char)opt << "`\n";
             usage();
@@ -245,13 +528,7 @@ command(int argc, char *argv[])
         dumpFlags |= trace::DUMP_FLAG_NO_COLOR;
     }
 
-    std::unique_ptr<trace::Dumper> dumper;
-
-    if (blobs) {
-        dumper = std::make_unique<BlobDumper>(std::cout, dumpFlags);
-    } else {
-        dumper = std::make_unique<trace::Dumper>(std::cout, dumpFlags);
-    }
+    std::unique_ptr<trace::Dumper> dumper = createDumper(std::cout);
 
     for (int i = optind; i < argc; ++i) {
         trace::Parser p;
@@ -269,32 +546,17 @@ command(int argc, char *argv[])
             }
         }
 
-        trace::Call *call;
-        while ((call = p.parse_call())) {
-            // Give a few calls of tolerance before bailing out to allow pending
-            // multi-threaded calls out of order to dump
-            const unsigned long long call_no_tol = 100;
+        p.setCallFilter(createCallFilter());
 
-            if (call->no > calls.getLast() + call_no_tol) {
-                delete call;
-                break;
+        if (jobs > 1) {
+            if (p.supportsOffsets()) {
+                ParallelDump(argv[i], jobs).run(p);
+                continue;
             }
-            if (calls.contains(*call) &&
-                (!grep ||
-                 std::regex_search(call->sig->name, grepRegex))) {
-                if (verbose ||
-                    !(call->flags & trace::CALL_FLAG_VERBOSE)) {
-                    dumper->visit(call);
-                    if (dumpFlags & trace::DUMP_FLAG_NO_MULTILINE) {
-                        std::cout << '\n';
-                    }
-                    if (grep) {
-                        std::cout << std::flush;
-                    }
-                }
-            }
-            delete call;
+            std::cerr << "warning: " << argv[i] << " does not support seeking, dumping sequentially\n";
         }
+
+        dumpSequential(p, *dumper);
     }
 
     return 0;
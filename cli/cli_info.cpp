@@ -33,9 +33,11 @@
 #include <unistd.h> // for isatty()
 #endif
 
+#include <algorithm>
 #include <memory>
 #include <fstream>
 #include <string>
+#include <vector>
 
 #include "cxx_compat.hpp" // for std::to_string, std::make_unique
 
@@ -56,12 +58,14 @@ usage(void)
         "\n"
         "    -h, --help        show this help message and exit\n"
         "    --dump-frames     dump per frame information\n"
+        "    --stats           collect per function, thread and frame statistics\n"
         "\n"
     ;
 }
 
 enum {
     DUMP_FRAMES_OPT = CHAR_MAX + 1,
+    STATS_OPT,
 };
 
 const static char *
@@ -71,6 +75,7 @@ const static struct option
 longOptions[] = {
     {"help", no_argument, 0, 'h'},
     {"dump-frames", no_argument, 0, DUMP_FRAMES_OPT},
+    {"stats", no_argument, 0, STATS_OPT},
     {0, 0, 0, 0}
 };
 
@@ -87,10 +92,216 @@ struct FrameEntry {
     size_t sizeInBytes;
 };
 
+
+static void
+writeString(std::ostream &os, const char *s)
+{
+    os << '"';
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') {
+            os << '\\';
+        }
+        os << *s;
+    }
+    os << '"';
+}
+
+
+/**
+ * Sizes, in power of two buckets: bucket 0 counts zero, and bucket i counts
+ * sizes in [2^(i-1), 2^i).
+ */
+struct SizeHistogram {
+    static const unsigned NUM_BUCKETS = 65;
+
+    unsigned long long buckets[NUM_BUCKETS] = {};
+    unsigned long long count = 0;
+    unsigned long long total = 0;
+    unsigned long long min = 0;
+    unsigned long long max = 0;
+
+    void
+    add(unsigned long long size) {
+        unsigned bucket = 0;
+        while (bucket < 64 && (size >> bucket)) {
+            ++bucket;
+        }
+        ++buckets[bucket];
+        if (!count || size < min) {
+            min = size;
+        }
+        if (size > max) {
+            max = size;
+        }
+        ++count;
+        total += size;
+    }
+
+    void
+    write(std::ostream &os) const {
+        os << "{\"Count\": " << count
+           << ", \"Total\": " << total
+           << ", \"Min\": " << min
+           << ", \"Max\": " << max
+           << ", \"Mean\": " << (count ? total / count : 0)
+           << ", \"Buckets\": [";
+        const char *separator = "";
+        for (unsigned i = 0; i < NUM_BUCKETS; ++i) {
+            if (buckets[i]) {
+                unsigned long long lo = i ? 1ULL << (i - 1) : 0;
+                unsigned long long hi = i ? lo * 2 - 1 : 0;
+                os << separator << "[" << lo << ", " << hi << ", " << buckets[i] << "]";
+                separator = ", ";
+            }
+        }
+        os << "]}";
+    }
+};
+
+
+/**
+ * Statistics gathered in a single scan_call() pass.  Only the length
+ * prefixes of blobs and strings are read, never their contents.
+ */
+class TraceStats : public trace::Parser::ScanObserver
+{
+private:
+    struct FunctionStats {
+        const char *name = nullptr;
+        unsigned long long calls = 0;
+        unsigned long long blobBytes = 0;
+        unsigned long long stringBytes = 0;
+        // Blob and string bytes of each argument carrying any
+        SizeHistogram argSizes;
+    };
+
+    std::vector<FunctionStats> functions;
+    std::vector<unsigned long long> threadCalls;
+
+    unsigned long long calls = 0;
+    unsigned long long blobBytes = 0;
+    unsigned long long stringBytes = 0;
+    unsigned long long threadSwitches = 0;
+    unsigned lastThread = 0;
+
+    SizeHistogram frameBytes;
+    SizeHistogram frameCalls;
+    SizeHistogram frameBlobBytes;
+    size_t frameStartBytes = 0;
+    unsigned long long callsInFrame = 0;
+    unsigned long long blobBytesInFrame = 0;
+
+    FunctionStats &
+    getFunction(const trace::FunctionSig *sig) {
+        if (sig->id >= functions.size()) {
+            functions.resize(sig->id + 1);
+        }
+        FunctionStats &function = functions[sig->id];
+        function.name = sig->name;
+        return function;
+    }
+
+public:
+    void
+    scannedArg(const trace::Call *call, unsigned index, size_t blob, size_t string) override {
+        if (blob || string) {
+            FunctionStats &function = getFunction(call->sig);
+            function.blobBytes += blob;
+            function.stringBytes += string;
+            function.argSizes.add(blob + string);
+            blobBytes += blob;
+            stringBytes += string;
+            blobBytesInFrame += blob;
+        }
+    }
+
+    void
+    addCall(const trace::Call *call, size_t dataBytesRead) {
+        ++getFunction(call->sig).calls;
+
+        if (call->thread_id >= threadCalls.size()) {
+            threadCalls.resize(call->thread_id + 1);
+        }
+        ++threadCalls[call->thread_id];
+        if (calls && call->thread_id != lastThread) {
+            ++threadSwitches;
+        }
+        lastThread = call->thread_id;
+        ++calls;
+
+        ++callsInFrame;
+        if (call->flags & trace::CALL_FLAG_END_FRAME) {
+            frameBytes.add(dataBytesRead - frameStartBytes);
+            frameCalls.add(callsInFrame);
+            frameBlobBytes.add(blobBytesInFrame);
+            frameStartBytes = dataBytesRead;
+            callsInFrame = 0;
+            blobBytesInFrame = 0;
+        }
+    }
+
+    void
+    write(std::ostream &os) const {
+        os << "  \"Stats\": {\n"
+           << "    \"CallsCount\": " << calls << ",\n"
+           << "    \"BlobBytes\": " << blobBytes << ",\n"
+           << "    \"StringBytes\": " << stringBytes << ",\n"
+           << "    \"ThreadSwitches\": " << threadSwitches << ",\n"
+           << "    \"Threads\": [";
+        const char *separator = "\n";
+        for (size_t i = 0; i < threadCalls.size(); ++i) {
+            if (threadCalls[i]) {
+                os << separator << "      {\"Id\": " << i << ", \"CallsCount\": " << threadCalls[i] << "}";
+                separator = ",\n";
+            }
+        }
+        os << "\n    ],\n";
+
+        os << "    \"FrameBytes\": ";
+        frameBytes.write(os);
+        os << ",\n    \"FrameCalls\": ";
+        frameCalls.write(os);
+        os << ",\n    \"FrameBlobBytes\": ";
+        frameBlobBytes.write(os);
+        os << ",\n";
+
+        // Most called first
+        std::vector<const FunctionStats *> sorted;
+        for (auto &function : functions) {
+            if (function.calls) {
+                sorted.push_back(&function);
+            }
+        }
+        std::stable_sort(sorted.begin(), sorted.end(),
+            [](const FunctionStats *a, const FunctionStats *b) {
+                return a->calls > b->calls;
+            });
+
+        os << "    \"Functions\": [";
+        separator = "\n";
+        for (const FunctionStats *function : sorted) {
+            os << separator << "      {\"Name\": ";
+            writeString(os, function->name);
+            os << ", \"CallsCount\": " << function->calls
+               << ", \"BlobBytes\": " << function->blobBytes
+               << ", \"StringBytes\": " << function->stringBytes;
+            if (function->argSizes.count) {
+                os << ", \"ArgSizes\": ";
+                function->argSizes.write(os);
+            }
+            os << "}";
+            separator = ",\n";
+        }
+        os << "\n    ]\n"
+           << "  }";
+    }
+};
+
 static int
 command(int argc, char *argv[])
 {
     bool flagDumpFrames = false;
+    bool flagStats = false;
     int opt;
     while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
         switch (opt) {
@@ -100,6 +311,9 @@ command(int argc, char *argv[])
         case DUMP_FRAMES_OPT:
             flagDumpFrames = true;
             break;
+        case STATS_OPT:
+            flagStats = true;
+            break;
         default:
             std::cerr << "error: unexpected option `" << (char)opt << "`\n";
             usage();
@@ -119,12 +333,21 @@ command(int argc, char *argv[])
             return 1;
         }
 
+        std::unique_ptr<TraceStats> stats;
+        if (flagStats) {
+            stats = std::make_unique<TraceStats>();
+            p.setScanObserver(stats.get());
+        }
+
         trace::Call *call;
         size_t callsInFrame = 0;
         size_t firstCallId = 0;
         size_t frameBytesOffset = 0;
         bool endFrame = true;
-        while ((call = p.parse_call())) {
+        while ((call = p.scan_call())) {
+            if (stats) {
+                stats->addCall(call, p.dataBytesRead());
+            }
             if (flagDumpFrames) {
                 ++callsInFrame;
                 if (endFrame) {
@@ -177,10 +400,13 @@ command(int argc, char *argv[])
                     std::cout << "  }, {" << std::endl;
                 }
             }
-            std::cout << "  }]" << std::endl;
-        } else {
-            std::cout << std::endl;
+            std::cout << "  }]";
+        }
+        if (stats) {
+            std::cout << "," << std::endl;
+            stats->write(std::cout);
         }
+        std::cout << std::endl;
         std::cout << "}" << std::endl;
     }
 
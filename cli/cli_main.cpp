@@ -95,11 +95,13 @@ static const Command * commands[] = {
     &leaks_command,
     &pickle_command,
     &sed_command,
+    &symbolize_command,
     &repack_command,
     &retrace_command,
     &trace_command,
     &trim_command,
     &info_command,
+    &verify_command,
     &version_command,
     &help_command
 };
@@ -276,6 +276,13 @@ command(int argc, char *argv[])
             return 1;
         }
 
+        trace::CallFilter filter;
+        filter.call = [&] (const trace::FunctionSig *, unsigned, unsigned call_no, trace::CallFlags flags) {
+            return calls.contains(call_no, flags);
+        };
+        filter.last = calls.getLast();
+        parser.setCallFilter(filter);
+
         trace::Call *call;
         while ((call = parser.parse_call())) {
             if (call->no > calls.getLast()) {
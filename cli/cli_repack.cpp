@@ -26,10 +26,12 @@
 
 #include <assert.h>
 #include <string.h>
+#include <limits.h> // for CHAR_MAX
 #include <getopt.h>
 
 #include <iostream>
 #include <memory>
+#include <string>
 
 #include "cli.hpp"
 
@@ -38,6 +40,8 @@
 
 #include "trace_file.hpp"
 #include "trace_ostream.hpp"
+#include "trace_parser.hpp"
+#include "trace_writer.hpp"
 
 
 static const char *synopsis = "Repack a trace file with different compression.";
@@ -56,12 +60,21 @@ usage(void)
         << "    -s,--snappy            Use Snappy compression (default format; recommended for qapitrace)\n"
         << "    -z,--zstd[=QUALITY]    Use Zstandard (seekable) compression (quality 1-22)\n"
         << "    -g,--zlib              Use ZLib (Gzip) compression\n"
+        << "    --dedup                Replace repeated blobs with back-references\n"
+        << "    --no-dedup             Expand blob back-references\n"
+        << "    --checksums            Add per-chunk checksums (Snappy and Zstandard), for `apitrace verify`\n"
         << "\n";
 }
 
 const static char *
 shortOptions = "hbstz";
 
+enum {
+    DEDUP_OPT = CHAR_MAX + 1,
+    NO_DEDUP_OPT,
+    CHECKSUMS_OPT,
+};
+
 const static struct option
 longOptions[] = {
     {"help", no_argument, 0, 'h'},
@@ -69,6 +82,9 @@ longOptions[] = {
     {"snappy", no_argument, 0, 's'},
     {"zstd", optional_argument, 0, 'z'},
     {"zlib", no_argument, 0, 'g'},
+    {"dedup", no_argument, 0, DEDUP_OPT},
+    {"no-dedup", no_argument, 0, NO_DEDUP_OPT},
+    {"checksums", no_argument, 0, CHECKSUMS_OPT},
     {0, 0, 0, 0}
 };
 
@@ -79,6 +95,12 @@ enum Format {
     FORMAT_ZSTD,
 };
 
+enum Dedup {
+    DEDUP_KEEP = 0,
+    DEDUP_ADD,
+    DEDUP_STRIP,
+};
+
 
 static int
 repack_generic(trace::File *inFile, trace::OutStream *outFile)
@@ -190,31 +212,74 @@ repack_brotli(trace::File *inFile, const char *outFileName, int quality)
     return EXIT_SUCCESS;
 }
 
+/*
+ * Rewrite all calls, as blob deduplication can't be changed without parsing
+ * the trace.
+ */
+static int
+repack_calls(const char *inFileName, trace::OutStream *outFile, bool dedup)
+{
+    trace::Parser p;
+    if (!p.open(inFileName)) {
+        std::cerr << "error: failed to open " << inFileName << "\n";
+        delete outFile;
+        return EXIT_FAILURE;
+    }
+
+    trace::Writer writer;
+    writer.setBlobDedup(dedup);
+    if (!writer.open(outFile, p.getVersion(), p.getProperties())) {
+        std::cerr << "error: failed to create output trace\n";
+        return EXIT_FAILURE;
+    }
+
+    trace::Call *call;
+    while ((call = p.parse_call())) {
+        writer.writeCall(call);
+        delete call;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
 static int
-repack(const char *inFileName, const char *outFileName, Format format, int quality)
+repack(const char *inFileName, const char *outFileName, Format format, int quality, Dedup dedup, bool checksums)
 {
     int ret = EXIT_FAILURE;
 
-    trace::File *inFile = trace::File::createForRead(inFileName);
-    if (!inFile) {
-        return 1;
+    trace::File *inFile = nullptr;
+    if (dedup == DEDUP_KEEP) {
+        inFile = trace::File::createForRead(inFileName);
+        if (!inFile) {
+            return 1;
+        }
     }
 
     trace::OutStream *outFile = nullptr;
     if (format == FORMAT_SNAPPY) {
-        outFile = trace::createSnappyStream(outFileName);
+        outFile = trace::createSnappyStream(outFileName, checksums);
     } else if (format == FORMAT_BROTLI) {
-        ret = repack_brotli(inFile, outFileName, quality);
-        delete inFile;
-        return ret;
+        if (!inFile) {
+            outFile = trace::createBrotliStream(outFileName, quality);
+        } else {
+            ret = repack_brotli(inFile, outFileName, quality);
+            delete inFile;
+            return ret;
+        }
     } else if (format == FORMAT_ZLIB) {
         outFile = trace::createZLibStream(outFileName);
     } else if (format == FORMAT_ZSTD) {
-        outFile = trace::createZstdStream(outFileName, quality);
+        outFile = trace::createZstdStream(outFileName, quality, checksums);
     }
     if (outFile) {
-        ret = repack_generic(inFile, outFile);
-        delete outFile;
+        if (inFile) {
+            ret = repack_generic(inFile, outFile);
+            delete outFile;
+        } else {
+            // Compress on another thread while parsing
+            ret = repack_calls(inFileName, trace::createAsyncStream(outFile), dedup == DEDUP_ADD);
+        }
     }
 
     delete inFile;
@@ -226,6 +291,8 @@ static int
 command(int argc, char *argv[])
 {
     Format format = FORMAT_SNAPPY;
+    Dedup dedup = DEDUP_KEEP;
+    bool checksums = false;
     int opt;
     int quality = 0;
     while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
@@ -261,6 +328,15 @@ command(int argc, char *argv[])
         case 'g':
             format = FORMAT_ZLIB;
             break;
+        case DEDUP_OPT:
+            dedup = DEDUP_ADD;
+            break;
+        case NO_DEDUP_OPT:
+            dedup = DEDUP_STRIP;
+            break;
+        case CHECKSUMS_OPT:
+            checksums = true;
+            break;
         default:
             std::cerr << "error: unexpected option `" << (char)opt << "`\n";
             usage();
@@ -274,7 +350,7 @@ command(int argc, char *argv[])
         return 1;
     }
 
-    return repack(argv[optind], argv[optind + 1], format, quality);
+    return repack(argv[optind], argv[optind + 1], format, quality, dedup, checksums);
 }
 
 const Command repack_command = {
@@ -55,6 +55,9 @@ usage(void)
         "                             separator.\n"
         "                             XXX: Only works for enums and strings.\n"
         "    -o, --output=TRACE_FILE  Output trace file\n"
+        "    --output-format=FORMAT[:LEVEL]\n"
+        "                             Output compression: snappy (default), zlib,\n"
+        "                             brotli or zstd\n"
         "    --property=NAME=VALUE    Set a property\n"
         "    --calls=CALLSET          Apply search/replace only to specified calls.\n"
         "                             All other calls remain untouched.\n"
@@ -64,7 +67,8 @@ usage(void)
 
 enum {
     PROPERTY_OPT = CHAR_MAX + 1,
-    CALLS_OPT
+    CALLS_OPT,
+    OUTPUT_FORMAT_OPT,
 };
 
 const static char *
@@ -74,6 +78,7 @@ const static struct option
 longOptions[] = {
     {"help", no_argument, 0, 'h'},
     {"output", required_argument, 0, 'o'},
+    {"output-format", required_argument, 0, OUTPUT_FORMAT_OPT},
     {"property", required_argument, 0, PROPERTY_OPT},
     {"calls", required_argument, 0, CALLS_OPT},
     {0, 0, 0, 0}
@@ -230,6 +235,7 @@ sed_trace(Replacements &replacements,
           const trace::Properties &extraProperties,
           const char *inFileName,
           std::string &outFileName,
+          const trace::OutputOptions &outputOptions,
           const trace::CallSet &calls)
 {
     trace::Parser p;
@@ -253,7 +259,7 @@ sed_trace(Replacements &replacements,
     }
 
     trace::Writer writer;
-    if (!writer.open(outFileName.c_str(), p.getVersion(), properties)) {
+    if (!writer.open(outFileName.c_str(), outputOptions, p.getVersion(), properties)) {
         std::cerr << "error: failed to create " << outFileName << "\n";
         return 1;
     }
@@ -360,6 +366,7 @@ command(int argc, char *argv[])
     Replacements replacements;
     trace::Properties extraProperties;
     std::string outFileName;
+    trace::OutputOptions outputOptions;
     trace::CallSet calls;
 
     int opt;
@@ -371,6 +378,11 @@ command(int argc, char *argv[])
         case 'o':
             outFileName = optarg;
             break;
+        case OUTPUT_FORMAT_OPT:
+            if (!trace::parseOutputFormat(optarg, outputOptions)) {
+                return 1;
+            }
+            break;
         case 'e':
             if (!parseSubstOpt(replacements, optarg)) {
                 std::cerr << "error: invalid replacement pattern `" << optarg << "`\n";
@@ -415,7 +427,7 @@ command(int argc, char *argv[])
         return 1;
     }
 
-    return sed_trace(replacements, extraProperties, argv[optind], outFileName, calls);
+    return sed_trace(replacements, extraProperties, argv[optind], outFileName, outputOptions, calls);
 }
 
 
@@ -0,0 +1,267 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <limits.h> // for CHAR_MAX
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cli.hpp"
+
+#include "os_backtrace.hpp"
+#include "os_string.hpp"
+
+#include "trace_parser.hpp"
+#include "trace_writer.hpp"
+
+
+static const char *synopsis = "Resolve deferred backtraces of a trace.";
+
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace symbolize [OPTIONS] TRACE_FILE\n"
+        << synopsis << "\n"
+        "\n"
+        "Traces captured with APITRACE_BACKTRACE_DEFERRED set only record module\n"
+        "relative addresses in their backtraces.  This command resolves those into\n"
+        "function names, source files, and line numbers, using the debug\n"
+        "information of the modules on this machine.\n"
+        "\n"
+        "    -h, --help               Show detailed help for symbolize options and exit\n"
+        "    -o, --output=TRACE_FILE  Output trace file\n"
+        "        --output-format=FORMAT[:LEVEL]\n"
+        "                             Output compression: snappy (default), zlib,\n"
+        "                             brotli or zstd\n"
+    ;
+}
+
+
+enum {
+    OUTPUT_FORMAT_OPT = CHAR_MAX + 1,
+};
+
+const static char *
+shortOptions = "ho:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"output", required_argument, 0, 'o'},
+    {"output-format", required_argument, 0, OUTPUT_FORMAT_OPT},
+    {0, 0, 0, 0}
+};
+
+
+static char *
+copyString(const char *str)
+{
+    if (!str) {
+        return NULL;
+    }
+    size_t len = strlen(str);
+    char *copy = new char[len + 1];
+    memcpy(copy, str, len + 1);
+    return copy;
+}
+
+
+class Symbolizer {
+    // Output frames for each input frame, which the parser shares among calls
+    std::map<const trace::StackFrame *, std::vector<std::unique_ptr<trace::StackFrame>>> cache;
+    trace::Id nextFrameId = 0;
+
+    unsigned numResolved = 0;
+    unsigned numUnresolved = 0;
+
+    trace::StackFrame *
+    newFrame(const trace::RawStackFrame &raw) {
+        trace::StackFrame *frame = new trace::StackFrame;
+        frame->id = nextFrameId++;
+        frame->module = copyString(raw.module);
+        frame->function = copyString(raw.function);
+        frame->filename = copyString(raw.filename);
+        frame->linenumber = raw.linenumber;
+        frame->offset = raw.offset;
+        return frame;
+    }
+
+    void
+    symbolize(const trace::StackFrame *in,
+              std::vector<std::unique_ptr<trace::StackFrame>> &out) {
+        bool deferred = in->module && in->offset >= 0 &&
+                        !in->function && !in->filename;
+        if (deferred) {
+            std::vector<trace::RawStackFrame> frames;
+            if (os::symbolize_frame(in->module, in->offset, frames)) {
+                for (auto & raw : frames) {
+                    out.emplace_back(newFrame(raw));
+                    free(const_cast<char *>(raw.function));
+                    free(const_cast<char *>(raw.filename));
+                }
+                ++numResolved;
+                return;
+            }
+            ++numUnresolved;
+        }
+        out.emplace_back(newFrame(*in));
+    }
+
+public:
+    void
+    visit(trace::Call *call, trace::Backtrace &backtrace) {
+        for (auto frame : *call->backtrace) {
+            auto & frames = cache[frame];
+            if (frames.empty()) {
+                symbolize(frame, frames);
+            }
+            for (auto & out : frames) {
+                backtrace.push_back(out.get());
+            }
+        }
+    }
+
+    void
+    report(void) {
+        std::cerr << "Resolved " << numResolved << " frames";
+        if (numUnresolved) {
+            std::cerr << ", failed to resolve " << numUnresolved;
+        }
+        std::cerr << "\n";
+    }
+};
+
+
+static int
+symbolize_trace(const char *inFileName, std::string &outFileName,
+                const trace::OutputOptions &outputOptions)
+{
+    trace::Parser p;
+    if (!p.open(inFileName)) {
+        std::cerr << "error: failed to open " << inFileName << "\n";
+        return 1;
+    }
+
+    if (outFileName.empty()) {
+        os::String base(inFileName);
+        base.trimExtension();
+
+        outFileName = std::string(base.str()) + std::string("-symbolized.trace");
+    }
+
+    trace::Writer writer;
+    writer.setBlobDedup(true);
+    if (!writer.open(outFileName.c_str(), outputOptions, p.getVersion(), p.getProperties())) {
+        std::cerr << "error: failed to create " << outFileName << "\n";
+        return 1;
+    }
+
+    Symbolizer symbolizer;
+
+    trace::Call *call;
+    while ((call = p.parse_call())) {
+        trace::Backtrace *backtrace = call->backtrace;
+        if (backtrace) {
+            trace::Backtrace symbolized;
+            symbolizer.visit(call, symbolized);
+            call->backtrace = &symbolized;
+            writer.writeCall(call);
+            call->backtrace = nullptr;
+            delete backtrace;
+        } else {
+            writer.writeCall(call);
+        }
+        delete call;
+    }
+
+    symbolizer.report();
+
+    std::cerr << "Symbolized trace is available as " << outFileName << "\n";
+
+    return 0;
+}
+
+
+static int
+command(int argc, char *argv[])
+{
+    std::string outFileName;
+    trace::OutputOptions outputOptions;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'o':
+            outFileName = optarg;
+            break;
+        case OUTPUT_FORMAT_OPT:
+            if (!trace::parseOutputFormat(optarg, outputOptions)) {
+                return 1;
+            }
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        std::cerr << "error: apitrace symbolize requires a trace file as an argument.\n";
+        usage();
+        return 1;
+    }
+
+    if (argc > optind + 1) {
+        std::cerr << "error: extraneous arguments:";
+        for (int i = optind + 1; i < argc; i++) {
+            std::cerr << " " << argv[i];
+        }
+        std::cerr << "\n";
+        usage();
+        return 1;
+    }
+
+    return symbolize_trace(argv[optind], outFileName, outputOptions);
+}
+
+
+const Command symbolize_command = {
+    "symbolize",
+    synopsis,
+    usage,
+    command
+};
@@ -52,13 +52,17 @@ usage(void)
         "        --frames=FRAMESET    Include specified frames in the trimmed output.\n"
         "        --thread=THREAD_ID   Only retain calls from specified thread (can be passed multiple times.)\n"
         "    -o, --output=TRACE_FILE  Output trace file\n"
+        "        --output-format=FORMAT[:LEVEL]\n"
+        "                             Output compression: snappy (default), zlib,\n"
+        "                             brotli or zstd\n"
     ;
 }
 
 enum {
     CALLS_OPT = CHAR_MAX + 1,
     FRAMES_OPT,
-    THREAD_OPT
+    THREAD_OPT,
+    OUTPUT_FORMAT_OPT,
 };
 
 const static char *
@@ -71,6 +75,7 @@ longOptions[] = {
     {"frames", required_argument, 0, FRAMES_OPT},
     {"thread", required_argument, 0, THREAD_OPT},
     {"output", required_argument, 0, 'o'},
+    {"output-format", required_argument, 0, OUTPUT_FORMAT_OPT},
     {0, 0, 0, 0}
 };
 
@@ -90,6 +95,9 @@ struct trim_options {
     /* Output filename */
     std::string output;
 
+    /* Output container and compression */
+    trace::OutputOptions outputOptions;
+
     /* Emit only calls from this thread (empty == all threads) */
     std::set<unsigned> threadIds;
 };
@@ -114,12 +122,30 @@ trim_trace(const char *filename, struct trim_options *options)
     }
 
     trace::Writer writer;
-    if (!writer.open(options->output.c_str(), p.getVersion(), p.getProperties())) {
+    if (!writer.open(options->output.c_str(), options->outputOptions, p.getVersion(), p.getProperties())) {
         std::cerr << "error: failed to create " << options->output << "\n";
         return 1;
     }
 
 
+    /* Skip the calls that won't be kept without decoding them.  Frame ends
+     * are always needed to count frames. */
+    trace::CallFilter filter;
+    filter.call = [options] (const trace::FunctionSig *, unsigned thread_id, unsigned call_no, trace::CallFlags flags) {
+        if (flags & trace::CALL_FLAG_END_FRAME) {
+            return true;
+        }
+        if (!options->threadIds.empty() &&
+            options->threadIds.find(thread_id) == options->threadIds.end()) {
+            return false;
+        }
+        return !options->frames.empty() || options->calls.contains(call_no, flags);
+    };
+    if (options->frames.empty()) {
+        filter.last = options->calls.getLast();
+    }
+    p.setCallFilter(filter);
+
     frame = 0;
     trace::Call *call;
     while ((call = p.parse_call())) {
@@ -187,6 +213,11 @@ command(int argc, char *argv[])
         case 'o':
             options.output = optarg;
             break;
+        case OUTPUT_FORMAT_OPT:
+            if (!trace::parseOutputFormat(optarg, options.outputOptions)) {
+                return 1;
+            }
+            break;
         default:
             std::cerr << "error: unexpected option `" << (char)opt << "`\n";
             usage();
@@ -0,0 +1,245 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <limits.h> // for CHAR_MAX
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <iostream>
+#include <limits>
+
+#include "cli.hpp"
+
+#include "trace_parser.hpp"
+#include "trace_verify.hpp"
+
+
+static const char *synopsis = "Check the integrity of trace files.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace verify [OPTIONS] TRACE_FILE...\n"
+        << synopsis << "\n"
+        "\n"
+        "Checks the framing of Snappy and seekable Zstandard traces, and each of their\n"
+        "chunks, on all cores.  Snappy chunks written with checksums (see\n"
+        "`apitrace repack --checksums`) are checked without being decompressed.\n"
+        "\n"
+        "    -h, --help           show this help message and exit\n"
+        "    -j, --jobs=N         check chunks with N threads [default: one per core]\n"
+        "    --decompress         decompress chunks even when they have checksums\n"
+        "    --parse              also parse every call\n"
+        "\n"
+    ;
+}
+
+enum {
+    DECOMPRESS_OPT = CHAR_MAX + 1,
+    PARSE_OPT,
+};
+
+const static char *
+shortOptions = "hj:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"jobs", required_argument, 0, 'j'},
+    {"decompress", no_argument, 0, DECOMPRESS_OPT},
+    {"parse", no_argument, 0, PARSE_OPT},
+    {0, 0, 0, 0}
+};
+
+
+struct ScanResult {
+    unsigned long long numCalls = 0;
+
+    // Number of the first call which isn't entirely before the limit
+    unsigned firstCallAfter = 0;
+
+    unsigned long long dataBytesRead = 0;
+
+    // Whether the data ends in the middle of calls
+    bool pendingCalls = false;
+};
+
+
+/**
+ * Scan the calls whose data lies before the given uncompressed offset.
+ */
+static bool
+scanCalls(const char *filename, unsigned long long limit, ScanResult &result)
+{
+    trace::Parser p;
+    if (!p.open(filename)) {
+        return false;
+    }
+
+    trace::Call *call;
+    while (p.dataBytesRead() < limit && (call = p.scan_call())) {
+        if (p.dataBytesRead() > limit) {
+            // Straddles the limit
+            result.firstCallAfter = call->no;
+            delete call;
+            break;
+        }
+        ++result.numCalls;
+        if (call->no >= result.firstCallAfter) {
+            result.firstCallAfter = call->no + 1;
+        }
+        delete call;
+    }
+
+    result.dataBytesRead = p.dataBytesRead();
+    result.pendingCalls = p.hasPendingCalls();
+
+    return true;
+}
+
+
+static bool
+verify(const char *filename, const trace::VerifyOptions &options, bool parse)
+{
+    trace::VerifyResult result;
+    if (!trace::verifyContainer(filename, options, result)) {
+        std::cerr << "error: failed to open " << filename << "\n";
+        return false;
+    }
+
+    std::cout << filename << ": " << result.containerType;
+    if (result.chunked) {
+        std::cout << ", " << result.chunkCount << " chunks"
+                  << (result.checksums ? " with checksums" : " without checksums");
+    }
+    std::cout << "\n";
+
+    if (!result.chunked && !parse) {
+        std::cout << filename << ": container can't be checked by chunks, parsing instead\n";
+        parse = true;
+    }
+
+    bool ok = result.ok();
+    if (result.hasBadChunk) {
+        std::cerr << "error: " << filename << ": chunk " << result.badChunk
+                  << " at offset " << result.badChunkOffset
+                  << ": " << result.error << "\n";
+    } else if (!ok) {
+        std::cerr << "error: " << filename << ": " << result.error << "\n";
+    }
+
+    if (parse || result.hasBadChunk) {
+        unsigned long long limit = result.hasBadChunk
+            ? result.badChunkDataOffset
+            : std::numeric_limits<unsigned long long>::max();
+
+        ScanResult scan;
+        if (!scanCalls(filename, limit, scan)) {
+            return false;
+        }
+
+        if (result.hasBadChunk) {
+            std::cerr << "error: " << filename << ": calls from "
+                      << scan.firstCallAfter << " onwards are affected\n";
+        } else {
+            std::cout << filename << ": " << scan.numCalls << " calls\n";
+            if (scan.numCalls == 0) {
+                std::cerr << "error: " << filename << ": no calls\n";
+                ok = false;
+            }
+            if (scan.pendingCalls) {
+                // Also the case when the traced application crashed
+                std::cerr << "warning: " << filename << ": data ends in the middle of a call\n";
+            }
+            if (result.chunked && scan.dataBytesRead < result.dataSize) {
+                std::cerr << "error: " << filename << ": parsing stopped at byte "
+                          << scan.dataBytesRead << " of " << result.dataSize
+                          << ", before call " << scan.firstCallAfter << "\n";
+                ok = false;
+            }
+        }
+    }
+
+    if (ok) {
+        std::cout << filename << ": OK\n";
+    }
+
+    return ok;
+}
+
+
+static int
+command(int argc, char *argv[])
+{
+    trace::VerifyOptions options;
+    bool parse = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'j':
+            options.jobs = atoi(optarg);
+            break;
+        case DECOMPRESS_OPT:
+            options.decompress = true;
+            break;
+        case PARSE_OPT:
+            parse = true;
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        std::cerr << "error: no trace file specified\n";
+        usage();
+        return 1;
+    }
+
+    int ret = 0;
+    for (int i = optind; i < argc; ++i) {
+        if (!verify(argv[i], options, parse)) {
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
+
+const Command verify_command = {
+    "verify",
+    synopsis,
+    usage,
+    command
+};
@@ -56,6 +56,9 @@ struct trim_options {
 
     /* Output filename */
     std::string output;
+
+    /* Output container and compression */
+    trace::OutputOptions outputOptions;
 };
 
 static const char *synopsis = "Create a new, retracable trace containing only the specified frames.";
@@ -74,12 +77,16 @@ usage(void)
                            "    -k, --keep-all-states    Keep all state calls in the trace (This may help with textures that are created by using FBO\n"
                            "    -F, --swap-to-finish     Replace swaps in the setup frame with glFinish\n"
                            "    -o, --output=TRACE_FILE  Output trace file\n"
+                           "        --output-format=FORMAT[:LEVEL]\n"
+                           "                             Output compression: snappy (default), zlib,\n"
+                           "                             brotli or zstd\n"
                ;
 }
 
 enum {
     FRAMES_OPT = 'f',
-    SETUPFRAMES_OPT = 's'
+    SETUPFRAMES_OPT = 's',
+    OUTPUT_FORMAT_OPT = CHAR_MAX + 1,
 };
 
 const static char *
@@ -99,6 +106,7 @@ longOptions[] = {
     {"keep-all-states", no_argument, 0, 'k'},
     {"swap-to-finish", no_argument, 0, 'F'},
     {"output", required_argument, 0, 'o'},
+    {"output-format", required_argument, 0, OUTPUT_FORMAT_OPT},
     {0, 0, 0, 0}
 };
 
@@ -199,7 +207,7 @@ static int trim_to_frame(const char *filename,
     std::cerr << "\nDone scanning frames\n";
 
     trace::Writer writer;
-    if (!writer.open(out_filename.c_str(), p.getVersion(), p.getProperties())) {
+    if (!writer.open(out_filename.c_str(), options.outputOptions, p.getVersion(), p.getProperties())) {
         std::cerr << "error: failed to create " << out_filename << "\n";
         return 2;
     }
@@ -298,6 +306,11 @@ int main(int argc, char **argv)
         case 'o':
             options.output = optarg;
             break;
+        case OUTPUT_FORMAT_OPT:
+            if (!trace::parseOutputFormat(optarg, options.outputOptions)) {
+                return 1;
+            }
+            break;
         case 't':
             options.top_frame_call_counts = atoi(optarg);
             break;
@@ -100,7 +100,8 @@ void ApiCallDelegate::paint(QPainter *painter,
 QSize ApiCallDelegate::sizeHint(const QStyleOptionViewItem &option,
                                 const QModelIndex &index) const
 {
-    QVariant var = index.data(ApiTraceModel::EventRole);
+    // Sizing rows must not force decoding of windowed frames
+    QVariant var = index.data(ApiTraceModel::CachedEventRole);
     ApiTraceEvent *event = var.value<ApiTraceEvent*>();
 
 #ifndef __APPLE__
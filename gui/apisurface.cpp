@@ -35,12 +35,16 @@ struct ByteArrayBuf : public std::streambuf
 
 QImage ApiSurface::calculateThumbnail(bool opaque, bool alpha) const
 {
-    return m_data.isEmpty() ? QImage{} : calculateThumbnail(m_data, opaque, alpha);
+    return thumbnailFromData(data(), opaque, alpha);
 }
 
-QImage ApiSurface::calculateThumbnail(const QByteArray &data, bool opaque,
-                                      bool alpha) const
+QImage ApiSurface::thumbnailFromData(const QByteArray &data, bool opaque,
+                                     bool alpha)
 {
+    if (data.isEmpty()) {
+        return QImage{};
+    }
+
     /*
      * We need to do the conversion to create the thumbnail
      */
@@ -50,12 +54,18 @@ QImage ApiSurface::calculateThumbnail(const QByteArray &data, bool opaque,
     return thumbnail(img);
 }
 
-void ApiSurface::setData(const QByteArray &data)
+void ApiSurface::setData(const QVariant &data)
 {
     m_data = data;
 }
 
 QByteArray ApiSurface::data() const
+{
+    // Spooled blobs are read back through their QByteArray converter
+    return m_data.toByteArray();
+}
+
+QVariant ApiSurface::lazyData() const
 {
     return m_data;
 }
@@ -3,6 +3,7 @@
 #include <QImage>
 #include <QSize>
 #include <QString>
+#include <QVariant>
 
 namespace image {
     class Image;
@@ -22,11 +23,17 @@ public:
     QString formatName() const;
     void setFormatName(const QString &str);
 
-    void setData(const QByteArray &data);
+    // Either a QByteArray or a spooled UBJSONBlob
+    void setData(const QVariant &data);
     QImage calculateThumbnail(bool opaque, bool alpha) const;
 
     QByteArray data() const;
 
+    // The data without reading spooled blobs back into memory
+    QVariant lazyData() const;
+
+    static QImage thumbnailFromData(const QByteArray &data, bool opaque,
+                                    bool alpha);
     static image::Image *imageFromData(const QByteArray &data);
     static QImage qimageFromRawImage(const image::Image *img,
                                      float lowerValue = 0.0f,
@@ -37,12 +44,9 @@ public:
 private:
 
     QSize  m_size;
-    QByteArray m_data;
+    QVariant m_data;
     int m_depth;
     QString m_formatName;
-
-    QImage calculateThumbnail(const QByteArray &data, bool opaque,
-                              bool alpha) const;
 };
 
 class ApiTexture : public ApiSurface
@@ -17,12 +17,24 @@ ApiTrace::ApiTrace()
             m_loader, SLOT(loadTrace(QString)));
     connect(this, SIGNAL(requestFrame(ApiTraceFrame*)),
             m_loader, SLOT(loadFrame(ApiTraceFrame*)));
+    connect(this, SIGNAL(requestFrameChunk(ApiTraceFrame*,int)),
+            m_loader, SLOT(loadFrameChunk(ApiTraceFrame*,int)));
     connect(m_loader, SIGNAL(framesLoaded(const QList<ApiTraceFrame*>)),
             this, SLOT(addFrames(const QList<ApiTraceFrame*>)));
     connect(m_loader,
             SIGNAL(frameContentsLoaded(ApiTraceFrame*,QVector<ApiTraceCall*>, QVector<ApiTraceCall*>,quint64)),
             this,
             SLOT(loaderFrameLoaded(ApiTraceFrame*,QVector<ApiTraceCall*>,QVector<ApiTraceCall*>,quint64)));
+    connect(m_loader,
+            SIGNAL(frameChunkLoaded(ApiTraceFrame*,int,QVector<ApiTraceCall*>)),
+            this,
+            SLOT(loaderFrameChunkLoaded(ApiTraceFrame*,int,QVector<ApiTraceCall*>)));
+    connect(m_loader,
+            SIGNAL(windowedSearchResult(ApiTrace::SearchRequest,ApiTraceFrame*,int)),
+            this,
+            SLOT(loaderWindowedSearchResult(ApiTrace::SearchRequest,ApiTraceFrame*,int)));
+    connect(m_loader, SIGNAL(foundWindowedCallIndex(ApiTraceFrame*,int)),
+            this, SLOT(loaderFoundWindowedCallIndex(ApiTraceFrame*,int)));
     connect(m_loader, SIGNAL(guessedApi(int)),
             this, SLOT(guessedApi(int)));
     connect(this, SIGNAL(loaderSearch(ApiTrace::SearchRequest)),
@@ -235,6 +247,10 @@ bool ApiTrace::hasErrors() const
 
 void ApiTrace::loadFrame(ApiTraceFrame *frame)
 {
+    if (frame->isWindowed()) {
+        // Windowed frames are loaded piecewise through loadFrameRow()
+        return;
+    }
     if (!isFrameLoading(frame)) {
         Q_ASSERT(!frame->isLoaded());
         m_loadingFrames.insert(frame);
@@ -242,6 +258,72 @@ void ApiTrace::loadFrame(ApiTraceFrame *frame)
     }
 }
 
+/**
+ * Ensure the call at the given row of a windowed frame gets decoded, along
+ * with the neighbouring chunk when the row is close to its edge, so that
+ * scrolling doesn't stall on every chunk boundary.
+ */
+void ApiTrace::loadFrameRow(ApiTraceFrame *frame, int row)
+{
+    Q_ASSERT(frame->isWindowed());
+
+    static const int prefetchRows = ApiTraceFrame::CallsPerChunk / 4;
+
+    int chunk = ApiTraceFrame::chunkForRow(row);
+    requestChunk(frame, chunk);
+
+    int offset = row - chunk * ApiTraceFrame::CallsPerChunk;
+    if (offset < prefetchRows) {
+        requestChunk(frame, chunk - 1);
+    } else if (offset >= ApiTraceFrame::CallsPerChunk - prefetchRows) {
+        requestChunk(frame, chunk + 1);
+    }
+}
+
+void ApiTrace::requestChunk(ApiTraceFrame *frame, int chunk)
+{
+    int numChunks = (frame->numChildren() + ApiTraceFrame::CallsPerChunk - 1) /
+                    ApiTraceFrame::CallsPerChunk;
+    if (chunk < 0 || chunk >= numChunks) {
+        return;
+    }
+    if (frame->isChunkResident(chunk)) {
+        frame->touchChunk(chunk);
+        return;
+    }
+    if (!frame->isChunkPending(chunk)) {
+        frame->setChunkPending(chunk);
+        emit requestFrameChunk(frame, chunk);
+    }
+}
+
+void ApiTrace::loaderFrameChunkLoaded(ApiTraceFrame *frame, int chunk,
+                                      const QVector<ApiTraceCall*> &calls)
+{
+    frame->setChunkCalls(chunk, calls);
+
+    int firstRow = chunk * ApiTraceFrame::CallsPerChunk;
+    int lastRow = qMin(firstRow + ApiTraceFrame::CallsPerChunk,
+                       frame->numChildren()) - 1;
+    emit frameRowsLoaded(frame, firstRow, lastRow);
+
+    applyQueuedErrors(frame);
+}
+
+void ApiTrace::loaderWindowedSearchResult(const ApiTrace::SearchRequest &request,
+                                          ApiTraceFrame *frame, int callIndex)
+{
+    ApiTraceCall *call = frame->callWithIndex(callIndex);
+    emit findResult(request,
+                    call ? SearchResult_Found : SearchResult_NotFound,
+                    call);
+}
+
+void ApiTrace::loaderFoundWindowedCallIndex(ApiTraceFrame *frame, int callIndex)
+{
+    emit foundCallIndex(frame->callWithIndex(callIndex));
+}
+
 void ApiTrace::guessedApi(int api)
 {
     m_api = static_cast<trace::API>(api);
@@ -256,7 +338,8 @@ void ApiTrace::finishedParsing()
 {
     if (!m_frames.isEmpty()) {
         ApiTraceFrame *firstFrame = m_frames[0];
-        if (firstFrame && !firstFrame->isLoaded()) {
+        if (firstFrame && !firstFrame->isLoaded() &&
+            !firstFrame->isWindowed()) {
             loadFrame(firstFrame);
         }
     }
@@ -276,6 +359,11 @@ void ApiTrace::loaderFrameLoaded(ApiTraceFrame *frame,
         m_loadingFrames.remove(frame);
     }
 
+    applyQueuedErrors(frame);
+}
+
+void ApiTrace::applyQueuedErrors(ApiTraceFrame *frame)
+{
     if (!m_queuedErrors.isEmpty()) {
         QList< QPair<ApiTraceFrame*, ApiTraceError> >::iterator itr;
         itr = m_queuedErrors.begin();
@@ -402,7 +490,9 @@ void ApiTrace::findFrameStart(ApiTraceFrame *frame)
     if (!frame)
         return;
 
-    if (frame->isLoaded()) {
+    if (frame->isWindowed()) {
+        findCallIndex(frame->firstCallIndex());
+    } else if (frame->isLoaded()) {
         emit foundFrameStart(frame);
     } else {
         emit loaderFindFrameStart(frame);
@@ -414,7 +504,9 @@ void ApiTrace::findFrameEnd(ApiTraceFrame *frame)
     if (!frame)
         return;
 
-    if (frame->isLoaded()) {
+    if (frame->isWindowed()) {
+        findCallIndex(frame->lastCallIndex());
+    } else if (frame->isLoaded()) {
         emit foundFrameEnd(frame);
     } else {
         emit loaderFindFrameEnd(frame);
@@ -437,6 +529,8 @@ void ApiTrace::findCallIndex(int index)
         if (frame->isLoaded()) {
             ApiTraceCall *call = frame->callWithIndex(index);
             emit foundCallIndex(call);
+        } else if (frame->isWindowed() && frame->callWithIndex(index)) {
+            emit foundCallIndex(frame->callWithIndex(index));
         } else {
             emit loaderFindCallIndex(index);
         }
@@ -472,7 +566,13 @@ void ApiTrace::setCallError(const ApiTraceError &error)
 
     ApiTraceFrame *frame = 0;
     frame = m_frames[frameIdx];
-    if (frame->isLoaded()) {
+    if (frame->isWindowed() && !frame->callWithIndex(error.callIndex)) {
+        int row = frame->rowForCallIndex(error.callIndex);
+        if (row >= 0) {
+            loadFrameRow(frame, row);
+            m_queuedErrors.append(qMakePair(frame, error));
+        }
+    } else if (frame->isLoaded() || frame->isWindowed()) {
         ApiTraceCall *call = frame->callWithIndex(error.callIndex);
         // call might be null if the error is in a filtered call
         if (call) {
@@ -95,6 +95,7 @@ public slots:
     void save();
     void finishedParsing();
     void loadFrame(ApiTraceFrame *frame);
+    void loadFrameRow(ApiTraceFrame *frame, int row);
     void findNext(ApiTraceFrame *frame,
                   ApiTraceCall *call,
                   const QString &str,
@@ -115,6 +116,7 @@ public slots:
 signals:
     void loadTrace(const QString &name);
     void requestFrame(ApiTraceFrame *frame);
+    void requestFrameChunk(ApiTraceFrame *frame, int chunk);
     void problemLoadingTrace(const QString &message);
     void startedLoadingTrace();
     void loaded(int percent);
@@ -132,6 +134,7 @@ signals:
     void endAddingFrames();
     void beginLoadingFrame(ApiTraceFrame *frame, int numAdded);
     void endLoadingFrame(ApiTraceFrame *frame);
+    void frameRowsLoaded(ApiTraceFrame *frame, int firstRow, int lastRow);
     void foundFrameStart(ApiTraceFrame *frame);
     void foundFrameEnd(ApiTraceFrame *frame);
     void foundCallIndex(ApiTraceCall *call);
@@ -153,10 +156,17 @@ private slots:
     void loaderSearchResult(const ApiTrace::SearchRequest &request,
                             ApiTrace::SearchResult result,
                             ApiTraceCall *call);
+    void loaderFrameChunkLoaded(ApiTraceFrame *frame, int chunk,
+                                const QVector<ApiTraceCall*> &calls);
+    void loaderWindowedSearchResult(const ApiTrace::SearchRequest &request,
+                                    ApiTraceFrame *frame, int callIndex);
+    void loaderFoundWindowedCallIndex(ApiTraceFrame *frame, int callIndex);
 
 private:
     int callInFrame(int callIdx) const;
     bool isFrameLoading(ApiTraceFrame *frame) const;
+    void requestChunk(ApiTraceFrame *frame, int chunk);
+    void applyQueuedErrors(ApiTraceFrame *frame);
 
     void missingThumbnail(int callIdx);
 private:
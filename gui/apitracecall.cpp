@@ -4,8 +4,10 @@
 #include "traceloader.h"
 #include "trace_model.hpp"
 #include "guids.hpp"
+#include "qubjson.h"
 
 #include <QDebug>
+#include <QHash>
 #include <QLocale>
 #include <QObject>
 #define QT_USE_FAST_OPERATOR_PLUS
@@ -13,6 +15,8 @@
 #include <QTextDocument>
 #include <QRegularExpression>
 
+#include <algorithm>
+
 const char * const styleSheet =
     ".call {\n"
     "    font-weight:bold;\n"
@@ -117,12 +121,16 @@ apiVariantToString(const QVariant &variant, bool multiLine)
     if (variant.userType() == QVariant::Double) {
         return QString::number(variant.toDouble());
     }
-    if (variant.userType() == QVariant::ByteArray) {
-        if (variant.toByteArray().size() < 1024) {
-            int bytes = variant.toByteArray().size();
+    if (variant.userType() == QVariant::ByteArray ||
+        variant.userType() == qMetaTypeId<UBJSONBlob>()) {
+        // Don't read spooled blobs back just to get their size
+        int bytes = variant.userType() == QVariant::ByteArray
+                  ? variant.toByteArray().size()
+                  : variant.value<UBJSONBlob>().size();
+        if (bytes < 1024) {
             return QObject::tr("[binary data, size = %1 bytes]").arg(bytes);
         } else {
-            float kb = variant.toByteArray().size()/1024.;
+            float kb = bytes/1024.;
             return QObject::tr("[binary data, size = %1 kb]").arg(kb);
         }
     }
@@ -456,7 +464,38 @@ ApiTraceState::ApiTraceState()
 {
 }
 
-static ApiTexture getTextureFrom(QVariantMap const &image, QString label)
+// Image data is kept as QVariant so that blobs spooled by the UBJSON decoder
+// are only read back when the image is actually looked at.
+typedef QHash<int, QVariant> ImageDataMap;
+
+/*
+ * Identical images are only dumped once, with an __id__ member; later
+ * occurrences carry a matching __ref__ instead of __data__.
+ */
+static void collectImageData(QVariantMap const &images, ImageDataMap &imageData)
+{
+    QVariantMap::const_iterator itr;
+    for (itr = images.constBegin(); itr != images.constEnd(); ++itr) {
+        QVariantMap image = itr.value().toMap();
+        QVariant id = image.value(QLatin1String("__id__"));
+        if (id.isValid()) {
+            imageData[id.toInt()] = image[QLatin1String("__data__")];
+        }
+    }
+}
+
+static QVariant getImageData(QVariantMap const &image,
+                             ImageDataMap const &imageData)
+{
+    QVariant ref = image.value(QLatin1String("__ref__"));
+    if (ref.isValid()) {
+        return imageData.value(ref.toInt());
+    }
+    return image[QLatin1String("__data__")];
+}
+
+static ApiTexture getTextureFrom(QVariantMap const &image, QString label,
+                                 ImageDataMap const &imageData)
 {
     QSize size(image[QLatin1String("__width__")].toInt(),
                image[QLatin1String("__height__")].toInt());
@@ -466,8 +505,7 @@ static ApiTexture getTextureFrom(QVariantMap const &image, QString label)
     QString formatName =
         image[QLatin1String("__format__")].toString();
 
-    QByteArray dataArray =
-        image[QLatin1String("__data__")].toByteArray();
+    QVariant dataArray = getImageData(image, imageData);
 
     QString userLabel =
         image[QLatin1String("__label__")].toString();
@@ -506,16 +544,20 @@ ApiTraceState::ApiTraceState(const QVariantMap &parsedJson)
     m_shaderStorageBufferBlocks =
         parsedJson[QLatin1String("shaderstoragebufferblocks")].toMap();
 
-    {
-        QVariantMap textures =
-            parsedJson[QLatin1String("textures")].toMap();
-        for (itr = textures.constBegin(); itr != textures.constEnd(); ++itr) {
-            m_textures.append(getTextureFrom(itr.value().toMap(), itr.key()));
-        }
-    }
-
+    QVariantMap textures =
+        parsedJson[QLatin1String("textures")].toMap();
     QVariantMap fbos =
         parsedJson[QLatin1String("framebuffer")].toMap();
+
+    ImageDataMap imageData;
+    collectImageData(textures, imageData);
+    collectImageData(fbos, imageData);
+
+    for (itr = textures.constBegin(); itr != textures.constEnd(); ++itr) {
+        m_textures.append(getTextureFrom(itr.value().toMap(), itr.key(),
+                                         imageData));
+    }
+
     for (itr = fbos.constBegin(); itr != fbos.constEnd(); ++itr) {
         QVariantMap buffer = itr.value().toMap();
         QSize size(buffer[QLatin1String("__width__")].toInt(),
@@ -524,8 +566,7 @@ ApiTraceState::ApiTraceState(const QVariantMap &parsedJson)
         int depth = buffer[QLatin1String("__depth__")].toInt();
         QString formatName = buffer[QLatin1String("__format__")].toString();
 
-        QByteArray dataArray =
-            buffer[QLatin1String("__data__")].toByteArray();
+        QVariant dataArray = getImageData(buffer, imageData);
 
         QString label = itr.key();
         QString userLabel =
@@ -629,7 +670,8 @@ ApiTraceEvent::ApiTraceEvent()
       m_binaryDataIndex(-1),
       m_state(0),
       m_staticText(0),
-      m_ignored(false)
+      m_ignored(false),
+      m_pinCount(0)
 {
 }
 
@@ -638,7 +680,8 @@ ApiTraceEvent::ApiTraceEvent(Type t)
       m_binaryDataIndex(-1),
       m_state(0),
       m_staticText(0),
-      m_ignored(false)
+      m_ignored(false),
+      m_pinCount(0)
 {
     Q_ASSERT(m_type == t);
 }
@@ -679,6 +722,22 @@ bool ApiTraceEvent::ignored() const
     return m_ignored;
 }
 
+void ApiTraceEvent::pin()
+{
+    ++m_pinCount;
+}
+
+void ApiTraceEvent::unpin()
+{
+    Q_ASSERT(m_pinCount > 0);
+    --m_pinCount;
+}
+
+bool ApiTraceEvent::pinned() const
+{
+    return m_pinCount > 0;
+}
+
 ApiTraceCall::ApiTraceCall(ApiTraceFrame *parentFrame,
                            TraceLoader *loader,
                            const trace::Call *call)
@@ -1168,13 +1227,16 @@ ApiTraceFrame::ApiTraceFrame(ApiTrace *parentTrace)
       m_binaryDataSize(0),
       m_loaded(false),
       m_callsToLoad(0),
-      m_lastCallIndex(0)
+      m_lastCallIndex(0),
+      m_rowPlaceholder(0)
 {
 }
 
 ApiTraceFrame::~ApiTraceFrame()
 {
     qDeleteAll(m_calls);
+    qDeleteAll(m_rows);
+    delete m_rowPlaceholder;
 }
 
 static QString formatDataSize(const quint64 size)
@@ -1211,6 +1273,12 @@ QStaticText ApiTraceFrame::staticText() const
             .arg(number)
             .arg(m_loaded ? m_calls.count() : m_callsToLoad);
 
+    if (m_rowPlaceholder) {
+        richText += QObject::tr(
+                "<span style=\"font-style:italic;font-size:small;font-weight:lighter;\">"
+                "&nbsp;(windowed)</span>");
+    }
+
     //mark the frame if it uploads more than a meg a frame
     if (m_binaryDataSize > (1024*1024)) {
         richText =
@@ -1235,6 +1303,9 @@ QStaticText ApiTraceFrame::staticText() const
 
 int ApiTraceFrame::numChildren() const
 {
+    if (m_rowPlaceholder) {
+        return m_rows.count();
+    }
     return m_children.count();
 }
 
@@ -1255,6 +1326,9 @@ QVector<ApiTraceCall*> ApiTraceFrame::calls() const
 
 ApiTraceEvent * ApiTraceFrame::eventAtRow(int row) const
 {
+    if (m_rowPlaceholder) {
+        return callAtRow(row);
+    }
     if (row < m_children.count())
         return m_children.value(row);
     else
@@ -1264,6 +1338,10 @@ ApiTraceEvent * ApiTraceFrame::eventAtRow(int row) const
 
 ApiTraceCall * ApiTraceFrame::callWithIndex(int index) const
 {
+    if (m_rowPlaceholder) {
+        return callAtRow(rowForCallIndex(index));
+    }
+
     QVector<ApiTraceCall*>::const_iterator itr;
     for (itr = m_calls.constBegin(); itr != m_calls.constEnd(); ++itr) {
         if ((*itr)->index() == index) {
@@ -1275,12 +1353,17 @@ ApiTraceCall * ApiTraceFrame::callWithIndex(int index) const
 
 int ApiTraceFrame::callIndex(ApiTraceCall *call) const
 {
+    if (m_rowPlaceholder) {
+        return rowForCall(call);
+    }
     return m_children.indexOf(call);
 }
 
 bool ApiTraceFrame::isEmpty() const
 {
-    if (m_loaded) {
+    if (m_rowPlaceholder) {
+        return m_rows.isEmpty();
+    } else if (m_loaded) {
         return m_calls.isEmpty();
     } else {
         return m_callsToLoad == 0;
@@ -1388,3 +1471,194 @@ void ApiTraceFrame::missingThumbnail()
 {
     m_parentTrace->missingThumbnail(this);
 }
+
+void ApiTraceFrame::setWindowed(const QVector<unsigned> &callIndices)
+{
+    Q_ASSERT(!m_loaded);
+    Q_ASSERT(callIndices.count() == int(m_callsToLoad));
+    if (!m_rowPlaceholder) {
+        m_rowPlaceholder = new ApiTraceCallRow(this);
+    }
+    m_rows.fill(0, callIndices.count());
+
+    m_rowCallIndices = callIndices;
+    m_rowsByCallIndex.resize(callIndices.count());
+    for (int row = 0; row < m_rowsByCallIndex.count(); ++row) {
+        m_rowsByCallIndex[row] = row;
+    }
+    std::sort(m_rowsByCallIndex.begin(), m_rowsByCallIndex.end(),
+              [&callIndices](int a, int b) {
+                  return callIndices[a] < callIndices[b];
+              });
+}
+
+bool ApiTraceFrame::isWindowed() const
+{
+    return m_rowPlaceholder != 0;
+}
+
+unsigned ApiTraceFrame::firstCallIndex() const
+{
+    if (m_rowCallIndices.isEmpty()) {
+        return 0;
+    }
+    return m_rowCallIndices.first();
+}
+
+ApiTraceCallRow * ApiTraceFrame::rowPlaceholder() const
+{
+    return m_rowPlaceholder;
+}
+
+ApiTraceCall * ApiTraceFrame::callAtRow(int row) const
+{
+    if (row < 0 || row >= m_rows.count()) {
+        return 0;
+    }
+    return m_rows[row];
+}
+
+int ApiTraceFrame::rowForCall(const ApiTraceCall *call) const
+{
+    int row = rowForCallIndex(call->index());
+    if (callAtRow(row) != call) {
+        return -1;
+    }
+    return row;
+}
+
+int ApiTraceFrame::rowForCallIndex(unsigned index) const
+{
+    QVector<int>::const_iterator itr =
+        std::lower_bound(m_rowsByCallIndex.constBegin(),
+                         m_rowsByCallIndex.constEnd(), index,
+                         [this](int row, unsigned value) {
+                             return m_rowCallIndices[row] < value;
+                         });
+    if (itr == m_rowsByCallIndex.constEnd() ||
+        m_rowCallIndices[*itr] != index) {
+        return -1;
+    }
+    return *itr;
+}
+
+bool ApiTraceFrame::isChunkResident(int chunk) const
+{
+    return m_chunkLru.contains(chunk);
+}
+
+bool ApiTraceFrame::isChunkPending(int chunk) const
+{
+    return m_pendingChunks.contains(chunk);
+}
+
+void ApiTraceFrame::setChunkPending(int chunk)
+{
+    m_pendingChunks.insert(chunk);
+}
+
+void ApiTraceFrame::touchChunk(int chunk)
+{
+    // The most recently used chunk is usually the last one already
+    if (!m_chunkLru.isEmpty() && m_chunkLru.last() == chunk) {
+        return;
+    }
+    if (m_chunkLru.removeOne(chunk)) {
+        m_chunkLru.append(chunk);
+    }
+}
+
+void ApiTraceFrame::setChunkCalls(int chunk,
+                                  const QVector<ApiTraceCall*> &calls)
+{
+    m_pendingChunks.remove(chunk);
+
+    if (isChunkResident(chunk)) {
+        // Already decoded on behalf of an earlier request
+        qDeleteAll(calls);
+        touchChunk(chunk);
+        return;
+    }
+
+    foreach (ApiTraceCall *call, calls) {
+        int row = rowForCallIndex(call->index());
+        if (row < 0 || chunkForRow(row) != chunk || m_rows[row]) {
+            delete call;
+            continue;
+        }
+        m_rows[row] = call;
+    }
+    m_chunkLru.append(chunk);
+
+    evictChunks();
+}
+
+bool ApiTraceFrame::isCallPinned(const ApiTraceCall *call)
+{
+    return call->edited() || call->hasError() ||
+           call->hasState() || call->ignored() || call->pinned();
+}
+
+void ApiTraceFrame::evictChunks()
+{
+    while (m_chunkLru.count() > MaxCachedChunks) {
+        int chunk = m_chunkLru.takeFirst();
+        int first = chunk * CallsPerChunk;
+        int last = qMin(first + CallsPerChunk, m_rows.count());
+        for (int row = first; row < last; ++row) {
+            ApiTraceCall *call = m_rows[row];
+            // Calls which carry user visible state (edits, errors, etc)
+            // or which are referred to by the UI (selection) must outlive
+            // scrolling, so keep them, but not the rest of their chunk.  Reloading the chunk skips the rows still set.
+            if (!call || isCallPinned(call)) {
+                continue;
+            }
+            delete call;
+            m_rows[row] = 0;
+        }
+    }
+}
+
+
+ApiTraceCallRow::ApiTraceCallRow(ApiTraceFrame *frame)
+    : ApiTraceEvent(ApiTraceEvent::None),
+      m_parentFrame(frame)
+{
+}
+
+ApiTraceFrame * ApiTraceCallRow::parentFrame() const
+{
+    return m_parentFrame;
+}
+
+QStaticText ApiTraceCallRow::staticText() const
+{
+    if (!m_staticText) {
+        m_staticText = new QStaticText(QObject::tr(
+            "<span style=\"font-style:italic;\">Loading...</span>"));
+        QTextOption opt;
+        opt.setWrapMode(QTextOption::NoWrap);
+        m_staticText->setTextOption(opt);
+        m_staticText->prepare();
+    }
+    return *m_staticText;
+}
+
+int ApiTraceCallRow::numChildren() const
+{
+    return 0;
+}
+
+int ApiTraceCallRow::callIndex(ApiTraceCall *call) const
+{
+    return -1;
+}
+
+ApiTraceEvent * ApiTraceCallRow::eventAtRow(int row) const
+{
+    return NULL;
+}
+
+void ApiTraceCallRow::missingThumbnail()
+{
+}
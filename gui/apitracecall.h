@@ -2,6 +2,7 @@
 
 #include "apisurface.h"
 
+#include <QSet>
 #include <QStaticText>
 #include <QStringList>
 #include <QUrl>
@@ -225,6 +226,12 @@ public:
     void setIgnored(bool ignored);
     bool ignored() const;
 
+    /* Keeps a call of a windowed frame from being evicted with its chunk
+     * while the UI holds on to it, e.g. as the selected call */
+    void pin();
+    void unpin();
+    bool pinned() const;
+
     virtual void missingThumbnail() = 0;
 
 protected:
@@ -237,6 +244,8 @@ protected:
     QImage m_thumbnail;
 
     bool m_ignored;
+
+    int m_pinCount;
 };
 Q_DECLARE_METATYPE(ApiTraceEvent*);
 
@@ -323,9 +332,45 @@ private:
 };
 Q_DECLARE_METATYPE(ApiTraceCall*);
 
+/**
+ * Stand-in for the rows of a windowed frame.
+ *
+ * All model indices below a windowed frame point to this object, and the
+ * actual call is looked up by row, as it might not be decoded yet, or might
+ * have been evicted from the cache since the index was created.
+ */
+class ApiTraceCallRow : public ApiTraceEvent
+{
+public:
+    ApiTraceCallRow(ApiTraceFrame *frame);
+
+    ApiTraceFrame *parentFrame() const;
+
+    QStaticText staticText() const override;
+    int numChildren() const override;
+    int callIndex(ApiTraceCall *call) const override;
+    ApiTraceEvent *eventAtRow(int row) const override;
+    void missingThumbnail() override;
+
+private:
+    ApiTraceFrame *m_parentFrame;
+};
+
 class ApiTraceFrame : public ApiTraceEvent
 {
 public:
+    /**
+     * Frames with more calls than this are not loaded in one go, but
+     * decoded in chunks of CallsPerChunk calls as they become visible.
+     */
+    static const int WindowedThreshold = 64 * 1024;
+    static const int CallsPerChunk = 1024;
+    /**
+     * Evicting a chunk keeps only the calls which carry user visible state
+     * (edits, errors, etc), so at most this many chunks are fully resident.
+     */
+    static const int MaxCachedChunks = 32;
+
     ApiTraceFrame(ApiTrace *parent=0);
     ~ApiTraceFrame();
     int number;
@@ -368,6 +413,30 @@ public:
 
     void missingThumbnail() override;
 
+    /* Windowed frames { */
+    void setWindowed(const QVector<unsigned> &callIndices);
+    bool isWindowed() const;
+    unsigned firstCallIndex() const;
+    ApiTraceCallRow *rowPlaceholder() const;
+    ApiTraceCall *callAtRow(int row) const;
+    int rowForCall(const ApiTraceCall *call) const;
+    int rowForCallIndex(unsigned index) const;
+
+    static int chunkForRow(int row)
+    {
+        return row / CallsPerChunk;
+    }
+    bool isChunkResident(int chunk) const;
+    bool isChunkPending(int chunk) const;
+    void setChunkPending(int chunk);
+    void touchChunk(int chunk);
+    void setChunkCalls(int chunk, const QVector<ApiTraceCall*> &calls);
+    /* } */
+
+private:
+    static bool isCallPinned(const ApiTraceCall *call);
+    void evictChunks();
+
 private:
     ApiTrace *m_parentTrace;
     quint64 m_binaryDataSize;
@@ -376,5 +445,23 @@ private:
     bool m_loaded;
     unsigned m_callsToLoad;
     unsigned m_lastCallIndex;
+
+    ApiTraceCallRow *m_rowPlaceholder;
+    /*
+     * Call numbers are not contiguous within a frame (calls from other
+     * threads, filtered calls), so rows are looked up by binary search over
+     * the call numbers recorded when the trace was scanned.  Both are
+     * immutable afterwards, so the loader thread may use them too.
+     */
+    // Call number of every row, in trace order
+    QVector<unsigned> m_rowCallIndices;
+    // Rows sorted by call number
+    QVector<int> m_rowsByCallIndex;
+    // Sparse per-row call pointers, only set for resident chunks and for
+    // the pinned calls of evicted ones
+    QVector<ApiTraceCall*> m_rows;
+    // Resident chunks, least recently used first
+    QList<int> m_chunkLru;
+    QSet<int> m_pendingChunks;
 };
 Q_DECLARE_METATYPE(ApiTraceFrame*);
@@ -16,12 +16,18 @@ bool ApiTraceFilter::filterAcceptsRow(int sourceRow,
                                       const QModelIndex &sourceParent) const
 {
     QModelIndex index0 = sourceModel()->index(sourceRow, 0, sourceParent);
-    QVariant varientData = sourceModel()->data(index0, ApiTraceModel::EventRole);
+    QVariant varientData = sourceModel()->data(index0, ApiTraceModel::CachedEventRole);
     ApiTraceEvent *event = varientData.value<ApiTraceEvent*>();
 
     if (!event)
         return false;
 
+    // Rows of windowed frames which are not decoded yet are accepted, and
+    // filtered once they get decoded.
+    if (event->type() == ApiTraceEvent::None) {
+        return true;
+    }
+
     // We don't filter frames
     if (event->type() == ApiTraceEvent::Frame) {
         return true;
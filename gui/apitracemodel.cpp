@@ -28,7 +28,8 @@ QVariant ApiTraceModel::data(const QModelIndex &index, int role) const
     if (index.column() != 0)
         return QVariant();
 
-    ApiTraceEvent *itm = item(index);
+    // Only rows which are actually looked at get decoded
+    ApiTraceEvent *itm = resolvedItem(index, role != CachedEventRole);
     if (!itm) {
         return QVariant();
     }
@@ -39,6 +40,9 @@ QVariant ApiTraceModel::data(const QModelIndex &index, int role) const
     case Qt::DecorationRole:
         return QImage();
     case Qt::ToolTipRole: {
+        if (itm->type() == ApiTraceEvent::None) {
+            return QVariant();
+        }
         const QString stateText = tr("State info available.");
         if (itm->type() == ApiTraceEvent::Call) {
             ApiTraceCall *call = static_cast<ApiTraceCall*>(itm);
@@ -102,6 +106,7 @@ QVariant ApiTraceModel::data(const QModelIndex &index, int role) const
         }
     }
     case ApiTraceModel::EventRole:
+    case ApiTraceModel::CachedEventRole:
         return QVariant::fromValue(itm);
     }
 
@@ -142,7 +147,14 @@ QModelIndex ApiTraceModel::index(int row, int column,
 
     //qDebug()<<"At row = "<<row<<", column = "<<column<<", parent "<<parent;
     ApiTraceEvent *parentEvent = item(parent);
-    if (parentEvent) {
+    if (parentEvent && parentEvent->type() == ApiTraceEvent::Frame &&
+        static_cast<ApiTraceFrame*>(parentEvent)->isWindowed()) {
+        ApiTraceFrame *frame = static_cast<ApiTraceFrame*>(parentEvent);
+        if (row < 0 || row >= frame->numChildren()) {
+            return QModelIndex();
+        }
+        return createIndex(row, column, frame->rowPlaceholder());
+    } else if (parentEvent) {
         ApiTraceEvent *event = parentEvent->eventAtRow(row);
         if (event) {
             Q_ASSERT(event->type() == ApiTraceEvent::Call);
@@ -169,6 +181,9 @@ bool ApiTraceModel::hasChildren(const QModelIndex &parent) const
         if (event->type() == ApiTraceEvent::Frame) {
             ApiTraceFrame *frame = static_cast<ApiTraceFrame*>(event);
             return !frame->isEmpty();
+        } else if (event->type() == ApiTraceEvent::None) {
+            // Windowed frames are shown flat
+            return false;
         } else {
             Q_ASSERT(event->type() == ApiTraceEvent::Call);
             ApiTraceCall *call = static_cast<ApiTraceCall*>(event);
@@ -186,7 +201,11 @@ QModelIndex ApiTraceModel::parent(const QModelIndex &index) const
 
     ApiTraceEvent *event = item(index);
 
-    if (event->type() == ApiTraceEvent::Call) {
+    if (event->type() == ApiTraceEvent::None) {
+        ApiTraceFrame *frame =
+            static_cast<ApiTraceCallRow*>(event)->parentFrame();
+        return createIndex(frame->number, 0, frame);
+    } else if (event->type() == ApiTraceEvent::Call) {
         ApiTraceCall *call = static_cast<ApiTraceCall*>(event);
 
         if (call->parentCall()) {
@@ -260,6 +279,8 @@ void ApiTraceModel::setApiTrace(ApiTrace *trace)
             this, SLOT(beginLoadingFrame(ApiTraceFrame*,int)));
     connect(m_trace, SIGNAL(endLoadingFrame(ApiTraceFrame*)),
             this, SLOT(endLoadingFrame(ApiTraceFrame*)));
+    connect(m_trace, SIGNAL(frameRowsLoaded(ApiTraceFrame*,int,int)),
+            this, SLOT(frameRowsLoaded(ApiTraceFrame*,int,int)));
 
 }
 
@@ -287,6 +308,30 @@ ApiTraceEvent * ApiTraceModel::item(const QModelIndex &index) const
     return static_cast<ApiTraceEvent*>(index.internalPointer());
 }
 
+/**
+ * Like item(), but resolves the rows of windowed frames to their decoded
+ * call, optionally requesting the decoding of the rows not available yet.
+ */
+ApiTraceEvent * ApiTraceModel::resolvedItem(const QModelIndex &index,
+                                            bool fetch) const
+{
+    ApiTraceEvent *event = item(index);
+    if (!event || event->type() != ApiTraceEvent::None) {
+        return event;
+    }
+
+    ApiTraceFrame *frame = static_cast<ApiTraceCallRow*>(event)->parentFrame();
+    ApiTraceCall *call = frame->callAtRow(index.row());
+    if (call) {
+        frame->touchChunk(ApiTraceFrame::chunkForRow(index.row()));
+        return call;
+    }
+    if (fetch) {
+        m_trace->loadFrameRow(frame, index.row());
+    }
+    return event;
+}
+
 void ApiTraceModel::stateSetOnEvent(ApiTraceEvent *event)
 {
     if (!event)
@@ -319,6 +364,12 @@ QModelIndex ApiTraceModel::indexForCall(ApiTraceCall *call) const
         qDebug() << "Couldn't find call num "<<call->index()<<" inside parent!";
         return QModelIndex();
     }
+
+    ApiTraceFrame *frame = call->parentFrame();
+    if (frame && frame->isWindowed()) {
+        return createIndex(row, 0, frame->rowPlaceholder());
+    }
+
     return createIndex(row, 0, call);
 }
 
@@ -369,7 +420,8 @@ bool ApiTraceModel::canFetchMore(const QModelIndex &parent) const
         ApiTraceEvent *event = item(parent);
         if (event && event->type() == ApiTraceEvent::Frame) {
             ApiTraceFrame *frame = static_cast<ApiTraceFrame*>(event);
-            return !frame->isLoaded() && !m_loadingFrames.contains(frame);
+            return !frame->isLoaded() && !frame->isWindowed() &&
+                   !m_loadingFrames.contains(frame);
         } else
             return false;
     } else {
@@ -415,3 +467,13 @@ void ApiTraceModel::endLoadingFrame(ApiTraceFrame *frame)
 
     m_loadingFrames.remove(frame);
 }
+
+void ApiTraceModel::frameRowsLoaded(ApiTraceFrame *frame,
+                                    int firstRow, int lastRow)
+{
+    if (firstRow > lastRow) {
+        return;
+    }
+    emit dataChanged(createIndex(firstRow, 0, frame->rowPlaceholder()),
+                     createIndex(lastRow, 0, frame->rowPlaceholder()));
+}
@@ -16,7 +16,10 @@ class ApiTraceModel : public QAbstractItemModel
     Q_OBJECT
 public:
     enum Roles {
-        EventRole = Qt::UserRole + 1
+        EventRole = Qt::UserRole + 1,
+        // Like EventRole, but never triggers decoding of windowed frame rows,
+        // yielding an ApiTraceCallRow placeholder for rows not decoded yet.
+        CachedEventRole
     };
 public:
     ApiTraceModel(QObject *parent = 0);
@@ -58,9 +61,11 @@ private slots:
     void frameChanged(ApiTraceFrame *frame);
     void beginLoadingFrame(ApiTraceFrame *frame, int numAdded);
     void endLoadingFrame(ApiTraceFrame *frame);
+    void frameRowsLoaded(ApiTraceFrame *frame, int firstRow, int lastRow);
 
 private:
     ApiTraceEvent *item(const QModelIndex &index) const;
+    ApiTraceEvent *resolvedItem(const QModelIndex &index, bool fetch) const;
 
 private:
     ApiTrace *m_trace;
@@ -36,25 +36,12 @@ protected:
         qint64 timeStart = state.start;
         qint64 timeEnd = state.end;
 
-        std::vector<trace::Profile::Call>::const_iterator itr;
+        const trace::Profile::Calls& calls = m_profile->calls;
+        auto start = [&] (qint64 i) { return calls.cpuStart[i]; };
+        auto duration = [&] (qint64 i) { return calls.cpuDuration[i]; };
 
-        itr =
-            Profiling::binarySearchTimespan<
-                trace::Profile::Call,
-                &trace::Profile::Call::cpuStart,
-                &trace::Profile::Call::cpuDuration>
-            (m_profile->calls.begin(), m_profile->calls.end(), timeStart, true);
-
-        state.start = itr - m_profile->calls.begin();
-
-        itr =
-            Profiling::binarySearchTimespan<
-                trace::Profile::Call,
-                &trace::Profile::Call::cpuStart,
-                &trace::Profile::Call::cpuDuration>
-            (m_profile->calls.begin(), m_profile->calls.end(), timeEnd, true);
-
-        state.end = itr - m_profile->calls.begin();
+        state.start = Profiling::binarySearchTimespan(calls.size(), start, duration, timeStart, true);
+        state.end = Profiling::binarySearchTimespan(calls.size(), start, duration, timeEnd, true);
 
         return state;
     }
@@ -65,12 +52,18 @@ protected:
             return state;
         }
 
-        qint64 start = qMax<qint64>(0, state.start);
-        qint64 end = qMin<qint64>(state.end, m_profile->calls.size());
+        const trace::Profile::Calls& calls = m_profile->calls;
+
+        if (calls.empty()) {
+            return state;
+        }
+
+        qint64 start = qBound<qint64>(0, state.start, calls.size() - 1);
+        qint64 end = qBound<qint64>(0, state.end, calls.size() - 1);
 
         /* Call based -> time based */
-        state.start = m_profile->calls[start].cpuStart;
-        state.end = m_profile->calls[end].cpuStart + m_profile->calls[end].cpuDuration;
+        state.start = calls.cpuStart[start];
+        state.end = calls.cpuStart[end] + calls.cpuDuration[end];
 
         return state;
     }
@@ -102,13 +95,61 @@ public:
                     return true;
                 }
             } else if (m_selectionState->type == SelectionState::Vertical) {
-                return m_profile->calls[index].program == m_selectionState->start;
+                return m_profile->calls.pixels[index] >= 0 &&
+                       m_profile->calls.program[index] == m_selectionState->start;
             }
         }
 
         return false;
     }
 
+    virtual qint64 maxValue(qint64 begin, qint64 end) const override
+    {
+        if (!m_profile) {
+            return 0;
+        }
+
+        begin = qMax<qint64>(0, begin);
+
+        const trace::Pyramid& durations = m_gpu ? m_profile->gpuDurations : m_profile->cpuDurations;
+        trace::Pyramid::Summary summary = durations.summarize(begin, end, [this] (size_t i) { return value(i); });
+        return summary.empty() ? 0 : summary.max;
+    }
+
+    virtual qint64 maxSelectedValue(qint64 begin, qint64 end) const override
+    {
+        if (!m_profile || !m_selectionState) {
+            return -1;
+        }
+
+        if (m_selectionState->type == SelectionState::Horizontal) {
+            begin = qMax<qint64>(begin, m_selectionState->start);
+            end = qMin<qint64>(end, m_selectionState->end);
+
+            if (begin >= end) {
+                return -1;
+            }
+
+            return maxValue(begin, end);
+        } else if (m_selectionState->type == SelectionState::Vertical) {
+            if (m_selectionState->start < 0 || m_selectionState->start >= (qint64)m_profile->programs.size()) {
+                return -1;
+            }
+
+            /* Positions of the program calls within [begin, end) */
+            const trace::Profile::Program& program = m_profile->programs[m_selectionState->start];
+            auto index = [&] (qint64 i) { return (qint64)program.calls[i]; };
+            qint64 first = Profiling::lowerBound(0, program.calls.size(), index, begin);
+            qint64 last = Profiling::lowerBound(first, program.calls.size(), index, end);
+
+            const trace::Pyramid& durations = m_gpu ? program.gpuDurations : program.cpuDurations;
+            trace::Pyramid::Summary summary = durations.summarize(first, last, [&] (size_t i) { return value(program.calls[i]); });
+            return summary.empty() ? -1 : summary.max;
+        }
+
+        return -1;
+    }
+
     virtual void setSelectionState(SelectionState* state) override
     {
         m_selectionState = state;
@@ -117,9 +158,13 @@ public:
     virtual qint64 value(qint64 index) const override
     {
         if (m_gpu) {
-            return m_profile->calls[index].gpuDuration;
+            /* Calls not drawn have no GPU duration */
+            if (m_profile->calls.pixels[index] < 0) {
+                return 0;
+            }
+            return m_profile->calls.gpuDuration[index];
         } else {
-            return m_profile->calls[index].cpuDuration;
+            return m_profile->calls.cpuDuration[index];
         }
     }
 
@@ -133,8 +178,7 @@ public:
             return;
         }
 
-        const trace::Profile::Call& call = m_profile->calls[index];
-        Profiling::jumpToCall(call.no);
+        Profiling::jumpToCall(m_profile->calls.no[index]);
     }
 
     virtual QString itemTooltip(qint64 index) const override
@@ -147,17 +191,17 @@ public:
             return QString();
         }
 
-        const trace::Profile::Call& call = m_profile->calls[index];
+        const trace::Profile::Call call = m_profile->calls[index];
 
         QString text;
-        text  = QString::fromStdString(call.name);
+        text  = QString::fromStdString(m_profile->names[call.name]);
         text += QString("\nCall: %1").arg(call.no);
         text += QString("\nCPU Duration: %1").arg(Profiling::getTimeString(call.cpuDuration));
 
         if (call.pixels >= 0) {
             text += QString("\nGPU Duration: %1").arg(Profiling::getTimeString(call.gpuDuration));
             text += QString("\nPixels Drawn: %1").arg(QLocale::system().toString((qlonglong)call.pixels));
-            text += QString("\nProgram: %1").arg(call.program);
+            text += QString("\nProgram: %1").arg(m_profile->programs[call.program].id);
         }
 
         return text;
@@ -31,6 +31,12 @@ public:
     /* Returns value for index */
     virtual qint64 value(qint64 index) const = 0;
 
+    /* Returns the highest value for indices [begin, end) */
+    virtual qint64 maxValue(qint64 begin, qint64 end) const = 0;
+
+    /* Returns the highest value of the selected items in [begin, end), or -1 if none */
+    virtual qint64 maxSelectedValue(qint64 begin, qint64 end) const = 0;
+
     /* Is the item at index selected */
     virtual bool selected(qint64 index) const = 0;
 
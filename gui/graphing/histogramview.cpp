@@ -100,13 +100,7 @@ void HistogramView::update()
     m_graphTop = 0;
 
     if (m_data) {
-        for (qint64 i = m_viewLeft; i < m_viewRight; ++i) {
-            qint64 value = m_data->value(i);
-
-            if (value > m_graphTop) {
-                m_graphTop = value;
-            }
-        }
+        m_graphTop = qMax<qint64>(0, m_data->maxValue(m_viewLeft, m_viewRight));
     }
 
     GraphView::update();
@@ -123,7 +117,8 @@ void HistogramView::resizeEvent(QResizeEvent *)
 /* Draw the histogram
  *
  * When the view is zoomed such that there is more than one item occupying a single pixel
- * the one with the highest value will be displayed.
+ * the one with the highest value will be displayed, which the data provider finds without
+ * visiting every item.
  */
 void HistogramView::paintEvent(QPaintEvent *)
 {
@@ -146,44 +141,28 @@ void HistogramView::paintEvent(QPaintEvent *)
 
     if (dxdv < 1.0) {
         /* Less than one pixel per item */
-        qint64 longestValue = m_graphBottom;
-        qint64 longestSelected = m_graphBottom;
-        int lastX = 0;
-        double x = 0;
+        double dvdx = 1.0 / dxdv;
 
-        if (selection) {
-            painter.setPen(unselectedPen);
-        } else {
-            painter.setPen(selectedPen);
-        }
-
-        for (qint64 i = m_viewLeft; i < m_viewRight; ++i) {
-            qint64 value = m_data->value(i);
-            int ix;
+        for (int x = 0; x < width(); ++x) {
+            qint64 left = m_viewLeft + (qint64)(x * dvdx);
+            qint64 right = qMin<qint64>(m_viewLeft + (qint64)((x + 1) * dvdx), m_viewRight);
 
-            if (value > longestValue) {
-                longestValue = value;
+            if (left >= right) {
+                continue;
             }
 
-            if (selection && m_data->selected(i) && value > longestSelected) {
-                longestSelected = value;
-            }
+            qint64 longestValue = m_data->maxValue(left, right);
 
-            x += dxdv;
-            ix = (int)x;
+            painter.setPen(selection ? unselectedPen : selectedPen);
+            painter.drawLine(x, height(), x, height() - (longestValue * dydv));
 
-            if (lastX != ix) {
-                painter.drawLine(lastX, height(), lastX, height() - (longestValue * dydv));
+            if (selection) {
+                qint64 longestSelected = m_data->maxSelectedValue(left, right);
 
-                if (selection && longestSelected > m_graphBottom) {
+                if (longestSelected > m_graphBottom) {
                     painter.setPen(selectedPen);
-                    painter.drawLine(lastX, height(), lastX, height() - (longestSelected * dydv));
-                    painter.setPen(unselectedPen);
-                    longestSelected = m_graphBottom;
+                    painter.drawLine(x, height(), x, height() - (longestSelected * dydv));
                 }
-
-                longestValue = m_graphBottom;
-                lastX = ix;
             }
         }
     } else {
@@ -160,6 +160,20 @@ void MainWindow::setRemoteTarget(const QString &host)
     m_retracer->setRemoteTarget(host);
 }
 
+/* Calls of windowed frames are evicted as their chunks scroll out of the
+ * cache, so keep the ones referred to here pinned. */
+static void
+setEvent(ApiTraceEvent *&slot, ApiTraceEvent *event)
+{
+    if (event) {
+        event->pin();
+    }
+    if (slot) {
+        slot->unpin();
+    }
+    slot = event;
+}
+
 void MainWindow::callItemSelected(const QModelIndex &index)
 {
     ApiTraceEvent *event =
@@ -200,12 +214,12 @@ void MainWindow::callItemSelected(const QModelIndex &index)
         m_ui.backtraceBrowser->setText(call->backtrace());
         m_ui.backtraceDock->setVisible(!call->backtrace().isNull());
         m_ui.vertexDataDock->setVisible(call->hasBinaryData());
-        m_selectedEvent = call;
+        setEvent(m_selectedEvent, call);
     } else {
         if (event && event->type() == ApiTraceEvent::Frame) {
-            m_selectedEvent = static_cast<ApiTraceFrame*>(event);
+            setEvent(m_selectedEvent, static_cast<ApiTraceFrame*>(event));
         } else {
-            m_selectedEvent = 0;
+            setEvent(m_selectedEvent, 0);
         }
         m_ui.detailsDock->hide();
         m_ui.backtraceDock->hide();
@@ -319,6 +333,8 @@ void MainWindow::newTraceFile(const QString &fileName)
     qDebug()<< "Loading:" << fileName;
 
     m_progressBar->setValue(0);
+    setEvent(m_selectedEvent, 0);
+    setEvent(m_stateEvent, 0);
     m_trace->setFileName(fileName);
 
     if (fileName.isEmpty()) {
@@ -337,7 +353,7 @@ void MainWindow::replayFinished(const QString &message)
     updateActionsState(true);
     m_progressBar->hide();
     statusBar()->showMessage(message, 2000);
-    m_stateEvent = 0;
+    setEvent(m_stateEvent, 0);
     m_ui.actionShowErrorsDock->setEnabled(m_trace->hasErrors());
     m_ui.errorsDock->setVisible(m_trace->hasErrors());
     if (!m_trace->hasErrors()) {
@@ -348,7 +364,7 @@ void MainWindow::replayFinished(const QString &message)
 void MainWindow::replayError(const QString &message)
 {
     updateActionsState(true);
-    m_stateEvent = 0;
+    setEvent(m_stateEvent, 0);
     m_nonDefaultsLookupEvent = 0;
 
     m_progressBar->hide();
@@ -491,7 +507,7 @@ void MainWindow::lookupState()
                "Please wait until it finishes and try again."));
         return;
     }
-    m_stateEvent = m_selectedEvent;
+    setEvent(m_stateEvent, m_selectedEvent);
     replayTrace(true, false);
 }
 
@@ -724,15 +740,15 @@ variantToItem(const QString &key, const QVariant &var,
     return item;
 }
 
+// Set on surface items whose thumbnail wasn't computed yet
+static const int ThumbnailPendingRole = Qt::UserRole + 1;
+
 static void addSurfaceItem(const ApiSurface &surface,
                            const QString &label,
                            QTreeWidgetItem *parent,
-                           QTreeWidget *tree,
-                           bool opaque, bool alpha)
+                           QTreeWidget *tree)
 {
-    QIcon icon(QPixmap::fromImage(surface.calculateThumbnail(opaque, alpha)));
     QTreeWidgetItem *item = new QTreeWidgetItem(parent);
-    item->setIcon(0, icon);
 
     int width = surface.size().width();
     int height = surface.size().height();
@@ -761,7 +777,9 @@ static void addSurfaceItem(const ApiSurface &surface,
     l->setWordWrap(true);
     tree->setItemWidget(item, 1, l);
 
-    item->setData(0, Qt::UserRole, surface.data());
+    // Decoding is deferred until the thumbnail or the image is needed
+    item->setData(0, Qt::UserRole, surface.lazyData());
+    item->setData(0, ThumbnailPendingRole, true);
 }
 
 void MainWindow::addSurface(const ApiTexture &image, QTreeWidgetItem *parent) {
@@ -775,9 +793,25 @@ void MainWindow::addSurface(const ApiFramebuffer &fbo, QTreeWidgetItem *parent)
 void MainWindow::addSurface(const ApiSurface &surface, const QString &label,
                             QTreeWidgetItem *parent)
 {
-    addSurfaceItem(surface, label, parent,
-                   m_ui.surfacesTreeWidget, m_ui.surfacesOpaqueCB->isChecked(),
-                   m_ui.surfacesAlphaCB->isChecked());
+    addSurfaceItem(surface, label, parent, m_ui.surfacesTreeWidget);
+}
+
+void MainWindow::surfaceGroupExpanded(QTreeWidgetItem *group)
+{
+    bool opaque = m_ui.surfacesOpaqueCB->isChecked();
+    bool alpha = m_ui.surfacesAlphaCB->isChecked();
+
+    for (int i = 0; i < group->childCount(); ++i) {
+        QTreeWidgetItem *item = group->child(i);
+        if (!item->data(0, ThumbnailPendingRole).toBool()) {
+            continue;
+        }
+
+        QByteArray data = item->data(0, Qt::UserRole).toByteArray();
+        QImage thumb = ApiSurface::thumbnailFromData(data, opaque, alpha);
+        item->setIcon(0, QIcon(QPixmap::fromImage(thumb)));
+        item->setData(0, ThumbnailPendingRole, false);
+    }
 }
 
 template <typename Surface>
@@ -791,6 +825,9 @@ void MainWindow::addSurfaces(const QList<Surface> &surfaces, const char *label)
         for (int i = 0; i < surfaces.count(); ++i) {
             addSurface(surfaces[i], imageItem);
         }
+        if (imageItem->isExpanded()) {
+            surfaceGroupExpanded(imageItem);
+        }
     }
 }
 
@@ -1042,7 +1079,7 @@ void MainWindow::showSelectedSurface()
 
     viewer->setAttribute(Qt::WA_DeleteOnClose, true);
 
-    QByteArray data = var.value<QByteArray>();
+    QByteArray data = var.toByteArray();
     viewer->setData(data);
 
     viewer->show();
@@ -1240,6 +1277,9 @@ void MainWindow::initConnections()
     connect(m_ui.surfacesTreeWidget,
             SIGNAL(itemDoubleClicked(QTreeWidgetItem *, int)),
             SLOT(showSelectedSurface()));
+    connect(m_ui.surfacesTreeWidget,
+            SIGNAL(itemExpanded(QTreeWidgetItem *)),
+            SLOT(surfaceGroupExpanded(QTreeWidgetItem *)));
 
     connect(m_ui.nonDefaultsCB, SIGNAL(toggled(bool)),
             this, SLOT(fillState(bool)));
@@ -1475,9 +1515,9 @@ void MainWindow::fillState(bool nonDefaults)
             ApiTraceCall *firstCall = firstFrame->calls().first();
             ApiTraceEvent *oldSelected = m_selectedEvent;
             m_nonDefaultsLookupEvent = m_selectedEvent;
-            m_selectedEvent = firstCall;
+            setEvent(m_selectedEvent, firstCall);
             lookupState();
-            m_selectedEvent = oldSelected;
+            setEvent(m_selectedEvent, oldSelected);
         }
     }
     fillStateForFrame();
@@ -1632,7 +1672,7 @@ void MainWindow::saveSelectedSurface()
 
     QImage img = var.value<QImage>();
     if (img.isNull()) {
-        image::Image *traceImage = ApiSurface::imageFromData(var.value<QByteArray>());
+        image::Image *traceImage = ApiSurface::imageFromData(var.toByteArray());
         img = ApiSurface::qimageFromRawImage(traceImage);
         delete traceImage;
     }
@@ -83,6 +83,7 @@ private slots:
     void showSurfacesMenu(const QPoint &pos);
     void showSelectedSurface();
     void saveSelectedSurface();
+    void surfaceGroupExpanded(QTreeWidgetItem *group);
     void exportBufferData();
     void slotGoTo();
     void slotJumpTo(int callNum);
@@ -162,10 +162,10 @@ void ProfileDialog::tableDoubleClicked(const QModelIndex& index)
         return;
     }
 
-    const trace::Profile::Call* call = model->getJumpCall(index);
+    qint64 call = model->getJumpCall(index);
 
-    if (call) {
-        emit jumpToCall(call->no);
+    if (call >= 0) {
+        emit jumpToCall(m_profile->calls.no[call]);
     } else {
         unsigned program = model->getProgram(index);
 
@@ -9,14 +9,111 @@
  * Data providers for a heatmap based off the trace::Profile call data
  */
 
+/**
+ * Calls of a heatmap row, ordered by start time: either all calls (CPU), the
+ * calls drawn (GPU), or those of a program.
+ */
+class ProfileCallSequence {
+public:
+    ProfileCallSequence() :
+        m_profile(NULL),
+        m_indices(NULL),
+        m_durations(NULL),
+        m_gpu(false)
+    {
+    }
+
+    ProfileCallSequence(const trace::Profile* profile, bool gpu, int program = -1) :
+        m_profile(profile),
+        m_gpu(gpu)
+    {
+        if (program != -1) {
+            const trace::Profile::Program& p = profile->programs[program];
+            m_indices = &p.calls;
+            m_durations = gpu ? &p.gpuDurations : &p.cpuDurations;
+        } else if (gpu) {
+            /* Calls not drawn have no GPU duration, so can be summarized along */
+            m_indices = &profile->draws;
+            m_durations = &profile->gpuDurations;
+        } else {
+            m_indices = NULL;
+            m_durations = &profile->cpuDurations;
+        }
+    }
+
+    bool isValid() const
+    {
+        return m_profile != NULL;
+    }
+
+    qint64 size() const
+    {
+        return m_indices ? m_indices->size() : m_profile->calls.size();
+    }
+
+    /* Index to profile->calls array */
+    unsigned callIndex(qint64 pos) const
+    {
+        return m_indices ? (*m_indices)[pos] : pos;
+    }
+
+    qint64 start(qint64 pos) const
+    {
+        unsigned index = callIndex(pos);
+        return m_gpu ? m_profile->calls.gpuStart[index] : m_profile->calls.cpuStart[index];
+    }
+
+    qint64 duration(qint64 pos) const
+    {
+        unsigned index = callIndex(pos);
+        return m_gpu ? m_profile->calls.gpuDuration[index] : m_profile->calls.cpuDuration[index];
+    }
+
+    /* Position of the first call starting at or after time */
+    qint64 lowerBound(qint64 time, qint64 begin = 0) const
+    {
+        return Profiling::lowerBound(begin, size(), [this] (qint64 pos) { return start(pos); }, time);
+    }
+
+    /* Summary of the durations of the calls in [begin, end) */
+    trace::Pyramid::Summary durations(qint64 begin, qint64 end) const
+    {
+        if (begin >= end) {
+            return trace::Pyramid::Summary();
+        }
+
+        if (m_indices && m_durations == &m_profile->gpuDurations) {
+            /* Summarized over all calls */
+            return m_durations->summarize(callIndex(begin), callIndex(end - 1) + 1,
+                                          [this] (size_t index) { return m_profile->calls.pixels[index] < 0 ? 0 : m_profile->calls.gpuDuration[index]; });
+        }
+
+        return m_durations->summarize(begin, end, [this] (size_t pos) { return duration(pos); });
+    }
+
+private:
+    const trace::Profile* m_profile;
+    const std::vector<unsigned>* m_indices;
+    const trace::Pyramid* m_durations;
+    bool m_gpu;
+};
+
+
+/**
+ * Heat is computed for each step from the summary of the durations of the
+ * calls starting in it, so painting takes time proportional to the number of
+ * steps rather than the number of calls.
+ */
 class ProfileHeatmapRowIterator : public HeatmapRowIterator {
 public:
     ProfileHeatmapRowIterator(const trace::Profile* profile, qint64 start, qint64 end, int steps, bool gpu, int program = -1) :
         m_profile(profile),
+        m_calls(profile, gpu, program),
         m_step(-1),
         m_stepWidth(1),
         m_stepCount(steps),
-        m_index(0),
+        m_pos(-1),
+        m_carry(0),
         m_timeStart(start),
         m_timeEnd(end),
         m_useGpu(gpu),
@@ -30,125 +127,122 @@ public:
 
     virtual bool next() override
     {
-        unsigned maxIndex = m_program == -1 ? m_profile->calls.size() : m_profile->programs[m_program].calls.size();
+        if (m_pos < 0) {
+            /* Start from the last call running at the start of the view */
+            m_pos = m_calls.lowerBound(m_timeStart);
+            if (m_pos > 0 && m_calls.start(m_pos - 1) + m_calls.duration(m_pos - 1) >= m_timeStart) {
+                --m_pos;
+            }
+        }
+
+        double dtds = m_timeWidth / (double)m_stepCount;
+        int firstStep = m_step + m_stepWidth;
 
-        if (m_index >= maxIndex) {
+        if (firstStep >= m_stepCount) {
             return false;
         }
 
-        double dtds = m_timeWidth / (double)m_stepCount;
+        /* Time of the previous call which runs into this step */
+        qint64 heatDuration = m_carry;
+        m_carry = 0;
 
-        qint64 heatDuration = 0;
-        qint64 programHeatDuration = 0;
         m_heat = 0.0f;
-        m_step += m_stepWidth;
-        m_stepWidth = 1;
-
+        m_programHeat = 0.0f;
         m_selected = false;
+        m_step = firstStep;
+        m_stepWidth = 1;
 
-        /* Iterator through calls until step != lastStep */
-        for (; m_index < maxIndex; ++m_index)
-        {
-            const trace::Profile::Call* call;
-
-            if (m_program == -1) {
-                call = &m_profile->calls[m_index];
-            } else {
-                call = &m_profile->calls[ m_profile->programs[m_program].calls[m_index] ];
-            }
-
-            qint64 start, duration, end;
-
-            if (m_useGpu) {
-                start = call->gpuStart;
-                duration = call->gpuDuration;
-
-                if (call->pixels < 0) {
-                    continue;
-                }
-            } else {
-                start = call->cpuStart;
-                duration = call->cpuDuration;
+        if (m_pos >= m_calls.size() || m_calls.start(m_pos) > m_timeEnd) {
+            if (heatDuration <= 0) {
+                return false;
             }
 
-            end = start + duration;
+            m_heat = heatDuration / dtds;
+            finishStep();
+            return true;
+        }
 
-            if (end < m_timeStart) {
-                continue;
-            }
+        qint64 start = m_calls.start(m_pos);
+        qint64 end = start + m_calls.duration(m_pos);
+        int leftStep = qMax<int>(timeToStep(start), firstStep);
+        int rightStep = timeToStep(end);
 
-            if (start > m_timeEnd) {
-                m_index = m_profile->calls.size();
-                break;
-            }
+        if (heatDuration > 0 && leftStep > firstStep) {
+            m_heat = heatDuration / dtds;
+            finishStep();
+            return true;
+        }
 
-            double left  = timeToStep(start);
-            double right = timeToStep(end);
+        if (rightStep - leftStep > 1) {
+            /* A call spanning several steps is drawn on its own, with a label */
+            unsigned index = m_calls.callIndex(m_pos);
 
-            int leftStep = left;
-            int rightStep = right;
+            m_label = QString::fromStdString(m_profile->names[m_profile->calls.name[index]]);
+            m_step = leftStep;
+            m_stepWidth = rightStep - leftStep;
+            m_heat = 1.0f;
+            ++m_pos;
 
-            if (leftStep > m_step) {
-                break;
-            }
+            /* Its end falls within the step after the box */
+            m_carry = qMax<qint64>(0, end - stepToTime(rightStep));
 
-            if (m_programSelection && call->program == m_programSel) {
+            if (m_programSelection && m_profile->calls.program[index] == (unsigned)m_programSel) {
                 m_selected = true;
             }
 
-            if (rightStep - leftStep > 1) {
-                m_label = QString::fromStdString(call->name);
-                m_step = left;
-                m_stepWidth = rightStep - leftStep;
-                heatDuration = dtds;
-                ++m_index;
-                break;
-            }
+            finishStep();
+            return true;
+        }
 
-            if (leftStep < m_step) {
-                qint64 rightTime = stepToTime(rightStep);
-                heatDuration += end - rightTime;
+        m_step = leftStep;
 
-                if (m_programSelection && call->program == m_programSel) {
-                    programHeatDuration += end - rightTime;
-                }
-            } else if (leftStep == rightStep) {
-                heatDuration += duration;
+        qint64 stepStart = stepToTime(m_step);
+        qint64 stepEnd = stepToTime(m_step + 1);
 
-                if (m_programSelection && call->program == m_programSel) {
-                    programHeatDuration += duration;
-                }
-            } else if (rightStep - leftStep == 1) {
-                qint64 rightTime = stepToTime(rightStep);
-                heatDuration += rightTime - start;
+        /* Calls starting in this step, up to any spanning several steps */
+        qint64 last = m_calls.lowerBound(stepEnd, m_pos + 1);
 
-                if (m_programSelection && call->program == m_programSel) {
-                    programHeatDuration += rightTime - start;
-                }
+        if (last - m_pos > 1 && m_calls.durations(m_pos + 1, last).max > dtds) {
+            for (qint64 pos = m_pos + 1; pos < last; ++pos) {
+                qint64 callStart = m_calls.start(pos);
+                int callLeft = qMax<int>(timeToStep(callStart), m_step);
 
-                break;
+                if (timeToStep(callStart + m_calls.duration(pos)) - callLeft > 1) {
+                    last = pos;
+                    break;
+                }
             }
         }
 
-        m_heat = heatDuration / dtds;
-        m_programHeat = programHeatDuration / dtds;
+        heatDuration += m_calls.durations(m_pos, last).sum;
 
-        if (m_timeSelection) {
-            qint64 time = stepToTime(m_step);
+        /* The last call may run into the next step */
+        qint64 lastEnd = m_calls.start(last - 1) + m_calls.duration(last - 1);
 
-            if (time >= m_timeSelStart && time <= m_timeSelEnd) {
-                m_programHeat = 1.0;
-            }
+        if (lastEnd > stepEnd) {
+            m_carry = lastEnd - qMax<qint64>(stepEnd, m_calls.start(last - 1));
+            heatDuration -= m_carry;
         }
 
-        if (m_programSelection && (m_program == m_programSel || (m_selected && m_stepWidth > 1))) {
-            m_programHeat = 1.0;
+        /* A call spanning several steps may start within this one */
+        if (last < m_calls.size() && m_calls.start(last) < stepEnd) {
+            heatDuration += stepEnd - m_calls.start(last);
         }
 
-        if (m_programHeat > 0) {
-            m_selected = true;
+        m_pos = last;
+        m_heat = heatDuration / dtds;
+
+        if (m_selectedCalls.isValid()) {
+            qint64 selFirst = m_selectedCalls.lowerBound(stepStart);
+            qint64 selLast = m_selectedCalls.lowerBound(stepEnd, selFirst);
+
+            if (selFirst < selLast) {
+                m_selected = true;
+                m_programHeat = m_selectedCalls.durations(selFirst, selLast).sum / dtds;
+            }
         }
 
+        finishStep();
         return true;
     }
 
@@ -186,6 +280,11 @@ public:
     {
         m_programSelection = true;
         m_programSel = program;
+
+        /* Calls of other programs are never selected in program rows */
+        if (m_program == -1 && program >= 0 && program < (int)m_profile->programs.size()) {
+            m_selectedCalls = ProfileCallSequence(m_profile, m_useGpu, program);
+        }
     }
 
     void setTimeSelection(qint64 start, qint64 end)
@@ -196,6 +295,25 @@ public:
     }
 
 private:
+    void finishStep()
+    {
+        if (m_timeSelection) {
+            qint64 time = stepToTime(m_step);
+
+            if (time >= m_timeSelStart && time <= m_timeSelEnd) {
+                m_programHeat = 1.0;
+            }
+        }
+
+        if (m_programSelection && (m_program == m_programSel || (m_selected && m_stepWidth > 1))) {
+            m_programHeat = 1.0;
+        }
+
+        if (m_programHeat > 0) {
+            m_selected = true;
+        }
+    }
+
     double timeToStep(qint64 time) const
     {
         double pos = time;
@@ -216,12 +334,18 @@ private:
 
 private:
     const trace::Profile* m_profile;
+    ProfileCallSequence m_calls;
+    ProfileCallSequence m_selectedCalls;
 
     int m_step;
     int m_stepWidth;
     int m_stepCount;
 
-    unsigned m_index;
+    /* Position in m_calls of the next call */
+    qint64 m_pos;
+
+    /* Duration carried into the next step */
+    qint64 m_carry;
 
     float m_heat;
 
@@ -282,7 +406,7 @@ public:
         if (row >= m_rowPrograms.size()) {
             return QString();
         } else {
-            return QString("%1").arg(m_rowPrograms[row]);
+            return QString("%1").arg(m_profile->programs[m_rowPrograms[row]].id);
         }
     }
 
@@ -352,17 +476,18 @@ public:
             return -1;
         }
 
-        unsigned program = m_rowPrograms[row];
+        ProfileCallSequence calls(m_profile, true, m_rowPrograms[row]);
 
-        std::vector<unsigned>::const_iterator item =
-                Profiling::binarySearchTimespanIndexed
-                    (m_profile->calls, m_profile->programs[program].calls.begin(), m_profile->programs[program].calls.end(), time);
+        qint64 pos = Profiling::binarySearchTimespan(calls.size(),
+                                                     [&] (qint64 i) { return calls.start(i); },
+                                                     [&] (qint64 i) { return calls.duration(i); },
+                                                     time);
 
-        if (item == m_profile->programs[program].calls.end()) {
+        if (pos == calls.size()) {
             return -1;
         }
 
-        return *item;
+        return calls.callIndex(pos);
     }
 
     virtual qint64 headerItemAt(unsigned row, qint64 time) const override
@@ -373,14 +498,15 @@ public:
 
         if (row == 0) {
             /* CPU */
-            std::vector<trace::Profile::Call>::const_iterator item =
-                    Profiling::binarySearchTimespan<trace::Profile::Call,
-                                        &trace::Profile::Call::cpuStart,
-                                        &trace::Profile::Call::cpuDuration>
-                    (m_profile->calls.begin(), m_profile->calls.end(), time);
-
-            if (item != m_profile->calls.end()) {
-                return item - m_profile->calls.begin();
+            const trace::Profile::Calls& calls = m_profile->calls;
+
+            qint64 index = Profiling::binarySearchTimespan(calls.size(),
+                                                           [&] (qint64 i) { return calls.cpuStart[i]; },
+                                                           [&] (qint64 i) { return calls.cpuDuration[i]; },
+                                                           time);
+
+            if (index != (qint64)calls.size()) {
+                return index;
             }
         } else if (row == 1) {
             /* GPU */
@@ -402,8 +528,7 @@ public:
             return;
         }
 
-        const trace::Profile::Call& call = m_profile->calls[index];
-        Profiling::jumpToCall(call.no);
+        Profiling::jumpToCall(m_profile->calls.no[index]);
     }
 
     virtual QString itemTooltip(qint64 index) const override
@@ -412,10 +537,10 @@ public:
             return QString();
         }
 
-        const trace::Profile::Call& call = m_profile->calls[index];
+        const trace::Profile::Call call = m_profile->calls[index];
 
         QString text;
-        text  = QString::fromStdString(call.name);
+        text  = QString::fromStdString(m_profile->names[call.name]);
 
         text += QString("\nCall: %1").arg(call.no);
         text += QString("\nCPU Start: %1").arg(Profiling::getTimeString(call.cpuStart, 1e3));
@@ -6,7 +6,6 @@
 
 #include <QLocale>
 
-typedef trace::Profile::Call Call;
 typedef trace::Profile::Frame Frame;
 typedef trace::Profile::Program Program;
 
@@ -101,23 +100,26 @@ void ProfileTableModel::updateModel()
         row.pixels = 0;
         row.gpuTime = 0;
         row.cpuTime = 0;
-        row.longestCpu = NULL;
-        row.longestGpu = NULL;
-        row.longestPixel = NULL;
+        row.longestCpu = -1;
+        row.longestGpu = -1;
+        row.longestPixel = -1;
     }
 
+    const trace::Profile::Calls& calls = m_profile->calls;
+
     for (std::vector<Program>::const_iterator itr = m_profile->programs.begin(); itr != m_profile->programs.end(); ++itr) {
         ProfileTableRow* row = NULL;
         const Program& program = *itr;
 
-        for (const auto & callNo : program.calls) {
-            const Call& call = m_profile->calls[callNo];
+        for (const auto & index : program.calls) {
+            int64_t cpuStart = calls.cpuStart[index];
+            int64_t cpuDuration = calls.cpuDuration[index];
 
-            if (call.cpuStart > m_timeMax) {
+            if (cpuStart > m_timeMax) {
                 break;
             }
 
-            if (call.cpuStart + call.cpuDuration < m_timeMin) {
+            if (cpuStart + cpuDuration < m_timeMin) {
                 continue;
             }
 
@@ -125,21 +127,24 @@ void ProfileTableModel::updateModel()
                 row = getRow(itr - m_profile->programs.begin());
             }
 
+            int64_t gpuDuration = calls.gpuDuration[index];
+            int64_t pixels = calls.pixels[index];
+
             row->uses++;
-            row->pixels  += call.pixels;
-            row->gpuTime += call.gpuDuration;
-            row->cpuTime += call.cpuDuration;
+            row->pixels  += pixels;
+            row->gpuTime += gpuDuration;
+            row->cpuTime += cpuDuration;
 
-            if (!row->longestGpu || row->longestGpu->gpuDuration < call.gpuDuration) {
-                row->longestGpu = &call;
+            if (row->longestGpu < 0 || calls.gpuDuration[row->longestGpu] < gpuDuration) {
+                row->longestGpu = index;
             }
 
-            if (!row->longestCpu || row->longestCpu->cpuDuration < call.cpuDuration) {
-                row->longestCpu = &call;
+            if (row->longestCpu < 0 || calls.cpuDuration[row->longestCpu] < cpuDuration) {
+                row->longestCpu = index;
             }
 
-            if (!row->longestPixel || row->longestPixel->pixels < call.pixels) {
-                row->longestPixel = &call;
+            if (row->longestPixel < 0 || calls.pixels[row->longestPixel] < pixels) {
+                row->longestPixel = index;
             }
         }
     }
@@ -147,9 +152,9 @@ void ProfileTableModel::updateModel()
 
 
 /**
- * Get the appropriate call associated with an item in the table
+ * Get the index of the appropriate call associated with an item in the table, or -1
  */
-const trace::Profile::Call *ProfileTableModel::getJumpCall(const QModelIndex & index) const {
+qint64 ProfileTableModel::getJumpCall(const QModelIndex & index) const {
     const ProfileTableRow& row = m_rowData[index.row()];
 
     switch(index.column()) {
@@ -164,7 +169,7 @@ const trace::Profile::Call *ProfileTableModel::getJumpCall(const QModelIndex & i
         return row.longestPixel;
     }
 
-    return NULL;
+    return -1;
 }
 
 
@@ -201,7 +206,7 @@ ProfileTableRow* ProfileTableModel::getRow(unsigned program) {
             return &row;
     }
 
-    m_rowData.append(ProfileTableRow(program));
+    m_rowData.append(ProfileTableRow(program, m_profile->programs[program].id));
     return &m_rowData.back();
 }
 
@@ -233,7 +238,7 @@ QVariant ProfileTableModel::data(const QModelIndex &index, int role) const
 
         switch(index.column()) {
         case COLUMN_PROGRAM:
-            return row.program;
+            return row.id;
         case COLUMN_USAGES:
             return QLocale::system().toString(row.uses);
         case COLUMN_GPU_TIME:
@@ -283,7 +288,7 @@ public:
 
         switch(mSortColumn) {
         case COLUMN_PROGRAM:
-            result = p1.program < p2.program;
+            result = p1.id < p2.id;
             break;
         case COLUMN_USAGES:
             result = p1.uses < p2.uses;
@@ -5,27 +5,31 @@
 
 struct ProfileTableRow
 {
-    ProfileTableRow(unsigned no)
+    ProfileTableRow(unsigned no, unsigned _id)
         : program(no),
+          id(_id),
           uses(0),
           gpuTime(0),
           cpuTime(0),
           pixels(0),
-          longestGpu(0),
-          longestCpu(0),
-          longestPixel(0)
+          longestGpu(-1),
+          longestCpu(-1),
+          longestPixel(-1)
     {
     }
 
+    /* Index to profile->programs array */
     unsigned program;
+    unsigned id;
     qulonglong uses;
     qulonglong gpuTime;
     qulonglong cpuTime;
     qulonglong pixels;
 
-    const trace::Profile::Call* longestGpu;
-    const trace::Profile::Call* longestCpu;
-    const trace::Profile::Call* longestPixel;
+    /* Indices to profile->calls array, or -1 */
+    qint64 longestGpu;
+    qint64 longestCpu;
+    qint64 longestPixel;
 };
 
 class ProfileTableModel : public QAbstractTableModel
@@ -43,7 +47,7 @@ public:
 
     int getRowIndex(unsigned program) const;
     unsigned getProgram(const QModelIndex & index) const;
-    const trace::Profile::Call* getJumpCall(const QModelIndex & index) const;
+    qint64 getJumpCall(const QModelIndex & index) const;
 
     virtual int rowCount(const QModelIndex & parent) const override;
     virtual int columnCount(const QModelIndex & parent) const override;
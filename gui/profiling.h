@@ -57,69 +57,63 @@ public:
         return text + unit;
     }
 
-    template<typename val_ty, int64_t val_ty::* mem_ptr_start, int64_t val_ty::* mem_ptr_dura>
-    static typename std::vector<val_ty>::const_iterator binarySearchTimespan(
-            typename std::vector<val_ty>::const_iterator begin,
-            typename std::vector<val_ty>::const_iterator end,
+    /**
+     * Find the item spanning time amongst size items ordered by start time,
+     * where start(i) and duration(i) give the times of the item at i.
+     * Returns size when there is none, unless nearest is set.
+     */
+    template<typename Start, typename Duration>
+    static qint64 binarySearchTimespan(
+            qint64 size,
+            Start start,
+            Duration duration,
             int64_t time,
             bool nearest = false)
     {
-        int lower = 0;
-        int upper = end - begin;
-        int pos = (lower + upper) / 2;
-        typename std::vector<val_ty>::const_iterator itr = begin + pos;
+        qint64 lower = 0;
+        qint64 upper = size - 1;
+        qint64 pos = (lower + upper) / 2;
+
+        while (lower <= upper) {
+            int64_t itemStart = start(pos);
+
+            if (itemStart <= time && itemStart + duration(pos) > time) {
+                break;
+            }
 
-        while (!((*itr).*mem_ptr_start <= time && (*itr).*mem_ptr_start + (*itr).*mem_ptr_dura > time) && (lower <= upper)) {
-            if ((*itr).*mem_ptr_start > time) {
+            if (itemStart > time) {
                 upper = pos - 1;
             } else {
                 lower = pos + 1;
             }
 
             pos = (lower + upper) / 2;
-            itr = begin + pos;
         }
 
         if (nearest || lower <= upper) {
-            return itr;
+            return pos;
         } else {
-            return end;
+            return size;
         }
     }
 
-    static std::vector<unsigned>::const_iterator binarySearchTimespanIndexed(
-            const std::vector<trace::Profile::Call>& calls,
-            std::vector<unsigned>::const_iterator begin,
-            std::vector<unsigned>::const_iterator end,
-            int64_t time,
-            bool nearest = false)
+    /**
+     * Find the position of the first item starting at or after time, amongst
+     * the items in [begin, end) ordered by start time.
+     */
+    template<typename Start>
+    static qint64 lowerBound(qint64 begin, qint64 end, Start start, int64_t time)
     {
-        int lower = 0;
-        int upper = end - begin - 1;
-        int pos = (lower + upper) / 2;
-        std::vector<unsigned>::const_iterator itr = begin + pos;
+        while (begin < end) {
+            qint64 pos = begin + (end - begin) / 2;
 
-        while (lower <= upper) {
-            const trace::Profile::Call& call = calls[*itr];
-
-            if (call.gpuStart <= time && call.gpuStart + call.gpuDuration > time) {
-                break;
-            }
-
-            if (call.gpuStart > time) {
-                upper = pos - 1;
+            if (start(pos) < time) {
+                begin = pos + 1;
             } else {
-                lower = pos + 1;
+                end = pos;
             }
-
-            pos = (lower + upper) / 2;
-            itr = begin + pos;
         }
 
-        if (nearest || lower <= upper) {
-            return itr;
-        } else {
-            return end;
-        }
+        return begin;
     }
 };
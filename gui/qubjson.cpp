@@ -29,6 +29,9 @@
 #include <QDebug>
 #include <QVariant>
 #include <QDataStream>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTemporaryFile>
 
 #include "ubjson.hpp"
 
@@ -36,6 +39,120 @@
 using namespace ubjson;
 
 
+struct UBJSONSpoolFile
+{
+    QTemporaryFile file;
+    QMutex mutex;
+};
+
+
+UBJSONBlob::UBJSONBlob() :
+    m_offset(0),
+    m_size(0)
+{
+}
+
+
+bool
+UBJSONBlob::isNull() const
+{
+    return m_file.isNull();
+}
+
+
+int
+UBJSONBlob::size() const
+{
+    return m_size;
+}
+
+
+QByteArray
+UBJSONBlob::data() const
+{
+    if (!m_file) {
+        return QByteArray();
+    }
+
+    QMutexLocker locker(&m_file->mutex);
+
+    QByteArray data;
+    if (m_file->file.seek(m_offset)) {
+        data = m_file->file.read(m_size);
+    }
+    if (data.size() != m_size) {
+        qWarning() << "error: failed to read spooled blob";
+        return QByteArray();
+    }
+    return data;
+}
+
+
+UBJSONSpool::UBJSONSpool(int threshold) :
+    m_threshold(threshold),
+    m_failed(false)
+{
+    static bool registered =
+        QMetaType::registerConverter<UBJSONBlob, QByteArray>(&UBJSONBlob::data);
+    Q_UNUSED(registered);
+}
+
+
+int
+UBJSONSpool::threshold() const
+{
+    return m_threshold;
+}
+
+
+UBJSONBlob
+UBJSONSpool::spool(QDataStream &stream, int size)
+{
+    UBJSONBlob blob;
+
+    if (m_failed) {
+        return blob;
+    }
+
+    if (!m_file) {
+        m_file.reset(new UBJSONSpoolFile);
+        if (!m_file->file.open()) {
+            qWarning() << "warning: failed to create spool file, keeping blobs in memory";
+            m_file.reset();
+            m_failed = true;
+            return blob;
+        }
+    }
+
+    QMutexLocker locker(&m_file->mutex);
+
+    QFile &file = m_file->file;
+    qint64 offset = file.size();
+    if (!file.seek(offset)) {
+        m_failed = true;
+        return blob;
+    }
+
+    char buf[64 * 1024];
+    int remaining = size;
+    while (remaining > 0) {
+        int chunk = qMin(remaining, int(sizeof buf));
+        int read = stream.readRawData(buf, chunk);
+        if (read <= 0) {
+            break;
+        }
+        file.write(buf, read);
+        remaining -= read;
+    }
+    Q_ASSERT(remaining == 0);
+
+    blob.m_file = m_file;
+    blob.m_offset = offset;
+    blob.m_size = size - remaining;
+    return blob;
+}
+
+
 static Marker
 readMarker(QDataStream &stream)
 {
@@ -180,11 +297,11 @@ readString(QDataStream &stream)
 
 
 static QVariant
-readVariant(QDataStream &stream, Marker type);
+readVariant(QDataStream &stream, Marker type, UBJSONSpool *spool);
 
 
 static QVariant
-readArray(QDataStream &stream)
+readArray(QDataStream &stream, UBJSONSpool *spool)
 {
     Marker marker = readMarker(stream);
     if (marker == MARKER_TYPE) {
@@ -194,6 +311,12 @@ readArray(QDataStream &stream)
         marker = readMarker(stream);
         Q_ASSERT(marker == MARKER_COUNT);
         int count = readSize(stream);
+        if (spool && count >= spool->threshold()) {
+            UBJSONBlob blob = spool->spool(stream, count);
+            if (!blob.isNull()) {
+                return QVariant::fromValue(blob);
+            }
+        }
         QByteArray array(count, Qt::Uninitialized);
         int read = stream.readRawData(array.data(), count);
         Q_ASSERT(read == count);
@@ -204,7 +327,7 @@ readArray(QDataStream &stream)
         QVariantList array;
         for (int i = 0; i < count; ++i) {
             marker = readMarker(stream);
-            QVariant value = readVariant(stream, marker);
+            QVariant value = readVariant(stream, marker, spool);
             array.append(value);
         }
         return array;
@@ -212,7 +335,7 @@ readArray(QDataStream &stream)
         QVariantList array;
         while (marker != MARKER_ARRAY_END &&
                marker != MARKER_EOF) {
-            QVariant value = readVariant(stream, marker);
+            QVariant value = readVariant(stream, marker, spool);
             array.append(value);
             marker = readMarker(stream);
         }
@@ -222,7 +345,7 @@ readArray(QDataStream &stream)
 
 
 static QVariantMap
-readObject(QDataStream &stream)
+readObject(QDataStream &stream, UBJSONSpool *spool)
 {
     QVariantMap object;
     Marker marker = readMarker(stream);
@@ -231,7 +354,7 @@ readObject(QDataStream &stream)
         int nameSize = readSize(stream, marker);
         QString name = readString(stream, nameSize);
         marker = readMarker(stream);
-        QVariant value = readVariant(stream, marker);
+        QVariant value = readVariant(stream, marker, spool);
         object[name] = value;
         marker = readMarker(stream);
     }
@@ -240,7 +363,7 @@ readObject(QDataStream &stream)
 
 
 static QVariant
-readVariant(QDataStream &stream, Marker type)
+readVariant(QDataStream &stream, Marker type, UBJSONSpool *spool)
 {
     switch (type) {
     case MARKER_NULL:
@@ -273,9 +396,9 @@ readVariant(QDataStream &stream, Marker type)
     case MARKER_STRING:
         return readString(stream);
     case MARKER_ARRAY_BEGIN:
-        return readArray(stream);
+        return readArray(stream, spool);
     case MARKER_OBJECT_BEGIN:
-        return readObject(stream);
+        return readObject(stream, spool);
     case MARKER_ARRAY_END:
     case MARKER_OBJECT_END:
     case MARKER_TYPE:
@@ -288,11 +411,11 @@ readVariant(QDataStream &stream, Marker type)
 }
 
 
-QVariant decodeUBJSONObject(QIODevice *io)
+QVariant decodeUBJSONObject(QIODevice *io, UBJSONSpool *spool)
 {
     QDataStream stream(io);
     stream.setByteOrder(QDataStream::BigEndian);
     Marker marker = readMarker(stream);
-    return readVariant(stream, marker);
+    return readVariant(stream, marker, spool);
 }
 
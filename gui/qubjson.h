@@ -27,8 +27,64 @@
 #pragma once
 
 
+#include <QByteArray>
+#include <QMetaType>
+#include <QSharedPointer>
 #include <QVariantMap>
 
+class QDataStream;
 class QIODevice;
+struct UBJSONSpoolFile;
 
-QVariant decodeUBJSONObject(QIODevice *io);
+
+/*
+ * Binary blob which was spooled to a temporary file while decoding, instead
+ * of being held in memory.
+ *
+ * QVariants holding it convert to QByteArray, reading the blob back on
+ * demand.
+ */
+class UBJSONBlob
+{
+public:
+    UBJSONBlob();
+
+    bool isNull() const;
+    int size() const;
+
+    QByteArray data() const;
+
+private:
+    friend class UBJSONSpool;
+
+    QSharedPointer<UBJSONSpoolFile> m_file;
+    qint64 m_offset;
+    int m_size;
+};
+
+Q_DECLARE_METATYPE(UBJSONBlob)
+
+
+/*
+ * Temporary file receiving the binary blobs at least threshold bytes large.
+ * The file lives as long as any blob referring to it.
+ */
+class UBJSONSpool
+{
+public:
+    explicit UBJSONSpool(int threshold = 64 * 1024);
+
+    int threshold() const;
+
+    // Copy size bytes from the stream into the spool.  Returns a null blob,
+    // without consuming anything, if the spool file can't be created.
+    UBJSONBlob spool(QDataStream &stream, int size);
+
+private:
+    QSharedPointer<UBJSONSpoolFile> m_file;
+    int m_threshold;
+    bool m_failed;
+};
+
+
+QVariant decodeUBJSONObject(QIODevice *io, UBJSONSpool *spool = nullptr);
@@ -149,6 +149,38 @@ TEST(qubjson, binary_data) {
 }
 
 
+TEST(qubjson, spooled_binary_data) {
+    QByteArray bytearray("[$U#U\x10", 5);
+    QByteArray payload("0123456789ABCDEF");
+    bytearray.append(payload);
+
+    // Below the threshold blobs stay in memory
+    {
+        QBuffer buffer(&bytearray);
+        buffer.open(QIODevice::ReadOnly);
+        UBJSONSpool spool(17);
+        QVariant actual = decodeUBJSONObject(&buffer, &spool);
+        EXPECT_TRUE(buffer.atEnd());
+        EXPECT_EQ(actual.userType(), int(QMetaType::QByteArray));
+        EXPECT_EQ(actual.toByteArray(), payload);
+    }
+
+    QVariant actual;
+    {
+        QBuffer buffer(&bytearray);
+        buffer.open(QIODevice::ReadOnly);
+        UBJSONSpool spool(16);
+        actual = decodeUBJSONObject(&buffer, &spool);
+        EXPECT_TRUE(buffer.atEnd());
+    }
+
+    // The blob outlives the spool
+    EXPECT_EQ(actual.userType(), qMetaTypeId<UBJSONBlob>());
+    EXPECT_EQ(actual.value<UBJSONBlob>().size(), payload.size());
+    EXPECT_EQ(actual.toByteArray(), payload);
+}
+
+
 int
 main(int argc, char **argv)
 {
@@ -399,6 +399,11 @@ void Retracer::run()
         arguments << QString::number(m_captureCall);
         arguments << QLatin1String("--dump-format");
         arguments << QLatin1String("ubjson");
+        // The images never leave the pipe, so don't bother compressing them
+        arguments << QLatin1String("--dump-images");
+        arguments << QLatin1String("raw");
+        // ApiTraceState resolves the __ref__ images
+        arguments << QLatin1String("--dedup-images");
     } else if (m_captureThumbnails) {
         if (!m_thumbnailsToCapture.isEmpty()) {
             arguments << QLatin1String("-S");
@@ -499,7 +504,10 @@ void Retracer::run()
         BlockingIODevice io(&process);
 
         if (m_captureState) {
-            parsedJson = decodeUBJSONObject(&io).toMap();
+            // Spool the image blobs to a temporary file rather than holding
+            // them in memory; they are only read back when looked at.
+            UBJSONSpool spool;
+            parsedJson = decodeUBJSONObject(&io, &spool).toMap();
             process.waitForFinished(-1);
         } else if (m_captureThumbnails) {
             /*
@@ -4,6 +4,8 @@
 #include <QDebug>
 #include <QFile>
 
+#include <algorithm>
+
 #define FRAMES_TO_CACHE 100
 
 static ApiTraceCall *
@@ -77,6 +79,11 @@ void TraceLoader::loadFrame(ApiTraceFrame *currentFrame)
     fetchFrameContents(currentFrame);
 }
 
+void TraceLoader::loadFrameChunk(ApiTraceFrame *frame, int chunk)
+{
+    fetchFrameChunk(frame, chunk);
+}
+
 int TraceLoader::numberOfFrames() const
 {
     return m_frameBookmarks.size();
@@ -118,14 +125,18 @@ void TraceLoader::scanTrace()
 
     trace::Call *call;
     trace::ParseBookmark startBookmark;
+    QVector<trace::ParseBookmark> chunkBookmarks;
+    QVector<unsigned> callIndices;
     int numOfFrames = 0;
     int numOfCalls = 0;
     int lastPercentReport = 0;
 
     m_parser.getBookmark(startBookmark);
+    chunkBookmarks.append(startBookmark);
 
     while ((call = m_parser.scan_call())) {
         ++numOfCalls;
+        callIndices.append(call->no);
 
         if (call->flags & trace::CALL_FLAG_END_FRAME) {
             FrameBookmark frameBookmark(startBookmark);
@@ -135,6 +146,10 @@ void TraceLoader::scanTrace()
             currentFrame->number = numOfFrames;
             currentFrame->setNumChildren(numOfCalls);
             currentFrame->setLastCallIndex(call->no);
+            if (numOfCalls > ApiTraceFrame::WindowedThreshold) {
+                setWindowed(currentFrame, frameBookmark,
+                            callIndices, chunkBookmarks);
+            }
             frames.append(currentFrame);
 
             m_createdFrames.append(currentFrame);
@@ -146,7 +161,14 @@ void TraceLoader::scanTrace()
                 lastPercentReport = m_parser.percentRead();
             }
             m_parser.getBookmark(startBookmark);
+            chunkBookmarks.clear();
+            chunkBookmarks.append(startBookmark);
+            callIndices.clear();
             numOfCalls = 0;
+        } else if (numOfCalls % ApiTraceFrame::CallsPerChunk == 0) {
+            trace::ParseBookmark chunkBookmark;
+            m_parser.getBookmark(chunkBookmark);
+            chunkBookmarks.append(chunkBookmark);
         }
         delete call;
     }
@@ -159,6 +181,11 @@ void TraceLoader::scanTrace()
         currentFrame = new ApiTraceFrame();
         currentFrame->number = numOfFrames;
         currentFrame->setNumChildren(numOfCalls);
+        if (numOfCalls > ApiTraceFrame::WindowedThreshold) {
+            setWindowed(currentFrame, frameBookmark,
+                        callIndices, chunkBookmarks);
+            currentFrame->setLastCallIndex(callIndices.last());
+        }
         frames.append(currentFrame);
 
         m_createdFrames.append(currentFrame);
@@ -171,6 +198,47 @@ void TraceLoader::scanTrace()
     emit framesLoaded(frames);
 }
 
+void TraceLoader::setWindowed(ApiTraceFrame *frame,
+                              FrameBookmark &frameBookmark,
+                              const QVector<unsigned> &callIndices,
+                              const QVector<trace::ParseBookmark> &chunkBookmarks)
+{
+    frame->setWindowed(callIndices);
+
+    /*
+     * A call is numbered when it starts but scanned when it ends, so the
+     * calls of a chunk may have started before its bookmark, even before
+     * the frame.  Parse each chunk from the last bookmark preceding all of
+     * its calls, so that none of them is lost.
+     */
+    frameBookmark.chunks.clear();
+    for (int chunk = 0; chunk < chunkBookmarks.count(); ++chunk) {
+        int first = chunk * ApiTraceFrame::CallsPerChunk;
+        int last = qMin(first + ApiTraceFrame::CallsPerChunk,
+                        callIndices.count());
+        if (first >= last) {
+            break;
+        }
+        unsigned minCallIndex =
+            *std::min_element(callIndices.constBegin() + first,
+                              callIndices.constBegin() + last);
+
+        int start = chunk;
+        while (start > 0 &&
+               chunkBookmarks[start].next_call_no > minCallIndex) {
+            --start;
+        }
+        trace::ParseBookmark bookmark = chunkBookmarks[start];
+
+        int frameIdx = frame->number;
+        while (frameIdx > 0 && bookmark.next_call_no > minCallIndex) {
+            --frameIdx;
+            bookmark = m_frameBookmarks[frameIdx].start;
+        }
+        frameBookmark.chunks.append(bookmark);
+    }
+}
+
 
 ApiTraceCallSignature * TraceLoader::signature(unsigned id)
 {
@@ -198,16 +266,7 @@ void TraceLoader::searchNext(const ApiTrace::SearchRequest &request)
 
         if (callContains(call, request.text, request.cs, request.useRegex)) {
             unsigned frameIdx = callInFrame(call->no);
-            ApiTraceFrame *frame = m_createdFrames[frameIdx];
-            const QVector<ApiTraceCall*> calls =
-                    fetchFrameContents(frame);
-            for (int i = 0; i < calls.count(); ++i) {
-                if (calls[i]->index() == call->no) {
-                    emit searchResult(request, ApiTrace::SearchResult_Found,
-                                      calls[i]);
-                    break;
-                }
-            }
+            emitFoundCall(request, frameIdx, call->no);
             delete call;
             return;
         }
@@ -265,17 +324,33 @@ bool TraceLoader::searchCallsBackwards(const QList<trace::Call*> &calls,
     for (int i = calls.count() - 1; i >= 0; --i) {
         trace::Call *call = calls[i];
         if (callContains(call, request.text, request.cs, request.useRegex)) {
-            ApiTraceFrame *frame = m_createdFrames[frameIdx];
-            const QVector<ApiTraceCall*> apiCalls =
-                    fetchFrameContents(frame);
-            for (int i = 0; i < apiCalls.count(); ++i) {
-                if (apiCalls[i]->index() == call->no) {
-                    emit searchResult(request,
-                                      ApiTrace::SearchResult_Found,
-                                      apiCalls[i]);
-                    break;
-                }
-            }
+            emitFoundCall(request, frameIdx, call->no);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TraceLoader::emitFoundCall(const ApiTrace::SearchRequest &request,
+                                int frameIdx, unsigned callIndex)
+{
+    ApiTraceFrame *frame = m_createdFrames[frameIdx];
+
+    if (frame->isWindowed()) {
+        int row = frame->rowForCallIndex(callIndex);
+        if (row < 0) {
+            return false;
+        }
+        fetchFrameChunk(frame, ApiTraceFrame::chunkForRow(row));
+        emit windowedSearchResult(request, frame, callIndex);
+        return true;
+    }
+
+    const QVector<ApiTraceCall*> calls = fetchFrameContents(frame);
+    for (int i = 0; i < calls.count(); ++i) {
+        if (calls[i]->index() == callIndex) {
+            emit searchResult(request, ApiTrace::SearchResult_Found,
+                              calls[i]);
             return true;
         }
     }
@@ -323,6 +398,11 @@ TraceLoader::fetchFrameContents(ApiTraceFrame *currentFrame)
         return currentFrame->calls();
     }
 
+    // Windowed frames are only ever decoded a chunk at a time
+    if (currentFrame->isWindowed()) {
+        return QVector<ApiTraceCall*>();
+    }
+
     unsigned frameIdx = currentFrame->number;
     int numOfCalls = numberOfCallsInFrame(frameIdx);
 
@@ -349,6 +429,47 @@ TraceLoader::fetchFrameContents(ApiTraceFrame *currentFrame)
     return QVector<ApiTraceCall*>();
 }
 
+void TraceLoader::fetchFrameChunk(ApiTraceFrame *frame, int chunk)
+{
+    Q_ASSERT(frame->isWindowed());
+
+    const FrameBookmark &frameBookmark = m_frameBookmarks[frame->number];
+    if (chunk < 0 || chunk >= frameBookmark.chunks.count()) {
+        return;
+    }
+
+    m_parser.setBookmark(frameBookmark.chunks[chunk]);
+
+    /*
+     * Parsing might start before the chunk, to pick up the calls which
+     * straddle its start, so keep only the calls in the chunk's rows, and
+     * stop once they are all found, or the frame ended.
+     */
+    int firstRow = chunk * ApiTraceFrame::CallsPerChunk;
+    int endRow = qMin(firstRow + ApiTraceFrame::CallsPerChunk,
+                      frameBookmark.numberOfCalls);
+    QVector<ApiTraceCall*> calls;
+    calls.reserve(endRow - firstRow);
+
+    trace::Call *call;
+    while (calls.count() < endRow - firstRow &&
+           (call = m_parser.parse_call())) {
+        int row = frame->rowForCallIndex(call->no);
+        if (row >= firstRow && row < endRow) {
+            ApiTraceCall *apiCall = apiCallFromTraceCall(call, m_helpHash,
+                                                         frame, 0, this);
+            calls.append(apiCall);
+        }
+        bool endFrame = row == frameBookmark.numberOfCalls - 1;
+        delete call;
+        if (endFrame) {
+            break;
+        }
+    }
+
+    emit frameChunkLoaded(frame, chunk, calls);
+}
+
 void TraceLoader::findFrameStart(ApiTraceFrame *frame)
 {
     if (!frame->isLoaded()) {
@@ -369,6 +490,14 @@ void TraceLoader::findCallIndex(int index)
 {
     int frameIdx = callInFrame(index);
     ApiTraceFrame *frame = m_createdFrames[frameIdx];
+    if (frame->isWindowed()) {
+        int row = frame->rowForCallIndex(index);
+        if (row >= 0) {
+            fetchFrameChunk(frame, ApiTraceFrame::chunkForRow(row));
+            emit foundWindowedCallIndex(frame, index);
+        }
+        return;
+    }
     QVector<ApiTraceCall*> calls = fetchFrameContents(frame);
     QVector<ApiTraceCall*>::const_iterator itr;
     ApiTraceCall *call = 0;
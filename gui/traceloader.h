@@ -50,6 +50,7 @@ private:
 public slots:
     void loadTrace(const QString &filename);
     void loadFrame(ApiTraceFrame *frame);
+    void loadFrameChunk(ApiTraceFrame *frame, int chunk);
     void findFrameStart(ApiTraceFrame *frame);
     void findFrameEnd(ApiTraceFrame *frame);
     void findCallIndex(int index);
@@ -67,6 +68,8 @@ signals:
                              const QVector<ApiTraceCall*> &topLevelItems,
                              const QVector<ApiTraceCall*> &calls,
                              quint64 binaryDataSize);
+    void frameChunkLoaded(ApiTraceFrame *frame, int chunk,
+                          const QVector<ApiTraceCall*> &calls);
 
     void searchResult(const ApiTrace::SearchRequest &request,
                       ApiTrace::SearchResult result,
@@ -74,6 +77,15 @@ signals:
     void foundFrameStart(ApiTraceFrame *frame);
     void foundFrameEnd(ApiTraceFrame *frame);
     void foundCallIndex(ApiTraceCall *call);
+
+    /*
+     * Windowed frames own and evict their calls on the GUI thread, so
+     * results in them are reported by call number, and resolved there after
+     * the chunk holding them was delivered.
+     */
+    void windowedSearchResult(const ApiTrace::SearchRequest &request,
+                              ApiTraceFrame *frame, int callIndex);
+    void foundWindowedCallIndex(ApiTraceFrame *frame, int callIndex);
 private:
     struct FrameBookmark {
         FrameBookmark()
@@ -86,6 +98,12 @@ private:
 
         trace::ParseBookmark start;
         int numberOfCalls;
+        /*
+         * Where to start parsing each chunk of ApiTraceFrame::CallsPerChunk
+         * calls from, for windowed frames only.  Calls which started before
+         * their chunk (on other threads) are decoded from an earlier point.
+         */
+        QVector<trace::ParseBookmark> chunks;
     };
     int numberOfFrames() const;
     int numberOfCallsInFrame(int frameIdx) const;
@@ -93,6 +111,9 @@ private:
     void loadHelpFile();
     void guessApi(const trace::Call *call);
     void scanTrace();
+    void setWindowed(ApiTraceFrame *frame, FrameBookmark &frameBookmark,
+                     const QVector<unsigned> &callIndices,
+                     const QVector<trace::ParseBookmark> &chunkBookmarks);
 
     void searchNext(const ApiTrace::SearchRequest &request);
     void searchPrev(const ApiTrace::SearchRequest &request);
@@ -103,6 +124,9 @@ private:
                       Qt::CaseSensitivity sensitivity,
                       bool useRegex);
      QVector<ApiTraceCall*> fetchFrameContents(ApiTraceFrame *frame);
+     void fetchFrameChunk(ApiTraceFrame *frame, int chunk);
+     bool emitFoundCall(const ApiTrace::SearchRequest &request,
+                        int frameIdx, unsigned callIndex);
      bool searchCallsBackwards(const QList<trace::Call*> &calls,
                                int frameIdx,
                                const ApiTrace::SearchRequest &request);
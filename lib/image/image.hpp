@@ -128,8 +128,10 @@ public:
     void
     writeMD5(std::ostream &os) const;
 
+    // When compress is false the image is stored (zlib level 0, no row
+    // filtering), trading size for encoding speed.
     bool
-    writePNG(std::ostream &os, bool strip_alpha = false) const;
+    writePNG(std::ostream &os, bool strip_alpha = false, bool compress = true) const;
 
     bool
     writePNG(const char *filename, bool strip_alpha = false) const;
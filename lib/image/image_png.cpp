@@ -84,7 +84,7 @@ floatToSRGB(float c)
 
 
 bool
-Image::writePNG(std::ostream &os, bool strip_alpha) const
+Image::writePNG(std::ostream &os, bool strip_alpha, bool compress) const
 {
     png_structp png_ptr;
     png_infop info_ptr;
@@ -129,7 +129,12 @@ Image::writePNG(std::ostream &os, bool strip_alpha) const
                  color_type, PNG_INTERLACE_NONE,
                  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
 
-    png_set_compression_level(png_ptr, png_compression_level);
+    if (compress) {
+        png_set_compression_level(png_ptr, png_compression_level);
+    } else {
+        png_set_compression_level(png_ptr, Z_NO_COMPRESSION);
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+    }
 
     png_write_info(png_ptr, info_ptr);
 
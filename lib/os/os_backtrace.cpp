@@ -32,15 +32,20 @@
 
 #include "os_backtrace.hpp"
 
+#include <map>
 #include <set>
 #include <vector>
 #include "os.hpp"
+#include "os_string.hpp"
 
 #if HAVE_BACKTRACE
 #  include <stdint.h>
 #  include <dlfcn.h>
+#  include <link.h>
 #  include <unistd.h>
+#  include <algorithm>
 #  include <map>
+#  include <string>
 #  include <vector>
 #  include <cxxabi.h>
 #  include <backtrace.h>
@@ -77,49 +82,86 @@ struct pstring {
 
 class StringPrefixes {
 private:
-    std::set<pstring> pset;
+    std::map<pstring, BacktraceSampling> pmap;
+    char *list;
 
-    void addPrefix(char* startbuf, int n) {
-        std::set<pstring>::iterator elem = pset.find(pstring(startbuf, n));
-        bool replace = elem != pset.end() && n < elem->n;
+    void addPrefix(char* startbuf, int n, const BacktraceSampling &sampling) {
+        std::map<pstring, BacktraceSampling>::iterator elem = pmap.find(pstring(startbuf, n));
+        bool replace = elem != pmap.end() && n < elem->first.n;
         if (replace) {
-            pset.erase(elem);
+            pmap.erase(elem);
         }
-        if (replace || elem == pset.end()) {
-            pset.insert(pstring(startbuf, n));
+        if (replace || elem == pmap.end()) {
+            pmap.emplace(pstring(startbuf, n), sampling);
         }
     }
+
+    static bool parseSampling(const char *str, BacktraceSampling &sampling) {
+        char *end;
+        unsigned long value = strtoul(str, &end, 10);
+        if (end == str || value == 0) {
+            return false;
+        }
+        if (strcmp(end, "ms") == 0) {
+            sampling.milliseconds = value;
+            return true;
+        }
+        if (*end == '\0') {
+            sampling.calls = value;
+            return true;
+        }
+        return false;
+    }
 public:
     StringPrefixes();
 
-    bool contain(const char* s) {
-        return pset.find(pstring(s, strlen(s) + 1)) != pset.end();
+    bool contain(const char* s, BacktraceSampling *sampling) {
+        std::map<pstring, BacktraceSampling>::iterator elem = pmap.find(pstring(s, strlen(s) + 1));
+        if (elem == pmap.end()) {
+            return false;
+        }
+        if (sampling) {
+            *sampling = elem->second;
+        }
+        return true;
     }
 };
 
-StringPrefixes::StringPrefixes() {
-    char *list = getenv("APITRACE_BACKTRACE");
-    if (!list)
+StringPrefixes::StringPrefixes() :
+    list(nullptr)
+{
+    const char *env = getenv("APITRACE_BACKTRACE");
+    if (!env)
         return;
-    list = strdup(list);
+    // The prefixes point into this copy, so it must outlive them
+    list = strdup(env);
     for (char *t = list; ; t = NULL) {
         char *tok = strtok(t, " \t\r\n");
         if (!tok)
             break;
         if (tok[0] == '#')
             continue;
+        BacktraceSampling sampling;
+        char *at = strchr(tok, '@');
+        if (at) {
+            *at = '\0';
+            if (!parseSampling(at + 1, sampling)) {
+                os::log("apitrace: warning: ignoring invalid backtrace sampling `%s` for %s\n", at + 1, tok);
+            }
+        }
+        if (tok[0] == '\0')
+            continue;
         if (tok[strlen(tok) - 1] == '*')
-            addPrefix(tok, strlen(tok) - 1);
+            addPrefix(tok, strlen(tok) - 1, sampling);
         else
-            addPrefix(tok, strlen(tok) + 1);
+            addPrefix(tok, strlen(tok) + 1, sampling);
     }
-    free(list);
 }
 
 
-bool backtrace_is_needed(const char* fname) {
+bool backtrace_is_needed(const char* fname, BacktraceSampling *sampling) {
     static StringPrefixes backtraceFunctionNamePrefixes;
-    return backtraceFunctionNamePrefixes.contain(fname);
+    return backtraceFunctionNamePrefixes.contain(fname, sampling);
 }
 
 #if HAVE_BACKTRACE
@@ -175,6 +217,83 @@ static void dumpFrame(const RawStackFrame &frame)
 
 #define BT_DEPTH 10
 
+
+/*
+ * Address ranges of the loaded modules, so that raw PCs can be made relative
+ * to their module without dladdr nor any symbol lookups.
+ */
+class ModuleMap {
+    struct Range {
+        uintptr_t start;
+        uintptr_t end;
+        uintptr_t bias;
+        const char *name;
+
+        bool operator < (const Range &other) const {
+            return start < other.start;
+        }
+    };
+
+    std::vector<Range> ranges;
+    std::set<std::string> names;
+
+    static int phdr_callback(struct dl_phdr_info *info, size_t size, void *data)
+    {
+        ModuleMap *this_ = (ModuleMap *)data;
+        const char *name = info->dlpi_name;
+        os::String processName;
+        if (!name || !name[0]) {
+            processName = os::getProcessName();
+            name = processName.str();
+        }
+        name = this_->names.insert(name).first->c_str();
+        for (int i = 0; i < info->dlpi_phnum; ++i) {
+            const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+            if (phdr.p_type == PT_LOAD) {
+                Range range;
+                range.start = info->dlpi_addr + phdr.p_vaddr;
+                range.end = range.start + phdr.p_memsz;
+                range.bias = info->dlpi_addr;
+                range.name = name;
+                this_->ranges.push_back(range);
+            }
+        }
+        return 0;
+    }
+
+    const Range *lookup(uintptr_t pc) const
+    {
+        Range key;
+        key.start = pc;
+        auto it = std::upper_bound(ranges.begin(), ranges.end(), key);
+        if (it == ranges.begin()) {
+            return nullptr;
+        }
+        --it;
+        return pc < it->end ? &*it : nullptr;
+    }
+
+public:
+    bool fill(RawStackFrame *frame, uintptr_t pc)
+    {
+        const Range *range = lookup(pc);
+        if (!range) {
+            // Possibly a module loaded since last time
+            ranges.clear();
+            dl_iterate_phdr(phdr_callback, this);
+            std::sort(ranges.begin(), ranges.end());
+            range = lookup(pc);
+        }
+        if (!range) {
+            return false;
+        }
+        frame->module = range->name;
+        frame->offset = pc - range->bias;
+        return true;
+    }
+};
+
+
 class libbacktraceProvider {
     struct backtrace_state *state;
     int skipFrames;
@@ -184,6 +303,10 @@ class libbacktraceProvider {
     RawStackFrame *current_frame;
     bool missingDwarf;
 
+    // Record module relative addresses only, leaving symbolization for later
+    bool deferred;
+    ModuleMap modules;
+
     static void bt_err_callback(void *vdata, const char *msg, int errnum)
     {
         libbacktraceProvider *this_ = (libbacktraceProvider*)vdata;
@@ -242,7 +365,14 @@ class libbacktraceProvider {
     {
         libbacktraceProvider *this_ = (libbacktraceProvider*)vdata;
         std::vector<RawStackFrame> &frames = this_->cache[pc];
-        if (!frames.size()) {
+        if (!frames.size() && this_->deferred) {
+            RawStackFrame frame;
+            if (!this_->modules.fill(&frame, pc)) {
+                frame.offset = pc;
+            }
+            frame.id = this_->nextFrameId++;
+            frames.push_back(frame);
+        } else if (!frames.size()) {
             RawStackFrame frame;
             dl_fill(&frame, pc);
             this_->current_frame = &frame;
@@ -285,7 +415,8 @@ class libbacktraceProvider {
 
 public:
     libbacktraceProvider():
-        state(backtrace_create_state(NULL, 0, bt_err_callback, NULL))
+        state(backtrace_create_state(NULL, 0, bt_err_callback, NULL)),
+        deferred(getenv("APITRACE_BACKTRACE_DEFERRED") != NULL)
     {
         backtrace_simple(state, 0, bt_countskip, bt_err_callback, this);
     }
@@ -315,6 +446,149 @@ void dump_backtrace() {
 }
 
 
+/*
+ * Offline symbolization of deferred backtraces, through a libbacktrace state
+ * per module file.
+ */
+class Symbolizer {
+    std::vector<RawStackFrame> *frames;
+    const char *module;
+    const char *symbol;
+    uintptr_t symbolAddress;
+
+    static void err_callback(void *vdata, const char *msg, int errnum)
+    {
+        // errnum == -1 means no debug info, which is fine
+        if (errnum > 0) {
+            os::log("libbacktrace: %s: %s\n", msg, strerror(errnum));
+        } else if (errnum == 0) {
+            os::log("libbacktrace: %s\n", msg);
+        }
+    }
+
+    static void syminfo_callback(void *vdata, uintptr_t pc,
+                                 const char *symname, uintptr_t symval, uintptr_t symsize)
+    {
+        Symbolizer *this_ = (Symbolizer *)vdata;
+        if (symname) {
+            this_->symbol = symname;
+            this_->symbolAddress = symval;
+        }
+    }
+
+    static int pcinfo_callback(void *vdata, uintptr_t pc,
+                               const char *file, int line, const char *func)
+    {
+        Symbolizer *this_ = (Symbolizer *)vdata;
+        if (!file && !func) {
+            return 0;
+        }
+        RawStackFrame frame;
+        frame.module = this_->module;
+        frame.filename = file ? strdup(file) : NULL;
+        frame.linenumber = file ? line : -1;
+        frame.function = demangle(func);
+        this_->frames->push_back(frame);
+        return 0;
+    }
+
+    static const char *demangle(const char *name)
+    {
+        if (!name) {
+            return NULL;
+        }
+        int status;
+        char *demangled = abi::__cxa_demangle(name, NULL, NULL, &status);
+        return demangled ? demangled : strdup(name);
+    }
+
+    /*
+     * libbacktrace treats the file it is given as this process' executable,
+     * so when it is position independent it gets relocated to where our own
+     * executable was loaded.
+     */
+    static uintptr_t executable_bias(const char *filename)
+    {
+        ElfW(Ehdr) ehdr;
+        FILE *fp = fopen(filename, "rb");
+        if (!fp) {
+            return 0;
+        }
+        size_t read = fread(&ehdr, sizeof ehdr, 1, fp);
+        fclose(fp);
+        if (read != 1 || ehdr.e_type != ET_DYN) {
+            return 0;
+        }
+
+        struct Callback {
+            static int call(struct dl_phdr_info *info, size_t size, void *data) {
+                *(uintptr_t *)data = info->dlpi_addr;
+                return 1;
+            }
+        };
+        uintptr_t bias = 0;
+        dl_iterate_phdr(Callback::call, &bias);
+        return bias;
+    }
+
+    struct Module {
+        struct backtrace_state *state;
+        uintptr_t bias;
+    };
+    std::map<std::string, Module> modules;
+
+public:
+    bool symbolize(const char *_module, uintptr_t offset,
+                   std::vector<RawStackFrame> &_frames)
+    {
+        auto it = modules.find(_module);
+        if (it == modules.end()) {
+            Module module;
+            module.state = backtrace_create_state(_module, 0, err_callback, NULL);
+            module.bias = executable_bias(_module);
+            it = modules.emplace(_module, module).first;
+        }
+        struct backtrace_state *state = it->second.state;
+        if (!state) {
+            return false;
+        }
+        uintptr_t pc = offset + it->second.bias;
+
+        module = _module;
+        frames = &_frames;
+        symbol = NULL;
+        symbolAddress = 0;
+
+        size_t first = _frames.size();
+        backtrace_syminfo(state, pc, syminfo_callback, err_callback, this);
+        backtrace_pcinfo(state, pc, pcinfo_callback, err_callback, this);
+
+        if (_frames.size() == first) {
+            if (!symbol) {
+                return false;
+            }
+            RawStackFrame frame;
+            frame.module = module;
+            frame.function = demangle(symbol);
+            _frames.push_back(frame);
+        }
+
+        // The outermost frame is the actual function containing the address
+        if (symbol) {
+            _frames.back().offset = pc - symbolAddress;
+        }
+        return true;
+    }
+};
+
+
+bool symbolize_frame(const char *module, unsigned long long offset,
+                     std::vector<RawStackFrame> &frames) {
+    static Symbolizer symbolizer;
+    return symbolizer.symbolize(module, offset, frames);
+}
+
+
 #else /* !HAVE_BACKTRACE */
 
 std::vector<RawStackFrame> get_backtrace() {
@@ -324,6 +598,11 @@ std::vector<RawStackFrame> get_backtrace() {
 void dump_backtrace() {
 }
 
+bool symbolize_frame(const char *module, unsigned long long offset,
+                     std::vector<RawStackFrame> &frames) {
+    return false;
+}
+
 #endif
 
 
@@ -35,10 +35,35 @@ namespace os {
 using trace::RawStackFrame;
 
 
+/*
+ * How often to take backtraces of a function, as given by an `@N` (every Nth
+ * call) or `@Nms` (at most once every N milliseconds) suffix on its
+ * APITRACE_BACKTRACE entry.
+ */
+struct BacktraceSampling {
+    unsigned calls = 1;
+    unsigned milliseconds = 0;
+};
+
 std::vector<RawStackFrame> get_backtrace();
-bool backtrace_is_needed(const char* fname);
+
+/*
+ * Whether APITRACE_BACKTRACE matches the function.  This is meant to be
+ * resolved once per function, not on every call.
+ */
+bool backtrace_is_needed(const char* fname, BacktraceSampling *sampling = nullptr);
 
 void dump_backtrace();
 
+/*
+ * Symbolize an address relative to the load bias of the given module, as
+ * recorded when APITRACE_BACKTRACE_DEFERRED is set, appending one frame per
+ * (inlined) function, innermost first.  The appended frames' module is the
+ * given pointer, while their function and filename are malloc'ed and owned
+ * by the caller.  Returns false when the address can't be symbolized.
+ */
+bool symbolize_frame(const char *module, unsigned long long offset,
+                     std::vector<RawStackFrame> &frames);
+
 
 } /* namespace os */
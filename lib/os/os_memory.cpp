@@ -0,0 +1,112 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Process memory usage measurement.
+ */
+
+
+#include "os_memory.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace os {
+
+
+#ifdef __linux__
+
+static const char *
+parseNumber(const char *p, long long &value)
+{
+    while (*p == ' ') {
+        ++p;
+    }
+    if (*p < '0' || *p > '9') {
+        return nullptr;
+    }
+    value = 0;
+    while (*p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+    return p;
+}
+
+bool
+getMemoryUsage(MemoryUsage &usage)
+{
+    /*
+     * Keep the file open and re-read it from the start with pread, instead
+     * of opening and scanning /proc/self/stat on every query, as procps'
+     * look_up_our_self() did.
+     */
+    static const int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    static const long long pageSize = sysconf(_SC_PAGESIZE);
+
+    usage.vsize = 0;
+    usage.rss = 0;
+
+    if (fd < 0) {
+        return false;
+    }
+
+    // size resident shared text lib data dt
+    char buf[128];
+    ssize_t length = pread(fd, buf, sizeof buf - 1, 0);
+    if (length <= 0) {
+        return false;
+    }
+    buf[length] = 0;
+
+    long long size, resident;
+    const char *p = parseNumber(buf, size);
+    if (!p || !parseNumber(p, resident)) {
+        return false;
+    }
+
+    usage.vsize = size * pageSize;
+    usage.rss = resident;
+    return true;
+}
+
+#else
+
+bool
+getMemoryUsage(MemoryUsage &usage)
+{
+    usage.vsize = 0;
+    usage.rss = 0;
+    return false;
+}
+
+#endif
+
+
+} /* namespace os */
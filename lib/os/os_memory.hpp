@@ -25,46 +25,40 @@
  **************************************************************************/
 
 /*
- * Simple OS time measurement abstraction.
+ * Process memory usage measurement.
  */
 
 #pragma once
 
-#ifdef HAVE_READPROC_H
-#include <proc/readproc.h>
-#endif
-
 namespace os {
 
-#if defined(HAVE_READPROC_H)
+    struct MemoryUsage {
+        long long vsize; /* bytes */
+        long long rss;   /* pages */
+    };
 
-    inline long long
-    getVsize(void) {
-        proc_t proc;
-        look_up_our_self(&proc);
-        return proc.vsize;
-    }
-
-    inline long long
-    getRss(void) {
-        proc_t proc;
-        look_up_our_self(&proc);
-        return proc.rss;
-    }
-
-#else
+    /*
+     * Get the virtual and resident set sizes with a single query.
+     *
+     * On Linux this reads /proc/self/statm through a file descriptor which is
+     * kept open, so it is cheap enough to be called around every call.
+     * Returns false (and zeroes) where unsupported.
+     */
+    bool
+    getMemoryUsage(MemoryUsage &usage);
 
     inline long long
     getVsize(void) {
-        return 0;
+        MemoryUsage usage;
+        getMemoryUsage(usage);
+        return usage.vsize;
     }
 
     inline long long
     getRss(void) {
-        return 0;
+        MemoryUsage usage;
+        getMemoryUsage(usage);
+        return usage.rss;
     }
 
-#endif
-
 } /* namespace os */
-
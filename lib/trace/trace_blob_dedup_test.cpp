@@ -0,0 +1,232 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_parser.hpp"
+#include "trace_test_helpers.hpp"
+
+using namespace trace;
+
+
+// Blob contents for call i, where only a handful of distinct blobs repeat
+static std::vector<char>
+blobData(unsigned i)
+{
+    std::vector<char> data(4096 + (i % 3) * 100);
+    for (size_t j = 0; j < data.size(); ++j) {
+        data[j] = char(j * 7 + (i % 3));
+    }
+    // A small blob, which is never deduplicated
+    if (i % 5 == 4) {
+        data.resize(16);
+    }
+    return data;
+}
+
+
+static std::string
+writeTrace(const char *path, unsigned num_calls, bool dedup)
+{
+    Writer writer;
+    writer.setBlobDedup(dedup);
+    EXPECT_TRUE(writer.open(path, TRACE_VERSION, Properties()));
+    writeUploads(writer, num_calls, blobData);
+
+    return path;
+}
+
+
+static void
+expectBlob(Call *call)
+{
+    ASSERT_TRUE(call != nullptr);
+    ASSERT_EQ(1U, call->args.size());
+    const Blob *blob = call->arg(0).toBlob();
+    ASSERT_TRUE(blob != nullptr);
+
+    std::vector<char> data = blobData(call->no);
+    ASSERT_EQ(data.size(), blob->size);
+    EXPECT_EQ(0, memcmp(data.data(), blob->buf, blob->size)) << "call " << call->no;
+}
+
+
+static long
+fileSize(const std::string &path)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+
+TEST(trace_blob_dedup, roundtrip)
+{
+    const unsigned num_calls = 100;
+    std::string plain = writeTrace("trace_blob_dedup_test_plain.trace", num_calls, false);
+    std::string dedup = writeTrace("trace_blob_dedup_test.trace", num_calls, true);
+
+    EXPECT_LT(fileSize(dedup), fileSize(plain));
+
+    Parser parser;
+    ASSERT_TRUE(parser.open(dedup.c_str()));
+    unsigned count = 0;
+    Call *call;
+    while ((call = parser.parse_call())) {
+        expectBlob(call);
+        delete call;
+        ++count;
+    }
+    EXPECT_EQ(num_calls, count);
+    parser.close();
+
+    remove(plain.c_str());
+    remove(dedup.c_str());
+}
+
+
+// Traces without blob references keep the format older readers understand
+TEST(trace_blob_dedup, version)
+{
+    const unsigned num_calls = 20;
+    std::string plain = writeTrace("trace_blob_dedup_test_plain.trace", num_calls, false);
+    std::string dedup = writeTrace("trace_blob_dedup_test.trace", num_calls, true);
+
+    Parser parser;
+    ASSERT_TRUE(parser.open(plain.c_str()));
+    EXPECT_EQ(6U, parser.getFormatVersion());
+    EXPECT_EQ(6U, parser.getVersion());
+    unsigned count = 0;
+    Call *call;
+    while ((call = parser.parse_call())) {
+        expectBlob(call);
+        delete call;
+        ++count;
+    }
+    EXPECT_EQ(num_calls, count);
+    parser.close();
+
+    ASSERT_TRUE(parser.open(dedup.c_str()));
+    EXPECT_EQ(unsigned(TRACE_VERSION), parser.getFormatVersion());
+    parser.close();
+
+    remove(plain.c_str());
+    remove(dedup.c_str());
+}
+
+
+TEST(trace_blob_dedup, bookmark)
+{
+    const unsigned num_calls = 50;
+    std::string path = writeTrace("trace_blob_dedup_test_bookmark.trace", num_calls, true);
+
+    Parser parser;
+    ASSERT_TRUE(parser.open(path.c_str()));
+    if (!parser.supportsOffsets()) {
+        return;
+    }
+
+    // Scan everything, as the GUI does, so references must be resolved by
+    // reading the definitions again
+    std::vector<ParseBookmark> bookmarks;
+    for (;;) {
+        ParseBookmark bookmark;
+        parser.getBookmark(bookmark);
+        Call *call = parser.scan_call();
+        if (!call) {
+            break;
+        }
+        bookmarks.push_back(bookmark);
+        delete call;
+    }
+    ASSERT_EQ(num_calls, bookmarks.size());
+
+    for (unsigned i = num_calls; i-- > 0; ) {
+        parser.setBookmark(bookmarks[i]);
+        Call *call = parser.parse_call();
+        expectBlob(call);
+        delete call;
+    }
+
+    parser.close();
+
+    remove(path.c_str());
+}
+
+
+class BlobSizeObserver : public Parser::ScanObserver
+{
+public:
+    unsigned count = 0;
+
+    void
+    scannedArg(const Call *call, unsigned index, size_t blobBytes, size_t stringBytes) override {
+        EXPECT_EQ(0U, index);
+        EXPECT_EQ(blobData(call->no).size(), blobBytes) << "call " << call->no;
+        EXPECT_EQ(0U, stringBytes);
+        ++count;
+    }
+};
+
+
+TEST(trace_blob_dedup, scan_observer)
+{
+    const unsigned num_calls = 50;
+    std::string path = writeTrace("trace_blob_dedup_test_scan.trace", num_calls, true);
+
+    // References report the size of the blob they refer to
+    BlobSizeObserver observer;
+    Parser parser;
+    ASSERT_TRUE(parser.open(path.c_str()));
+    parser.setScanObserver(&observer);
+    Call *call;
+    while ((call = parser.scan_call())) {
+        delete call;
+    }
+    EXPECT_EQ(num_calls, observer.count);
+    parser.close();
+
+    remove(path.c_str());
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,154 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_parser.hpp"
+#include "trace_test_helpers.hpp"
+
+using namespace trace;
+
+
+static const FunctionSig
+draw_sig = { 1, "draw", 1, arg_names };
+
+
+static const char *path = "trace_call_filter_test.trace";
+
+
+// Call i is an upload on even calls, a draw on odd ones, alternating between
+// two threads every two calls.  All calls share a deduplicated blob, first
+// written by call 0.
+static void
+writeTrace(unsigned num_calls)
+{
+    std::vector<char> data(1024, 'x');
+
+    Writer writer;
+    writer.setBlobDedup(true);
+    ASSERT_TRUE(writer.open(path, TRACE_VERSION, Properties()));
+    for (unsigned i = 0; i < num_calls; ++i) {
+        writeBlobCall(writer, i % 2 ? &draw_sig : &upload_sig,
+                      data.data(), data.size(), (i / 2) % 2);
+    }
+    writer.close();
+}
+
+
+static std::vector<unsigned>
+parseTrace(const CallFilter &filter)
+{
+    std::vector<unsigned> result;
+
+    Parser parser;
+    EXPECT_TRUE(parser.open(path));
+    parser.setCallFilter(filter);
+    Call *call;
+    while ((call = parser.parse_call())) {
+        result.push_back(call->no);
+
+        const Blob *blob = call->arg(0).toBlob();
+        EXPECT_TRUE(blob != nullptr);
+        if (blob) {
+            EXPECT_EQ(1024U, blob->size);
+            EXPECT_EQ('x', blob->buf[blob->size - 1]);
+        }
+
+        delete call;
+    }
+
+    return result;
+}
+
+
+TEST(trace_call_filter, signature)
+{
+    writeTrace(20);
+
+    unsigned evaluations = 0;
+    CallFilter filter;
+    filter.signature = [&] (const FunctionSig *sig, CallFlags) {
+        ++evaluations;
+        return strcmp(sig->name, "draw") == 0;
+    };
+
+    std::vector<unsigned> calls = parseTrace(filter);
+    ASSERT_EQ(10U, calls.size());
+    for (unsigned i = 0; i < calls.size(); ++i) {
+        EXPECT_EQ(2 * i + 1, calls[i]);
+    }
+
+    // Cached per signature
+    EXPECT_EQ(2U, evaluations);
+
+    remove(path);
+}
+
+
+TEST(trace_call_filter, call)
+{
+    writeTrace(20);
+
+    CallFilter filter;
+    filter.call = [] (const FunctionSig *, unsigned thread_id, unsigned call_no, CallFlags) {
+        return thread_id == 1 && call_no != 6;
+    };
+
+    std::vector<unsigned> calls = parseTrace(filter);
+    std::vector<unsigned> expected = { 2, 3, 7, 10, 11, 14, 15, 18, 19 };
+    EXPECT_EQ(expected, calls);
+
+    remove(path);
+}
+
+
+TEST(trace_call_filter, last)
+{
+    writeTrace(20);
+
+    CallFilter filter;
+    filter.last = 4;
+
+    std::vector<unsigned> calls = parseTrace(filter);
+    std::vector<unsigned> expected = { 0, 1, 2, 3, 4 };
+    EXPECT_EQ(expected, calls);
+
+    remove(path);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -27,15 +27,176 @@
 #include <assert.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 
 #include <trace_callset.hpp>
 
+#include "os_thread.hpp"
+
 using namespace trace;
 
 
+/*
+ * Lookup cursors of a thread, one for each of the last few indices it
+ * looked up, as replaying checks several call sets for every call.
+ */
+struct CallRangeCursor {
+    unsigned long long generation = 0;
+    CallNo callNo = 0;
+    size_t next = 0;
+    std::vector<size_t> active;
+};
+
+struct CallRangeCursors {
+    CallRangeCursor cursors[4];
+    unsigned victim = 0;
+};
+
+// Never freed, as threads doing lookups are few and long lived
+static OS_THREAD_LOCAL CallRangeCursors *threadCursors;
+
+static std::atomic<unsigned long long> generations(0);
+
+
+static CallNo
+buildMaxStop(const std::vector<CallRange> &ranges,
+             std::vector<CallNo> &maxStop,
+             size_t lo, size_t hi)
+{
+    if (lo >= hi) {
+        return std::numeric_limits<CallNo>::min();
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    CallNo stop = ranges[mid].stop;
+    stop = std::max(stop, buildMaxStop(ranges, maxStop, lo, mid));
+    stop = std::max(stop, buildMaxStop(ranges, maxStop, mid + 1, hi));
+    maxStop[mid] = stop;
+    return stop;
+}
+
+
+void
+CallRangeIndex::build(void)
+{
+    if (!dirty) {
+        return;
+    }
+    maxStop.resize(ranges.size());
+    buildMaxStop(ranges, maxStop, 0, ranges.size());
+    dirty = false;
+    generation = ++generations;
+}
+
+
+void
+CallRangeIndex::add(const CallRange & range)
+{
+    // Ranges from files are usually sorted already, so this appends
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), range,
+        [](const CallRange &a, const CallRange &b) {
+            return a.start < b.start;
+        });
+    ranges.insert(it, range);
+    dirty = true;
+}
+
+
+bool
+CallRangeIndex::search(size_t lo, size_t hi, CallNo callNo, CallFlags callFlags) const
+{
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (maxStop[mid] < callNo) {
+            // Nothing in this subtree reaches callNo
+            return false;
+        }
+        if (search(lo, mid, callNo, callFlags)) {
+            return true;
+        }
+        const CallRange &range = ranges[mid];
+        if (range.start > callNo) {
+            // Neither does anything to the right start early enough
+            return false;
+        }
+        if (range.contains(callNo, callFlags)) {
+            return true;
+        }
+        lo = mid + 1;
+    }
+    return false;
+}
+
+
+bool
+CallRangeIndex::contains(CallNo callNo, CallFlags callFlags) const
+{
+    if (dirty) {
+        for (auto &range : ranges) {
+            if (range.contains(callNo, callFlags)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    CallRangeCursors *cursors = threadCursors;
+    if (!cursors) {
+        cursors = new CallRangeCursors;
+        threadCursors = cursors;
+    }
+    // Copies of an index share its generation, as well as its ranges
+    CallRangeCursor *cursor = nullptr;
+    for (auto &c : cursors->cursors) {
+        if (c.generation == generation) {
+            cursor = &c;
+            break;
+        }
+    }
+    if (!cursor) {
+        cursor = &cursors->cursors[cursors->victim];
+        cursors->victim = (cursors->victim + 1) % 4;
+        cursor->generation = generation;
+        cursor->callNo = 0;
+        cursor->next = 0;
+        cursor->active.clear();
+    }
+
+    if (callNo < cursor->callNo) {
+        return search(0, ranges.size(), callNo, callFlags);
+    }
+
+    // Move the cursor forward
+    while (cursor->next < ranges.size() &&
+           ranges[cursor->next].start <= callNo) {
+        if (ranges[cursor->next].stop >= callNo) {
+            cursor->active.push_back(cursor->next);
+        }
+        ++cursor->next;
+    }
+    cursor->callNo = callNo;
+
+    std::vector<size_t> &active = cursor->active;
+    size_t i = 0;
+    while (i < active.size()) {
+        const CallRange &range = ranges[active[i]];
+        if (range.stop < callNo) {
+            active[i] = active.back();
+            active.pop_back();
+            continue;
+        }
+        if (range.contains(callNo, callFlags)) {
+            return true;
+        }
+        ++i;
+    }
+    return false;
+}
+
+
 // Parser class for call sets
 class CallSetParser
 {
@@ -249,6 +410,8 @@ CallSet::merge(const char *string)
             parser.parse();
         }
     }
+
+    ranges.build();
 }
 
 
@@ -258,6 +421,7 @@ CallSet::CallSet(CallFlags freq): limits(std::numeric_limits<CallNo>::min(), std
         CallNo stop = std::numeric_limits<CallNo>::max();
         CallNo step = 1;
         addRange(CallRange(start, stop, step, freq));
+        ranges.build();
         assert(!empty());
     }
 }
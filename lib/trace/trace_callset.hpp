@@ -48,7 +48,7 @@
 
 
 #include <limits>
-#include <list>
+#include <vector>
 
 #include "trace_model.hpp"
 #include "trace_fast_callset.hpp"
@@ -98,6 +98,56 @@ namespace trace {
     };
 
 
+    /*
+     * Ranges with a step or frequency, indexed for lookups.
+     *
+     * Ranges are kept sorted by start, with an implicit interval tree on top
+     * (each subtree knows the largest stop within it), so a lookup visits
+     * O(log n + k) ranges, where k is the number of ranges spanning the call.
+     *
+     * Calls are usually looked up in increasing order, so a per-thread cursor
+     * also keeps the ranges spanning the last call looked up, and advances
+     * through the sorted ranges from there.  Lookups leave the index itself
+     * untouched, so they may happen concurrently, but build() must be called
+     * after adding ranges, or lookups fall back to checking every range.
+     */
+    class CallRangeIndex
+    {
+    private:
+        std::vector<CallRange> ranges;
+
+        // Largest stop in the subtree rooted at each range
+        std::vector<CallNo> maxStop;
+        bool dirty = false;
+
+        // Identifies the built ranges to the thread cursors
+        unsigned long long generation = 0;
+
+        bool
+        search(size_t lo, size_t hi, CallNo callNo, CallFlags callFlags) const;
+
+    public:
+        inline bool
+        empty() const {
+            return ranges.empty();
+        }
+
+        inline size_t
+        size() const {
+            return ranges.size();
+        }
+
+        void
+        add(const CallRange & range);
+
+        void
+        build(void);
+
+        bool
+        contains(CallNo callNo, CallFlags callFlags) const;
+    };
+
+
     // A collection of call ranges
     class CallSet
     {
@@ -108,11 +158,7 @@ namespace trace {
     public:
         FastCallSet fast_call_set;
 
-        // TODO: use binary tree to speed up lookups, (less important
-        // now that we are using FastCallSet for ranges without step
-        // or freq).
-        typedef std::list< CallRange > RangeList;
-        RangeList ranges;
+        CallRangeIndex ranges;
 
         CallSet(): limits(std::numeric_limits<CallNo>::min(), std::numeric_limits<CallNo>::max()), firstmerge(true) {}
 
@@ -146,30 +192,21 @@ namespace trace {
                 if (range.step == 1 && range.freq == FREQUENCY_ALL) {
                     fast_call_set.add(range.start, range.stop);
                 } else {
-                    RangeList::iterator it = ranges.begin();
-                    while (it != ranges.end() && it->start < range.start) {
-                        ++it;
-                    }
-
-                    ranges.insert(it, range);
+                    ranges.add(range);
                 }
             }
         }
 
         inline bool
         contains(CallNo callNo, CallFlags callFlags = FREQUENCY_ALL) const {
-            if (empty()) {
+            if (empty() ||
+                callNo < limits.start ||
+                callNo > limits.stop) {
                 return false;
             }
             if (fast_call_set.contains(callNo))
                 return true;
-            RangeList::const_iterator it;
-            for (it = ranges.begin(); it != ranges.end() && it->start <= callNo; ++it) {
-                if (it->contains(callNo, callFlags)) {
-                    return true;
-                }
-            }
-            return false;
+            return !ranges.empty() && ranges.contains(callNo, callFlags);
         }
 
         inline bool
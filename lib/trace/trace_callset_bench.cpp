@@ -0,0 +1,152 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+/*
+ * Micro-benchmark of trace::CallSet lookups, for large call sets read from a
+ * file, with stepped and frequency ranges, as generated by scripts.
+ *
+ * The same lookups are timed on a plain list scan, as CallSet used to do, for
+ * comparison.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "os_time.hpp"
+#include "trace_callset.hpp"
+
+
+using namespace trace;
+
+
+static bool
+listContains(const std::list<CallRange> &ranges, CallNo callNo, CallFlags callFlags)
+{
+    for (auto it = ranges.begin(); it != ranges.end() && it->start <= callNo; ++it) {
+        if (it->contains(callNo, callFlags)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static const CallFlags
+callFlags[] = { 0, 0, 0, CALL_FLAG_RENDER, 0, 0, 0, CALL_FLAG_END_FRAME };
+
+
+template< class Func >
+static void
+bench(const char *name, const std::vector<CallNo> &calls, Func func)
+{
+    unsigned found = 0;
+    long long start = os::getTime();
+    for (size_t i = 0; i < calls.size(); ++i) {
+        found += func(calls[i], callFlags[i % 8]);
+    }
+    long long end = os::getTime();
+
+    double ns = double(end - start) * 1.0e9 / double(os::timeFrequency) / calls.size();
+    printf("%-32s %10.1f ns/lookup %8u found\n", name, ns, found);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    unsigned numRanges = 50000;
+    if (argc > 1) {
+        numRanges = atoi(argv[1]);
+    }
+
+    const char *filename = "trace_callset_bench.txt";
+    FILE *fp = fopen(filename, "wt");
+    if (!fp) {
+        fprintf(stderr, "error: failed to create %s\n", filename);
+        return 1;
+    }
+    std::list<CallRange> list;
+    std::mt19937 rng(0);
+    for (unsigned i = 0; i < numRanges; ++i) {
+        CallNo start = i * 100 + rng() % 50;
+        if (i % 3 == 0) {
+            fprintf(fp, "%u/draw\n", start);
+            list.emplace_back(start, start, 1, FREQUENCY_RENDER);
+        } else {
+            CallNo stop = start + rng() % 500;
+            CallNo step = 2 + rng() % 4;
+            fprintf(fp, "%u-%u/%u\n", start, stop, step);
+            list.emplace_back(start, stop, step);
+        }
+    }
+    fclose(fp);
+    list.sort([](const CallRange &a, const CallRange &b) { return a.start < b.start; });
+
+    CallSet set;
+    long long start = os::getTime();
+    set.merge((std::string("@") + filename).c_str());
+    long long end = os::getTime();
+    remove(filename);
+    printf("parsed %u ranges in %.1f ms\n", numRanges,
+           double(end - start) * 1.0e3 / double(os::timeFrequency));
+
+    CallNo maxCallNo = numRanges * 100;
+
+    std::vector<CallNo> sequential(maxCallNo);
+    for (CallNo callNo = 0; callNo < maxCallNo; ++callNo) {
+        sequential[callNo] = callNo;
+    }
+    std::vector<CallNo> random(1000000);
+    for (auto &callNo : random) {
+        callNo = rng() % maxCallNo;
+    }
+
+    // The list scan is quadratic, so only time a prefix and a sample
+    std::vector<CallNo> sequentialSample(sequential.begin(), sequential.begin() + std::min<size_t>(maxCallNo, 200000));
+    std::vector<CallNo> randomSample(random.begin(), random.begin() + 2000);
+
+    auto setContains = [&set](CallNo callNo, CallFlags flags) {
+        return set.contains(callNo, flags);
+    };
+    auto listContainsFunc = [&list](CallNo callNo, CallFlags flags) {
+        return listContains(list, callNo, flags);
+    };
+
+    bench("CallSet sequential", sequential, setContains);
+    bench("CallSet random", random, setContains);
+    bench("list scan sequential (prefix)", sequentialSample, listContainsFunc);
+    bench("list scan random (sample)", randomSample, listContainsFunc);
+
+    return 0;
+}
@@ -0,0 +1,216 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_callset.hpp"
+
+using namespace trace;
+
+
+// Reference implementation, checking every range
+static bool
+referenceContains(const std::vector<CallRange> &ranges, CallNo callNo, CallFlags callFlags)
+{
+    for (auto &range : ranges) {
+        if (range.contains(callNo, callFlags)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static CallRange
+randomRange(std::mt19937 &rng, CallNo maxCallNo)
+{
+    static const CallFlags freqs[] = {
+        FREQUENCY_ALL, FREQUENCY_FRAME, FREQUENCY_RENDERTARGET, FREQUENCY_RENDER
+    };
+    CallNo start = rng() % maxCallNo;
+    CallNo stop = start + rng() % (rng() % 4 ? 50 : maxCallNo);
+    CallNo step = 1 + rng() % 5;
+    CallFlags freq = freqs[rng() % 4];
+    return CallRange(start, stop, step, freq);
+}
+
+
+static CallFlags
+randomFlags(std::mt19937 &rng)
+{
+    static const CallFlags flags[] = {
+        0, CALL_FLAG_RENDER, CALL_FLAG_END_FRAME, CALL_FLAG_SWAP_RENDERTARGET
+    };
+    return flags[rng() % 4];
+}
+
+
+TEST(trace_callset, random)
+{
+    std::mt19937 rng(42);
+    const CallNo maxCallNo = 5000;
+
+    for (unsigned iteration = 0; iteration < 20; ++iteration) {
+        CallSet set(FREQUENCY_NONE);
+        std::vector<CallRange> reference;
+        unsigned numRanges = 1 + rng() % 200;
+        for (unsigned i = 0; i < numRanges; ++i) {
+            CallRange range = randomRange(rng, maxCallNo);
+            set.addRange(range);
+            reference.push_back(range);
+        }
+        set.ranges.build();
+
+        // Sequential lookups, as done while replaying
+        for (CallNo callNo = 0; callNo < maxCallNo * 2; ++callNo) {
+            CallFlags flags = randomFlags(rng);
+            ASSERT_EQ(referenceContains(reference, callNo, flags),
+                      set.contains(callNo, flags)) << "call " << callNo;
+        }
+
+        // Random lookups
+        for (unsigned i = 0; i < 2000; ++i) {
+            CallNo callNo = rng() % (maxCallNo * 2);
+            CallFlags flags = randomFlags(rng);
+            ASSERT_EQ(referenceContains(reference, callNo, flags),
+                      set.contains(callNo, flags)) << "call " << callNo;
+        }
+
+        // Adding ranges after lookups, both before and after rebuilding
+        CallRange range = randomRange(rng, maxCallNo);
+        set.addRange(range);
+        reference.push_back(range);
+        for (CallNo callNo = 0; callNo < maxCallNo * 2; callNo += 3) {
+            ASSERT_EQ(referenceContains(reference, callNo, CALL_FLAG_RENDER),
+                      set.contains(callNo, CALL_FLAG_RENDER)) << "call " << callNo;
+        }
+        set.ranges.build();
+        for (CallNo callNo = 0; callNo < maxCallNo * 2; callNo += 3) {
+            ASSERT_EQ(referenceContains(reference, callNo, CALL_FLAG_RENDER),
+                      set.contains(callNo, CALL_FLAG_RENDER)) << "call " << callNo;
+        }
+    }
+}
+
+
+// Lookups from several threads at once, as done by `apitrace dump --jobs`
+TEST(trace_callset, concurrent)
+{
+    std::mt19937 rng(7);
+    const CallNo maxCallNo = 20000;
+
+    CallSet set(FREQUENCY_NONE);
+    CallSet other(FREQUENCY_NONE);
+    std::vector<CallRange> reference;
+    std::vector<CallRange> otherReference;
+    for (unsigned i = 0; i < 300; ++i) {
+        CallRange range = randomRange(rng, maxCallNo);
+        set.addRange(range);
+        reference.push_back(range);
+        range = randomRange(rng, maxCallNo);
+        other.addRange(range);
+        otherReference.push_back(range);
+    }
+    set.ranges.build();
+    other.ranges.build();
+
+    const unsigned numThreads = 4;
+    std::vector<unsigned> mismatches(numThreads, 0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t] () {
+            // Each thread walks its own stretch of calls, interleaving
+            // lookups of two sets, and jumping back now and then
+            for (unsigned pass = 0; pass < 3; ++pass) {
+                CallNo begin = t * maxCallNo / numThreads / 2;
+                for (CallNo callNo = begin; callNo < maxCallNo + begin; ++callNo) {
+                    CallFlags flags = callNo % 7 ? 0 : CALL_FLAG_RENDER;
+                    if (set.contains(callNo, flags) !=
+                        referenceContains(reference, callNo, flags)) {
+                        ++mismatches[t];
+                    }
+                    if (other.contains(callNo, flags) !=
+                        referenceContains(otherReference, callNo, flags)) {
+                        ++mismatches[t];
+                    }
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (unsigned t = 0; t < numThreads; ++t) {
+        EXPECT_EQ(0U, mismatches[t]) << "thread " << t;
+    }
+}
+
+
+TEST(trace_callset, file)
+{
+    const char *filename = "trace_callset_test.txt";
+    FILE *fp = fopen(filename, "wt");
+    ASSERT_TRUE(fp != nullptr);
+    for (unsigned i = 0; i < 1000; ++i) {
+        fprintf(fp, "%u-%u/3\n", i * 100, i * 100 + 30);
+    }
+    fprintf(fp, "*/frame\n");
+    fclose(fp);
+
+    CallSet set;
+    set.merge((std::string("@") + filename).c_str());
+    EXPECT_EQ(0U, set.getFirst());
+
+    EXPECT_TRUE(set.contains(0, 0));
+    EXPECT_TRUE(set.contains(99930, 0));
+    EXPECT_FALSE(set.contains(99931, 0));
+    EXPECT_TRUE(set.contains(99931, CALL_FLAG_END_FRAME));
+    EXPECT_TRUE(set.contains(500, 0));
+    EXPECT_TRUE(set.contains(503, 0));
+    EXPECT_FALSE(set.contains(531, 0));
+    EXPECT_FALSE(set.contains(200000, 0));
+    EXPECT_TRUE(set.contains(200000, CALL_FLAG_END_FRAME));
+
+    remove(filename);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -28,6 +28,8 @@
 
 #include <assert.h>
 
+#include <algorithm>
+
 
 using namespace trace;
 
@@ -67,7 +69,16 @@ int File::rawGetc()
     return c;
 }
 
-bool File::rawSkip(size_t)
+// Containers which can't skip within their cache read and discard instead
+bool File::rawSkip(size_t length)
 {
-    return false;
+    char buffer[4096];
+    while (length) {
+        size_t read = rawRead(buffer, std::min(length, sizeof buffer));
+        if (!read) {
+            return false;
+        }
+        length -= read;
+    }
+    return true;
 }
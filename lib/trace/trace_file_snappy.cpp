@@ -37,7 +37,8 @@
  *     uint32 - specifying the length of the compressed data
  *     compressed data, in little endian
  * }
- * File can contain any number of such chunks.
+ * File can contain any number of such chunks, optionally followed by a zero
+ * length and the checksums of the chunks, as described in trace_snappy.hpp.
  * The default size of an uncompressed chunk is specified in
  * SNAPPY_CHUNK_SIZE.
  *
@@ -107,7 +108,7 @@ private:
     }
     inline bool endOfData(void) const
     {
-        return m_stream.eof() && freeCacheSize() == 0;
+        return (m_endOfStream || m_stream.eof()) && freeCacheSize() == 0;
     }
     void flushWriteCache(void);
     void flushReadCache(size_t skipLength = 0);
@@ -124,6 +125,9 @@ private:
 
     uint64_t m_currentChunkOffset = 0;
     std::streampos m_endPos = 0;
+    // Set once a zero length or a bad chunk is met, so that whatever follows
+    // (e.g. the checksums) is never taken for chunks
+    bool m_endOfStream = false;
     size_t m_dataBytesRead = 0;
 };
 
@@ -160,6 +164,7 @@ bool SnappyFile::rawOpen(const char *filename)
         m_stream.seekg(0, std::ios::beg);
 
         m_dataBytesRead = 0;
+        m_endOfStream = false;
 
         // read the snappy file identifier
         unsigned char byte1, byte2;
@@ -215,11 +220,17 @@ void SnappyFile::rawClose(void)
 void SnappyFile::flushReadCache(size_t skipLength)
 {
     //assert(m_cachePtr == m_cache + m_cacheSize);
+    if (m_endOfStream) {
+        createCache(0);
+        return;
+    }
+
     m_currentChunkOffset = m_stream.tellg();
     size_t compressedLength;
     compressedLength = readCompressedLength();
     if (!compressedLength) {
         // Reached end of file
+        m_endOfStream = true;
         createCache(0);
         return;
     }
@@ -246,14 +257,19 @@ void SnappyFile::flushReadCache(size_t skipLength)
 
     if (!snappy::GetUncompressedLength(m_compressedCache, compressedLength,
                                        &m_cacheSize)) {
+        m_endOfStream = true;
         createCache(0);
         return;
     }
 
     createCache(m_cacheSize);
     if (skipLength < m_cacheSize) {
-        snappy::RawUncompress(m_compressedCache, compressedLength,
-                              m_cache);
+        if (!snappy::RawUncompress(m_compressedCache, compressedLength,
+                                   m_cache)) {
+            std::cerr << "warning: corrupt chunk at offset " << m_currentChunkOffset << " while reading trace\n";
+            m_endOfStream = true;
+            createCache(0);
+        }
     }
 }
 
@@ -306,6 +322,7 @@ void SnappyFile::setCurrentOffset(const File::Offset &offset)
 {
     // to remove eof bit
     m_stream.clear();
+    m_endOfStream = false;
     // seek to the start of a chunk
     m_stream.seekg(offset.chunk, std::ios::beg);
     // load the chunk
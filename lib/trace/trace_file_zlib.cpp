@@ -68,6 +68,9 @@ private:
     gzFile m_gzFile = nullptr;
     off_t m_endOffset = 0;
     size_t m_dataBytesRead = 0;
+    bool m_truncated = false;
+
+    void checkTruncated(void);
 };
 
 ZLibFile::ZLibFile(void)
@@ -120,12 +123,29 @@ size_t ZLibFile::rawRead(void *buffer, size_t length)
     if (ret > 0) {
         m_dataBytesRead += static_cast<size_t>(ret);
     }
+    if (ret < int(length)) {
+        checkTruncated();
+    }
     return ret < 0 ? 0 : ret;
 }
 
 int ZLibFile::rawGetc()
 {
-    return gzgetc(m_gzFile);
+    int c = gzgetc(m_gzFile);
+    if (c < 0) {
+        checkTruncated();
+    }
+    return c;
+}
+
+void ZLibFile::checkTruncated(void)
+{
+    int err = Z_OK;
+    gzerror(m_gzFile, &err);
+    if (err == Z_BUF_ERROR && !m_truncated) {
+        std::cerr << "warning: unexpected end of file while reading trace\n";
+        m_truncated = true;
+    }
 }
 
 void ZLibFile::rawClose()
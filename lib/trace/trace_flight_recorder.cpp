@@ -0,0 +1,1371 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "trace_flight_recorder.hpp"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <initializer_list>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <snappy.h>
+
+#include "os.hpp"
+#include "os_string.hpp"
+#include "trace_file.hpp"
+#include "trace_format.hpp"
+#include "trace_ostream.hpp"
+
+
+namespace trace {
+
+
+typedef FlightRecorder::ChunkPtr ChunkPtr;
+typedef FlightRecorder::Mark Mark;
+
+// Byte range within a chunk
+typedef std::pair<size_t, size_t> Span;
+
+static const size_t CHUNK_SIZE = FlightRecorder::CHUNK_SIZE;
+
+// Call number matching no call, for leave events of calls entered before
+// the dumped frames, which parsers then skip
+static const unsigned STRANDED_CALL_NO = ~0U;
+
+
+static void
+uncompress(const FlightRecorder::Chunk &chunk, char *buffer)
+{
+    if (chunk.size) {
+        ::snappy::RawUncompress(chunk.data.data(), chunk.data.size(), buffer);
+    }
+}
+
+
+/*
+ * Writes into the frame being recorded.
+ */
+class RecorderOutStream : public OutStream {
+    FlightRecorder *m_recorder;
+
+public:
+    RecorderOutStream(FlightRecorder *recorder) :
+        m_recorder(recorder)
+    {}
+
+    bool write(const void *buffer, size_t length) override {
+        m_recorder->append(buffer, length);
+        return true;
+    }
+
+    void flush(void) override {}
+};
+
+
+/*
+ * Keeps everything written as a list of compressed chunks, of CHUNK_SIZE
+ * each, and the rest uncompressed.
+ */
+class ChunkedOutStream : public OutStream {
+    std::string m_current;
+    size_t m_size = 0;
+
+public:
+    std::vector<ChunkPtr> chunks;
+
+    bool write(const void *buffer, size_t length) override {
+        const char *data = static_cast<const char *>(buffer);
+        m_size += length;
+        while (length) {
+            size_t n = std::min(length, CHUNK_SIZE - m_current.size());
+            m_current.append(data, n);
+            data += n;
+            length -= n;
+            if (m_current.size() == CHUNK_SIZE) {
+                seal();
+            }
+        }
+        return true;
+    }
+
+    // The rest is left uncompressed, so that dumps can write it as it is
+    void flush(void) override {}
+
+    void seal(void) {
+        if (!m_current.empty()) {
+            chunks.push_back(FlightRecorder::compress(m_current.data(), m_current.size()));
+            m_current.clear();
+        }
+    }
+
+    const std::string &pending(void) const {
+        return m_current;
+    }
+
+    // Uncompressed size of everything written
+    size_t size(void) const {
+        return m_size;
+    }
+};
+
+
+/*
+ * Reads a sequence of compressed chunks, to which more can be appended as
+ * the reading progresses, leaving out the given spans of each.
+ */
+class MemoryFile : public File {
+    struct Entry {
+        ChunkPtr chunk;
+        std::vector<Span> skips;
+    };
+
+    std::deque<Entry> m_chunks;
+    std::string m_buffer;
+    std::string m_spliced;
+    size_t m_pos = 0;
+
+    size_t m_containerSize = 0;
+    size_t m_containerRead = 0;
+    size_t m_dataRead = 0;
+
+    bool refill(void) {
+        while (m_pos == m_buffer.size()) {
+            if (m_chunks.empty()) {
+                return false;
+            }
+            Entry entry = std::move(m_chunks.front());
+            m_chunks.pop_front();
+            m_buffer.resize(entry.chunk->size);
+            uncompress(*entry.chunk, &m_buffer[0]);
+            if (!entry.skips.empty()) {
+                m_spliced.clear();
+                size_t pos = 0;
+                for (auto & skip : entry.skips) {
+                    m_spliced.append(m_buffer, pos, skip.first - pos);
+                    pos = skip.second;
+                }
+                m_spliced.append(m_buffer, pos, std::string::npos);
+                m_buffer.swap(m_spliced);
+            }
+            m_pos = 0;
+            m_containerRead += entry.chunk->data.size();
+        }
+        return true;
+    }
+
+public:
+    MemoryFile() {
+        m_isOpened = true;
+    }
+
+    void push(ChunkPtr chunk, std::vector<Span> skips = std::vector<Span>()) {
+        m_containerSize += chunk->data.size();
+        m_chunks.push_back(Entry{chunk, std::move(skips)});
+    }
+
+    size_t containerSizeInBytes(void) const override {
+        return m_containerSize;
+    }
+
+    size_t containerBytesRead(void) const override {
+        return m_containerRead;
+    }
+
+    size_t dataBytesRead(void) const override {
+        return m_dataRead;
+    }
+
+    const char *containerType(void) const override {
+        return "Memory";
+    }
+
+protected:
+    bool rawOpen(const char *filename) override {
+        return true;
+    }
+
+    size_t rawRead(void *buffer, size_t length) override {
+        size_t read = 0;
+        while (read < length && refill()) {
+            size_t n = std::min(length - read, m_buffer.size() - m_pos);
+            memcpy(static_cast<char *>(buffer) + read, &m_buffer[m_pos], n);
+            m_pos += n;
+            read += n;
+        }
+        m_dataRead += read;
+        return read;
+    }
+
+    int rawGetc(void) override {
+        if (!refill()) {
+            return -1;
+        }
+        ++m_dataRead;
+        return static_cast<unsigned char>(m_buffer[m_pos++]);
+    }
+
+    void rawClose(void) override {
+        m_chunks.clear();
+        m_buffer.clear();
+        m_pos = 0;
+    }
+};
+
+
+/*
+ * Gets integer, enum and pointer values, which is all state keys are made of.
+ */
+class ScalarVisitor : public Visitor {
+public:
+    bool found = false;
+    unsigned long long value = 0;
+
+    using Visitor::visit;
+    void visit(Null *) override { found = true; value = 0; }
+    void visit(Bool *node) override { found = true; value = node->value; }
+    void visit(SInt *node) override { found = true; value = node->value; }
+    void visit(UInt *node) override { found = true; value = node->value; }
+    void visit(Enum *node) override { visit(static_cast<SInt *>(node)); }
+    void visit(Pointer *node) override { visit(static_cast<UInt *>(node)); }
+    void visit(Float *) override {}
+    void visit(Double *) override {}
+    void visit(String *) override {}
+    void visit(WString *) override {}
+    void visit(Struct *) override {}
+    void visit(Array *) override {}
+    void visit(Blob *) override {}
+};
+
+
+static bool
+scalar(Value *value, unsigned long long &result)
+{
+    if (!value) {
+        return false;
+    }
+    ScalarVisitor visitor;
+    value->visit(visitor);
+    result = visitor.value;
+    return visitor.found;
+}
+
+
+static bool
+scalarArg(const Call *call, unsigned index, unsigned long long &result)
+{
+    return index < call->args.size() &&
+           scalar(call->args[index].value, result);
+}
+
+
+static bool
+startsWith(const char *name, const char *prefix)
+{
+    return strncmp(name, prefix, strlen(prefix)) == 0;
+}
+
+
+static bool
+isAny(const char *name, std::initializer_list<const char *> names)
+{
+    for (const char *candidate : names) {
+        if (strcmp(name, candidate) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static std::string
+makeKey(const char *prefix, std::initializer_list<unsigned long long> values)
+{
+    std::string key(prefix);
+    for (unsigned long long value : values) {
+        key += ':';
+        key += std::to_string(value);
+    }
+    return key;
+}
+
+
+/*
+ * Finds the kept state calls which later ones make redundant.
+ *
+ * A call is only dropped when a later call of the same function sets the
+ * same state of the same object on the same context, with no call in
+ * between which might read it.  Objects are found through the bindings of
+ * each context, tracked from the binding calls; a call not known to leave
+ * bindings and state alone ends the search, and makes the bindings of its
+ * context unknown.  So only GL is compacted in practice.
+ */
+class StateCompactor {
+    typedef unsigned long long Handle;
+
+    enum Domain {
+        DOMAIN_SETTER,
+        DOMAIN_UNIFORM,
+        DOMAIN_ATTRIB,
+        DOMAIN_TEXTURE,
+        DOMAIN_BUFFER,
+        NUM_DOMAINS,
+    };
+
+    struct Context {
+        // Bindings missing below are zero while the context is fresh, and
+        // unknown afterwards
+        bool fresh = true;
+        std::map<std::string, Handle> bindings;
+
+        Context() {
+            bindings["unit"] = 0x84C0;  // GL_TEXTURE0
+        }
+
+        bool binding(const std::string &name, Handle &value) const {
+            auto found = bindings.find(name);
+            if (found != bindings.end()) {
+                value = found->second;
+                return true;
+            }
+            value = 0;
+            return fresh;
+        }
+
+        void invalidate(void) {
+            fresh = false;
+            bindings.clear();
+        }
+    };
+
+    std::unordered_map<Handle, Context> contexts;
+    std::unordered_map<unsigned, Handle> current;  // by thread
+    std::unordered_set<unsigned> compiling;         // display lists, by thread
+
+    // Latest call setting each state, and calls setting parts of each object
+    std::unordered_map<std::string, size_t> latest[NUM_DOMAINS];
+    std::unordered_map<std::string, std::vector<size_t>> groups[NUM_DOMAINS];
+
+    std::vector<bool> m_dropped;
+    size_t m_numDropped = 0;
+
+    void drop(size_t index) {
+        if (!m_dropped[index]) {
+            m_dropped[index] = true;
+            ++m_numDropped;
+        }
+    }
+
+    void supersede(Domain domain, const std::string &key, size_t index) {
+        auto result = latest[domain].emplace(key, index);
+        if (!result.second) {
+            drop(result.first->second);
+            result.first->second = index;
+        }
+    }
+
+    void supersedePart(Domain domain, const std::string &group,
+                       const std::string &key, size_t index) {
+        supersede(domain, group + key, index);
+        groups[domain][group].push_back(index);
+    }
+
+    void supersedeGroup(Domain domain, const std::string &group, size_t index) {
+        std::vector<size_t> &calls = groups[domain][group];
+        for (size_t call : calls) {
+            drop(call);
+        }
+        calls.assign(1, index);
+    }
+
+    void barrier(std::initializer_list<Domain> domains) {
+        for (Domain domain : domains) {
+            latest[domain].clear();
+            groups[domain].clear();
+        }
+    }
+
+    void barrier(void) {
+        barrier({DOMAIN_SETTER, DOMAIN_UNIFORM, DOMAIN_ATTRIB, DOMAIN_TEXTURE, DOMAIN_BUFFER});
+    }
+
+    void bind(Context *context, const std::string &name, const Call *call, unsigned index) {
+        if (context) {
+            Handle value;
+            if (scalarArg(call, index, value)) {
+                context->bindings[name] = value;
+            } else {
+                context->invalidate();
+            }
+        }
+    }
+
+    static bool isTextureCap(Handle cap) {
+        return cap == 0x0DE0 /* GL_TEXTURE_1D */ ||
+               cap == 0x0DE1 /* GL_TEXTURE_2D */ ||
+               cap == 0x806F /* GL_TEXTURE_3D */ ||
+               cap == 0x84F5 /* GL_TEXTURE_RECTANGLE */ ||
+               cap == 0x8513 /* GL_TEXTURE_CUBE_MAP */ ||
+               (cap >= 0x0C60 && cap <= 0x0C63) /* GL_TEXTURE_GEN_S..Q */;
+    }
+
+    // Texture bound to the given texture image target on the active unit
+    static bool boundTexture(const Context &context, Handle target, Handle &texture) {
+        if (target >= 0x8515 && target <= 0x851A) {
+            // GL_TEXTURE_CUBE_MAP_POSITIVE_X..NEGATIVE_Z
+            target = 0x8513;
+        }
+        Handle unit;
+        return context.binding("unit", unit) &&
+               context.binding(makeKey("texture", {unit, target}), texture);
+    }
+
+    static bool boundBuffer(const Context &context, Handle target, Handle &buffer) {
+        return context.binding(makeKey("buffer", {target}), buffer);
+    }
+
+    bool makeCurrent(const Call *call);
+    bool track(const Call *call, Context *context);
+    bool supersede(const Call *call, size_t index, Handle handle, Context *context);
+    bool read(const Call *call);
+    static bool transparent(const char *name);
+
+public:
+    void add(const Call *call);
+
+    const std::vector<bool> &dropped(void) const {
+        return m_dropped;
+    }
+
+    size_t numDropped(void) const {
+        return m_numDropped;
+    }
+};
+
+
+bool
+StateCompactor::makeCurrent(const Call *call)
+{
+    static const struct {
+        const char *name;
+        unsigned context;
+    } functions[] = {
+        {"glXMakeCurrent", 2},
+        {"glXMakeContextCurrent", 3},
+        {"eglMakeCurrent", 3},
+        {"wglMakeCurrent", 1},
+        {"wglMakeContextCurrentARB", 2},
+        {"CGLSetCurrentContext", 0},
+    };
+
+    const char *name = call->sig->name;
+    for (auto & function : functions) {
+        if (strcmp(name, function.name) == 0) {
+            Handle handle;
+            if (scalarArg(call, function.context, handle)) {
+                current[call->thread_id] = handle;
+                if (handle) {
+                    // Contexts are fresh when first made current
+                    contexts[handle];
+                }
+            } else {
+                current.erase(call->thread_id);
+            }
+            return true;
+        }
+    }
+
+    if (strstr(name, "CreateContext") || strstr(name, "CreateNewContext")) {
+        Handle handle;
+        if (scalar(call->ret, handle) && handle) {
+            // The handle of a destroyed context may be reused
+            contexts[handle] = Context();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/*
+ * Binding calls, and calls which neither read nor set any state calls are
+ * dropped for.
+ */
+bool
+StateCompactor::track(const Call *call, Context *context)
+{
+    const char *name = call->sig->name;
+
+    if (isAny(name, {"glUseProgram", "glUseProgramObjectARB"})) {
+        bind(context, "program", call, 0);
+        return true;
+    }
+    if (isAny(name, {"glBindVertexArray", "glBindVertexArrayAPPLE"})) {
+        bind(context, "vao", call, 0);
+        return true;
+    }
+    if (isAny(name, {"glActiveTexture", "glActiveTextureARB"})) {
+        bind(context, "unit", call, 0);
+        return true;
+    }
+    if (isAny(name, {"glBindBuffer", "glBindBufferARB",
+                     "glBindBufferBase", "glBindBufferRange"})) {
+        // Indexed bindings set the generic binding too
+        unsigned buffer = strcmp(name, "glBindBufferBase") == 0 ||
+                          strcmp(name, "glBindBufferRange") == 0 ? 2 : 1;
+        Handle target;
+        if (context && scalarArg(call, 0, target)) {
+            bind(context, makeKey("buffer", {target}), call, buffer);
+        } else if (context) {
+            context->invalidate();
+        }
+        return true;
+    }
+    if (isAny(name, {"glBindTexture", "glBindTextureEXT"})) {
+        Handle unit, target;
+        if (context && context->binding("unit", unit) && scalarArg(call, 0, target)) {
+            bind(context, makeKey("texture", {unit, target}), call, 1);
+        } else if (context) {
+            context->invalidate();
+        }
+        return true;
+    }
+
+    if (startsWith(name, "glDelete")) {
+        // Deleting unbinds, and names get reused, in every context sharing
+        // them
+        for (auto & entry : contexts) {
+            entry.second.invalidate();
+        }
+        return true;
+    }
+
+    return transparent(name);
+}
+
+
+bool
+StateCompactor::transparent(const char *name)
+{
+    static const char *prefixes[] = {
+        "glGen",
+        "glCreate",
+        "glFramebufferTexture",
+        "glFramebufferRenderbuffer",
+        "glRenderbufferStorage",
+        "glTexStorage",
+        "glTextureStorage",
+        "glDebugMessage",
+        "glObjectLabel",
+        "glObjectPtrLabel",
+    };
+    for (const char *prefix : prefixes) {
+        if (startsWith(name, prefix)) {
+            return true;
+        }
+    }
+
+    return isAny(name, {
+        "glBindFramebuffer", "glBindFramebufferEXT",
+        "glBindRenderbuffer", "glBindRenderbufferEXT",
+        "glBindSampler",
+        "glBindAttribLocation", "glBindAttribLocationARB",
+        "glBindFragDataLocation", "glBindFragDataLocationEXT",
+        "glBindFragDataLocationIndexed",
+        "glBindImageTexture",
+        "glBindProgramPipeline",
+        "glShaderSource", "glShaderSourceARB",
+        "glCompileShader", "glCompileShaderARB",
+        "glAttachShader", "glAttachObjectARB", "glDetachShader",
+        "glLinkProgram", "glLinkProgramARB",
+        "glProgramParameteri",
+        "glPixelStorei", "glPixelStoref",
+        "glFlush", "glFinish",
+        "glDrawBuffer", "glDrawBuffers", "glDrawBuffersARB", "glReadBuffer",
+        "glBufferStorage", "glNamedBufferStorage",
+        "glTexBuffer",
+        "glFenceSync", "glWaitSync", "glClientWaitSync",
+        "glMemoryBarrier",
+    });
+}
+
+
+/*
+ * Calls setting state which later calls may supersede.  Returns false for
+ * any other call.
+ */
+bool
+StateCompactor::supersede(const Call *call, size_t index, Handle handle, Context *context)
+{
+    // Functions setting context state, with the number of leading arguments
+    // selecting which
+    static const struct {
+        const char *name;
+        unsigned selectors;
+    } setters[] = {
+        {"glAlphaFunc", 0},
+        {"glBlendColor", 0},
+        {"glBlendEquation", 0},
+        {"glBlendEquationSeparate", 0},
+        {"glBlendEquationSeparatei", 1},
+        {"glBlendEquationi", 1},
+        {"glBlendFunc", 0},
+        {"glBlendFuncSeparate", 0},
+        {"glBlendFuncSeparatei", 1},
+        {"glBlendFunci", 1},
+        {"glClearColor", 0},
+        {"glClearDepth", 0},
+        {"glClearDepthf", 0},
+        {"glClearStencil", 0},
+        {"glColorMask", 0},
+        {"glColorMaski", 1},
+        {"glCullFace", 0},
+        {"glDepthFunc", 0},
+        {"glDepthMask", 0},
+        {"glDepthRange", 0},
+        {"glDepthRangef", 0},
+        {"glFrontFace", 0},
+        {"glHint", 1},
+        {"glLineWidth", 0},
+        {"glLogicOp", 0},
+        {"glMinSampleShading", 0},
+        {"glPatchParameteri", 1},
+        {"glPointSize", 0},
+        {"glPolygonMode", 1},
+        {"glPolygonOffset", 0},
+        {"glPrimitiveRestartIndex", 0},
+        {"glProvokingVertex", 0},
+        {"glSampleCoverage", 0},
+        {"glSamplerParameterf", 2},
+        {"glSamplerParameterfv", 2},
+        {"glSamplerParameteri", 2},
+        {"glSamplerParameteriv", 2},
+        {"glScissor", 0},
+        {"glShadeModel", 0},
+        {"glStencilFunc", 0},
+        {"glStencilFuncSeparate", 1},
+        {"glStencilMask", 0},
+        {"glStencilMaskSeparate", 1},
+        {"glStencilOp", 0},
+        {"glStencilOpSeparate", 1},
+        {"glUniformBlockBinding", 2},
+        {"glViewport", 0},
+    };
+
+    const char *name = call->sig->name;
+    Handle a, b, c, d;
+
+    for (auto & setter : setters) {
+        if (strcmp(name, setter.name) == 0) {
+            if (context) {
+                std::string key = makeKey(name, {handle});
+                for (unsigned i = 0; i < setter.selectors; ++i) {
+                    if (!scalarArg(call, i, a)) {
+                        return true;
+                    }
+                    key += makeKey("", {a});
+                }
+                supersede(DOMAIN_SETTER, key, index);
+            }
+            return true;
+        }
+    }
+
+    if (isAny(name, {"glEnable", "glDisable"})) {
+        if (context && scalarArg(call, 0, a)) {
+            if (!isTextureCap(a)) {
+                supersede(DOMAIN_SETTER, makeKey("enable", {handle, a}), index);
+            } else if (context->binding("unit", b)) {
+                supersede(DOMAIN_SETTER, makeKey("enable", {handle, a, b}), index);
+            }
+        }
+        return true;
+    }
+    if (isAny(name, {"glEnablei", "glDisablei"})) {
+        if (context && scalarArg(call, 0, a) && scalarArg(call, 1, b)) {
+            supersede(DOMAIN_SETTER, makeKey("enablei", {handle, a, b}), index);
+        }
+        return true;
+    }
+
+    // glUniform*, glProgramUniform*; the v variants have a count
+    bool program = startsWith(name, "glProgramUniform");
+    const char *suffix = name + strlen(program ? "glProgramUniform" : "glUniform");
+    if ((program || startsWith(name, "glUniform")) &&
+        ((*suffix >= '1' && *suffix <= '4') || startsWith(suffix, "Matrix"))) {
+        size_t length = strlen(name);
+        while (length && name[length - 1] >= 'A' && name[length - 1] <= 'Z') {
+            --length;  // ARB, EXT
+        }
+        bool vector = name[length - 1] == 'v';
+        unsigned first = program ? 1 : 0;
+        if (context &&
+            (program ? scalarArg(call, 0, a) : context->binding("program", a)) &&
+            scalarArg(call, first, b) &&
+            (!vector || scalarArg(call, first + 1, c))) {
+            supersede(DOMAIN_UNIFORM, makeKey(name, {handle, a, b, vector ? c : 0}), index);
+        }
+        return true;
+    }
+
+    const char *attrib = nullptr;
+    if (isAny(name, {"glVertexAttribPointer", "glVertexAttribPointerARB",
+                     "glVertexAttribIPointer", "glVertexAttribIPointerEXT",
+                     "glVertexAttribLPointer"})) {
+        attrib = "attribpointer";
+    } else if (isAny(name, {"glEnableVertexAttribArray", "glEnableVertexAttribArrayARB",
+                            "glDisableVertexAttribArray", "glDisableVertexAttribArrayARB"})) {
+        attrib = "attribenable";
+    } else if (isAny(name, {"glVertexAttribDivisor", "glVertexAttribDivisorARB"})) {
+        attrib = "attribdivisor";
+    }
+    if (attrib) {
+        if (context && context->binding("vao", a) && scalarArg(call, 0, b)) {
+            supersede(DOMAIN_ATTRIB, makeKey(attrib, {handle, a, b}), index);
+        }
+        return true;
+    }
+
+    // Texture objects, by name, and by target for the default ones
+    bool dsa = isAny(name, {"glTextureParameterf", "glTextureParameterfv",
+                            "glTextureParameteri", "glTextureParameteriv",
+                            "glTextureParameterIiv", "glTextureParameterIuiv"});
+    if (dsa || isAny(name, {"glTexParameterf", "glTexParameterfv",
+                            "glTexParameteri", "glTexParameteriv",
+                            "glTexParameterIiv", "glTexParameterIuiv",
+                            "glTexParameterIivEXT", "glTexParameterIuivEXT"})) {
+        if (context && scalarArg(call, 0, a) && scalarArg(call, 1, c) &&
+            (dsa ? (b = a, a = 0, b != 0) : boundTexture(*context, a, b))) {
+            supersede(DOMAIN_TEXTURE, makeKey("texparameter", {handle, b, b ? 0 : a, c}), index);
+        }
+        return true;
+    }
+
+    unsigned dimensions = 0;
+    bool whole = false;
+    if (isAny(name, {"glTexImage1D", "glCompressedTexImage1D", "glCompressedTexImage1DARB"})) {
+        dimensions = 1;
+        whole = true;
+    } else if (isAny(name, {"glTexImage2D", "glCompressedTexImage2D", "glCompressedTexImage2DARB"})) {
+        dimensions = 2;
+        whole = true;
+    } else if (isAny(name, {"glTexImage3D", "glCompressedTexImage3D", "glCompressedTexImage3DARB"})) {
+        dimensions = 3;
+        whole = true;
+    } else if (isAny(name, {"glTexSubImage1D", "glCompressedTexSubImage1D", "glCompressedTexSubImage1DARB"})) {
+        dimensions = 1;
+    } else if (isAny(name, {"glTexSubImage2D", "glCompressedTexSubImage2D", "glCompressedTexSubImage2DARB"})) {
+        dimensions = 2;
+    } else if (isAny(name, {"glTexSubImage3D", "glCompressedTexSubImage3D", "glCompressedTexSubImage3DARB"})) {
+        dimensions = 3;
+    }
+    if (dimensions) {
+        if (!context) {
+            return true;
+        }
+        Handle unpack;
+        if (!boundBuffer(*context, 0x88EC /* GL_PIXEL_UNPACK_BUFFER */, unpack) || unpack) {
+            // Reads buffer data
+            barrier({DOMAIN_TEXTURE, DOMAIN_BUFFER});
+            return true;
+        }
+        if (scalarArg(call, 0, a) && scalarArg(call, 1, c) && boundTexture(*context, a, b)) {
+            std::string group = makeKey("teximage", {handle, b, b ? 0 : a, a, c});
+            if (whole) {
+                supersedeGroup(DOMAIN_TEXTURE, group, index);
+            } else {
+                // Offsets and sizes
+                std::string key = makeKey(name, {});
+                for (unsigned i = 0; i < 2 * dimensions; ++i) {
+                    if (!scalarArg(call, 2 + i, d)) {
+                        return true;
+                    }
+                    key += makeKey("", {d});
+                }
+                supersedePart(DOMAIN_TEXTURE, group, key, index);
+            }
+        }
+        return true;
+    }
+
+    bool named = isAny(name, {"glNamedBufferData", "glNamedBufferDataEXT",
+                              "glNamedBufferSubData", "glNamedBufferSubDataEXT"});
+    if (named || isAny(name, {"glBufferData", "glBufferDataARB",
+                              "glBufferSubData", "glBufferSubDataARB"})) {
+        if (context && scalarArg(call, 0, a) &&
+            (named ? (b = a, true) : boundBuffer(*context, a, b)) &&
+            b != 0) {
+            std::string group = makeKey("buffer", {handle, b});
+            if (!strstr(name, "SubData")) {
+                supersedeGroup(DOMAIN_BUFFER, group, index);
+            } else if (scalarArg(call, 1, c) && scalarArg(call, 2, d)) {
+                supersedePart(DOMAIN_BUFFER, group, makeKey("", {c, d}), index);
+            }
+        }
+        return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Calls known to read buffer or texture contents only.
+ */
+bool
+StateCompactor::read(const Call *call)
+{
+    const char *name = call->sig->name;
+
+    static const char *buffers[] = {
+        "glMap",
+        "glUnmap",
+        "glFlushMapped",
+        "glCopyBufferSubData",
+        "glCopyNamedBufferSubData",
+        "glClearBuffer",
+        "glClearNamedBuffer",
+        "glInvalidateBuffer",
+        "memcpy",
+    };
+    for (const char *prefix : buffers) {
+        if (startsWith(name, prefix)) {
+            barrier({DOMAIN_BUFFER});
+            return true;
+        }
+    }
+
+    static const char *textures[] = {
+        "glGenerateMipmap",
+        "glGenerateTextureMipmap",
+        "glCopyTexImage",
+        "glCopyTexSubImage",
+        "glCopyTextureSubImage",
+        "glCopyImageSubData",
+        "glInvalidateTex",
+    };
+    for (const char *prefix : textures) {
+        if (startsWith(name, prefix)) {
+            barrier({DOMAIN_TEXTURE});
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void
+StateCompactor::add(const Call *call)
+{
+    size_t index = m_dropped.size();
+    m_dropped.push_back(false);
+
+    const char *name = call->sig->name;
+    unsigned thread = call->thread_id;
+
+    Handle handle = 0;
+    Context *context = nullptr;
+    auto found = current.find(thread);
+    if (found != current.end() && found->second) {
+        handle = found->second;
+        context = &contexts[handle];
+    }
+
+    // Display lists are only executed later on
+    if (compiling.count(thread) || strcmp(name, "glNewList") == 0) {
+        if (strcmp(name, "glEndList") == 0) {
+            compiling.erase(thread);
+        } else {
+            compiling.insert(thread);
+        }
+        barrier();
+        if (context) {
+            context->invalidate();
+        }
+        return;
+    }
+
+    if (makeCurrent(call) ||
+        read(call) ||
+        track(call, context) ||
+        supersede(call, index, handle, context)) {
+        return;
+    }
+
+    barrier();
+    if (context) {
+        context->invalidate();
+    }
+    if (strstr(name, "MakeCurrent") || strstr(name, "SetCurrentContext")) {
+        current.erase(thread);
+    }
+}
+
+
+void
+FlightRecorder::Definitions::clear(void)
+{
+    for (auto & defined : ids) {
+        std::fill(defined.begin(), defined.end(), false);
+    }
+}
+
+
+FlightRecorder::FlightRecorder(unsigned _maxFrames, const char *_filename,
+                               const Properties &_properties,
+                               size_t _maxStateSize) :
+    maxFrames(_maxFrames),
+    maxStateSize(_maxStateSize),
+    filename(_filename),
+    properties(_properties),
+    input(new MemoryFile),
+    compactionSize(_maxStateSize / 4),
+    scratch(new char[CHUNK_SIZE])
+{
+    // No blob deduplication for the state, as its blob ids would clash with
+    // those of the frames dumped after it
+}
+
+
+FlightRecorder::~FlightRecorder()
+{
+    if (parserOpen) {
+        // The parser owns the input file
+        parser.close();
+    } else {
+        delete input;
+    }
+    state.close();
+    delete [] scratch;
+}
+
+
+OutStream *
+FlightRecorder::createStream(void)
+{
+    return new RecorderOutStream(this);
+}
+
+
+void
+FlightRecorder::attach(Writer *_writer)
+{
+    writer = _writer;
+    writer->setMarks(&marks);
+    currentFirstCallNo = writer->nextCallNo();
+}
+
+
+FlightRecorder::ChunkPtr
+FlightRecorder::compress(const char *data, size_t size)
+{
+    std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+    chunk->size = size;
+    chunk->data.resize(::snappy::MaxCompressedLength(size));
+    size_t compressedLength;
+    ::snappy::RawCompress(data, size, &chunk->data[0], &compressedLength);
+    chunk->data.resize(compressedLength);
+    chunk->data.shrink_to_fit();
+    return chunk;
+}
+
+
+bool
+FlightRecorder::isStateCall(const char *name, CallFlags flags)
+{
+    // glEnd must stay paired with the glBegin and vertex calls, which are kept
+    if ((flags & CALL_FLAG_RENDER) && strcmp(name, "glEnd") == 0) {
+        return true;
+    }
+
+    return !(flags & (CALL_FLAG_NO_SIDE_EFFECTS |
+                            CALL_FLAG_RENDER |
+                            CALL_FLAG_END_FRAME |
+                            CALL_FLAG_MARKER |
+                            CALL_FLAG_MARKER_PUSH |
+                            CALL_FLAG_MARKER_POP));
+}
+
+
+void
+FlightRecorder::seal(void)
+{
+    assert(writer);
+
+    if (current.empty() && !currentCalls) {
+        return;
+    }
+
+    Frame frame;
+    for (size_t offset = 0; offset < current.size(); offset += CHUNK_SIZE) {
+        frame.chunks.push_back(compress(current.data() + offset,
+                                        std::min(CHUNK_SIZE, current.size() - offset)));
+    }
+    frame.numCalls = currentCalls;
+    frame.firstCallNo = currentFirstCallNo;
+    frame.marks.swap(marks);
+    for (auto & mark : frame.marks) {
+        mark.begin -= currentOffset;
+        mark.end -= currentOffset;
+        if (mark.kind != Mark::CALL_NO) {
+            dumped.reserve(mark.kind, mark.id + 1);
+        }
+    }
+    frames.push_back(std::move(frame));
+
+    currentOffset += current.size();
+    current.clear();
+    currentCalls = 0;
+
+    // So that the next frame can be dumped without the ones before it
+    writer->forgetDefinitions();
+    currentFirstCallNo = writer->nextCallNo();
+}
+
+
+void
+FlightRecorder::openState(void)
+{
+    if (!stateOpen) {
+        stateStream = new ChunkedOutStream;
+        // Its header is dumped in front of frames, which may refer to
+        // deduplicated blobs
+        state.setBlobRefsAllowed(writer && writer->getBlobDedup());
+        if (!state.open(stateStream, TRACE_VERSION, properties)) {
+            os::log("apitrace: error: failed to open flight recorder state\n");
+            os::abort();
+        }
+        stateOpen = true;
+    }
+}
+
+
+void
+FlightRecorder::keepState(Call *call)
+{
+    if (!stateFull) {
+        state.writeCall(call);
+    }
+}
+
+
+/*
+ * Parse the oldest frame back, keeping its state calls.
+ */
+void
+FlightRecorder::evict(void)
+{
+    const Frame &frame = frames.front();
+
+    // Definitions the parser has seen already must be left out, split
+    // along the chunks
+    std::vector<std::vector<Span>> skips(frame.chunks.size());
+    for (auto & mark : frame.marks) {
+        if (mark.kind != Mark::CALL_NO && parsed.define(mark.kind, mark.id)) {
+            for (uint64_t begin = mark.begin; begin < mark.end; ) {
+                size_t index = begin / CHUNK_SIZE;
+                uint64_t end = std::min<uint64_t>(mark.end, (index + 1) * CHUNK_SIZE);
+                skips[index].push_back(Span(begin - index * CHUNK_SIZE, end - index * CHUNK_SIZE));
+                begin = end;
+            }
+        }
+    }
+    for (size_t i = 0; i < frame.chunks.size(); ++i) {
+        input->push(frame.chunks[i], std::move(skips[i]));
+    }
+
+    if (!parserOpen) {
+        // The first frame starts with the trace header
+        if (!parser.open(input)) {
+            os::log("apitrace: error: failed to parse flight recorder frames\n");
+            os::abort();
+        }
+        parserOpen = true;
+    }
+
+    openState();
+
+    // The frame ends right after the leave event of its last call, so this
+    // never reads past it
+    for (unsigned i = 0; i < frame.numCalls; ++i) {
+        Call *call = parser.parse_call();
+        if (!call) {
+            break;
+        }
+        if (isStateCall(call)) {
+            keepState(call);
+        }
+        delete call;
+    }
+
+    frames.pop_front();
+}
+
+
+/*
+ * Drop the kept calls which later ones made redundant.
+ */
+void
+FlightRecorder::compactState(void)
+{
+    stateStream->seal();
+    std::vector<ChunkPtr> chunks = stateStream->chunks;
+    size_t size = stateStream->size();
+    unsigned numCalls = state.nextCallNo();
+
+    StateCompactor compactor;
+    Call *call;
+    {
+        MemoryFile *file = new MemoryFile;
+        for (auto & chunk : chunks) {
+            file->push(chunk);
+        }
+        Parser stateParser;
+        if (!stateParser.open(file)) {
+            return;
+        }
+        while ((call = stateParser.parse_call())) {
+            compactor.add(call);
+            delete call;
+        }
+    }
+
+    if (!compactor.numDropped()) {
+        return;
+    }
+
+    state.close();
+    stateOpen = false;
+    openState();
+
+    const std::vector<bool> &dropped = compactor.dropped();
+    MemoryFile *file = new MemoryFile;
+    for (auto & chunk : chunks) {
+        file->push(chunk);
+    }
+    Parser stateParser;
+    if (stateParser.open(file)) {
+        size_t index = 0;
+        while ((call = stateParser.parse_call())) {
+            if (index < dropped.size() && !dropped[index]) {
+                state.writeCall(call);
+            }
+            ++index;
+            delete call;
+        }
+    }
+    state.flush();
+
+    os::log("apitrace: flight recorder state compacted from %u to %u calls, %u to %u KB\n",
+            numCalls, state.nextCallNo(),
+            unsigned(size >> 10), unsigned(stateStream->size() >> 10));
+}
+
+
+/*
+ * Keep the state within bounds, and ready to be dumped.
+ */
+void
+FlightRecorder::checkState(void)
+{
+    if (!stateOpen) {
+        return;
+    }
+
+    state.flush();
+
+    if (!stateFull && stateStream->size() >= compactionSize) {
+        compactState();
+        compactionSize = std::max(maxStateSize / 4, 2 * stateStream->size());
+    }
+
+    if (!stateFull && stateStream->size() > maxStateSize) {
+        os::log("apitrace: warning: flight recorder state exceeds %u MB; "
+                "later state calls are dropped, so dumps may not replay faithfully\n",
+                unsigned(maxStateSize >> 20));
+        stateFull = true;
+    }
+
+    for (unsigned kind = 0; kind < Mark::NUM_DEFINITION_KINDS; ++kind) {
+        Mark::Kind k = static_cast<Mark::Kind>(kind);
+        dumped.reserve(k, state.definitions(k).size());
+    }
+}
+
+
+void
+FlightRecorder::endFrame(void)
+{
+    seal();
+
+    if (frames.size() > maxFrames) {
+        while (frames.size() > maxFrames) {
+            evict();
+        }
+        checkState();
+    }
+}
+
+
+/*
+ * Copy the events of a frame, given in bytes from its start, leaving out
+ * definitions given earlier in the dump, and renumbering leave events after
+ * the calls the dump starts with.
+ */
+template <class Copy>
+static void
+splice(OutStream *out, Copy copy, uint64_t size,
+       const std::vector<Mark> &marks, uint64_t offset,
+       FlightRecorder::Definitions &defined,
+       unsigned firstCallNo, unsigned stateCalls)
+{
+    uint64_t pos = 0;
+    for (auto & mark : marks) {
+        uint64_t begin = mark.begin - offset;
+        uint64_t end = mark.end - offset;
+        if (mark.kind == Mark::CALL_NO) {
+            copy(pos, begin);
+            char buffer[Writer::CALL_NO_LENGTH];
+            Writer::encodeCallNo(buffer,
+                                 mark.id >= firstCallNo ? mark.id - firstCallNo + stateCalls
+                                                        : STRANDED_CALL_NO);
+            out->write(buffer, sizeof buffer);
+            pos = end;
+        } else if (defined.define(mark.kind, mark.id)) {
+            copy(pos, begin);
+            pos = end;
+        }
+    }
+    copy(pos, size);
+}
+
+
+bool
+FlightRecorder::dump(bool final)
+{
+    if (frames.empty() && !stateOpen && (!final || current.empty())) {
+        return false;
+    }
+
+    os::String name;
+    if (numDumps) {
+        os::String base(filename.c_str());
+        base.trimExtension();
+        name = os::String::format("%s.%u.trace", base.str(), numDumps);
+    } else {
+        name = filename.c_str();
+    }
+    ++numDumps;
+
+    OutStream *out = createSnappyStream(name);
+    if (!out) {
+        os::log("apitrace: error: failed to open %s\n", name.str());
+        return false;
+    }
+
+    // Only serialized events are copied from here on, as this may run from
+    // a crash handler
+    dumped.clear();
+
+    unsigned stateCalls = 0;
+    if (stateOpen) {
+        // It starts with the trace header
+        for (auto & chunk : stateStream->chunks) {
+            uncompress(*chunk, scratch);
+            out->write(scratch, chunk->size);
+        }
+        const std::string &pending = stateStream->pending();
+        out->write(pending.data(), pending.size());
+
+        for (unsigned kind = 0; kind < Mark::NUM_DEFINITION_KINDS; ++kind) {
+            Mark::Kind k = static_cast<Mark::Kind>(kind);
+            const std::vector<bool> &defined = state.definitions(k);
+            for (unsigned id = 0; id < defined.size(); ++id) {
+                if (defined[id]) {
+                    dumped.define(k, id);
+                }
+            }
+        }
+
+        stateCalls = state.nextCallNo();
+    }
+
+    // Otherwise the first frame is dumped, with the trace header
+    unsigned firstCallNo = frames.empty() ? currentFirstCallNo : frames.front().firstCallNo;
+    assert(stateOpen || firstCallNo == 0);
+
+    for (auto & frame : frames) {
+        size_t loaded = frame.chunks.size();
+        auto copy = [&] (uint64_t begin, uint64_t end) {
+            while (begin < end) {
+                size_t index = begin / CHUNK_SIZE;
+                if (index != loaded) {
+                    uncompress(*frame.chunks[index], scratch);
+                    loaded = index;
+                }
+                size_t offset = begin - index * CHUNK_SIZE;
+                size_t length = std::min<uint64_t>(end - begin, CHUNK_SIZE - offset);
+                out->write(scratch + offset, length);
+                begin += length;
+            }
+        };
+        uint64_t size = 0;
+        for (auto & chunk : frame.chunks) {
+            size += chunk->size;
+        }
+        splice(out, copy, size, frame.marks, 0, dumped, firstCallNo, stateCalls);
+    }
+
+    if (final) {
+        // The frame being recorded, with any calls which never returned
+        auto copy = [&] (uint64_t begin, uint64_t end) {
+            out->write(current.data() + begin, end - begin);
+        };
+        splice(out, copy, current.size(), marks, currentOffset, dumped, firstCallNo, stateCalls);
+    }
+
+    delete out;
+
+    os::log("apitrace: flight recorder dumped %u frames to %s\n", unsigned(frames.size()), name.str());
+
+    if (!final) {
+        while (!frames.empty()) {
+            evict();
+        }
+        checkState();
+    }
+
+    return true;
+}
+
+
+} /* namespace trace */
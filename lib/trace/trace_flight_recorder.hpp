@@ -0,0 +1,210 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * In-memory "flight recorder" for LocalWriter.
+ */
+
+#pragma once
+
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "trace_model.hpp"
+#include "trace_parser.hpp"
+#include "trace_writer.hpp"
+
+
+namespace trace {
+
+    class OutStream;
+    class ChunkedOutStream;
+    class MemoryFile;
+
+    /**
+     * Keeps only the last frames of the trace, as a ring of compressed chunks,
+     * one per frame.
+     *
+     * Calls of the frames falling off the ring are parsed back, and those
+     * which may change the state seen by later frames (that is, anything but
+     * draws, frame ends, markers and queries) are kept, so that the retained
+     * frames can still be replayed.  Kept calls which later ones make
+     * redundant are dropped from time to time, and past maxStateSize no more
+     * are kept.
+     *
+     * Frames are recorded so that they can be dumped as they are, without
+     * parsing them: the writer defines everything anew in every frame, and
+     * marks where the definitions and the call numbers of leave events are,
+     * so that dumps can leave out repeated definitions and renumber calls.
+     */
+    class FlightRecorder {
+    public:
+        // Uncompressed size of the chunks frames and state are split into
+        static const size_t CHUNK_SIZE = 1024 * 1024;
+
+        struct Chunk {
+            std::string data;  // snappy compressed
+            size_t size;       // uncompressed size
+        };
+
+        typedef std::shared_ptr<const Chunk> ChunkPtr;
+
+        typedef Writer::Mark Mark;
+
+        /**
+         * Which signatures and stack frames were defined, by kind.
+         */
+        struct Definitions {
+            std::vector<bool> ids[Mark::NUM_DEFINITION_KINDS];
+
+            void reserve(Mark::Kind kind, size_t size) {
+                if (ids[kind].size() < size) {
+                    ids[kind].resize(size);
+                }
+            }
+
+            /**
+             * Mark as defined, returning whether it was defined already.
+             */
+            bool define(Mark::Kind kind, unsigned id) {
+                reserve(kind, id + 1);
+                bool defined = ids[kind][id];
+                ids[kind][id] = true;
+                return defined;
+            }
+
+            void clear(void);
+        };
+
+    private:
+        struct Frame {
+            std::vector<ChunkPtr> chunks;  // of CHUNK_SIZE, but the last
+            unsigned numCalls;
+            unsigned firstCallNo;     // of the first call entered in it
+            std::vector<Mark> marks;  // from the start of the frame
+        };
+
+        unsigned maxFrames;
+        size_t maxStateSize;
+        std::string filename;
+        Properties properties;
+        unsigned numDumps = 0;
+
+        Writer *writer = nullptr;
+
+        // Serialized calls of the frame being recorded
+        std::string current;
+        unsigned currentCalls = 0;
+        unsigned currentFirstCallNo = 0;
+        uint64_t currentOffset = 0;   // in the writer output
+        std::vector<Mark> marks;      // from the start of the writer output
+
+        std::deque<Frame> frames;
+
+        // Parses the frames falling off the ring, in order
+        MemoryFile *input;
+        Parser parser;
+        bool parserOpen = false;
+        Definitions parsed;
+
+        // State calls of the frames which fell off the ring
+        ChunkedOutStream *stateStream = nullptr;
+        Writer state;
+        bool stateOpen = false;
+        bool stateFull = false;
+        size_t compactionSize;
+
+        // Allocated beforehand, so that dumps allocate little
+        char *scratch;
+        Definitions dumped;
+
+        void append(const void *buffer, size_t length) {
+            current.append(static_cast<const char *>(buffer), length);
+        }
+
+        void seal(void);
+        void evict(void);
+        void openState(void);
+        void keepState(Call *call);
+        void checkState(void);
+        void compactState(void);
+
+        friend class RecorderOutStream;
+
+    public:
+        FlightRecorder(unsigned maxFrames, const char *filename,
+                       const Properties &properties,
+                       size_t maxStateSize = 256 * 1024 * 1024);
+        ~FlightRecorder();
+
+        /**
+         * Stream the recorded calls must be written to, owned by the caller.
+         * It must be closed before the recorder is destroyed.
+         */
+        OutStream *createStream(void);
+
+        /**
+         * Must be called once the writer is open on createStream(), before
+         * any call is written.
+         */
+        void attach(Writer *writer);
+
+        void endCall(void) {
+            ++currentCalls;
+        }
+
+        /**
+         * Must be called at an event boundary, after the calls to the stream
+         * have been flushed.
+         */
+        void endFrame(void);
+
+        /**
+         * Write the kept state and the recorded frames to a new trace file,
+         * and start recording afresh.  When final, the frame being recorded,
+         * and any calls which haven't returned yet, are dumped too, and
+         * nothing is parsed nor serialized again, as the process is likely
+         * dying.
+         */
+        bool dump(bool final);
+
+        /**
+         * Whether calls to the function may change the state seen by later
+         * frames.
+         */
+        static bool isStateCall(const char *name, CallFlags flags);
+
+        static bool isStateCall(const Call *call) {
+            return isStateCall(call->sig->name, call->flags);
+        }
+
+        static ChunkPtr compress(const char *data, size_t size);
+    };
+
+} /* namespace trace */
@@ -0,0 +1,341 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_flight_recorder.hpp"
+#include "trace_parser.hpp"
+#include "trace_test_helpers.hpp"
+
+using namespace trace;
+
+
+static const char *
+bind_args[] = { "target", "texture" };
+
+static const FunctionSig
+bind_sig = { 0, "glBindTexture", 2, bind_args };
+
+static const char *
+draw_args[] = { "mode", "first", "count" };
+
+static const FunctionSig
+draw_sig = { 1, "glDrawArrays", 3, draw_args };
+
+static const char *
+swap_args[] = { "dpy", "drawable" };
+
+static const FunctionSig
+swap_sig = { 2, "glXSwapBuffers", 2, swap_args };
+
+static const char *
+make_current_args[] = { "dpy", "drawable", "ctx" };
+
+static const FunctionSig
+make_current_sig = { 3, "glXMakeCurrent", 3, make_current_args };
+
+static const char *
+enable_args[] = { "cap" };
+
+static const FunctionSig
+enable_sig = { 4, "glEnable", 1, enable_args };
+
+static const char *
+viewport_args[] = { "x", "y", "width", "height" };
+
+static const FunctionSig
+viewport_sig = { 5, "glViewport", 4, viewport_args };
+
+static const char *
+hint_args[] = { "target", "mode" };
+
+// Not known to the compaction, so nothing can be dropped across it
+static const FunctionSig
+unknown_sig = { 6, "glUnknownEXT", 2, hint_args };
+
+
+static void
+writeCall(Writer &writer, FlightRecorder &recorder,
+          const FunctionSig *sig, unsigned value)
+{
+    writeUIntCall(writer, sig, value);
+    recorder.endCall();
+}
+
+
+static void
+writeFrames(Writer &writer, FlightRecorder &recorder,
+            unsigned first, unsigned count)
+{
+    for (unsigned frame = first; frame < first + count; ++frame) {
+        writeCall(writer, recorder, &bind_sig, frame);
+        writeCall(writer, recorder, &draw_sig, frame);
+        writeCall(writer, recorder, &swap_sig, frame);
+        writer.flush();
+        recorder.endFrame();
+    }
+}
+
+
+struct Calls {
+    std::vector<unsigned> binds;
+    std::vector<unsigned> draws;
+    std::vector<unsigned> viewports;
+    unsigned swaps = 0;
+    unsigned enables = 0;
+    unsigned unknown = 0;
+    unsigned incomplete = 0;
+};
+
+
+static Calls
+readCalls(const char *filename)
+{
+    Calls calls;
+    Parser parser;
+    EXPECT_TRUE(parser.open(filename));
+    Call *call;
+    while ((call = parser.parse_call())) {
+        if (call->flags & CALL_FLAG_INCOMPLETE) {
+            ++calls.incomplete;
+        }
+        unsigned value = call->arg(0).toUInt();
+        if (call->sig->id == bind_sig.id) {
+            calls.binds.push_back(value);
+        } else if (call->sig->id == draw_sig.id) {
+            calls.draws.push_back(value);
+        } else if (call->sig->id == viewport_sig.id) {
+            calls.viewports.push_back(value);
+        } else if (call->sig->id == enable_sig.id) {
+            ++calls.enables;
+        } else if (call->sig->id == unknown_sig.id) {
+            ++calls.unknown;
+        } else if (call->sig->id == swap_sig.id) {
+            ++calls.swaps;
+        }
+        delete call;
+    }
+    return calls;
+}
+
+
+TEST(trace_flight_recorder, keeps_state_and_last_frames)
+{
+    const char *filename = "trace_flight_recorder_test.trace";
+
+    FlightRecorder recorder(3, filename, Properties());
+    Writer writer;
+    ASSERT_TRUE(writer.open(recorder.createStream(), TRACE_VERSION, Properties()));
+    recorder.attach(&writer);
+
+    writeFrames(writer, recorder, 0, 10);
+    ASSERT_TRUE(recorder.dump(false));
+
+    Calls calls = readCalls(filename);
+    EXPECT_EQ(std::vector<unsigned>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}), calls.binds);
+    EXPECT_EQ(std::vector<unsigned>({7, 8, 9}), calls.draws);
+    EXPECT_EQ(3U, calls.swaps);
+    EXPECT_EQ(0U, calls.incomplete);
+
+    // Recording goes on after a dump, with the state of all earlier frames
+    const char *second = "trace_flight_recorder_test.1.trace";
+    writeFrames(writer, recorder, 10, 5);
+    ASSERT_TRUE(recorder.dump(false));
+
+    calls = readCalls(second);
+    EXPECT_EQ(15U, calls.binds.size());
+    EXPECT_EQ(std::vector<unsigned>({12, 13, 14}), calls.draws);
+    EXPECT_EQ(3U, calls.swaps);
+
+    writer.close();
+
+    remove(filename);
+    remove(second);
+}
+
+
+TEST(trace_flight_recorder, final_dump)
+{
+    const char *filename = "trace_flight_recorder_test_final.trace";
+
+    FlightRecorder recorder(2, filename, Properties());
+    Writer writer;
+    ASSERT_TRUE(writer.open(recorder.createStream(), TRACE_VERSION, Properties()));
+    recorder.attach(&writer);
+
+    writeFrames(writer, recorder, 0, 4);
+
+    // A partial frame, with a call which never returns
+    writeCall(writer, recorder, &bind_sig, 4);
+    writer.beginEnter(&draw_sig, 0);
+    writer.beginArg(0);
+    writer.writeUInt(4);
+    writer.endArg();
+    writer.endEnter();
+    writer.flush();
+
+    ASSERT_TRUE(recorder.dump(true));
+
+    Calls calls = readCalls(filename);
+    EXPECT_EQ(std::vector<unsigned>({0, 1, 2, 3, 4}), calls.binds);
+    EXPECT_EQ(std::vector<unsigned>({2, 3, 4}), calls.draws);
+    EXPECT_EQ(2U, calls.swaps);
+    EXPECT_EQ(1U, calls.incomplete);
+
+    writer.close();
+
+    remove(filename);
+}
+
+
+// A call entered before the dumped frames, and returning in them, is left out
+TEST(trace_flight_recorder, stranded_leave)
+{
+    const char *filename = "trace_flight_recorder_test_stranded.trace";
+
+    FlightRecorder recorder(2, filename, Properties());
+    Writer writer;
+    ASSERT_TRUE(writer.open(recorder.createStream(), TRACE_VERSION, Properties()));
+    recorder.attach(&writer);
+
+    unsigned call_no = writer.beginEnter(&bind_sig, 1);
+    writer.beginArg(0);
+    writer.writeUInt(100);
+    writer.endArg();
+    writer.endEnter();
+
+    writeFrames(writer, recorder, 0, 3);
+
+    writer.beginLeave(call_no);
+    writer.endLeave();
+    recorder.endCall();
+    writeFrames(writer, recorder, 3, 1);
+
+    ASSERT_TRUE(recorder.dump(true));
+
+    Calls calls = readCalls(filename);
+    EXPECT_EQ(std::vector<unsigned>({0, 1, 2, 3}), calls.binds);
+    EXPECT_EQ(std::vector<unsigned>({2, 3}), calls.draws);
+    EXPECT_EQ(2U, calls.swaps);
+    EXPECT_EQ(0U, calls.incomplete);
+
+    writer.close();
+
+    remove(filename);
+}
+
+
+static void
+writeStateFrames(Writer &writer, FlightRecorder &recorder,
+                 unsigned first, unsigned count, bool barriers)
+{
+    for (unsigned frame = first; frame < first + count; ++frame) {
+        writeCall(writer, recorder, &enable_sig, 0x0B71 /* GL_DEPTH_TEST */);
+        writeCall(writer, recorder, &viewport_sig, frame);
+        if (barriers) {
+            writeCall(writer, recorder, &unknown_sig, frame);
+        }
+        writeCall(writer, recorder, &bind_sig, frame);
+        writeCall(writer, recorder, &draw_sig, frame);
+        writeCall(writer, recorder, &swap_sig, frame);
+        writer.flush();
+        recorder.endFrame();
+    }
+}
+
+
+TEST(trace_flight_recorder, supersedes_state)
+{
+    const char *filename = "trace_flight_recorder_test_supersede.trace";
+
+    FlightRecorder recorder(2, filename, Properties(), 64 * 1024);
+    Writer writer;
+    ASSERT_TRUE(writer.open(recorder.createStream(), TRACE_VERSION, Properties()));
+    recorder.attach(&writer);
+
+    writeCall(writer, recorder, &make_current_sig, 0x1234);
+    writeStateFrames(writer, recorder, 0, 1000, false);
+    ASSERT_TRUE(recorder.dump(false));
+
+    // Only the last of the evicted frames' settings are left, besides any
+    // kept since the last compaction
+    Calls calls = readCalls(filename);
+    EXPECT_EQ(1000U, calls.binds.size());
+    EXPECT_EQ(std::vector<unsigned>({998, 999}), calls.draws);
+    EXPECT_LT(calls.enables, 500U);
+    EXPECT_EQ(calls.enables, calls.viewports.size());
+    ASSERT_LE(3U, calls.viewports.size());
+    EXPECT_EQ(999U, calls.viewports.back());
+    EXPECT_EQ(997U, calls.viewports[calls.viewports.size() - 3]);
+    EXPECT_TRUE(std::is_sorted(calls.viewports.begin(), calls.viewports.end()));
+
+    writer.close();
+
+    remove(filename);
+}
+
+
+TEST(trace_flight_recorder, limits_state)
+{
+    const char *filename = "trace_flight_recorder_test_limit.trace";
+
+    FlightRecorder recorder(2, filename, Properties(), 16 * 1024);
+    Writer writer;
+    ASSERT_TRUE(writer.open(recorder.createStream(), TRACE_VERSION, Properties()));
+    recorder.attach(&writer);
+
+    // Nothing can be dropped, so the state stops growing at its limit
+    writeCall(writer, recorder, &make_current_sig, 0x1234);
+    writeStateFrames(writer, recorder, 0, 1000, true);
+    ASSERT_TRUE(recorder.dump(true));
+
+    Calls calls = readCalls(filename);
+    EXPECT_GT(1000U, calls.binds.size());
+    EXPECT_EQ(998U, calls.binds[calls.binds.size() - 2]);
+    EXPECT_EQ(999U, calls.binds.back());
+    EXPECT_EQ(std::vector<unsigned>({998, 999}), calls.draws);
+    EXPECT_EQ(0U, calls.incomplete);
+
+    writer.close();
+
+    remove(filename);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -34,7 +34,23 @@
 namespace trace {
 
 
-#define TRACE_VERSION 6
+#define TRACE_VERSION 7
+
+
+/*
+ * Oldest version able to hold blob definitions and references.  Traces
+ * without them are written with the version before, so that older readers
+ * can still parse them.
+ */
+#define TRACE_VERSION_BLOB_DEDUP 7
+
+
+/*
+ * Blob definitions are numbered sequentially, and a blob may only be
+ * referenced while the combined size of it and of all blobs defined after it
+ * does not exceed this.
+ */
+#define TRACE_BLOB_WINDOW_SIZE (64*1024*1024)
 
 
 enum Event {
@@ -68,6 +84,8 @@ enum Type {
     TYPE_OPAQUE,
     TYPE_REPR,
     TYPE_WSTRING,
+    TYPE_BLOB_DEF,
+    TYPE_BLOB_REF,
 };
 
 enum BacktraceDetail {
@@ -0,0 +1,130 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include "trace_ostream.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "os.hpp"
+
+
+using namespace trace;
+
+
+struct OutputFormatInfo {
+    const char *name;
+    OutputFormat format;
+    int minLevel;
+    int maxLevel;
+    int defaultLevel;
+};
+
+static const OutputFormatInfo
+outputFormats[] = {
+    {"snappy", OUTPUT_FORMAT_SNAPPY, 0, 0, 0},
+    {"zlib", OUTPUT_FORMAT_ZLIB, 1, 9, 9},
+    {"gzip", OUTPUT_FORMAT_ZLIB, 1, 9, 9},
+    {"brotli", OUTPUT_FORMAT_BROTLI, 0, 11, 9},
+    {"zstd", OUTPUT_FORMAT_ZSTD, 1, 22, 3},
+};
+
+
+static const OutputFormatInfo *
+lookupOutputFormat(OutputFormat format)
+{
+    for (auto & info : outputFormats) {
+        if (info.format == format) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+
+bool
+trace::parseOutputFormat(const char *spec, OutputOptions &options)
+{
+    const char *colon = strchr(spec, ':');
+    std::string name(spec, colon ? colon - spec : strlen(spec));
+
+    for (auto & info : outputFormats) {
+        if (name != info.name) {
+            continue;
+        }
+
+        options.format = info.format;
+        options.level = -1;
+        if (colon) {
+            char *end = nullptr;
+            long level = strtol(colon + 1, &end, 10);
+            if (end == colon + 1 || *end ||
+                info.minLevel == info.maxLevel ||
+                level < info.minLevel || level > info.maxLevel) {
+                os::log("error: invalid %s compression level: %s\n", info.name, colon + 1);
+                return false;
+            }
+            options.level = int(level);
+        }
+        return true;
+    }
+
+    os::log("error: unknown output format: %s\n", name.c_str());
+    return false;
+}
+
+
+OutStream *
+trace::createOutStream(const char *filename, const OutputOptions &options)
+{
+    const OutputFormatInfo *info = lookupOutputFormat(options.format);
+    int level = options.level < 0 ? info->defaultLevel : options.level;
+
+    OutStream *stream = nullptr;
+    switch (options.format) {
+    case OUTPUT_FORMAT_SNAPPY:
+        stream = createSnappyStream(filename, options.checksums);
+        break;
+    case OUTPUT_FORMAT_ZLIB:
+        stream = createZLibStream(filename, level);
+        break;
+    case OUTPUT_FORMAT_BROTLI:
+        stream = createBrotliStream(filename, level);
+        break;
+    case OUTPUT_FORMAT_ZSTD:
+        stream = createZstdStream(filename, level, options.checksums);
+        break;
+    }
+
+    if (stream && options.async) {
+        stream = createAsyncStream(stream);
+    }
+
+    return stream;
+}
@@ -42,14 +42,62 @@ public:
 };
 
 
+/**
+ * With checksums, a CRC-32C of each compressed chunk is appended to the file,
+ * so that `apitrace verify` can check it without decompressing.
+ */
 OutStream *
-createSnappyStream(const char *filename);
+createSnappyStream(const char *filename, bool checksums = false);
 
 OutStream *
-createZLibStream(const char *filename);
+createZLibStream(const char *filename, int compressionLevel = 9);
 
+/**
+ * With checksums, the seek table holds a checksum of each frame's
+ * uncompressed data.
+ */
 OutStream *
-createZstdStream(const char *filename, int compressionLevel);
+createZstdStream(const char *filename, int compressionLevel, bool checksums = false);
+
+OutStream *
+createBrotliStream(const char *filename, int quality);
+
+/**
+ * Hand the data to another stream from a background thread, so that
+ * compression and I/O overlap with the producer.  Takes ownership of the
+ * stream.
+ */
+OutStream *
+createAsyncStream(OutStream *stream);
+
+
+enum OutputFormat {
+    OUTPUT_FORMAT_SNAPPY = 0,
+    OUTPUT_FORMAT_ZLIB,
+    OUTPUT_FORMAT_BROTLI,
+    OUTPUT_FORMAT_ZSTD,
+};
+
+struct OutputOptions {
+    OutputFormat format = OUTPUT_FORMAT_SNAPPY;
+
+    // Negative for the default level of the format
+    int level = -1;
+
+    bool async = true;
+
+    // Per-chunk checksums, for the formats which support them
+    bool checksums = false;
+};
+
+/**
+ * Parse a FORMAT[:LEVEL] specification, as given to --output-format.
+ */
+bool
+parseOutputFormat(const char *spec, OutputOptions &options);
+
+OutStream *
+createOutStream(const char *filename, const OutputOptions &options);
 
 
 } /* namespace trace */
@@ -0,0 +1,170 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include "trace_ostream.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+using namespace trace;
+
+
+// Amount of data handed to the background thread at once
+#define ASYNC_CHUNK_SIZE (1024 * 1024)
+
+// Chunks queued before the producer blocks, which bounds memory usage
+#define ASYNC_MAX_CHUNKS 8
+
+
+class AsyncOutStream : public OutStream {
+public:
+    AsyncOutStream(OutStream *stream);
+    virtual ~AsyncOutStream();
+
+protected:
+    virtual bool write(const void *buffer, size_t length) override;
+    virtual void flush(void) override;
+
+private:
+    void submit(void);
+    void wait(void);
+    void run(void);
+
+    OutStream *m_stream;
+    std::string m_chunk;
+
+    std::mutex m_mutex;
+    std::condition_variable m_queueCond;
+    std::condition_variable m_doneCond;
+    std::deque<std::string> m_queue;
+    bool m_busy = false;
+    bool m_closing = false;
+    bool m_failed = false;
+
+    std::thread m_thread;
+};
+
+AsyncOutStream::AsyncOutStream(OutStream *stream)
+    : m_stream(stream)
+{
+    m_chunk.reserve(ASYNC_CHUNK_SIZE);
+    m_thread = std::thread(&AsyncOutStream::run, this);
+}
+
+AsyncOutStream::~AsyncOutStream()
+{
+    submit();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing = true;
+    }
+    m_queueCond.notify_one();
+    m_thread.join();
+
+    delete m_stream;
+}
+
+void AsyncOutStream::run(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_queueCond.wait(lock, [this] { return !m_queue.empty() || m_closing; });
+        if (m_queue.empty()) {
+            break;
+        }
+
+        std::string chunk = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_busy = true;
+        m_doneCond.notify_all();
+
+        lock.unlock();
+        bool ok = m_stream->write(chunk.data(), chunk.size());
+        lock.lock();
+
+        m_busy = false;
+        m_failed = m_failed || !ok;
+        m_doneCond.notify_all();
+    }
+}
+
+void AsyncOutStream::submit(void)
+{
+    if (m_chunk.empty()) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCond.wait(lock, [this] { return m_queue.size() < ASYNC_MAX_CHUNKS; });
+    m_queue.push_back(std::move(m_chunk));
+    lock.unlock();
+    m_queueCond.notify_one();
+
+    m_chunk.clear();
+    m_chunk.reserve(ASYNC_CHUNK_SIZE);
+}
+
+void AsyncOutStream::wait(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCond.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+}
+
+bool AsyncOutStream::write(const void *buffer, size_t length)
+{
+    m_chunk.append((const char *)buffer, length);
+    if (m_chunk.size() >= ASYNC_CHUNK_SIZE) {
+        submit();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_failed;
+}
+
+void AsyncOutStream::flush(void)
+{
+    submit();
+    wait();
+
+    // The background thread is idle, so the stream can be used from here
+    m_stream->flush();
+}
+
+
+OutStream *
+trace::createAsyncStream(OutStream *stream)
+{
+    if (!stream) {
+        return nullptr;
+    }
+    return new AsyncOutStream(stream);
+}
@@ -0,0 +1,131 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include "trace_ostream.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <brotli/encode.h>
+
+#include "os.hpp"
+#include "trace_stats.hpp"
+
+
+using namespace trace;
+
+
+class BrotliOutStream : public OutStream {
+public:
+    BrotliOutStream(FILE *fp, BrotliEncoderState *state);
+    virtual ~BrotliOutStream();
+
+protected:
+    virtual bool write(const void *buffer, size_t length) override;
+    virtual void flush(void) override;
+
+private:
+    bool compress(const uint8_t *buffer, size_t length, BrotliEncoderOperation op);
+
+    FILE *m_fp;
+    BrotliEncoderState *m_state;
+    uint8_t m_output[1 << 16];
+};
+
+BrotliOutStream::BrotliOutStream(FILE *fp, BrotliEncoderState *state)
+    : m_fp(fp),
+      m_state(state)
+{
+}
+
+BrotliOutStream::~BrotliOutStream()
+{
+    compress(nullptr, 0, BROTLI_OPERATION_FINISH);
+    BrotliEncoderDestroyInstance(m_state);
+    fclose(m_fp);
+}
+
+bool BrotliOutStream::compress(const uint8_t *buffer, size_t length, BrotliEncoderOperation op)
+{
+    stats::Scope scope(stats::SUBSYSTEM_COMPRESSION);
+
+    size_t available_in = length;
+    const uint8_t *next_in = buffer;
+    do {
+        size_t available_out = sizeof m_output;
+        uint8_t *next_out = m_output;
+        if (!BrotliEncoderCompressStream(m_state, op,
+                                         &available_in, &next_in,
+                                         &available_out, &next_out, nullptr)) {
+            os::log("error: brotli compression failed\n");
+            return false;
+        }
+
+        size_t out_size = sizeof m_output - available_out;
+        if (out_size && fwrite(m_output, 1, out_size, m_fp) != out_size) {
+            os::log("error: failed to write compressed data\n");
+            return false;
+        }
+    } while (available_in || BrotliEncoderHasMoreOutput(m_state));
+
+    return true;
+}
+
+bool BrotliOutStream::write(const void *buffer, size_t length)
+{
+    return compress((const uint8_t *)buffer, length, BROTLI_OPERATION_PROCESS);
+}
+
+void BrotliOutStream::flush(void)
+{
+    compress(nullptr, 0, BROTLI_OPERATION_FLUSH);
+    fflush(m_fp);
+}
+
+
+OutStream *
+trace::createBrotliStream(const char *filename, int quality)
+{
+    BrotliEncoderState *state = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+    if (!state) {
+        return nullptr;
+    }
+
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY, quality);
+
+    // The larger the window, the higher the compression ratio and
+    // decompression speeds, so choose the maximum.
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_LGWIN, 24);
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        BrotliEncoderDestroyInstance(state);
+        return nullptr;
+    }
+
+    return new BrotliOutStream(fp, state);
+}
@@ -28,14 +28,18 @@
 #include "trace_ostream.hpp"
 
 #include <fstream>
+#include <vector>
 
 #include <assert.h>
 #include <string.h>
 
 #include <snappy.h>
 
+#include "crc32c.hpp"
+
 #include "os.hpp"
 #include "trace_snappy.hpp"
+#include "trace_stats.hpp"
 
 
 #define SNAPPY_CHUNK_SIZE (1 * 1024 * 1024)
@@ -46,7 +50,7 @@ using namespace trace;
 
 class SnappyOutStream : public OutStream {
 public:
-    SnappyOutStream(const char *filename);
+    SnappyOutStream(const char *filename, bool checksums = false);
     ~SnappyOutStream();
 
     SnappyOutStream(void);
@@ -81,6 +85,7 @@ private:
     void flushWriteCache(void);
     void createCache(size_t size);
     void writeCompressedLength(size_t length);
+    void writeChecksums(void);
 private:
     std::ofstream m_stream;
     size_t m_cacheMaxSize;
@@ -89,13 +94,17 @@ private:
     char *m_cachePtr;
 
     char *m_compressedCache;
+
+    bool m_checksums;
+    std::vector<uint32_t> m_chunkChecksums;
 };
 
-SnappyOutStream::SnappyOutStream(const char *filename)
+SnappyOutStream::SnappyOutStream(const char *filename, bool checksums)
     : m_cacheMaxSize(SNAPPY_CHUNK_SIZE),
       m_cacheSize(m_cacheMaxSize),
       m_cache(new char [m_cacheMaxSize]),
-      m_cachePtr(m_cache)
+      m_cachePtr(m_cache),
+      m_checksums(checksums)
 {
     size_t maxCompressedLength =
         snappy::MaxCompressedLength(SNAPPY_CHUNK_SIZE);
@@ -152,6 +161,9 @@ bool SnappyOutStream::write(const void *buffer, size_t length)
 void SnappyOutStream::close(void)
 {
     flushWriteCache();
+    if (m_checksums && m_stream.is_open()) {
+        writeChecksums();
+    }
     m_stream.close();
     delete [] m_cache;
     m_cache = NULL;
@@ -169,6 +181,7 @@ void SnappyOutStream::flushWriteCache(void)
     size_t inputLength = usedCacheSize();
 
     if (inputLength) {
+        stats::Scope scope(stats::SUBSYSTEM_COMPRESSION);
         size_t compressedLength;
 
         ::snappy::RawCompress(m_cache, inputLength,
@@ -176,6 +189,9 @@ void SnappyOutStream::flushWriteCache(void)
 
         writeCompressedLength(compressedLength);
         m_stream.write(m_compressedCache, compressedLength);
+        if (m_checksums) {
+            m_chunkChecksums.push_back(crc32c_8bytes(m_compressedCache, compressedLength));
+        }
         m_cachePtr = m_cache;
     }
     assert(m_cachePtr == m_cache);
@@ -192,11 +208,21 @@ void SnappyOutStream::writeCompressedLength(size_t length)
     m_stream.write((const char *)buf, sizeof buf);
 }
 
+void SnappyOutStream::writeChecksums(void)
+{
+    writeCompressedLength(0);
+    for (uint32_t checksum : m_chunkChecksums) {
+        writeCompressedLength(checksum);
+    }
+    writeCompressedLength(m_chunkChecksums.size());
+    writeCompressedLength(SNAPPY_CHECKSUM_MAGIC);
+}
+
 
 OutStream *
-trace::createSnappyStream(const char *filename)
+trace::createSnappyStream(const char *filename, bool checksums)
 {
-    SnappyOutStream *outStream = new SnappyOutStream(filename);
+    SnappyOutStream *outStream = new SnappyOutStream(filename, checksums);
     if (!outStream->isOpen()) {
         os::log("error: could not open %s for writing\n", filename);
         delete outStream;
@@ -0,0 +1,126 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_ostream.hpp"
+#include "trace_parser.hpp"
+#include "trace_test_helpers.hpp"
+
+using namespace trace;
+
+
+static void
+writeTrace(const char *path, const OutputOptions &options, unsigned num_calls)
+{
+    Writer writer;
+    ASSERT_TRUE(writer.open(path, options, TRACE_VERSION, Properties()));
+    std::vector<char> data(3000);
+    for (unsigned i = 0; i < num_calls; ++i) {
+        data[i % data.size()] = char(i);
+        writeBlobCall(writer, &upload_sig, data.data(), data.size());
+        if (i % 1000 == 0) {
+            writer.flush();
+        }
+    }
+    writer.close();
+}
+
+
+static void
+checkTrace(const char *path, unsigned num_calls)
+{
+    Parser parser;
+    ASSERT_TRUE(parser.open(path));
+    unsigned count = 0;
+    Call *call;
+    while ((call = parser.parse_call())) {
+        EXPECT_EQ(count, call->no);
+        const Blob *blob = call->arg(0).toBlob();
+        ASSERT_TRUE(blob != nullptr);
+        EXPECT_EQ(3000U, blob->size);
+        EXPECT_EQ(char(count), blob->buf[count % 3000]);
+        delete call;
+        ++count;
+    }
+    EXPECT_EQ(num_calls, count);
+}
+
+
+TEST(trace_ostream, parse)
+{
+    OutputOptions options;
+    EXPECT_TRUE(parseOutputFormat("zstd", options));
+    EXPECT_EQ(OUTPUT_FORMAT_ZSTD, options.format);
+    EXPECT_EQ(-1, options.level);
+
+    EXPECT_TRUE(parseOutputFormat("brotli:5", options));
+    EXPECT_EQ(OUTPUT_FORMAT_BROTLI, options.format);
+    EXPECT_EQ(5, options.level);
+
+    EXPECT_TRUE(parseOutputFormat("snappy", options));
+    EXPECT_EQ(OUTPUT_FORMAT_SNAPPY, options.format);
+
+    EXPECT_FALSE(parseOutputFormat("snappy:1", options));
+    EXPECT_FALSE(parseOutputFormat("zlib:10", options));
+    EXPECT_FALSE(parseOutputFormat("zstd:", options));
+    EXPECT_FALSE(parseOutputFormat("lzma", options));
+}
+
+
+TEST(trace_ostream, roundtrip)
+{
+    const unsigned num_calls = 5000;
+    const char *formats[] = { "snappy", "zlib:1", "brotli:1", "zstd:1" };
+    for (const char *format : formats) {
+        for (bool async : {false, true}) {
+            SCOPED_TRACE(std::string(format) + (async ? " async" : ""));
+
+            OutputOptions options;
+            ASSERT_TRUE(parseOutputFormat(format, options));
+            options.async = async;
+
+            const char *path = "trace_ostream_test.trace";
+            writeTrace(path, options, num_calls);
+            checkTrace(path, num_calls);
+            remove(path);
+        }
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
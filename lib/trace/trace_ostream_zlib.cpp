@@ -78,16 +78,16 @@ void ZLibOutStream::flush(void)
 
 
 OutStream *
-trace::createZLibStream(const char *filename)
+trace::createZLibStream(const char *filename, int compressionLevel)
 {
     gzFile file = gzopen(filename, "wb");
     if (!file) {
         return nullptr;
     }
 
-    // Currently we only use gzip for offline compression, so aim for maximum
-    // compression
-    gzsetparams(file, Z_BEST_COMPRESSION, Z_DEFAULT_STRATEGY);
+    // Currently we only use gzip for offline compression, so the default is
+    // maximum compression
+    gzsetparams(file, compressionLevel, Z_DEFAULT_STRATEGY);
 
     return new ZLibOutStream(file);
 }
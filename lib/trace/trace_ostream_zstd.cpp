@@ -34,6 +34,7 @@
 #include <zstd_seekable.h>
 
 #include "os.hpp"
+#include "trace_stats.hpp"
 
 
 // Default frame size: 2MB (recommendation of Zstandard documentation)
@@ -50,7 +51,8 @@ class ZstdOutStream : public OutStream {
 public:
     ZstdOutStream(const char *filename,
                   int compressionLevel = ZSTD_COMPRESSION_LEVEL,
-                  unsigned maxFrameSize = ZSTD_FRAME_SIZE);
+                  unsigned maxFrameSize = ZSTD_FRAME_SIZE,
+                  bool checksums = false);
     ~ZstdOutStream();
 
     bool write(const void *buffer, size_t length) override;
@@ -72,7 +74,8 @@ private:
 
 ZstdOutStream::ZstdOutStream(const char *filename,
                              int compressionLevel,
-                             unsigned maxFrameSize)
+                             unsigned maxFrameSize,
+                             bool checksums)
     : m_fp(nullptr),
       m_cstream(nullptr),
       m_outputBuffer(nullptr),
@@ -91,10 +94,10 @@ ZstdOutStream::ZstdOutStream(const char *filename,
     }
 
     // Initialize seekable compression stream
-    // Parameters: compression level, add checksums, max frame size
+    // Parameters: compression level, add checksums to the seek table, max frame size
     size_t result = ZSTD_seekable_initCStream(m_cstream,
                                               compressionLevel,
-                                              0, // Add checksums for data integrity
+                                              checksums ? 1 : 0,
                                               maxFrameSize);
     if (ZSTD_isError(result)) {
         os::log("error: failed to initialize zstd compression: %s\n", ZSTD_getErrorName(result));
@@ -122,6 +125,8 @@ bool ZstdOutStream::write(const void *buffer, size_t length)
         return false;
     }
 
+    stats::Scope scope(stats::SUBSYSTEM_COMPRESSION);
+
     ZSTD_inBuffer input = { buffer, length, 0 };
 
     while (input.pos < input.size) {
@@ -203,23 +208,33 @@ void ZstdOutStream::flush(void)
     // trace_file_zstd_seekable.cpp, but we will fall back to
     // trace_file_zstd.cpp, which parses it but just doesn't allow seeking.  You
     // can repack to get a seekable file.
-    ZSTD_outBuffer output = { m_outputBuffer, m_outputBufferSize, 0 };
-    ZSTD_seekable_endFrame(m_cstream, nullptr);
-    if (output.pos > 0) {
-        size_t written = fwrite(m_outputBuffer, 1, output.pos, m_fp);
-        if (written != output.pos) {
-            os::log("error: failed to write final compressed data\n");
+    size_t remaining;
+    do {
+        ZSTD_outBuffer output = { m_outputBuffer, m_outputBufferSize, 0 };
+        remaining = ZSTD_seekable_endFrame(m_cstream, &output);
+
+        if (ZSTD_isError(remaining)) {
+            os::log("error: zstd frame flush failed: %s\n", ZSTD_getErrorName(remaining));
+            break;
         }
-    }
+
+        if (output.pos > 0) {
+            size_t written = fwrite(m_outputBuffer, 1, output.pos, m_fp);
+            if (written != output.pos) {
+                os::log("error: failed to write compressed data\n");
+                break;
+            }
+        }
+    } while (remaining > 0);
 
     fflush(m_fp);
 }
 
 
 OutStream *
-trace::createZstdStream(const char *filename, int compressionLevel)
+trace::createZstdStream(const char *filename, int compressionLevel, bool checksums)
 {
-    ZstdOutStream *outStream = new ZstdOutStream(filename, compressionLevel);
+    ZstdOutStream *outStream = new ZstdOutStream(filename, compressionLevel, ZSTD_FRAME_SIZE, checksums);
     if (!outStream->isOpen()) {
         os::log("error: could not open %s for writing\n", filename);
         delete outStream;
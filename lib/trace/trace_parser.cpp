@@ -53,11 +53,19 @@ Parser::~Parser() {
 
 bool Parser::open(const char *filename) {
     assert(!file);
-    file = File::createForRead(filename);
-    if (!file) {
+    File *_file = File::createForRead(filename);
+    if (!_file) {
         return false;
     }
 
+    return open(_file);
+}
+
+
+bool Parser::open(File *_file) {
+    assert(!file);
+    file = _file;
+
     version = read_uint();
     if (version > TRACE_VERSION) {
         std::cerr << "error: unsupported trace format version " << version << "\n";
@@ -159,7 +167,23 @@ void Parser::close(void) {
     }
     bitmasks.clear();
 
+    for (auto & blob : blobs) {
+        delete [] blob.data;
+    }
+    blobs.clear();
+    blobWindow.clear();
+    blobWindowSize = 0;
+
     next_call_no = 0;
+
+    sigFilter.clear();
+}
+
+
+void Parser::setCallFilter(const CallFilter &callFilter) {
+    filter = callFilter;
+    filtering = filter.signature || filter.call || filter.last != ~0U;
+    sigFilter.clear();
 }
 
 
@@ -177,6 +201,28 @@ void Parser::setBookmark(const ParseBookmark &bookmark) {
     deleteAll(calls);
 }
 
+
+void Parser::skipTo(const ParseBookmark &bookmark) {
+    while (file->currentOffset() < bookmark.offset) {
+        int c = read_byte();
+        if (c == trace::EVENT_ENTER) {
+            unsigned thread_id = version >= 4 ? read_uint() : 0;
+            FunctionSigFlags *sig = parse_function_sig();
+            Call call(sig, sig->flags, thread_id);
+            skip_call_details(&call);
+        } else if (c == trace::EVENT_LEAVE) {
+            read_uint();
+            const FunctionSig sig = {0, NULL, 0, NULL};
+            Call call(&sig, 0, 0);
+            skip_call_details(&call);
+        } else {
+            break;
+        }
+    }
+
+    setBookmark(bookmark);
+}
+
 void Parser::parseProperties(void)
 {
     if (TRACE_VERBOSE) {
@@ -195,6 +241,9 @@ void Parser::parseProperties(void)
 Call *Parser::parse_call(Mode mode) {
     do {
         Call *call;
+        if (filtering && next_call_no > filter.last && calls.empty()) {
+            return NULL;
+        }
         int c = read_byte();
         switch (c) {
         case trace::EVENT_ENTER:
@@ -457,9 +506,19 @@ void Parser::parse_enter(Mode mode) {
 
     FunctionSigFlags *sig = parse_function_sig();
 
+    unsigned call_no = next_call_no++;
+
+    if (filtering && !acceptCall(sig, thread_id, call_no)) {
+        // Its leave event won't find it, so won't be decoded either
+        Call call(sig, sig->flags, thread_id);
+        call.no = call_no;
+        skip_call_details(&call);
+        return;
+    }
+
     Call *call = new Call(sig, sig->flags, thread_id);
 
-    call->no = next_call_no++;
+    call->no = call_no;
 
     if (parse_call_details(call, mode)) {
         calls.push_back(call);
@@ -485,9 +544,8 @@ Call *Parser::parse_leave(Mode mode) {
          * over its data.
          */
         const FunctionSig sig = {0, NULL, 0, NULL};
-        call = new Call(&sig, 0, 0);
-        parse_call_details(call, SCAN);
-        delete call;
+        Call stranded(&sig, 0, 0);
+        skip_call_details(&stranded);
         return NULL;
     }
 
@@ -500,6 +558,35 @@ Call *Parser::parse_leave(Mode mode) {
 }
 
 
+bool Parser::acceptCall(const FunctionSigFlags *sig, unsigned thread_id, unsigned call_no) {
+    if (call_no > filter.last) {
+        return false;
+    }
+    if (sig->id >= sigFilter.size()) {
+        sigFilter.resize(sig->id + 1, SIG_UNFILTERED);
+    }
+    uint8_t &accepted = sigFilter[sig->id];
+    if (accepted == SIG_UNFILTERED) {
+        accepted = !filter.signature || filter.signature(sig, sig->flags) ? SIG_ACCEPTED : SIG_REJECTED;
+    }
+    if (accepted == SIG_REJECTED) {
+        return false;
+    }
+    return !filter.call || filter.call(sig, thread_id, call_no, sig->flags);
+}
+
+
+void Parser::skip_call_details(Call *call) {
+    // Calls skipped over are not scanned on behalf of the caller
+    ScanObserver *observer = scanObserver;
+    scanObserver = nullptr;
+    parse_call_details(call, SCAN);
+    scanObserver = observer;
+    delete call->backtrace;
+    call->backtrace = nullptr;
+}
+
+
 bool Parser::parse_call_details(Call *call, Mode mode) {
     do {
         int c = read_byte();
@@ -643,6 +730,13 @@ void Parser::adjust_call_flags(Call *call) {
 
 void Parser::parse_arg(Call *call, Mode mode) {
     size_t index = (size_t)read_uint();
+    if (mode == SCAN && scanObserver) {
+        scanBlobBytes = 0;
+        scanStringBytes = 0;
+        scan_value();
+        scanObserver->scannedArg(call, index, scanBlobBytes, scanStringBytes);
+        return;
+    }
     Value *value = parse_value(mode);
     if (value) {
         if (index >= call->args.size()) {
@@ -697,6 +791,12 @@ Value *Parser::parse_value(void) {
     case trace::TYPE_BLOB:
         value = parse_blob();
         break;
+    case trace::TYPE_BLOB_DEF:
+        value = parse_blob_def();
+        break;
+    case trace::TYPE_BLOB_REF:
+        value = parse_blob_ref();
+        break;
     case trace::TYPE_OPAQUE:
         value = parse_opaque();
         break;
@@ -761,6 +861,12 @@ void Parser::scan_value(void) {
     case trace::TYPE_BLOB:
         scan_blob();
         break;
+    case trace::TYPE_BLOB_DEF:
+        scan_blob_def();
+        break;
+    case trace::TYPE_BLOB_REF:
+        scan_blob_ref();
+        break;
     case trace::TYPE_OPAQUE:
         scan_opaque();
         break;
@@ -829,7 +935,9 @@ Value *Parser::parse_string() {
 
 
 void Parser::scan_string() {
-    skip_string();
+    size_t len = read_uint();
+    scanStringBytes += len;
+    file->skip(len);
 }
 
 
@@ -903,12 +1011,111 @@ Value *Parser::parse_blob(void) {
 
 void Parser::scan_blob(void) {
     size_t size = read_uint();
+    scanBlobBytes += size;
     if (size) {
         file->skip(size);
     }
 }
 
 
+void Parser::add_blob(unsigned id, const File::Offset &offset, size_t size, const char *data) {
+    if (id >= blobs.size()) {
+        blobs.resize(id + 1);
+    }
+
+    BlobState &state = blobs[id];
+    if (state.defined && (state.data || !data)) {
+        // Seen before, when reparsing after setBookmark
+        return;
+    }
+    state.defined = true;
+    state.fileOffset = offset;
+    state.size = size;
+
+    if (data) {
+        state.data = new char[size];
+        memcpy(state.data, data, size);
+
+        blobWindow.push_back(id);
+        blobWindowSize += size;
+        while (blobWindowSize > TRACE_BLOB_WINDOW_SIZE) {
+            BlobState &oldest = blobs[blobWindow.front()];
+            delete [] oldest.data;
+            oldest.data = nullptr;
+            blobWindowSize -= oldest.size;
+            blobWindow.pop_front();
+        }
+    }
+}
+
+
+Value *Parser::parse_blob_def(void) {
+    unsigned id = read_uint();
+    File::Offset offset = file->currentOffset();
+    size_t size = read_uint();
+    Blob *blob = new Blob(size);
+    if (size) {
+        file->read(blob->buf, size);
+    }
+    add_blob(id, offset, size, blob->buf);
+    return blob;
+}
+
+
+void Parser::scan_blob_def(void) {
+    unsigned id = read_uint();
+    File::Offset offset = file->currentOffset();
+    size_t size = read_uint();
+    scanBlobBytes += size;
+    if (file->supportsOffsets()) {
+        // Read it later if needed
+        file->skip(size);
+        add_blob(id, offset, size, nullptr);
+    } else {
+        char *data = new char[size];
+        file->read(data, size);
+        add_blob(id, offset, size, data);
+        delete [] data;
+    }
+}
+
+
+Value *Parser::parse_blob_ref(void) {
+    unsigned id = read_uint();
+    if (id >= blobs.size() || !blobs[id].defined) {
+        std::cerr << "error: reference to undefined blob " << id << "\n";
+        exit(1);
+    }
+
+    BlobState &state = blobs[id];
+    Blob *blob = new Blob(state.size);
+    if (state.data) {
+        memcpy(blob->buf, state.data, state.size);
+    } else {
+        // Evicted from the window (or only scanned), so read it again
+        if (!file->supportsOffsets()) {
+            std::cerr << "error: blob " << id << " is no longer available\n";
+            exit(1);
+        }
+        File::Offset offset = file->currentOffset();
+        file->setCurrentOffset(state.fileOffset);
+        read_uint();
+        file->read(blob->buf, state.size);
+        file->setCurrentOffset(offset);
+        add_blob(id, state.fileOffset, state.size, blob->buf);
+    }
+    return blob;
+}
+
+
+void Parser::scan_blob_ref(void) {
+    unsigned id = read_uint();
+    if (id < blobs.size()) {
+        scanBlobBytes += blobs[id].size;
+    }
+}
+
+
 Value *Parser::parse_struct() {
     StructSig *sig = parse_struct_sig();
     Struct *value = new Struct(sig);
@@ -970,6 +1177,7 @@ Value *Parser::parse_wstring() {
 
 void Parser::scan_wstring() {
     size_t len = read_uint();
+    scanStringBytes += len;
     for (size_t i = 0; i < len; ++i) {
         skip_uint();
     }
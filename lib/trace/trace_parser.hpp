@@ -26,6 +26,8 @@
 #pragma once
 
 
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <list>
 
@@ -45,6 +47,25 @@ struct ParseBookmark
 };
 
 
+/**
+ * Selects the calls a Parser returns, from what is known when a call starts,
+ * so that the arguments of rejected calls are never decoded.
+ */
+struct CallFilter
+{
+    // Evaluated once per function signature.  Calls of rejected functions are
+    // skipped without evaluating the call predicate.
+    std::function<bool (const FunctionSig *sig, CallFlags flags)> signature;
+
+    // Evaluated for every call of accepted functions.
+    std::function<bool (const FunctionSig *sig, unsigned thread_id, unsigned call_no, CallFlags flags)> call;
+
+    // Calls numbered after this are skipped, and parsing ends once all calls
+    // up to it have left.
+    unsigned last = ~0U;
+};
+
+
 // Parser interface
 class AbstractParser
 {
@@ -58,12 +79,21 @@ public:
     virtual unsigned long long getVersion(void) const = 0;
     virtual const Properties & getProperties(void) const = 0;
 
+    // Whether bookmarks can be taken, which is known once opened
+    virtual bool supportsOffsets(void) const { return false; }
+
+    // Whether a bookmark taken now would miss calls which already entered
+    virtual bool hasPendingCalls(void) const { return false; }
+
     const std::string & getProperty(const char *name) const;
 };
 
 
 class Parser: public AbstractParser
 {
+public:
+    class ScanObserver;
+
 protected:
     File *file = nullptr;
 
@@ -111,15 +141,55 @@ protected:
     StackFrameMap frames;
 
 
+    // Deduplicated blobs, indexed by their id.  Only the contents of the
+    // blobs in the window are kept in memory; others are read again from
+    // their file offset when referenced (e.g., after setBookmark.)
+    struct BlobState {
+        bool defined = false;
+        File::Offset fileOffset;
+        size_t size = 0;
+        char *data = nullptr;
+    };
+    std::vector<BlobState> blobs;
+    std::deque<unsigned> blobWindow;
+    size_t blobWindowSize = 0;
+
     FunctionSig *glGetErrorSig = nullptr;
 
+    CallFilter filter;
+    bool filtering = false;
+    enum {
+        SIG_UNFILTERED = 0,
+        SIG_ACCEPTED,
+        SIG_REJECTED,
+    };
+    std::vector<uint8_t> sigFilter;
+
     int next_event_type = -1;
     unsigned next_call_no = 0;
 
+    ScanObserver *scanObserver = nullptr;
+    size_t scanBlobBytes = 0;
+    size_t scanStringBytes = 0;
+
     unsigned long long version = 0;
     unsigned long long semanticVersion = 0;
 
 public:
+    /**
+     * Told about the arguments scan_call() skips over, with the amount of
+     * blob and string data within each.  The sizes come from the length
+     * prefixes, so the data itself is still skipped, not read.
+     */
+    class ScanObserver
+    {
+    public:
+        virtual ~ScanObserver() {}
+
+        virtual void
+        scannedArg(const Call *call, unsigned index, size_t blobBytes, size_t stringBytes) = 0;
+    };
+
     API api = API_UNKNOWN;
 
     Parser();
@@ -128,13 +198,18 @@ public:
 
     bool open(const char *filename) override;
 
+    /**
+     * Parse an already opened file, taking ownership of it.
+     */
+    bool open(File *file);
+
     void close(void) override;
 
     Call *parse_call(void) override {
         return parse_call(FULL);
     }
 
-    bool supportsOffsets() const
+    bool supportsOffsets() const override
     {
         return file->supportsOffsets();
     }
@@ -143,10 +218,24 @@ public:
 
     void setBookmark(const ParseBookmark &bookmark) override;
 
+    /**
+     * Like setBookmark, but for a parser which has not seen the preceding
+     * part of the trace: the calls up to the bookmark are skipped over, only
+     * to learn the signatures and blobs defined there.
+     */
+    void skipTo(const ParseBookmark &bookmark);
+
     unsigned long long getVersion(void) const override {
         return semanticVersion;
     }
 
+    /**
+     * Version of the binary format, which may be newer than getVersion().
+     */
+    unsigned long long getFormatVersion(void) const {
+        return version;
+    }
+
     const Properties & getProperties(void) const override {
         return properties;
     }
@@ -176,6 +265,24 @@ public:
         return parse_call(SCAN);
     }
 
+    /**
+     * Only return the calls accepted by the filter.  Call numbers are
+     * unaffected.
+     */
+    void setCallFilter(const CallFilter &callFilter);
+
+    /**
+     * Whether calls were entered but have not left yet.  A bookmark taken
+     * when there are none splits the trace cleanly.
+     */
+    bool hasPendingCalls(void) const override {
+        return !calls.empty();
+    }
+
+    void setScanObserver(ScanObserver *observer) {
+        scanObserver = observer;
+    }
+
 protected:
     Call *parse_call(Mode mode);
 
@@ -196,6 +303,10 @@ protected:
 
     void parse_enter(Mode mode);
 
+    bool acceptCall(const FunctionSigFlags *sig, unsigned thread_id, unsigned call_no);
+
+    void skip_call_details(Call *call);
+
     Call *parse_leave(Mode mode);
 
     bool parse_call_details(Call *call, Mode mode);
@@ -245,6 +356,14 @@ protected:
     Value *parse_blob(void);
     void scan_blob(void);
 
+    Value *parse_blob_def(void);
+    void scan_blob_def(void);
+
+    Value *parse_blob_ref(void);
+    void scan_blob_ref(void);
+
+    void add_blob(unsigned id, const File::Offset &offset, size_t size, const char *data);
+
     Value *parse_struct();
     void scan_struct();
 
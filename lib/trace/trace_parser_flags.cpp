@@ -33,8 +33,7 @@
 #include "trace_parser.hpp"
 
 #include <assert.h>
-
-#include <regex>
+#include <string.h>
 
 #include "trace_lookup.hpp"
 
@@ -489,64 +488,336 @@ callFlagTable[] = {
 
 
 
+/*
+ * Name pattern matchers.
+ *
+ * These used to be std::regex, but matching every new signature against a
+ * handful of regular expressions dominated the cost of opening a trace.  The
+ * patterns are simple enough to match by hand, without backtracking; each
+ * function documents the expression it implements, and
+ * trace_parser_flags_test.cpp checks them against std::regex.
+ */
+
+static inline bool
+isUpper(char c) {
+    return c >= 'A' && c <= 'Z';
+}
+
+static inline bool
+isLower(char c) {
+    return c >= 'a' && c <= 'z';
+}
+
+static inline bool
+isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool
+isAlpha(char c) {
+    return isUpper(c) || isLower(c);
+}
+
+static inline bool
+isWord(char c) {
+    return isAlpha(c) || isDigit(c) || c == '_';
+}
+
+
+// Skip the given prefix, or return nullptr
+static inline const char *
+skip(const char *s, const char *prefix)
+{
+    size_t len = strlen(prefix);
+    return strncmp(s, prefix, len) == 0 ? s + len : nullptr;
+}
+
+
+// [0-9A-Z]*$
+static bool
+matchUpperSuffix(const char *s)
+{
+    while (isUpper(*s) || isDigit(*s)) {
+        ++s;
+    }
+    return *s == '\0';
+}
+
+
+// \w*$
+static bool
+matchWordSuffix(const char *s)
+{
+    while (isWord(*s)) {
+        ++s;
+    }
+    return *s == '\0';
+}
+
+
+// ([A-Z][a-zA-Z]*)?[0-9A-Z]*$
+static bool
+matchOptionalWordUpperSuffix(const char *s)
+{
+    if (matchUpperSuffix(s)) {
+        return true;
+    }
+    if (!isUpper(*s)) {
+        return false;
+    }
+    do {
+        ++s;
+        if (matchUpperSuffix(s)) {
+            return true;
+        }
+    } while (isAlpha(*s));
+    return false;
+}
+
+
+// ^gl([A-Z][a-z]+)*Draw(Range|Mesh)?(Arrays|Elements)([A-Z][a-zA-Z]*)?$
+static bool
+matchGlDraw(const char *name)
+{
+    const char *s = skip(name, "gl");
+    if (!s) {
+        return false;
+    }
+
+    // Every word, including Draw, is capitalized, so word boundaries are
+    // unambiguous
+    while (true) {
+        const char *t = skip(s, "Draw");
+        if (t) {
+            const char *u;
+            if ((u = skip(t, "Range")) || (u = skip(t, "Mesh"))) {
+                t = u;
+            }
+            if ((u = skip(t, "Arrays")) || (u = skip(t, "Elements"))) {
+                if (*u == '\0') {
+                    return true;
+                }
+                if (isUpper(*u)) {
+                    do {
+                        ++u;
+                    } while (isAlpha(*u));
+                    if (*u == '\0') {
+                        return true;
+                    }
+                }
+            }
+        }
+
+        if (!isUpper(s[0]) || !isLower(s[1])) {
+            return false;
+        }
+        s += 2;
+        while (isLower(*s)) {
+            ++s;
+        }
+    }
+}
+
+
+// ^gl(CallLists?|Clear|End|DrawPixels|DrawTransformFeedback([A-Z][a-zA-Z]*)?|
+//     BlitFramebuffer|Rect[dfis]v?|EvalMesh[0-9]+)[0-9A-Z]*$
+static bool
+matchGlMiscDraw(const char *name)
+{
+    const char *s = skip(name, "gl");
+    if (!s) {
+        return false;
+    }
+
+    const char *t;
+    if ((t = skip(s, "CallList"))) {
+        if (*t == 's') {
+            ++t;
+        }
+        return matchUpperSuffix(t);
+    }
+    if ((t = skip(s, "Clear")) ||
+        (t = skip(s, "End")) ||
+        (t = skip(s, "DrawPixels")) ||
+        (t = skip(s, "BlitFramebuffer"))) {
+        return matchUpperSuffix(t);
+    }
+    if ((t = skip(s, "DrawTransformFeedback"))) {
+        return matchOptionalWordUpperSuffix(t);
+    }
+    if ((t = skip(s, "Rect"))) {
+        if (!*t || !strchr("dfis", *t)) {
+            return false;
+        }
+        ++t;
+        if (*t == 'v') {
+            ++t;
+        }
+        return matchUpperSuffix(t);
+    }
+    if ((t = skip(s, "EvalMesh"))) {
+        return isDigit(*t) && matchUpperSuffix(t + 1);
+    }
+    return false;
+}
+
+
+// ^gl(GetFloat|GetInteger|GetVertexAttrib|GetTex(ture)?(Level)?Parameter)\w+$
+static bool
+matchGlGet(const char *name)
+{
+    const char *s = skip(name, "glGet");
+    if (!s) {
+        return false;
+    }
+
+    const char *t;
+    if (!(t = skip(s, "Float")) &&
+        !(t = skip(s, "Integer")) &&
+        !(t = skip(s, "VertexAttrib"))) {
+        t = skip(s, "Tex");
+        if (!t) {
+            return false;
+        }
+        const char *u;
+        if ((u = skip(t, "ture"))) {
+            t = u;
+        }
+        if ((u = skip(t, "Level"))) {
+            t = u;
+        }
+        t = skip(t, "Parameter");
+        if (!t) {
+            return false;
+        }
+    }
+    return *t != '\0' && matchWordSuffix(t);
+}
+
+
+// ^IDXGI(Decode)?SwapChain\w*::Present\w*$
+static bool
+matchDxgiPresent(const char *name)
+{
+    const char *s = skip(name, "IDXGI");
+    if (!s) {
+        return false;
+    }
+    const char *t;
+    if ((t = skip(s, "Decode"))) {
+        s = t;
+    }
+    s = skip(s, "SwapChain");
+    if (!s) {
+        return false;
+    }
+    while (isWord(*s)) {
+        ++s;
+    }
+    s = skip(s, "::Present");
+    return s && matchWordSuffix(s);
+}
+
+
+// ^ID3D1(0Device|1DeviceContext)\d*::
+static const char *
+skipD3D10DeviceOrD3D11DeviceContext(const char *name)
+{
+    const char *s = skip(name, "ID3D1");
+    if (!s) {
+        return nullptr;
+    }
+    const char *t;
+    if (!(t = skip(s, "0Device")) &&
+        !(t = skip(s, "1DeviceContext"))) {
+        return nullptr;
+    }
+    while (isDigit(*t)) {
+        ++t;
+    }
+    return skip(t, "::");
+}
+
+
+// ^ID3D1(0Device|1DeviceContext)\d*::(Draw\w*|ExecuteCommandList)$
+static bool
+matchD3DDraw(const char *name)
+{
+    const char *s = skipD3D10DeviceOrD3D11DeviceContext(name);
+    if (!s) {
+        return false;
+    }
+    const char *t = skip(s, "Draw");
+    if (t) {
+        return matchWordSuffix(t);
+    }
+    return strcmp(s, "ExecuteCommandList") == 0;
+}
+
+
+// ^ID3D1(0Device|1DeviceContext)\d*::OMSetRenderTargets\w*$
+static bool
+matchD3DSetRenderTargets(const char *name)
+{
+    const char *s = skipD3D10DeviceOrD3D11DeviceContext(name);
+    if (!s) {
+        return false;
+    }
+    s = skip(s, "OMSetRenderTargets");
+    return s && matchWordSuffix(s);
+}
+
+
+// ^ID3D1[01]Device\d*::(CheckFormatSupport|CheckMultisampleQualityLevels)$
+static bool
+matchD3DCheckFormat(const char *name)
+{
+    const char *s = skip(name, "ID3D1");
+    if (!s || (*s != '0' && *s != '1')) {
+        return false;
+    }
+    s = skip(s + 1, "Device");
+    if (!s) {
+        return false;
+    }
+    while (isDigit(*s)) {
+        ++s;
+    }
+    s = skip(s, "::");
+    return s &&
+           (strcmp(s, "CheckFormatSupport") == 0 ||
+            strcmp(s, "CheckMultisampleQualityLevels") == 0);
+}
+
+
 /**
  * Lookup call flags by name.
  */
 CallFlags
 Parser::lookupCallFlags(const char *name)
 {
-    using namespace std;
-
     if (name[0] == 'g') {
-        static const regex draw(
-            "^gl([A-Z][a-z]+)*Draw(Range|Mesh)?(Arrays|Elements)([A-Z][a-zA-Z]*)?$"
-        );
-
-        static const regex miscDraw(
-            "^gl("
-                "CallLists?|"
-                "Clear|"
-                "End|"
-                "DrawPixels|"
-                "DrawTransformFeedback([A-Z][a-zA-Z]*)?|"
-                "BlitFramebuffer|"
-                "Rect[dfis]v?|"
-                "EvalMesh[0-9]+"
-            ")[0-9A-Z]*$"
-        );
-        if (regex_match(name, draw) ||
-            regex_match(name, miscDraw)) {
+        if (matchGlDraw(name) ||
+            matchGlMiscDraw(name)) {
             return CALL_FLAG_RENDER;
         }
 
-        static const regex fbo( "^glBindFramebuffer[0-9A-Z]*");
-        if (regex_match(name, fbo)) {
+        // ^glBindFramebuffer[0-9A-Z]*$
+        const char *fbo = skip(name, "glBindFramebuffer");
+        if (fbo && matchUpperSuffix(fbo)) {
             return CALL_FLAG_SWAP_RENDERTARGET;
         }
 
-        static const regex get(
-            "^gl("
-                "GetFloat|"
-                "GetInteger|"
-                "GetVertexAttrib|"
-                "GetTex(ture)?(Level)?Parameter"
-            ")\\w+$"
-        );
-        if (regex_match(name, get)) {
+        if (matchGlGet(name)) {
             return CALL_FLAG_NO_SIDE_EFFECTS;
         }
     }
 
     if (name[0] == 'I') {
-        static const regex present("^IDXGI(Decode)?SwapChain\\w*::Present\\w*$");
-        static const regex draw   ("^ID3D1(0Device|1DeviceContext)\\d*::(Draw\\w*|ExecuteCommandList)$");
-        static const regex srt    ("^ID3D1(0Device|1DeviceContext)\\d*::OMSetRenderTargets\\w*$");
-        static const regex cmql   ("^ID3D1[01]Device\\d*::(CheckFormatSupport|CheckMultisampleQualityLevels)$");
-
-        if (regex_match(name, draw))    return CALL_FLAG_RENDER;
-        if (regex_match(name, srt))     return CALL_FLAG_SWAP_RENDERTARGET;
-        if (regex_match(name, present)) return CALL_FLAG_END_FRAME /* | CALL_FLAG_SWAPBUFFERS */;
-        if (regex_match(name, cmql))    return CALL_FLAG_NO_SIDE_EFFECTS | CALL_FLAG_VERBOSE;
+        if (matchD3DDraw(name))             return CALL_FLAG_RENDER;
+        if (matchD3DSetRenderTargets(name)) return CALL_FLAG_SWAP_RENDERTARGET;
+        if (matchDxgiPresent(name))         return CALL_FLAG_END_FRAME /* | CALL_FLAG_SWAPBUFFERS */;
+        if (matchD3DCheckFormat(name))      return CALL_FLAG_NO_SIDE_EFFECTS | CALL_FLAG_VERBOSE;
     }
 
     return entryLookup(name, callFlagTable, defaultCallFlags);
@@ -26,6 +26,10 @@
 
 #include "trace_parser.hpp"
 
+#include <regex>
+#include <string>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 #include "trace_lookup.hpp"
@@ -85,6 +89,7 @@ entries[] = {
     { "ID3D11DeviceContext::ExecuteCommandList",            CALL_FLAG_RENDER },
     { "ID3D11DeviceContext::OMSetRenderTargets",       CALL_FLAG_SWAP_RENDERTARGET },
     { "ID3D11DeviceContext::OMSetRenderTargetsAndUnorderedAccessViews", CALL_FLAG_SWAP_RENDERTARGET },
+    { "ID3D11VideoProcessorEnumerator::CheckVideoProcessorFormat", CALL_FLAG_NO_SIDE_EFFECTS | CALL_FLAG_VERBOSE },
     { "ID3DUserDefinedAnnotation::BeginEvent",         /* CALL_FLAG_NO_SIDE_EFFECTS | */ CALL_FLAG_MARKER | CALL_FLAG_MARKER_PUSH },
     { "ID3DUserDefinedAnnotation::EndEvent",           /* CALL_FLAG_NO_SIDE_EFFECTS | */ CALL_FLAG_MARKER | CALL_FLAG_MARKER_POP },
     { "ID3DUserDefinedAnnotation::SetMarker",          /* CALL_FLAG_NO_SIDE_EFFECTS | */ CALL_FLAG_MARKER },
@@ -164,7 +169,10 @@ entries[] = {
     { "eglGetConfigAttrib",                            CALL_FLAG_VERBOSE },
     { "eglGetProcAddress",                             CALL_FLAG_NO_SIDE_EFFECTS | CALL_FLAG_VERBOSE },
     { "eglQueryString",                                CALL_FLAG_NO_SIDE_EFFECTS | CALL_FLAG_VERBOSE },
+    { "eglSetDamageRegionKHR",                         CALL_FLAG_NO_SIDE_EFFECTS },
     { "eglSwapBuffers",                                CALL_FLAG_SWAPBUFFERS },
+    { "eglSwapBuffersWithDamageEXT",                   CALL_FLAG_SWAPBUFFERS },
+    { "eglSwapBuffersWithDamageKHR",                   CALL_FLAG_SWAPBUFFERS },
     { "glAreProgramsResidentNV",                       CALL_FLAG_NO_SIDE_EFFECTS },
     { "glAreTexturesResident",                         CALL_FLAG_NO_SIDE_EFFECTS },
     { "glAreTexturesResidentEXT",                      CALL_FLAG_NO_SIDE_EFFECTS },
@@ -605,6 +613,7 @@ entries[] = {
     { "glXQueryExtensionsString",                      CALL_FLAG_NO_SIDE_EFFECTS | CALL_FLAG_VERBOSE },
     { "glXQueryVersion",                               CALL_FLAG_NO_SIDE_EFFECTS | CALL_FLAG_VERBOSE },
     { "glXSwapBuffers",                                CALL_FLAG_SWAPBUFFERS },
+    { "glXSwapBuffersMscOML",                          CALL_FLAG_SWAPBUFFERS },
     { "wglDescribePixelFormat",                        CALL_FLAG_NO_SIDE_EFFECTS | CALL_FLAG_VERBOSE },
     { "wglGetCurrentContext",                          CALL_FLAG_NO_SIDE_EFFECTS | CALL_FLAG_VERBOSE },
     { "wglGetCurrentDC",                               CALL_FLAG_NO_SIDE_EFFECTS | CALL_FLAG_VERBOSE },
@@ -636,6 +645,207 @@ TEST(common_parser, lookupCallFlags)
 }
 
 
+/**
+ * Name patterns, as regular expressions.
+ *
+ * Parser::lookupCallFlags matches these by hand, so this is the reference
+ * implementation it is checked against.
+ */
+static bool
+regexCallFlags(const char *name, CallFlags &flags)
+{
+    using namespace std;
+
+    static const regex glDraw(
+        "^gl([A-Z][a-z]+)*Draw(Range|Mesh)?(Arrays|Elements)([A-Z][a-zA-Z]*)?$"
+    );
+    static const regex glMiscDraw(
+        "^gl("
+            "CallLists?|"
+            "Clear|"
+            "End|"
+            "DrawPixels|"
+            "DrawTransformFeedback([A-Z][a-zA-Z]*)?|"
+            "BlitFramebuffer|"
+            "Rect[dfis]v?|"
+            "EvalMesh[0-9]+"
+        ")[0-9A-Z]*$"
+    );
+    static const regex glFbo("^glBindFramebuffer[0-9A-Z]*");
+    static const regex glGet(
+        "^gl("
+            "GetFloat|"
+            "GetInteger|"
+            "GetVertexAttrib|"
+            "GetTex(ture)?(Level)?Parameter"
+        ")\\w+$"
+    );
+    static const regex present("^IDXGI(Decode)?SwapChain\\w*::Present\\w*$");
+    static const regex d3dDraw("^ID3D1(0Device|1DeviceContext)\\d*::(Draw\\w*|ExecuteCommandList)$");
+    static const regex srt    ("^ID3D1(0Device|1DeviceContext)\\d*::OMSetRenderTargets\\w*$");
+    static const regex cmql   ("^ID3D1[01]Device\\d*::(CheckFormatSupport|CheckMultisampleQualityLevels)$");
+
+    if (name[0] == 'g') {
+        if (regex_match(name, glDraw) || regex_match(name, glMiscDraw)) {
+            flags = CALL_FLAG_RENDER;
+            return true;
+        }
+        if (regex_match(name, glFbo)) {
+            flags = CALL_FLAG_SWAP_RENDERTARGET;
+            return true;
+        }
+        if (regex_match(name, glGet)) {
+            flags = CALL_FLAG_NO_SIDE_EFFECTS;
+            return true;
+        }
+    }
+
+    if (name[0] == 'I') {
+        if (regex_match(name, d3dDraw)) {
+            flags = CALL_FLAG_RENDER;
+            return true;
+        }
+        if (regex_match(name, srt)) {
+            flags = CALL_FLAG_SWAP_RENDERTARGET;
+            return true;
+        }
+        if (regex_match(name, present)) {
+            flags = CALL_FLAG_END_FRAME;
+            return true;
+        }
+        if (regex_match(name, cmql)) {
+            flags = CALL_FLAG_NO_SIDE_EFFECTS | CALL_FLAG_VERBOSE;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+ * Names which probe the edges of the patterns.
+ */
+static const char *
+patternNames[] = {
+    "gl",
+    "glDraw",
+    "glDrawArraysinstanced",
+    "glDrawRangeElementArrayAPPLE",
+    "glDrawMeshArraysSUN",
+    "glDrawMeshTasksNV",
+    "glMultiDrawElementsIndirectCount",
+    "glMultiModeDrawArraysIBM",
+    "glXDrawArrays",
+    "glMultiDrawArrays2",
+    "glCallLists2",
+    "glCallListsEXT",
+    "glCallListx",
+    "glClearColor",
+    "glClearNamedFramebufferfv",
+    "glEndList",
+    "glEndQuery",
+    "glEnd2D",
+    "glDrawTransformFeedbackStreamInstanced",
+    "glDrawTransformFeedbackStream2",
+    "glDrawTransformFeedbackNV",
+    "glDrawTransformFeedbackinstanced",
+    "glRect",
+    "glRectx",
+    "glRectsvEXT",
+    "glRectfvv",
+    "glEvalMesh",
+    "glEvalMesh12",
+    "glEvalMeshA",
+    "glBindFramebufferEXT2",
+    "glBindFramebuffers",
+    "glGetFloat",
+    "glGetFloati_v",
+    "glGetIntegerui64i_vNV",
+    "glGetTexParameter",
+    "glGetTexLevelParameterfv",
+    "glGetTextureLevelParameterfvEXT",
+    "glGetTexturParameteriv",
+    "glGetTextureParameter",
+    "glGetVertexAttribLdv",
+    "I",
+    "IDXGISwapChain",
+    "IDXGISwapChain::",
+    "IDXGISwapChain4::Present",
+    "IDXGISwapChain_::Present_1",
+    "IDXGIDecodeSwapChain::Present",
+    "IDXGIDecodeSwapChain:::Present",
+    "IDXGISwapChain::Present::",
+    "ID3D10Device",
+    "ID3D10Device::",
+    "ID3D10Device::Draw",
+    "ID3D10Device1::DrawIndexed_",
+    "ID3D10Device12::ExecuteCommandList",
+    "ID3D10Device::ExecuteCommandListX",
+    "ID3D10DeviceContext::Draw",
+    "ID3D11Device::Draw",
+    "ID3D11DeviceContext4::DrawAuto",
+    "ID3D11DeviceContextX::DrawAuto",
+    "ID3D11DeviceContext::OMSetRenderTargets2",
+    "ID3D11DeviceContext::OMSetRenderTarget",
+    "ID3D10Device::CheckFormatSupport",
+    "ID3D11Device5::CheckFormatSupport",
+    "ID3D11Device5::CheckFormatSupport2",
+    "ID3D11DeviceContext::CheckFormatSupport",
+    "ID3D12Device::CheckFormatSupport",
+};
+
+
+/**
+ * Variations of a name, which may or may not match the same patterns.
+ */
+static void
+addVariations(std::vector<std::string> &names, const std::string &name)
+{
+    static const char *suffixes[] = {
+        "", "s", "v", "2", "_", "EXT", "Ext", "::", "x", "A1",
+    };
+    for (const char *suffix : suffixes) {
+        names.push_back(name + suffix);
+    }
+    for (size_t len = 1; len < name.size(); ++len) {
+        names.push_back(name.substr(0, len));
+    }
+    for (size_t i = 2; i < name.size(); ++i) {
+        std::string swapped(name);
+        char c = swapped[i];
+        swapped[i] = c >= 'a' && c <= 'z' ? c - 'a' + 'A' :
+                     c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : 'X';
+        names.push_back(swapped);
+    }
+}
+
+
+TEST(common_parser, lookupCallFlagsPatterns)
+{
+    std::vector<std::string> names;
+    for (const Entry<CallFlags> &entry : entries) {
+        addVariations(names, entry.name);
+    }
+    for (const char *name : patternNames) {
+        addVariations(names, name);
+    }
+
+    for (const std::string &name : names) {
+        // All names in the lookup table are in the entries too, so the
+        // expected flags for names matching no pattern are known
+        CallFlags expected;
+        if (!regexCallFlags(name.c_str(), expected)) {
+            expected = entryLookup(name.c_str(), entries, CallFlags(0));
+        }
+
+        CallFlags flags = Parser::lookupCallFlags(name.c_str());
+
+        EXPECT_EQ(expected, flags) << "flags differ for " << name;
+    }
+}
+
+
 int
 main(int argc, char **argv)
 {
@@ -30,19 +30,27 @@
 namespace trace {
 
 
-// Decorator for parser which loops
+/*
+ * Decorator for parser which loops over the last frame.
+ *
+ * When the parser supports offsets, only a bookmark to the start of the
+ * current frame is kept, and the last frame is parsed again when looping
+ * starts, so calls are freed by the caller as usual until then.  Otherwise,
+ * or for frames where other calls had already entered when it started, the
+ * calls of the current frame are held until the next frame starts.
+ */
 class LastFrameLoopParser : public AbstractParser  {
 public:
     LastFrameLoopParser(AbstractParser *p, int c) {
         parser = p;
         loopCount = c;
         starts_new_frame = true;
+        holding = true;
+        looping = false;
     }
 
     ~LastFrameLoopParser() {
-        for (auto c : lastFrameCalls)
-            delete c;
-        lastFrameCalls.clear();
+        deleteLastFrameCalls();
         delete parser;
     }
 
@@ -58,9 +66,23 @@ public:
 private:
     int loopCount;
     bool starts_new_frame;
+    bool holding;
+    bool looping;
     AbstractParser *parser;
+    ParseBookmark lastFrameBookmark;
     std::vector<Call *> lastFrameCalls;
     std::vector<Call *>::iterator lastFrameIterator;
+
+    void deleteLastFrameCalls(void) {
+        for (auto c : lastFrameCalls)
+            delete c;
+        lastFrameCalls.clear();
+    }
+
+    void holdCall(Call *call) {
+        call->reuse_call = true;
+        lastFrameCalls.push_back(call);
+    }
 };
 
 
@@ -75,26 +97,54 @@ LastFrameLoopParser::parse_call(void)
 {
     trace::Call *call;
 
-    call = parser->parse_call();
+    if (!looping) {
+        ParseBookmark bookmark;
+        bool bookmarked = false;
+        if (starts_new_frame &&
+            parser->supportsOffsets() &&
+            !parser->hasPendingCalls()) {
+            parser->getBookmark(bookmark);
+            bookmarked = true;
+        }
+
+        call = parser->parse_call();
 
-    /* Restart last frame when looping is requested. */
-    if (call) {
-        if (starts_new_frame) {
-            for (auto c : lastFrameCalls)
-                delete c;
-            lastFrameCalls.clear();
+        if (call) {
+            if (starts_new_frame) {
+                deleteLastFrameCalls();
+                holding = !bookmarked;
+                if (bookmarked) {
+                    lastFrameBookmark = bookmark;
+                }
+            }
+
+            if (holding) {
+                holdCall(call);
+            }
+            starts_new_frame = call->flags & trace::CALL_FLAG_END_FRAME;
+
+            return call;
         }
 
-        call->reuse_call = true;
-        lastFrameCalls.push_back(call);
-        starts_new_frame = call->flags & trace::CALL_FLAG_END_FRAME;
+        /* Restart last frame when looping is requested. */
+        if (!loopCount) {
+            return nullptr;
+        }
+        looping = true;
 
+        if (!holding) {
+            parser->setBookmark(lastFrameBookmark);
+            while ((call = parser->parse_call())) {
+                holdCall(call);
+            }
+        }
+        if (lastFrameCalls.empty()) {
+            return nullptr;
+        }
         lastFrameIterator = lastFrameCalls.begin();
-
-        return call;
     }
 
-    /* else */
+    call = nullptr;
     if (loopCount) {
         call = *lastFrameIterator;
         ++lastFrameIterator;
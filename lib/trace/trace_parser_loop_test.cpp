@@ -0,0 +1,202 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_parser.hpp"
+#include "trace_test_helpers.hpp"
+
+using namespace trace;
+
+
+static const FunctionSig
+draw_sig = { 0, "glDrawArrays", 1, arg_names };
+
+static const FunctionSig
+swap_sig = { 1, "glXSwapBuffers", 0, arg_names };
+
+
+static void
+writeDraw(Writer &writer)
+{
+    // Blob size and contents vary with the call number
+    unsigned call_no = writer.nextCallNo();
+    std::vector<char> data(1000 + call_no, char(call_no));
+    writeBlobCall(writer, &draw_sig, data.data(), data.size());
+}
+
+
+static void
+writeSwap(Writer &writer)
+{
+    writeUIntCall(writer, &swap_sig, 0);
+}
+
+
+/*
+ * Five frames of four calls each, then trailing calls, optionally with a
+ * call of another thread which enters in the fourth frame and leaves after
+ * its swap.
+ */
+static void
+writeTrace(const char *path, unsigned trailing, bool straddle)
+{
+    Writer writer;
+    ASSERT_TRUE(writer.open(path, TRACE_VERSION, Properties()));
+    for (unsigned frame = 0; frame < 5; ++frame) {
+        unsigned straddling = ~0U;
+        for (unsigned j = 0; j < 3; ++j) {
+            if (straddle && frame == 3 && j == 2) {
+                straddling = writer.beginEnter(&draw_sig, 1);
+                writer.endEnter();
+            }
+            writeDraw(writer);
+        }
+        writeSwap(writer);
+        if (straddling != ~0U) {
+            writer.beginLeave(straddling);
+            writer.endLeave();
+        }
+    }
+    for (unsigned j = 0; j < trailing; ++j) {
+        writeDraw(writer);
+    }
+    writer.close();
+}
+
+
+static std::vector<unsigned>
+replay(const char *path, int loopCount, unsigned &reused)
+{
+    std::vector<unsigned> calls;
+    Parser *parser = new Parser;
+    AbstractParser *loop = lastFrameLoopParser(parser, loopCount);
+    EXPECT_TRUE(loop->open(path));
+    reused = 0;
+    Call *call;
+    while ((call = loop->parse_call())) {
+        calls.push_back(call->no);
+        if (call->sig->id == draw_sig.id && call->args[0].value) {
+            const Blob *blob = call->arg(0).toBlob();
+            EXPECT_TRUE(blob != nullptr);
+            if (blob) {
+                EXPECT_EQ(1000 + call->no, blob->size);
+            }
+        }
+        if (call->reuse_call) {
+            ++reused;
+        } else {
+            delete call;
+        }
+    }
+    loop->close();
+    delete loop;
+    return calls;
+}
+
+
+TEST(trace_parser_loop, last_frame)
+{
+    const char *path = "trace_parser_loop_test.trace";
+    writeTrace(path, 0, false);
+
+    unsigned reused;
+    std::vector<unsigned> calls = replay(path, 2, reused);
+
+    std::vector<unsigned> expected;
+    for (unsigned no = 0; no < 20; ++no) {
+        expected.push_back(no);
+    }
+    for (unsigned loop = 0; loop < 2; ++loop) {
+        for (unsigned no = 16; no < 20; ++no) {
+            expected.push_back(no);
+        }
+    }
+    EXPECT_EQ(expected, calls);
+
+    Parser parser;
+    ASSERT_TRUE(parser.open(path));
+    if (parser.supportsOffsets()) {
+        // Only the replayed frame is held
+        EXPECT_EQ(8U, reused);
+    }
+    parser.close();
+
+    remove(path);
+}
+
+
+TEST(trace_parser_loop, trailing_calls)
+{
+    const char *path = "trace_parser_loop_test_trailing.trace";
+    writeTrace(path, 2, false);
+
+    unsigned reused;
+    std::vector<unsigned> calls = replay(path, 1, reused);
+
+    std::vector<unsigned> expected;
+    for (unsigned no = 0; no < 22; ++no) {
+        expected.push_back(no);
+    }
+    expected.push_back(20);
+    expected.push_back(21);
+    EXPECT_EQ(expected, calls);
+
+    remove(path);
+}
+
+
+TEST(trace_parser_loop, pending_calls)
+{
+    const char *path = "trace_parser_loop_test_pending.trace";
+    writeTrace(path, 0, true);
+
+    // The straddling call (14) leaves after the swap (16), and starts the
+    // last frame, so that frame cannot be bookmarked and is held instead
+    unsigned reused;
+    std::vector<unsigned> calls = replay(path, 1, reused);
+    std::vector<unsigned> lastFrame = {14, 17, 18, 19, 20};
+    ASSERT_EQ(21U + 5U, calls.size());
+    EXPECT_EQ(lastFrame, std::vector<unsigned>(calls.end() - 10, calls.end() - 5));
+    EXPECT_EQ(lastFrame, std::vector<unsigned>(calls.end() - 5, calls.end()));
+    EXPECT_EQ(10U, reused);
+
+    remove(path);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -134,7 +134,7 @@ void Profiler::addCall(unsigned no,
         pixels = 0;
     }
 
-    if (!memoryUsage || !vsizeStart || !rssStart) {
+    if (!memoryUsage || (!vsizeStart && !rssStart)) {
         vsizeStart = 0;
         vsizeDuration = 0;
         rssStart = 0;
@@ -162,6 +162,106 @@ void Profiler::addFrameEnd()
     std::cout << "frame_end" << std::endl;
 }
 
+void Pyramid::push_back(int64_t value)
+{
+    tail.add(value);
+    if (++count % BLOCK_SIZE) {
+        return;
+    }
+
+    // Add the completed block, and every block it completes in turn
+    Summary block = tail;
+    tail = Summary();
+    for (size_t level = 0; ; ++level) {
+        if (level == levels.size()) {
+            levels.emplace_back();
+        }
+        std::vector<Summary> &blocks = levels[level];
+        blocks.push_back(block);
+        if (blocks.size() % 2) {
+            break;
+        }
+        block = blocks[blocks.size() - 2];
+        block.merge(blocks.back());
+    }
+}
+
+Profile::Call Profile::Calls::operator [] (size_t index) const
+{
+    Call call;
+    call.no = no[index];
+    call.program = program[index];
+    call.gpuStart = gpuStart[index];
+    call.gpuDuration = gpuDuration[index];
+    call.cpuStart = cpuStart[index];
+    call.cpuDuration = cpuDuration[index];
+    call.vsizeStart = vsizeStart[index];
+    call.vsizeDuration = vsizeDuration[index];
+    call.rssStart = rssStart[index];
+    call.rssDuration = rssDuration[index];
+    call.pixels = pixels[index];
+    call.name = name[index];
+    return call;
+}
+
+void Profile::Calls::push_back(const Call &call)
+{
+    size_t index = no.size();
+    no.push_back(call.no);
+    program.set(index, call.program);
+    gpuStart.set(index, call.gpuStart);
+    gpuDuration.set(index, call.gpuDuration);
+    cpuStart.set(index, call.cpuStart);
+    cpuDuration.set(index, call.cpuDuration);
+    vsizeStart.set(index, call.vsizeStart);
+    vsizeDuration.set(index, call.vsizeDuration);
+    rssStart.set(index, call.rssStart);
+    rssDuration.set(index, call.rssDuration);
+    pixels.set(index, call.pixels);
+    name.set(index, call.name);
+}
+
+unsigned Profile::internName(const std::string &name)
+{
+    auto result = nameIndices.emplace(name, unsigned(names.size()));
+    if (result.second) {
+        names.push_back(name);
+    }
+    return result.first->second;
+}
+
+unsigned Profile::internProgram(unsigned id)
+{
+    auto result = programIndices.emplace(id, unsigned(programs.size()));
+    if (result.second) {
+        programs.emplace_back(id);
+    }
+    return result.first->second;
+}
+
+void Profile::addCall(const Call &call)
+{
+    unsigned index = unsigned(calls.size());
+    calls.push_back(call);
+
+    cpuDurations.push_back(call.cpuDuration);
+    gpuDurations.push_back(call.pixels >= 0 ? call.gpuDuration : 0);
+
+    if (call.pixels >= 0) {
+        draws.push_back(index);
+
+        Program& program = programs[call.program];
+        program.cpuTotal += call.cpuDuration;
+        program.gpuTotal += call.gpuDuration;
+        program.pixelTotal += call.pixels;
+        program.vsizeTotal += call.vsizeDuration;
+        program.rssTotal += call.rssDuration;
+        program.calls.push_back(index);
+        program.cpuDurations.push_back(call.cpuDuration);
+        program.gpuDurations.push_back(call.gpuDuration);
+    }
+}
+
 void Profiler::parseLine(const char* in, Profile* profile)
 {
     std::stringstream line(in, std::ios_base::in);
@@ -185,6 +285,8 @@ void Profiler::parseLine(const char* in, Profile* profile)
 
     if (type.compare("call") == 0) {
         Profile::Call call;
+        unsigned program;
+        std::string name;
 
         line >> call.no
              >> call.gpuStart
@@ -196,8 +298,11 @@ void Profiler::parseLine(const char* in, Profile* profile)
              >> call.rssStart
              >> call.rssDuration
              >> call.pixels
-             >> call.program
-             >> call.name;
+             >> program
+             >> name;
+
+        call.program = profile->internProgram(program);
+        call.name = profile->internName(name);
 
         if (lastGpuTime < call.gpuStart + call.gpuDuration) {
             lastGpuTime = call.gpuStart + call.gpuDuration;
@@ -215,21 +320,7 @@ void Profiler::parseLine(const char* in, Profile* profile)
             lastRssUsage = call.rssStart + call.rssDuration;
         }
 
-        profile->calls.push_back(call);
-
-        if (call.pixels >= 0) {
-            if (profile->programs.size() <= call.program) {
-                profile->programs.resize(call.program + 1);
-            }
-
-            Profile::Program& program = profile->programs[call.program];
-            program.cpuTotal += call.cpuDuration;
-            program.gpuTotal += call.gpuDuration;
-            program.pixelTotal += call.pixels;
-            program.vsizeTotal += call.vsizeDuration;
-            program.rssTotal += call.rssDuration;
-            program.calls.push_back((unsigned int)(profile->calls.size() - 1));
-        }
+        profile->addCall(call);
     } else if (type.compare("frame_end") == 0) {
         Profile::Frame frame;
         frame.no = unsigned(profile->frames.size());
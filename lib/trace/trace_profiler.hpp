@@ -27,16 +27,128 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <stdint.h>
 
 namespace trace
 {
 
+/**
+ * Minimum, maximum, and sum of a sequence of values, kept for aligned blocks
+ * of BLOCK_SIZE * 2^k values, so that any range can be summarized by looking
+ * at a logarithmic number of blocks.
+ */
+class Pyramid
+{
+public:
+    struct Summary {
+        int64_t min = INT64_MAX;
+        int64_t max = INT64_MIN;
+        int64_t sum = 0;
+
+        bool empty(void) const {
+            return min > max;
+        }
+
+        void add(int64_t value) {
+            if (value < min) {
+                min = value;
+            }
+            if (value > max) {
+                max = value;
+            }
+            sum += value;
+        }
+
+        void merge(const Summary &other) {
+            if (other.min < min) {
+                min = other.min;
+            }
+            if (other.max > max) {
+                max = other.max;
+            }
+            sum += other.sum;
+        }
+    };
+
+    static const size_t BLOCK_SIZE = 16;
+
+    void push_back(int64_t value);
+
+    size_t size(void) const {
+        return count;
+    }
+
+    /**
+     * Summarize the values in [begin, end).  The values at the edges, which
+     * don't fill a whole block, are obtained with get(index).
+     */
+    template <typename Get>
+    Summary summarize(size_t begin, size_t end, Get get) const {
+        Summary summary;
+        if (end > count) {
+            end = count;
+        }
+        while (begin < end && begin % BLOCK_SIZE) {
+            summary.add(get(begin++));
+        }
+        while (begin < end && end % BLOCK_SIZE) {
+            summary.add(get(--end));
+        }
+        size_t lo = begin / BLOCK_SIZE;
+        size_t hi = end / BLOCK_SIZE;
+        for (size_t level = 0; lo < hi; ++level) {
+            const std::vector<Summary> &blocks = levels[level];
+            if (lo & 1) {
+                summary.merge(blocks[lo++]);
+            }
+            if (hi & 1) {
+                summary.merge(blocks[--hi]);
+            }
+            lo /= 2;
+            hi /= 2;
+        }
+        return summary;
+    }
+
+private:
+    size_t count = 0;
+
+    // Values of the last, incomplete block
+    Summary tail;
+
+    std::vector<std::vector<Summary>> levels;
+};
+
+
 struct Profile {
+    /**
+     * Values of a column are set in increasing index order.  Zeros are only
+     * stored when followed by a non-zero value, so a column which is all
+     * zeros (e.g., memory usage when it was not profiled) takes no space.
+     */
+    template <typename T>
+    class Column {
+        std::vector<T> values;
+
+    public:
+        T operator [] (size_t index) const {
+            return index < values.size() ? values[index] : T(0);
+        }
+
+        void set(size_t index, T value) {
+            if (value) {
+                values.resize(index);
+                values.push_back(value);
+            }
+        }
+    };
+
     struct Call {
         unsigned no;
 
+        /* Index to profile->programs array */
         unsigned program;
 
         int64_t gpuStart;
@@ -52,7 +164,39 @@ struct Profile {
 
         int64_t pixels;
 
-        std::string name;
+        /* Index to profile->names array */
+        unsigned name;
+    };
+
+    /**
+     * Calls are stored column-wise, with the names interned, which takes a
+     * fraction of the memory of an array of Call.
+     */
+    struct Calls {
+        std::vector<unsigned> no;
+        Column<unsigned> program;
+        Column<int64_t> gpuStart;
+        Column<int64_t> gpuDuration;
+        Column<int64_t> cpuStart;
+        Column<int64_t> cpuDuration;
+        Column<int64_t> vsizeStart;
+        Column<int64_t> vsizeDuration;
+        Column<int64_t> rssStart;
+        Column<int64_t> rssDuration;
+        Column<int64_t> pixels;
+        Column<unsigned> name;
+
+        size_t size(void) const {
+            return no.size();
+        }
+
+        bool empty(void) const {
+            return no.empty();
+        }
+
+        Call operator [] (size_t index) const;
+
+        void push_back(const Call &call);
     };
 
     struct Frame {
@@ -77,21 +221,46 @@ struct Profile {
     };
 
     struct Program {
-        Program() : gpuTotal(0), cpuTotal(0), pixelTotal(0) {}
+        Program(unsigned _id) : id(_id) {}
 
-        uint64_t gpuTotal;
-        uint64_t cpuTotal;
-        uint64_t pixelTotal;
-        int64_t vsizeTotal;
-        int64_t rssTotal;
+        /* Program name, as used by the API */
+        unsigned id;
+
+        uint64_t gpuTotal = 0;
+        uint64_t cpuTotal = 0;
+        uint64_t pixelTotal = 0;
+        int64_t vsizeTotal = 0;
+        int64_t rssTotal = 0;
 
         /* Indices to profile->calls array */
         std::vector<unsigned> calls;
+
+        /* Durations of the calls above */
+        Pyramid cpuDurations;
+        Pyramid gpuDurations;
     };
 
-    std::vector<Call> calls;
+    Calls calls;
     std::vector<Frame> frames;
     std::vector<Program> programs;
+    std::vector<std::string> names;
+
+    /* Indices to profile->calls array of the calls with a program, i.e.,
+     * which were drawn */
+    std::vector<unsigned> draws;
+
+    /* Durations of all calls; GPU durations are zero for calls not drawn */
+    Pyramid cpuDurations;
+    Pyramid gpuDurations;
+
+    unsigned internName(const std::string &name);
+    unsigned internProgram(unsigned id);
+
+    void addCall(const Call &call);
+
+private:
+    std::unordered_map<std::string, unsigned> nameIndices;
+    std::unordered_map<unsigned, unsigned> programIndices;
 };
 
 class Profiler
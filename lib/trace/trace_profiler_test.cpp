@@ -0,0 +1,132 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <stdio.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_profiler.hpp"
+
+using namespace trace;
+
+
+TEST(trace_profiler, pyramid)
+{
+    std::mt19937 rng(0);
+    std::vector<int64_t> values;
+    Pyramid pyramid;
+    for (unsigned i = 0; i < 1000; ++i) {
+        int64_t value = int64_t(rng() % 1000) - 100;
+        values.push_back(value);
+        pyramid.push_back(value);
+    }
+    ASSERT_EQ(values.size(), pyramid.size());
+
+    auto get = [&] (size_t i) { return values[i]; };
+
+    for (unsigned i = 0; i < 2000; ++i) {
+        size_t begin = rng() % (values.size() + 1);
+        size_t end = rng() % (values.size() + 1);
+        if (begin > end) {
+            std::swap(begin, end);
+        }
+
+        Pyramid::Summary expected;
+        for (size_t j = begin; j < end; ++j) {
+            expected.add(values[j]);
+        }
+
+        Pyramid::Summary summary = pyramid.summarize(begin, end, get);
+        EXPECT_EQ(expected.empty(), summary.empty());
+        EXPECT_EQ(expected.min, summary.min) << begin << ", " << end;
+        EXPECT_EQ(expected.max, summary.max) << begin << ", " << end;
+        EXPECT_EQ(expected.sum, summary.sum) << begin << ", " << end;
+    }
+}
+
+
+TEST(trace_profiler, parse)
+{
+    Profile profile;
+    Profiler::parseLine("# call no gpu_start gpu_dura cpu_start cpu_dura vsize_start vsize_dura rss_start rss_dura pixels program name", &profile);
+    Profiler::parseLine("call 1 0 0 100 10 0 0 0 0 -1 0 glClear", &profile);
+    Profiler::parseLine("call 2 50 20 120 5 0 0 0 0 1000 42 glDrawArrays", &profile);
+    Profiler::parseLine("call 3 80 30 130 8 0 0 0 0 2000 7 glDrawArrays", &profile);
+    Profiler::parseLine("frame_end", &profile);
+    Profiler::parseLine("call 5 120 40 200 6 0 0 0 0 500 42 glDrawElements", &profile);
+    Profiler::parseLine("frame_end", &profile);
+
+    ASSERT_EQ(4U, profile.calls.size());
+    ASSERT_EQ(2U, profile.frames.size());
+    EXPECT_EQ(3U, profile.names.size());
+
+    Profile::Call call = profile.calls[2];
+    EXPECT_EQ(3U, call.no);
+    EXPECT_EQ(80, call.gpuStart);
+    EXPECT_EQ(30, call.gpuDuration);
+    EXPECT_EQ(130, call.cpuStart);
+    EXPECT_EQ(8, call.cpuDuration);
+    EXPECT_EQ(0, call.vsizeStart);
+    EXPECT_EQ(2000, call.pixels);
+    EXPECT_EQ("glDrawArrays", profile.names[call.name]);
+    EXPECT_EQ(profile.calls.name[1], call.name);
+    EXPECT_EQ(7U, profile.programs[call.program].id);
+
+    // Programs are interned, and only track the calls drawn
+    ASSERT_EQ(3U, profile.programs.size());
+    const Profile::Program &program = profile.programs[profile.calls.program[1]];
+    EXPECT_EQ(42U, program.id);
+    EXPECT_EQ(60U, program.gpuTotal);
+    EXPECT_EQ(1500U, program.pixelTotal);
+    ASSERT_EQ(2U, program.calls.size());
+    EXPECT_EQ(1U, program.calls[0]);
+    EXPECT_EQ(3U, program.calls[1]);
+    EXPECT_TRUE(profile.programs[profile.calls.program[0]].calls.empty());
+
+    std::vector<unsigned> draws = {1, 2, 3};
+    EXPECT_EQ(draws, profile.draws);
+
+    auto get = [] (size_t) -> int64_t { return 0; };
+    EXPECT_EQ(29, profile.cpuDurations.summarize(0, 4, [&] (size_t i) { return profile.calls.cpuDuration[i]; }).sum);
+    EXPECT_EQ(90, profile.gpuDurations.summarize(0, 4, [&] (size_t i) { return profile.calls.gpuDuration[i]; }).sum);
+    EXPECT_TRUE(profile.gpuDurations.summarize(2, 2, get).empty());
+
+    EXPECT_EQ(3U, profile.frames[1].calls.begin);
+    EXPECT_EQ(3U, profile.frames[1].calls.end);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -31,4 +31,17 @@
 #define SNAPPY_BYTE1 'a'
 #define SNAPPY_BYTE2 't'
 
+/*
+ * Optional per-chunk checksums, written after a zero chunk length.  Readers
+ * must take it as the final end of the chunks, and never read past it:
+ *
+ *   uint32 0
+ *   uint32 CRC-32C of each chunk's compressed data
+ *   uint32 number of chunks
+ *   uint32 SNAPPY_CHECKSUM_MAGIC
+ *
+ * All in little endian.
+ */
+#define SNAPPY_CHECKSUM_MAGIC 0x6b637461 // "atck"
+
 
@@ -0,0 +1,307 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include "trace_stats.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "os.hpp"
+#include "os_string.hpp"
+#include "os_thread.hpp"
+
+
+namespace trace {
+
+namespace stats {
+
+
+bool enabled = false;
+
+
+static const char *
+subsystemNames[SUBSYSTEM_COUNT] = {
+    "lock_wait",
+    "serialization",
+    "compression",
+    "memory_shadow",
+    "gl_memory_shadow",
+};
+
+
+void
+Histogram::add(unsigned long long ns)
+{
+    unsigned bucket = 0;
+    for (unsigned long long n = ns; n && bucket < NUM_BUCKETS - 1; n >>= 1) {
+        ++bucket;
+    }
+    ++buckets[bucket];
+    ++count;
+    total += ns;
+    max = std::max(max, ns);
+}
+
+
+void
+Histogram::merge(const Histogram &other)
+{
+    for (unsigned i = 0; i < NUM_BUCKETS; ++i) {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    total += other.total;
+    max = std::max(max, other.max);
+}
+
+
+struct CallStats {
+    const FunctionSig *sig = nullptr;
+    Histogram time;
+    unsigned long long lockWait = 0;
+};
+
+
+/*
+ * Counters of one thread.  Only that thread updates them, but it does so
+ * holding the mutex, so that write() can merge them from another thread.
+ * The mutex is uncontended except while writing.
+ */
+struct ThreadStats {
+    std::mutex mutex;
+    Histogram subsystems[SUBSYSTEM_COUNT];
+    std::vector<CallStats> calls;
+};
+
+
+/*
+ * Allocated by enable() and never freed, as the counters are written from
+ * the LocalWriter destructor, which may run after this module's static
+ * destructors.
+ */
+struct Registry {
+    std::string filename;
+    long long startTime;
+    std::mutex mutex;
+    std::vector<ThreadStats *> threads;
+};
+
+static Registry *registry;
+
+static OS_THREAD_LOCAL ThreadStats *threadStats;
+
+
+static ThreadStats *
+getThreadStats(void)
+{
+    ThreadStats *stats = threadStats;
+    if (!stats) {
+        // Never freed, as the counters outlive the thread
+        stats = new ThreadStats;
+        std::lock_guard<std::mutex> lock(registry->mutex);
+        registry->threads.push_back(stats);
+        threadStats = stats;
+    }
+    return stats;
+}
+
+
+static inline unsigned long long
+toNanoseconds(long long ticks)
+{
+    if (os::timeFrequency == 1000000000LL) {
+        return ticks;
+    }
+    return (unsigned long long)((double)ticks * 1.0e9 / os::timeFrequency);
+}
+
+
+void
+enable(const char *_filename)
+{
+    registry = new Registry;
+    registry->filename = _filename;
+    registry->startTime = os::getTime();
+    enabled = true;
+}
+
+
+void
+addTime(Subsystem subsystem, long long ticks)
+{
+    ThreadStats *stats = getThreadStats();
+    unsigned long long ns = toNanoseconds(ticks);
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    stats->subsystems[subsystem].add(ns);
+}
+
+
+void
+addCall(const FunctionSig *sig, long long serializationTicks, long long lockWaitTicks)
+{
+    ThreadStats *stats = getThreadStats();
+
+    unsigned long long serialization = toNanoseconds(serializationTicks);
+    unsigned long long lockWait = toNanoseconds(lockWaitTicks);
+
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    stats->subsystems[SUBSYSTEM_SERIALIZATION].add(serialization);
+    stats->subsystems[SUBSYSTEM_LOCK_WAIT].add(lockWait);
+
+    if (sig->id >= stats->calls.size()) {
+        stats->calls.resize(sig->id + 1);
+    }
+    CallStats &call = stats->calls[sig->id];
+    call.sig = sig;
+    call.time.add(serialization + lockWait);
+    call.lockWait += lockWait;
+}
+
+
+static void
+writeString(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (const char *p = str; *p; ++p) {
+        unsigned char c = *p;
+        if (c == '"' || c == '\\') {
+            fprintf(fp, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(fp, "\\u%04x", c);
+        } else {
+            fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+
+static void
+writeHistogram(FILE *fp, const Histogram &histogram)
+{
+    fprintf(fp, "\"count\": %llu, \"total_ns\": %llu, \"max_ns\": %llu, \"histogram_ns\": [",
+            histogram.count, histogram.total, histogram.max);
+    const char *sep = "";
+    for (unsigned i = 0; i < Histogram::NUM_BUCKETS; ++i) {
+        if (histogram.buckets[i]) {
+            // Upper bound of the bucket, and the number of samples in it
+            unsigned long long bound = i ? (1ULL << i) - 1 : 0;
+            fprintf(fp, "%s[%llu, %llu]", sep, bound, histogram.buckets[i]);
+            sep = ", ";
+        }
+    }
+    fprintf(fp, "]");
+}
+
+
+void
+write(void)
+{
+    if (!enabled) {
+        return;
+    }
+
+    Histogram subsystems[SUBSYSTEM_COUNT];
+    std::vector<CallStats> calls;
+
+    {
+        std::lock_guard<std::mutex> registryLock(registry->mutex);
+        for (ThreadStats *stats : registry->threads) {
+            // A crash handler may have interrupted this thread while it was
+            // updating its own counters, in which case they are skipped
+            std::unique_lock<std::mutex> lock(stats->mutex, std::defer_lock);
+            if (stats == threadStats) {
+                if (!lock.try_lock()) {
+                    continue;
+                }
+            } else {
+                lock.lock();
+            }
+            for (unsigned i = 0; i < SUBSYSTEM_COUNT; ++i) {
+                subsystems[i].merge(stats->subsystems[i]);
+            }
+            if (calls.size() < stats->calls.size()) {
+                calls.resize(stats->calls.size());
+            }
+            for (size_t id = 0; id < stats->calls.size(); ++id) {
+                const CallStats &call = stats->calls[id];
+                if (call.sig) {
+                    calls[id].sig = call.sig;
+                    calls[id].time.merge(call.time);
+                    calls[id].lockWait += call.lockWait;
+                }
+            }
+        }
+    }
+
+    calls.erase(std::remove_if(calls.begin(), calls.end(),
+                               [](const CallStats &call) { return !call.sig; }),
+                calls.end());
+    std::sort(calls.begin(), calls.end(),
+              [](const CallStats &a, const CallStats &b) { return a.time.total > b.time.total; });
+
+    FILE *fp = fopen(registry->filename.c_str(), "wt");
+    if (!fp) {
+        os::log("apitrace: error: failed to open %s\n", registry->filename.c_str());
+        return;
+    }
+
+    os::String process = os::getProcessName();
+    fprintf(fp, "{\n  \"process\": ");
+    writeString(fp, process.str());
+    fprintf(fp, ",\n  \"elapsed_ns\": %llu,\n", toNanoseconds(os::getTime() - registry->startTime));
+
+    fprintf(fp, "  \"subsystems\": {");
+    for (unsigned i = 0; i < SUBSYSTEM_COUNT; ++i) {
+        fprintf(fp, "%s\n    \"%s\": {", i ? "," : "", subsystemNames[i]);
+        writeHistogram(fp, subsystems[i]);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  },\n");
+
+    fprintf(fp, "  \"functions\": {");
+    for (size_t i = 0; i < calls.size(); ++i) {
+        fprintf(fp, "%s\n    ", i ? "," : "");
+        writeString(fp, calls[i].sig->name);
+        fprintf(fp, ": {\"lock_wait_ns\": %llu, ", calls[i].lockWait);
+        writeHistogram(fp, calls[i].time);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  }\n}\n");
+
+    fclose(fp);
+}
+
+
+} /* namespace stats */
+
+} /* namespace trace */
@@ -0,0 +1,110 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Accounting of the time spent tracing, per function and per subsystem.
+ */
+
+#pragma once
+
+
+#include "os_time.hpp"
+#include "trace_model.hpp"
+
+
+namespace trace {
+
+namespace stats {
+
+
+    enum Subsystem {
+        SUBSYSTEM_LOCK_WAIT,
+        SUBSYSTEM_SERIALIZATION,
+        SUBSYSTEM_COMPRESSION,
+        SUBSYSTEM_MEMORY_SHADOW,
+        SUBSYSTEM_GL_MEMORY_SHADOW,
+        SUBSYSTEM_COUNT
+    };
+
+
+    /**
+     * Durations, in power of two buckets of nanoseconds.
+     */
+    struct Histogram {
+        static const unsigned NUM_BUCKETS = 40;
+
+        unsigned long long buckets[NUM_BUCKETS] = {};
+        unsigned long long count = 0;
+        unsigned long long total = 0;
+        unsigned long long max = 0;
+
+        void add(unsigned long long ns);
+        void merge(const Histogram &other);
+    };
+
+
+    /**
+     * Set once, before the first traced call, when TRACE_STATS is set.
+     */
+    extern bool enabled;
+
+    void enable(const char *filename);
+
+    void addTime(Subsystem subsystem, long long ticks);
+
+    void addCall(const FunctionSig *sig, long long serializationTicks, long long lockWaitTicks);
+
+    /**
+     * Merge the counters of all threads so far, and write them as JSON to
+     * the TRACE_STATS file.
+     */
+    void write(void);
+
+
+    /**
+     * Accounts the lifetime of the object to a subsystem.
+     */
+    class Scope {
+        Subsystem subsystem;
+        long long start;
+
+    public:
+        inline Scope(Subsystem _subsystem) :
+            subsystem(_subsystem),
+            start(enabled ? os::getTime() : 0)
+        {}
+
+        inline ~Scope() {
+            if (start) {
+                addTime(subsystem, os::getTime() - start);
+            }
+        }
+    };
+
+
+} /* namespace stats */
+
+} /* namespace trace */
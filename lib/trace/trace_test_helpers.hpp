@@ -0,0 +1,102 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Helpers shared by the trace unit tests, to write small synthetic traces.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "trace_writer.hpp"
+
+
+namespace trace {
+
+
+static const char *
+arg_names[] = { "data" };
+
+// A call with a single blob argument
+static const FunctionSig
+upload_sig = { 0, "upload", 1, arg_names };
+
+
+// Write a call of sig with every argument set to value
+static inline unsigned
+writeUIntCall(Writer &writer, const FunctionSig *sig, unsigned value,
+              unsigned thread_id = 0)
+{
+    unsigned call_no = writer.beginEnter(sig, thread_id);
+    for (unsigned i = 0; i < sig->num_args; ++i) {
+        writer.beginArg(i);
+        writer.writeUInt(value);
+        writer.endArg();
+    }
+    writer.endEnter();
+    writer.beginLeave(call_no);
+    writer.endLeave();
+    return call_no;
+}
+
+
+// Write a call of sig with a single blob argument, which only returns when
+// leave is set
+static inline unsigned
+writeBlobCall(Writer &writer, const FunctionSig *sig,
+              const void *data, size_t size,
+              unsigned thread_id = 0, bool leave = true)
+{
+    unsigned call_no = writer.beginEnter(sig, thread_id);
+    writer.beginArg(0);
+    writer.writeBlob(data, size);
+    writer.endArg();
+    writer.endEnter();
+    if (leave) {
+        writer.beginLeave(call_no);
+        writer.endLeave();
+    }
+    return call_no;
+}
+
+
+// Write num_calls uploads of the blobs returned by blob(i) to an open writer,
+// then close it
+template <typename BlobFunc>
+static inline void
+writeUploads(Writer &writer, unsigned num_calls, BlobFunc blob)
+{
+    for (unsigned i = 0; i < num_calls; ++i) {
+        std::vector<char> data = blob(i);
+        writeBlobCall(writer, &upload_sig, data.data(), data.size());
+    }
+    writer.close();
+}
+
+
+} /* namespace trace */
@@ -0,0 +1,241 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include "trace_timeline.hpp"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "os_process.hpp"
+#include "os_thread.hpp"
+
+
+namespace trace {
+
+
+static std::atomic<unsigned> nextTimelineId(1);
+
+
+Timeline::Timeline() :
+    id(nextTimelineId++),
+    enabled(false),
+    baseTime(0)
+{
+}
+
+
+Timeline::~Timeline()
+{
+    for (ThreadBuffer *thread : threads) {
+        Chunk *chunk = thread->head;
+        while (chunk) {
+            Chunk *next = chunk->next.load(std::memory_order_relaxed);
+            delete chunk;
+            chunk = next;
+        }
+        delete thread;
+    }
+}
+
+
+void
+Timeline::enable(void)
+{
+    baseTime = os::getTime();
+    enabled = true;
+}
+
+
+Timeline::ThreadBuffer *
+Timeline::getThreadBuffer(void)
+{
+    // Cache the buffer of the last timeline used by this thread
+    static OS_THREAD_LOCAL unsigned cachedId = 0;
+    static OS_THREAD_LOCAL ThreadBuffer *cachedBuffer = nullptr;
+
+    if (cachedId == id) {
+        return cachedBuffer;
+    }
+
+    ThreadBuffer *thread = new ThreadBuffer;
+    thread->head = new Chunk;
+    thread->tail = thread->head;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        thread->tid = threads.size();
+        threads.push_back(thread);
+    }
+
+    cachedId = id;
+    cachedBuffer = thread;
+    return thread;
+}
+
+
+void
+Timeline::addSpan(const char *name, int64_t start, int64_t end, int64_t callNo)
+{
+    ThreadBuffer *thread = getThreadBuffer();
+
+    // Only this thread writes to the buffer
+    size_t count = thread->count.load(std::memory_order_relaxed);
+    size_t index = count % CHUNK_SIZE;
+    if (count && index == 0) {
+        Chunk *chunk = new Chunk;
+        thread->tail->next.store(chunk, std::memory_order_release);
+        thread->tail = chunk;
+    }
+
+    Span &span = thread->tail->spans[index];
+    span.name = name;
+    span.start = start;
+    span.end = end;
+    span.callNo = callNo;
+
+    thread->count.store(count + 1, std::memory_order_release);
+}
+
+
+void
+Timeline::setThreadName(const std::string &name)
+{
+    ThreadBuffer *thread = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(mutex);
+    thread->name = name;
+}
+
+
+static void
+writeString(std::ostream &os, const char *s)
+{
+    os << '"';
+    for (; *s; ++s) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof buf, "\\u%04x", c);
+            os << buf;
+        } else {
+            os << c;
+        }
+    }
+    os << '"';
+}
+
+
+void
+Timeline::write(std::ostream &os)
+{
+    std::vector<ThreadBuffer *> buffers;
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers = threads;
+        for (ThreadBuffer *thread : threads) {
+            names.push_back(thread->name);
+        }
+    }
+
+    unsigned long long pid = os::getCurrentProcessId();
+    double scale = 1.0e6 / double(os::timeFrequency);
+    std::vector<Span> spans;
+    char buf[64];
+    const char *separator = "\n";
+
+    os << "{\"traceEvents\":[";
+
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        ThreadBuffer *thread = buffers[i];
+
+        std::string name = names[i];
+        if (name.empty()) {
+            name = "thread " + std::to_string(thread->tid);
+        }
+        os << separator
+           << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+           << ",\"tid\":" << thread->tid << ",\"args\":{\"name\":";
+        writeString(os, name.c_str());
+        os << "}}";
+        separator = ",\n";
+
+        size_t count = thread->count.load(std::memory_order_acquire);
+        spans.clear();
+        spans.reserve(count);
+        const Chunk *chunk = thread->head;
+        for (size_t j = 0; j < count; ++j) {
+            if (j && j % CHUNK_SIZE == 0) {
+                chunk = chunk->next.load(std::memory_order_acquire);
+            }
+            spans.push_back(chunk->spans[j % CHUNK_SIZE]);
+        }
+
+        std::stable_sort(spans.begin(), spans.end(),
+            [](const Span &a, const Span &b) {
+                if (a.start != b.start) {
+                    return a.start < b.start;
+                }
+                return a.end > b.end;
+            });
+
+        for (const Span &span : spans) {
+            os << separator << "{\"name\":";
+            writeString(os, span.name);
+            snprintf(buf, sizeof buf, ",\"ts\":%.3f,\"dur\":%.3f",
+                     double(span.start - baseTime) * scale,
+                     double(span.end - span.start) * scale);
+            os << ",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << thread->tid << buf;
+            if (span.callNo >= 0) {
+                os << ",\"args\":{\"call\":" << span.callNo << "}";
+            }
+            os << "}";
+        }
+    }
+
+    os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+
+bool
+Timeline::write(const char *filename)
+{
+    std::ofstream os(filename, std::ofstream::out | std::ofstream::binary);
+    if (!os) {
+        std::cerr << "error: failed to open " << filename << "\n";
+        return false;
+    }
+    write(os);
+    os.close();
+    return !os.fail();
+}
+
+
+} /* namespace trace */
@@ -0,0 +1,145 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Timeline of nested spans, for seeing where the replayer itself spends time.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "os_time.hpp"
+
+namespace trace
+{
+
+/**
+ * Records spans into per-thread buffers and writes them in the Chrome Trace
+ * Event Format, which chrome://tracing and Perfetto can open.
+ *
+ * Each thread appends only to its own buffer, so recording takes no lock
+ * except once per thread to register the buffer.  Spans are published with
+ * release semantics, so the timeline can be written while other threads are
+ * still recording; their newest spans may just be missing.
+ */
+class Timeline
+{
+public:
+    struct Span {
+        const char *name;  // must outlive the timeline, e.g. a literal
+        int64_t start;     // os::getTime() ticks
+        int64_t end;
+        int64_t callNo;    // -1 when not associated with a call
+    };
+
+    Timeline();
+    ~Timeline();
+
+    Timeline(const Timeline &) = delete;
+    Timeline & operator = (const Timeline &) = delete;
+
+    void enable(void);
+
+    inline bool isEnabled(void) const {
+        return enabled;
+    }
+
+    void addSpan(const char *name, int64_t start, int64_t end, int64_t callNo = -1);
+
+    /* Name the calling thread in the output. */
+    void setThreadName(const std::string &name);
+
+    /*
+     * Write all spans, per thread, with parents before their children, i.e.,
+     * ordered by start time and then by decreasing end time.
+     */
+    void write(std::ostream &os);
+    bool write(const char *filename);
+
+private:
+    enum { CHUNK_SIZE = 4096 };
+
+    struct Chunk {
+        Span spans[CHUNK_SIZE];
+        std::atomic<Chunk *> next{nullptr};
+    };
+
+    struct ThreadBuffer {
+        unsigned tid;
+        std::string name;
+        Chunk *head;
+        Chunk *tail;
+        std::atomic<size_t> count{0};
+    };
+
+    unsigned id;
+    bool enabled;
+    int64_t baseTime;
+
+    std::mutex mutex;  // protects threads and thread names
+    std::vector<ThreadBuffer *> threads;
+
+    ThreadBuffer *getThreadBuffer(void);
+};
+
+
+/**
+ * Record the lifetime of this object as a span, if the timeline is enabled.
+ */
+class TimelineScope
+{
+public:
+    inline TimelineScope(Timeline &_timeline, const char *_name, int64_t _callNo = -1) :
+        timeline(_timeline),
+        name(_name),
+        callNo(_callNo),
+        start(_timeline.isEnabled() ? os::getTime() : -1)
+    {}
+
+    inline ~TimelineScope() {
+        if (start >= 0) {
+            timeline.addSpan(name, start, os::getTime(), callNo);
+        }
+    }
+
+    TimelineScope(const TimelineScope &) = delete;
+    TimelineScope & operator = (const TimelineScope &) = delete;
+
+private:
+    Timeline &timeline;
+    const char *name;
+    int64_t callNo;
+    int64_t start;
+};
+
+} /* namespace trace */
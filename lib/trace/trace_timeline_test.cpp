@@ -0,0 +1,139 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_timeline.hpp"
+
+using namespace trace;
+
+
+static size_t
+countOccurrences(const std::string &s, const std::string &pattern)
+{
+    size_t count = 0;
+    for (size_t pos = s.find(pattern); pos != std::string::npos; pos = s.find(pattern, pos + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+
+TEST(trace_timeline, disabled)
+{
+    Timeline timeline;
+    {
+        TimelineScope scope(timeline, "span");
+    }
+
+    std::ostringstream os;
+    timeline.write(os);
+    EXPECT_EQ(0U, countOccurrences(os.str(), "\"ph\":\"X\""));
+}
+
+
+TEST(trace_timeline, nesting)
+{
+    Timeline timeline;
+    timeline.enable();
+    timeline.setThreadName("main \"thread\"");
+
+    // Children complete, and are therefore recorded, before their parents
+    int64_t t = os::getTime();
+    timeline.addSpan("child1", t + 10, t + 20, 7);
+    timeline.addSpan("grandchild", t + 30, t + 35);
+    timeline.addSpan("child2", t + 30, t + 40);
+    timeline.addSpan("parent", t, t + 100);
+    timeline.addSpan("sibling", t + 100, t + 110);
+
+    std::ostringstream os;
+    timeline.write(os);
+    std::string s = os.str();
+
+    EXPECT_EQ(0U, s.find("{\"traceEvents\":["));
+    EXPECT_NE(std::string::npos, s.find("\"args\":{\"name\":\"main \\\"thread\\\"\"}"));
+    EXPECT_NE(std::string::npos, s.find("\"name\":\"child1\",\"ph\":\"X\""));
+    EXPECT_NE(std::string::npos, s.find("\"args\":{\"call\":7}"));
+    EXPECT_EQ(1U, countOccurrences(s, "\"args\":{\"call\":"));
+
+    size_t parent = s.find("\"parent\"");
+    size_t child1 = s.find("\"child1\"");
+    size_t child2 = s.find("\"child2\"");
+    size_t grandchild = s.find("\"grandchild\"");
+    size_t sibling = s.find("\"sibling\"");
+    EXPECT_LT(parent, child1);
+    EXPECT_LT(child1, child2);
+    EXPECT_LT(child2, grandchild);
+    EXPECT_LT(grandchild, sibling);
+}
+
+
+TEST(trace_timeline, threads)
+{
+    const unsigned numThreads = 4;
+    const unsigned numSpans = 10000;
+
+    Timeline timeline;
+    timeline.enable();
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < numThreads; ++i) {
+        threads.emplace_back([&timeline, i] {
+            timeline.setThreadName("worker " + std::to_string(i));
+            for (unsigned j = 0; j < numSpans; ++j) {
+                TimelineScope scope(timeline, "work", j);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    std::ostringstream os;
+    timeline.write(os);
+    std::string s = os.str();
+
+    EXPECT_EQ(numThreads, countOccurrences(s, "\"thread_name\""));
+    EXPECT_EQ(numThreads * numSpans, countOccurrences(s, "\"ph\":\"X\""));
+    EXPECT_EQ(numThreads, countOccurrences(s, "\"args\":{\"call\":9999}"));
+    for (unsigned i = 0; i < numThreads; ++i) {
+        EXPECT_NE(std::string::npos, s.find("\"worker " + std::to_string(i) + "\""));
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
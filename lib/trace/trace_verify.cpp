@@ -0,0 +1,505 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "trace_verify.hpp"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <snappy.h>
+#include <zstd.h>
+#include <zstd_seekable.h>
+#include <xxhash.h>
+
+#include "crc32c.hpp"
+
+#include "trace_snappy.hpp"
+
+
+using namespace trace;
+
+
+namespace {
+
+
+struct Chunk {
+    uint64_t offset;        // in the file
+    uint64_t size;          // compressed
+    uint64_t dataSize = 0;  // uncompressed
+    uint32_t checksum = 0;  // from the seek table, if any
+    std::string error;
+
+    Chunk(uint64_t _offset, uint64_t _size) :
+        offset(_offset),
+        size(_size)
+    {}
+};
+
+
+class ChunkReader {
+public:
+    virtual ~ChunkReader() {}
+
+    /**
+     * Check the chunk, filling in its uncompressed size.
+     */
+    virtual bool check(size_t index, Chunk &chunk) = 0;
+};
+
+typedef std::function<ChunkReader *(void)> CreateChunkReader;
+
+
+/**
+ * Check the chunks on several threads, each with its own reader, and return
+ * the index of the first corrupt one, or the number of chunks.
+ *
+ * Chunks are handed out in order, so every chunk before the first corrupt
+ * one is checked, while those after it are not, once it is found.
+ */
+size_t
+checkChunks(std::vector<Chunk> &chunks, unsigned jobs,
+            const CreateChunkReader &createReader)
+{
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> firstBad(chunks.size());
+
+    auto work = [&] () {
+        std::unique_ptr<ChunkReader> reader(createReader());
+        for (;;) {
+            size_t index = next++;
+            if (index >= firstBad.load()) {
+                break;
+            }
+            if (!reader->check(index, chunks[index])) {
+                size_t bad = firstBad.load();
+                while (index < bad &&
+                       !firstBad.compare_exchange_weak(bad, index)) {
+                }
+            }
+        }
+    };
+
+    if (jobs == 0) {
+        jobs = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    jobs = std::max<size_t>(std::min<size_t>(jobs, chunks.size()), 1);
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < jobs; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto & thread : threads) {
+        thread.join();
+    }
+
+    return firstBad;
+}
+
+
+/**
+ * Fill in the result from the checked chunks, and the first corrupt one.
+ */
+void
+reportChunks(const std::vector<Chunk> &chunks, size_t bad,
+             VerifyResult &result)
+{
+    result.chunkCount = chunks.size();
+    result.dataSize = 0;
+    for (size_t i = 0; i < bad && i < chunks.size(); ++i) {
+        result.dataSize += chunks[i].dataSize;
+    }
+    if (bad < chunks.size()) {
+        result.error = chunks[bad].error;
+        result.hasBadChunk = true;
+        result.badChunk = bad;
+        result.badChunkOffset = chunks[bad].offset;
+        result.badChunkDataOffset = result.dataSize;
+    }
+}
+
+
+inline uint32_t
+readUInt32(const unsigned char *buf)
+{
+    return (uint32_t)buf[0] |
+           ((uint32_t)buf[1] <<  8) |
+           ((uint32_t)buf[2] << 16) |
+           ((uint32_t)buf[3] << 24);
+}
+
+
+class SnappyChunkReader : public ChunkReader {
+    std::ifstream stream;
+    std::vector<char> buffer;
+    const std::vector<uint32_t> &checksums;
+    bool decompress;
+
+public:
+    SnappyChunkReader(const char *filename,
+                      const std::vector<uint32_t> &_checksums,
+                      bool _decompress) :
+        stream(filename, std::ifstream::binary | std::ifstream::in),
+        checksums(_checksums),
+        decompress(_decompress)
+    {}
+
+    bool check(size_t index, Chunk &chunk) override {
+        buffer.resize(chunk.size);
+        stream.clear();
+        stream.seekg(chunk.offset + 4);
+        stream.read(buffer.data(), chunk.size);
+        if (stream.fail()) {
+            chunk.error = "failed to read chunk";
+            return false;
+        }
+
+        if (!checksums.empty() &&
+            crc32c_8bytes(buffer.data(), chunk.size) != checksums[index]) {
+            chunk.error = "checksum mismatch";
+            return false;
+        }
+
+        // The uncompressed length is at the start, so this is cheap
+        size_t length;
+        if (!snappy::GetUncompressedLength(buffer.data(), chunk.size, &length)) {
+            chunk.error = "invalid uncompressed length";
+            return false;
+        }
+        chunk.dataSize = length;
+
+        if ((checksums.empty() || decompress) &&
+            !snappy::IsValidCompressedBuffer(buffer.data(), chunk.size)) {
+            chunk.error = "corrupt compressed data";
+            return false;
+        }
+
+        return true;
+    }
+};
+
+
+/*
+ * Snappy chunks are framed by their compressed length alone, so walk the
+ * lengths first, then check the chunks in parallel.
+ */
+void
+verifySnappy(const char *filename, const VerifyOptions &options,
+             VerifyResult &result)
+{
+    result.containerType = "Snappy";
+    result.chunked = true;
+
+    std::ifstream stream(filename, std::ifstream::binary | std::ifstream::in);
+
+    std::vector<Chunk> chunks;
+    std::vector<uint32_t> checksums;
+
+    // Problem with the framing of the chunk after the last one in `chunks`
+    std::string framingError;
+
+    // Problem after the last chunk
+    std::string trailerError;
+
+    uint64_t offset = 2;
+    for (;;) {
+        unsigned char buf[4];
+        stream.clear();
+        stream.seekg(offset);
+        stream.read((char *)buf, sizeof buf);
+        size_t count = stream.gcount();
+        if (count == 0) {
+            // No checksums
+            break;
+        }
+        if (count < sizeof buf) {
+            framingError = "truncated chunk length";
+            break;
+        }
+
+        uint32_t length = readUInt32(buf);
+        if (length == 0) {
+            // Checksums follow, if anything
+            uint64_t remaining = result.fileSize - offset - sizeof buf;
+            if (remaining == 0) {
+                break;
+            }
+            std::vector<unsigned char> table(remaining);
+            stream.read((char *)table.data(), remaining);
+            if (remaining < 8 ||
+                stream.gcount() != std::streamsize(remaining) ||
+                readUInt32(&table[remaining - 4]) != SNAPPY_CHECKSUM_MAGIC ||
+                remaining != 8 + 4 * uint64_t(readUInt32(&table[remaining - 8]))) {
+                trailerError = "unexpected data after the last chunk";
+                break;
+            }
+            size_t numChecksums = readUInt32(&table[remaining - 8]);
+            if (numChecksums != chunks.size()) {
+                trailerError = "checksums for " + std::to_string(numChecksums) +
+                               " chunks, but the file has " + std::to_string(chunks.size());
+                break;
+            }
+            checksums.resize(numChecksums);
+            for (size_t i = 0; i < numChecksums; ++i) {
+                checksums[i] = readUInt32(&table[4 * i]);
+            }
+            result.checksums = true;
+            break;
+        }
+
+        if (length > result.fileSize - offset - sizeof buf) {
+            framingError = "chunk of " + std::to_string(length) +
+                           " bytes extends past the end of the file";
+            break;
+        }
+
+        chunks.emplace_back(offset, length);
+        offset += sizeof buf + length;
+    }
+
+    size_t bad = checkChunks(chunks, options.jobs, [&] () {
+        return new SnappyChunkReader(filename, checksums, options.decompress);
+    });
+
+    if (bad == chunks.size() && !framingError.empty()) {
+        chunks.emplace_back(offset, 0);
+        chunks.back().error = framingError;
+    }
+    reportChunks(chunks, bad, result);
+    if (result.ok()) {
+        result.error = trailerError;
+    }
+}
+
+
+class ZstdChunkReader : public ChunkReader {
+    FILE *fp = nullptr;
+    ZSTD_seekable *seekable = nullptr;
+    bool checksums;
+    std::vector<char> buffer;
+    std::string error;
+
+public:
+    ZstdChunkReader(const char *filename, bool _checksums) :
+        checksums(_checksums)
+    {
+        fp = fopen(filename, "rb");
+        seekable = ZSTD_seekable_create();
+        if (!fp || !seekable) {
+            error = "failed to open file";
+            return;
+        }
+        size_t ret = ZSTD_seekable_initFile(seekable, fp);
+        if (ZSTD_isError(ret)) {
+            error = ZSTD_getErrorName(ret);
+        }
+    }
+
+    ~ZstdChunkReader() {
+        if (seekable) {
+            ZSTD_seekable_free(seekable);
+        }
+        if (fp) {
+            fclose(fp);
+        }
+    }
+
+    // ZSTD_seekable_decompressFrame only verifies the checksum when the
+    // output buffer has room to spare, so compare it here instead
+    bool check(size_t index, Chunk &chunk) override {
+        if (!error.empty()) {
+            chunk.error = error;
+            return false;
+        }
+
+        buffer.resize(chunk.dataSize);
+        size_t ret = ZSTD_seekable_decompressFrame(seekable, buffer.data(), buffer.size(), unsigned(index));
+        if (ZSTD_isError(ret)) {
+            chunk.error = ZSTD_getErrorName(ret);
+            return false;
+        }
+        if (ret != chunk.dataSize) {
+            chunk.error = "frame decompressed to " + std::to_string(ret) +
+                          " bytes instead of " + std::to_string(chunk.dataSize);
+            return false;
+        }
+        if (checksums &&
+            uint32_t(XXH64(buffer.data(), ret, 0)) != chunk.checksum) {
+            chunk.error = "checksum mismatch";
+            return false;
+        }
+        return true;
+    }
+};
+
+
+/*
+ * Seekable Zstandard frames are listed in the seek table at the end, so
+ * check that it describes the whole file, then decompress the frames in
+ * parallel.
+ */
+void
+verifyZstdSeekable(const char *filename, const VerifyOptions &options,
+                   VerifyResult &result)
+{
+    result.containerType = "Zstandard (seekable)";
+    result.chunked = true;
+
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        result.error = "failed to open file";
+        return;
+    }
+
+    // The seek table ends with the number of frames, a descriptor whose top
+    // bit flags checksums, and the magic number
+    unsigned char footer[9];
+    if (fseek(fp, -long(sizeof footer), SEEK_END) != 0 ||
+        fread(footer, sizeof footer, 1, fp) != 1) {
+        fclose(fp);
+        result.error = "truncated seek table";
+        return;
+    }
+    result.checksums = (footer[4] & 0x80) != 0;
+
+    ZSTD_seekable *seekable = ZSTD_seekable_create();
+    size_t ret = ZSTD_seekable_initFile(seekable, fp);
+    if (ZSTD_isError(ret)) {
+        result.error = std::string("invalid seek table: ") + ZSTD_getErrorName(ret);
+        ZSTD_seekable_free(seekable);
+        fclose(fp);
+        return;
+    }
+
+    std::vector<Chunk> chunks;
+    unsigned numFrames = ZSTD_seekable_getNumFrames(seekable);
+    uint64_t offset = 0;
+    for (unsigned i = 0; i < numFrames; ++i) {
+        uint64_t frameOffset = ZSTD_seekable_getFrameCompressedOffset(seekable, i);
+        if (frameOffset != offset) {
+            result.error = "seek table places frame " + std::to_string(i) +
+                           " at offset " + std::to_string(frameOffset) +
+                           " instead of " + std::to_string(offset);
+            break;
+        }
+        chunks.emplace_back(frameOffset, ZSTD_seekable_getFrameCompressedSize(seekable, i));
+        chunks.back().dataSize = ZSTD_seekable_getFrameDecompressedSize(seekable, i);
+        offset += chunks.back().size;
+    }
+
+    ZSTD_seekable_free(seekable);
+
+    // Skippable frame header, entries, and footer
+    const unsigned entrySize = result.checksums ? 12 : 8;
+    uint64_t tableSize = 8 + uint64_t(numFrames) * entrySize + sizeof footer;
+    if (result.ok() && offset + tableSize != result.fileSize) {
+        result.error = "frames and seek table take " + std::to_string(offset + tableSize) +
+                       " bytes, but the file has " + std::to_string(result.fileSize);
+    }
+
+    // Each entry ends with the low 32 bits of the XXH64 of the frame's data
+    if (result.ok() && result.checksums) {
+        std::vector<unsigned char> entries(size_t(numFrames) * entrySize);
+        if (fseek(fp, long(offset + 8), SEEK_SET) != 0 ||
+            fread(entries.data(), 1, entries.size(), fp) != entries.size()) {
+            result.error = "truncated seek table";
+        } else {
+            for (unsigned i = 0; i < numFrames; ++i) {
+                chunks[i].checksum = readUInt32(&entries[i * entrySize + 8]);
+            }
+        }
+    }
+
+    fclose(fp);
+
+    if (!result.ok()) {
+        result.chunkCount = chunks.size();
+        return;
+    }
+
+    bool checksums = result.checksums;
+    size_t bad = checkChunks(chunks, options.jobs, [&] () {
+        return new ZstdChunkReader(filename, checksums);
+    });
+    reportChunks(chunks, bad, result);
+}
+
+
+} /* anonymous namespace */
+
+
+bool
+trace::verifyContainer(const char *filename,
+                       const VerifyOptions &options,
+                       VerifyResult &result)
+{
+    result = VerifyResult();
+
+    std::ifstream stream(filename, std::ifstream::binary | std::ifstream::in);
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    stream.seekg(0, std::ios::end);
+    result.fileSize = stream.tellg();
+    stream.seekg(0, std::ios::beg);
+
+    // Same detection as File::createForRead
+    unsigned char magic[4] = {0, 0, 0, 0};
+    unsigned char lastMagic[4] = {0, 0, 0, 0};
+    stream.read((char *)magic, sizeof magic);
+    if (result.fileSize >= sizeof lastMagic) {
+        stream.clear();
+        stream.seekg(-4, std::ios::end);
+        stream.read((char *)lastMagic, sizeof lastMagic);
+    }
+    stream.close();
+
+    if (magic[0] == SNAPPY_BYTE1 && magic[1] == SNAPPY_BYTE2) {
+        verifySnappy(filename, options, result);
+    } else if (magic[0] == 0x1f && magic[1] == 0x8b) {
+        result.containerType = "ZLib";
+    } else if (readUInt32(magic) == ZSTD_MAGICNUMBER) {
+        if (readUInt32(lastMagic) == ZSTD_SEEKABLE_MAGICNUMBER) {
+            verifyZstdSeekable(filename, options, result);
+        } else {
+            result.containerType = "Zstandard";
+        }
+    } else {
+        result.containerType = "Brotli";
+    }
+
+    return true;
+}
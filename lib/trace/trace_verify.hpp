@@ -0,0 +1,97 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Integrity checks of trace containers.
+ */
+
+#pragma once
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+
+namespace trace {
+
+
+    struct VerifyOptions {
+        // Worker threads; zero for one per core
+        unsigned jobs = 0;
+
+        // Decompress chunks even when their checksums can be checked instead
+        bool decompress = false;
+    };
+
+
+    struct VerifyResult {
+        const char *containerType = "";
+
+        // Whether the container is made of independently compressed chunks,
+        // which could be checked
+        bool chunked = false;
+
+        // Whether the chunks have checksums
+        bool checksums = false;
+
+        size_t chunkCount = 0;
+        uint64_t fileSize = 0;
+
+        // Total uncompressed size of the chunks before the first corrupt one
+        uint64_t dataSize = 0;
+
+        // Description of the first problem found, empty if none
+        std::string error;
+
+        // First corrupt chunk, and where its data would start once
+        // uncompressed, when the problem can be pinned to a chunk
+        bool hasBadChunk = false;
+        size_t badChunk = 0;
+        uint64_t badChunkOffset = 0;
+        uint64_t badChunkDataOffset = 0;
+
+        bool ok(void) const {
+            return error.empty();
+        }
+    };
+
+
+    /**
+     * Check the framing of the container, and each of its chunks, on several
+     * threads.  Returns false if the file could not be opened at all.
+     *
+     * Only Snappy and seekable Zstandard traces are chunked; other containers
+     * can only be checked by parsing them.
+     */
+    bool
+    verifyContainer(const char *filename,
+                    const VerifyOptions &options,
+                    VerifyResult &result);
+
+
+} /* namespace trace */
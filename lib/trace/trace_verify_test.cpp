@@ -0,0 +1,283 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <stdio.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_ostream.hpp"
+#include "trace_parser.hpp"
+#include "trace_test_helpers.hpp"
+#include "trace_verify.hpp"
+
+using namespace trace;
+
+
+static const unsigned num_calls = 40;
+
+
+// About 4MB of poorly compressible data by default, so that there are
+// several chunks
+static void
+writeTrace(OutStream *stream, unsigned count = num_calls, size_t size = 100 * 1024)
+{
+    Writer writer;
+    ASSERT_TRUE(writer.open(stream, TRACE_VERSION, Properties()));
+    uint32_t seed = 1;
+    writeUploads(writer, count, [&](unsigned) {
+        std::vector<char> data(size);
+        for (auto & c : data) {
+            seed = seed * 1103515245 + 12345;
+            c = char(seed >> 24);
+        }
+        return data;
+    });
+}
+
+
+static std::string
+readFile(const char *path)
+{
+    std::ifstream stream(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(stream),
+                       std::istreambuf_iterator<char>());
+}
+
+
+static void
+writeFile(const char *path, const std::string &contents)
+{
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream.write(contents.data(), contents.size());
+}
+
+
+static uint32_t
+readUInt32(const std::string &contents, size_t offset)
+{
+    const unsigned char *buf = (const unsigned char *)contents.data() + offset;
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+
+static unsigned
+countCalls(const char *path)
+{
+    Parser parser;
+    EXPECT_TRUE(parser.open(path));
+    unsigned count = 0;
+    Call *call;
+    while ((call = parser.parse_call())) {
+        delete call;
+        ++count;
+    }
+    return count;
+}
+
+
+TEST(trace_verify, checksums)
+{
+    const char *path = "trace_verify_test_checksums.trace";
+    writeTrace(createSnappyStream(path, true));
+
+    VerifyResult result;
+    ASSERT_TRUE(verifyContainer(path, VerifyOptions(), result));
+    EXPECT_TRUE(result.ok()) << result.error;
+    EXPECT_STREQ("Snappy", result.containerType);
+    EXPECT_TRUE(result.chunked);
+    EXPECT_TRUE(result.checksums);
+    EXPECT_GE(result.chunkCount, 4U);
+    EXPECT_GT(result.dataSize, num_calls * 100 * 1024);
+
+    // Readers stop before the checksums
+    EXPECT_EQ(num_calls, countCalls(path));
+
+    remove(path);
+}
+
+
+// Calls which never leave are only returned once the end of the stream is
+// reached, and the parser keeps reading afterwards
+TEST(trace_verify, pending_calls)
+{
+    for (bool checksums : {false, true}) {
+        const char *path = "trace_verify_test_pending.trace";
+        Writer writer;
+        ASSERT_TRUE(writer.open(createSnappyStream(path, checksums), TRACE_VERSION, Properties()));
+        for (unsigned i = 0; i < 3; ++i) {
+            writeBlobCall(writer, &upload_sig, "data", 4, 0, i == 0);
+        }
+        writer.close();
+
+        Parser parser;
+        ASSERT_TRUE(parser.open(path));
+        unsigned count = 0;
+        Call *call;
+        while ((call = parser.parse_call())) {
+            EXPECT_EQ(count, call->no);
+            delete call;
+            ++count;
+        }
+        EXPECT_EQ(3U, count) << "checksums " << checksums;
+        EXPECT_EQ(nullptr, parser.parse_call());
+        EXPECT_EQ(nullptr, parser.parse_call());
+        parser.close();
+
+        remove(path);
+    }
+}
+
+
+TEST(trace_verify, no_checksums)
+{
+    const char *path = "trace_verify_test_plain.trace";
+    writeTrace(createSnappyStream(path, false));
+
+    VerifyResult result;
+    ASSERT_TRUE(verifyContainer(path, VerifyOptions(), result));
+    EXPECT_TRUE(result.ok()) << result.error;
+    EXPECT_FALSE(result.checksums);
+    EXPECT_GE(result.chunkCount, 4U);
+
+    remove(path);
+}
+
+
+TEST(trace_verify, corrupt_chunk)
+{
+    const char *path = "trace_verify_test_corrupt.trace";
+    writeTrace(createSnappyStream(path, true));
+
+    std::string contents = readFile(path);
+    size_t chunk1 = 2 + 4 + readUInt32(contents, 2);
+    size_t chunk2 = chunk1 + 4 + readUInt32(contents, chunk1);
+    contents[chunk2 + 4 + 1000] ^= 0x55;
+    writeFile(path, contents);
+
+    for (unsigned jobs : {1, 4}) {
+        for (bool decompress : {false, true}) {
+            VerifyOptions options;
+            options.jobs = jobs;
+            options.decompress = decompress;
+            VerifyResult result;
+            ASSERT_TRUE(verifyContainer(path, options, result));
+            EXPECT_FALSE(result.ok());
+            EXPECT_EQ("checksum mismatch", result.error);
+            ASSERT_TRUE(result.hasBadChunk);
+            EXPECT_EQ(2U, result.badChunk);
+            EXPECT_EQ(chunk2, result.badChunkOffset);
+            EXPECT_EQ(2U * 1024 * 1024, result.badChunkDataOffset);
+        }
+    }
+
+    remove(path);
+}
+
+
+// Random data is mostly stored in raw blocks, where corruption goes unnoticed
+// when decompressing, so only the checksum catches it
+TEST(trace_verify, corrupt_zstd_frame)
+{
+    const char *path = "trace_verify_test_corrupt.zst.trace";
+    writeTrace(createZstdStream(path, 1, true), 20, 500000);
+
+    VerifyResult result;
+    ASSERT_TRUE(verifyContainer(path, VerifyOptions(), result));
+    EXPECT_TRUE(result.ok()) << result.error;
+    EXPECT_TRUE(result.checksums);
+    EXPECT_EQ(5U, result.chunkCount);
+
+    std::string contents = readFile(path);
+    contents[3000000] ^= 0x55;
+    writeFile(path, contents);
+
+    for (unsigned jobs : {1, 4}) {
+        VerifyOptions options;
+        options.jobs = jobs;
+        ASSERT_TRUE(verifyContainer(path, options, result));
+        EXPECT_FALSE(result.ok());
+        EXPECT_EQ("checksum mismatch", result.error);
+        ASSERT_TRUE(result.hasBadChunk);
+        EXPECT_EQ(1U, result.badChunk);
+        EXPECT_EQ(2U * 1024 * 1024, result.badChunkDataOffset);
+    }
+
+    remove(path);
+}
+
+
+TEST(trace_verify, truncated)
+{
+    const char *path = "trace_verify_test_truncated.trace";
+    writeTrace(createSnappyStream(path, false));
+
+    std::string contents = readFile(path);
+    contents.resize(contents.size() - 100);
+    writeFile(path, contents);
+
+    VerifyResult result;
+    ASSERT_TRUE(verifyContainer(path, VerifyOptions(), result));
+    EXPECT_FALSE(result.ok());
+    ASSERT_TRUE(result.hasBadChunk);
+    EXPECT_EQ(result.chunkCount - 1, result.badChunk);
+    EXPECT_EQ(result.badChunk * 1024 * 1024, result.badChunkDataOffset);
+
+    remove(path);
+}
+
+
+TEST(trace_verify, truncated_checksums)
+{
+    const char *path = "trace_verify_test_truncated_checksums.trace";
+    writeTrace(createSnappyStream(path, true));
+
+    // Cut within the checksums
+    std::string contents = readFile(path);
+    contents.resize(contents.size() - 2);
+    writeFile(path, contents);
+
+    VerifyResult result;
+    ASSERT_TRUE(verifyContainer(path, VerifyOptions(), result));
+    EXPECT_FALSE(result.ok());
+    EXPECT_FALSE(result.hasBadChunk);
+    EXPECT_GE(result.dataSize, num_calls * 100 * 1024);
+
+    remove(path);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -30,6 +30,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
+
+#include <algorithm>
 #include <vector>
 
 #include "os.hpp"
@@ -40,21 +42,73 @@
 namespace trace {
 
 
+// Size of the staging buffer; larger writes bypass it
+#define WRITER_BUFFER_SIZE (64 * 1024)
+
+// Maximum length of an encoded uint
+#define MAX_UINT_LENGTH 10
+
+
 Writer::Writer() :
     call_no(0)
 {
     m_file = nullptr;
+    m_buf = new char[WRITER_BUFFER_SIZE];
+    m_bufPtr = m_buf;
+    m_bufEnd = m_buf + WRITER_BUFFER_SIZE;
+    m_muteStart = m_buf;
 }
 
 Writer::~Writer()
 {
     close();
+    delete [] m_buf;
 }
 
 void
 Writer::close(void) {
+    if (m_file) {
+        _flushBuffer();
+    }
     delete m_file;
     m_file = nullptr;
+    m_bufPtr = m_buf;
+    m_written = 0;
+}
+
+void
+Writer::flush(void) {
+    if (m_file) {
+        _flushBuffer();
+        m_file->flush();
+    }
+}
+
+void
+Writer::_flushBuffer(void) {
+    // Anything written since beginMute is dropped
+    char *end = muted ? m_muteStart : m_bufPtr;
+    if (end != m_buf) {
+        m_file->write(m_buf, end - m_buf);
+        m_written += end - m_buf;
+    }
+    m_bufPtr = m_buf;
+    m_muteStart = m_buf;
+}
+
+void
+Writer::_writeSlow(const void *sBuffer, size_t dwBytesToWrite) {
+    _flushBuffer();
+    if (muted) {
+        return;
+    }
+    if (dwBytesToWrite >= WRITER_BUFFER_SIZE / 2) {
+        m_file->write(sBuffer, dwBytesToWrite);
+        m_written += dwBytesToWrite;
+    } else {
+        memcpy(m_bufPtr, sBuffer, dwBytesToWrite);
+        m_bufPtr += dwBytesToWrite;
+    }
 }
 
 bool
@@ -64,22 +118,37 @@ Writer::open(const char *filename,
 {
     close();
 
-    m_file = createSnappyStream(filename);
+    return open(createSnappyStream(filename), semanticVersion, properties);
+}
+
+bool
+Writer::open(OutStream *stream,
+             unsigned semanticVersion,
+             const Properties &properties)
+{
+    close();
+
+    m_file = stream;
     if (!m_file) {
         return false;
     }
 
     call_no = 0;
-    functions.clear();
-    structs.clear();
-    enums.clear();
-    bitmasks.clear();
-    frames.clear();
-
-    _writeUInt(TRACE_VERSION);
+    muted_call_no = 0;
+    blob_no = 0;
+    forgetDefinitions();
+
+    // Only claim the newer format when blob references may be written
+    unsigned version = TRACE_VERSION;
+    if (!blobDedup && !blobRefsAllowed) {
+        version = TRACE_VERSION_BLOB_DEDUP - 1;
+    }
+    _writeUInt(version);
 
+    // Version 7 only changed how blobs are written, not the meaning of
+    // calls, and readers reject semantic versions above the format one
     assert(semanticVersion <= TRACE_VERSION);
-    _writeUInt(semanticVersion);
+    _writeUInt(std::min<unsigned>(semanticVersion, version));
 
     beginProperties();
     for (auto & kv : properties) {
@@ -90,33 +159,92 @@ Writer::open(const char *filename,
     return true;
 }
 
+void
+Writer::forgetDefinitions(void)
+{
+    functions.clear();
+    structs.clear();
+    enums.clear();
+    bitmasks.clear();
+    frames.clear();
+
+    // Blob ids keep increasing, so that they stay unique within the output
+    blobs.clear();
+    blobWindow.clear();
+    blobWindowSize = 0;
+}
+
+const std::vector<bool> &
+Writer::definitions(Mark::Kind kind) const
+{
+    switch (kind) {
+    case Mark::FUNCTION:
+        return functions;
+    case Mark::STRUCT:
+        return structs;
+    case Mark::ENUM:
+        return enums;
+    case Mark::BITMASK:
+        return bitmasks;
+    default:
+        assert(kind == Mark::FRAME);
+        return frames;
+    }
+}
+
+void
+Writer::encodeCallNo(char *buffer, unsigned call)
+{
+    // An overlong encoding, which readers accept as any other
+    static_assert(sizeof call * 8 <= CALL_NO_LENGTH * 7, "CALL_NO_LENGTH too small");
+    unsigned long long value = call;
+    for (unsigned i = 0; i + 1 < CALL_NO_LENGTH; ++i) {
+        buffer[i] = 0x80 | (value & 0x7f);
+        value >>= 7;
+    }
+    buffer[CALL_NO_LENGTH - 1] = value;
+}
+
+void
+Writer::_mark(Mark::Kind kind, unsigned id, uint64_t begin)
+{
+    if (m_marks && !muted) {
+        m_marks->push_back(Mark{kind, id, begin, _tell()});
+    }
+}
+
 void inline
 Writer::_write(const void *sBuffer, size_t dwBytesToWrite) {
-    m_file->write(sBuffer, dwBytesToWrite);
+    if (dwBytesToWrite <= size_t(m_bufEnd - m_bufPtr)) {
+        memcpy(m_bufPtr, sBuffer, dwBytesToWrite);
+        m_bufPtr += dwBytesToWrite;
+    } else {
+        _writeSlow(sBuffer, dwBytesToWrite);
+    }
 }
 
 void inline
 Writer::_writeByte(char c) {
-    _write(&c, 1);
+    if (m_bufPtr == m_bufEnd) {
+        _flushBuffer();
+    }
+    *m_bufPtr++ = c;
 }
 
 void inline
 Writer::_writeUInt(unsigned long long value) {
-    char buf[2 * sizeof value];
-    unsigned len;
+    static_assert(sizeof value * 8 <= MAX_UINT_LENGTH * 7, "MAX_UINT_LENGTH too small");
+    if (m_bufEnd - m_bufPtr < MAX_UINT_LENGTH) {
+        _flushBuffer();
+    }
 
-    len = 0;
-    do {
-        assert(len < sizeof buf);
-        buf[len] = 0x80 | (value & 0x7f);
+    char *p = m_bufPtr;
+    while (value >= 0x80) {
+        *p++ = 0x80 | (value & 0x7f);
         value >>= 7;
-        ++len;
-    } while (value);
-
-    assert(len);
-    buf[len - 1] &= 0x7f;
-
-    _write(buf, len);
+    }
+    *p++ = value;
+    m_bufPtr = p;
 }
 
 void inline
@@ -157,6 +285,7 @@ void Writer::beginBacktrace(unsigned num_frames) {
 void Writer::writeStackFrame(const RawStackFrame *frame) {
     _writeUInt(frame->id);
     if (!lookup(frames, frame->id)) {
+        uint64_t begin = _tell();
         if (frame->module != NULL) {
             _writeByte(trace::BACKTRACE_MODULE);
             _writeString(frame->module);
@@ -178,7 +307,8 @@ void Writer::writeStackFrame(const RawStackFrame *frame) {
             _writeUInt(frame->offset);
         }
         _writeByte(trace::BACKTRACE_END);
-        frames[frame->id] = true;
+        frames[frame->id] = !muted;
+        _mark(Mark::FRAME, frame->id, begin);
     }
 }
 
@@ -211,14 +341,19 @@ unsigned Writer::beginEnter(const FunctionSig *sig, unsigned thread_id) {
     _writeUInt(thread_id);
     _writeUInt(sig->id);
     if (!lookup(functions, sig->id)) {
+        uint64_t begin = _tell();
         _writeString(sig->name);
         _writeUInt(sig->num_args);
         for (unsigned i = 0; i < sig->num_args; ++i) {
             _writeString(sig->arg_names[i]);
         }
-        functions[sig->id] = true;
+        functions[sig->id] = !muted;
+        _mark(Mark::FUNCTION, sig->id, begin);
     }
 
+    if (muted) {
+        return MUTED_CALL_NO | muted_call_no++;
+    }
     return call_no++;
 }
 
@@ -228,7 +363,17 @@ void Writer::endEnter(void) {
 
 void Writer::beginLeave(unsigned call) {
     _writeByte(trace::EVENT_LEAVE);
-    _writeUInt(call);
+    if (m_marks && !muted) {
+        if (size_t(m_bufEnd - m_bufPtr) < CALL_NO_LENGTH) {
+            _flushBuffer();
+        }
+        uint64_t begin = _tell();
+        encodeCallNo(m_bufPtr, call);
+        m_bufPtr += CALL_NO_LENGTH;
+        _mark(Mark::CALL_NO, call, begin);
+    } else {
+        _writeUInt(call);
+    }
 }
 
 void Writer::endLeave(void) {
@@ -253,12 +398,14 @@ void Writer::beginStruct(const StructSig *sig) {
     _writeByte(trace::TYPE_STRUCT);
     _writeUInt(sig->id);
     if (!lookup(structs, sig->id)) {
+        uint64_t begin = _tell();
         _writeString(sig->name);
         _writeUInt(sig->num_members);
         for (unsigned i = 0; i < sig->num_members; ++i) {
             _writeString(sig->member_names[i]);
         }
-        structs[sig->id] = true;
+        structs[sig->id] = !muted;
+        _mark(Mark::STRUCT, sig->id, begin);
     }
 }
 
@@ -335,11 +482,96 @@ void Writer::writeWString(const wchar_t *str) {
     writeWString(str, len);
 }
 
+// Smaller blobs aren't worth hashing
+static const size_t BLOB_DEDUP_MIN_SIZE = 256;
+
+static inline uint64_t
+rotl64(uint64_t x, unsigned r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * Hash blob contents into two independent 64bit values; the first keys the
+ * blob table, and the second guards against collisions.
+ */
+static void
+hashBlob(const void *data, size_t size, uint64_t &hash, uint64_t &check)
+{
+    const uint64_t k1 = 0x9e3779b185ebca87ULL;
+    const uint64_t k2 = 0xc2b2ae3d27d4eb4fULL;
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    uint64_t h1 = size ^ k1;
+    uint64_t h2 = size ^ k2;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint64_t a, b;
+        memcpy(&a, p + i, sizeof a);
+        memcpy(&b, p + i + 8, sizeof b);
+        h1 = rotl64(h1 + a * k2, 31) * k1;
+        h2 = rotl64(h2 + b * k1, 29) * k2;
+    }
+    uint64_t tail[2] = {0, 0};
+    memcpy(tail, p + i, size - i);
+    h1 = rotl64(h1 + tail[0] * k2, 31) * k1;
+    h2 = rotl64(h2 + tail[1] * k1, 29) * k2;
+    hash = mix64(h1 ^ rotl64(h2, 17));
+    check = mix64(h2 + h1 * k1);
+}
+
 void Writer::writeBlob(const void *data, size_t size) {
     if (!data) {
         Writer::writeNull();
         return;
     }
+
+    if (blobDedup &&
+        !muted &&
+        size >= BLOB_DEDUP_MIN_SIZE &&
+        size <= TRACE_BLOB_WINDOW_SIZE) {
+        uint64_t hash, check;
+        hashBlob(data, size, hash, check);
+
+        auto it = blobs.find(hash);
+        if (it != blobs.end() &&
+            it->second.size == size &&
+            it->second.check == check) {
+            _writeByte(trace::TYPE_BLOB_REF);
+            _writeUInt(it->second.id);
+            return;
+        }
+
+        unsigned id = blob_no++;
+        _writeByte(trace::TYPE_BLOB_DEF);
+        _writeUInt(id);
+        _writeUInt(size);
+        _write(data, size);
+
+        // Keep the window in sync with what the parser retains
+        blobs[hash] = BlobEntry{id, size, check};
+        blobWindow.push_back(BlobWindowEntry{hash, id, size});
+        blobWindowSize += size;
+        while (blobWindowSize > TRACE_BLOB_WINDOW_SIZE) {
+            const BlobWindowEntry &oldest = blobWindow.front();
+            auto found = blobs.find(oldest.hash);
+            if (found != blobs.end() && found->second.id == oldest.id) {
+                blobs.erase(found);
+            }
+            blobWindowSize -= oldest.size;
+            blobWindow.pop_front();
+        }
+        return;
+    }
+
     _writeByte(trace::TYPE_BLOB);
     _writeUInt(size);
     if (size) {
@@ -351,12 +583,14 @@ void Writer::writeEnum(const EnumSig *sig, signed long long value) {
     _writeByte(trace::TYPE_ENUM);
     _writeUInt(sig->id);
     if (!lookup(enums, sig->id)) {
+        uint64_t begin = _tell();
         _writeUInt(sig->num_values);
         for (unsigned i = 0; i < sig->num_values; ++i) {
             _writeString(sig->values[i].name);
             writeSInt(sig->values[i].value);
         }
-        enums[sig->id] = true;
+        enums[sig->id] = !muted;
+        _mark(Mark::ENUM, sig->id, begin);
     }
     writeSInt(value);
 }
@@ -365,6 +599,7 @@ void Writer::writeBitmask(const BitmaskSig *sig, unsigned long long value) {
     _writeByte(trace::TYPE_BITMASK);
     _writeUInt(sig->id);
     if (!lookup(bitmasks, sig->id)) {
+        uint64_t begin = _tell();
         _writeUInt(sig->num_flags);
         for (unsigned i = 0; i < sig->num_flags; ++i) {
             if (i != 0 && sig->flags[i].value == 0) {
@@ -373,7 +608,8 @@ void Writer::writeBitmask(const BitmaskSig *sig, unsigned long long value) {
             _writeString(sig->flags[i].name);
             _writeUInt(sig->flags[i].value);
         }
-        bitmasks[sig->id] = true;
+        bitmasks[sig->id] = !muted;
+        _mark(Mark::BITMASK, sig->id, begin);
     }
     _writeUInt(value);
 }
@@ -31,25 +31,91 @@
 
 
 #include <stddef.h>
+#include <stdint.h>
 
+#include <deque>
+#include <unordered_map>
 #include <vector>
 
 #include "trace_model.hpp"
+#include "trace_ostream.hpp"
 
 namespace trace {
-    class OutStream;
 
     class Writer {
+    public:
+        /**
+         * Where a definition, or the call number of a leave event, was
+         * written, in bytes from the start of the output.  See setMarks.
+         */
+        struct Mark {
+            enum Kind : unsigned char {
+                FUNCTION,
+                STRUCT,
+                ENUM,
+                BITMASK,
+                FRAME,
+                NUM_DEFINITION_KINDS,
+                CALL_NO = NUM_DEFINITION_KINDS,
+            };
+
+            Kind kind;
+            unsigned id;  // of the signature or stack frame, or the call number
+            uint64_t begin;
+            uint64_t end;
+        };
+
+        // Length of the call numbers of leave events, when marked
+        static const unsigned CALL_NO_LENGTH = 5;
+
+        /**
+         * Encode a call number with the fixed length of marked leave events.
+         */
+        static void encodeCallNo(char *buffer, unsigned call);
+
     protected:
         OutStream *m_file;
         unsigned call_no;
 
+        // Bytes handed to m_file so far
+        uint64_t m_written = 0;
+        std::vector<Mark> *m_marks = nullptr;
+
+        // Staging buffer, so that values are encoded in place and only
+        // handed to m_file in large spans
+        char *m_buf;
+        char *m_bufPtr;
+        char *m_bufEnd;
+
+        // See beginMute
+        bool muted = false;
+        char *m_muteStart;
+        unsigned muted_call_no = 0;
+
         std::vector<bool> functions;
         std::vector<bool> structs;
         std::vector<bool> enums;
         std::vector<bool> bitmasks;
         std::vector<bool> frames;
 
+        // Blob deduplication state; see writeBlob
+        struct BlobEntry {
+            unsigned id;
+            size_t size;
+            uint64_t check;
+        };
+        struct BlobWindowEntry {
+            uint64_t hash;
+            unsigned id;
+            size_t size;
+        };
+        bool blobDedup = false;
+        bool blobRefsAllowed = false;
+        unsigned blob_no = 0;
+        std::unordered_map<uint64_t, BlobEntry> blobs;
+        std::deque<BlobWindowEntry> blobWindow;
+        size_t blobWindowSize = 0;
+
     public:
         Writer();
         ~Writer();
@@ -57,8 +123,97 @@ namespace trace {
         bool open(const char *filename,
                   unsigned semanticVersion,
                   const Properties &properties);
+
+        /**
+         * Open on an existing stream, which the writer takes ownership of.
+         */
+        bool open(OutStream *stream,
+                  unsigned semanticVersion,
+                  const Properties &properties);
+
+        /**
+         * Open with the given container and compression.  Inline so that
+         * only the users of it link in every compressor.
+         */
+        bool open(const char *filename,
+                  const OutputOptions &options,
+                  unsigned semanticVersion,
+                  const Properties &properties) {
+            return open(createOutStream(filename, options), semanticVersion, properties);
+        }
         void close(void);
 
+        /**
+         * Hand all staged data to the output stream and flush it.
+         */
+        void flush(void);
+
+        /**
+         * Replace repeated blobs with references to earlier ones.  Must be
+         * called before open, as it decides the format version written.
+         */
+        void setBlobDedup(bool enabled) {
+            blobDedup = enabled;
+        }
+
+        bool getBlobDedup(void) const {
+            return blobDedup;
+        }
+
+        /**
+         * Write the format version able to hold blob references even
+         * without deduplicating blobs, for output later spliced together
+         * with deduplicated output.  Must be called before open.
+         */
+        void setBlobRefsAllowed(bool allowed) {
+            blobRefsAllowed = allowed;
+        }
+
+        /**
+         * Record where definitions and the call numbers of leave events are
+         * written, the latter with a fixed length, so that the output can be
+         * spliced and renumbered later on without parsing it.
+         */
+        void setMarks(std::vector<Mark> *marks) {
+            m_marks = marks;
+        }
+
+        /**
+         * Write definitions again on their next use, and start blob
+         * deduplication afresh, so that nothing written from now on refers
+         * back to earlier output.
+         */
+        void forgetDefinitions(void);
+
+        /**
+         * Which ids of the given kind were defined so far.
+         */
+        const std::vector<bool> &definitions(Mark::Kind kind) const;
+
+        /**
+         * Number the next call entered will get.
+         */
+        unsigned nextCallNo(void) const {
+            return call_no;
+        }
+
+        static const unsigned MUTED_CALL_NO = 0x80000000U;
+
+        /**
+         * Drop everything written until endMute, leaving no trace of it
+         * in the output nor in the writer state.  Calls entered meanwhile are
+         * numbered apart, with MUTED_CALL_NO set.
+         */
+        void beginMute(void) {
+            muted = true;
+            m_muteStart = m_bufPtr;
+        }
+
+        void endMute(void) {
+            m_bufPtr = m_muteStart;
+            muted = false;
+        }
+
         unsigned beginEnter(const FunctionSig *sig, unsigned thread_id);
         void endEnter(void);
 
@@ -112,6 +267,9 @@ namespace trace {
         void endProperties(void);
 
     protected:
+        void _flushBuffer(void);
+        void _writeSlow(const void *sBuffer, size_t dwBytesToWrite);
+
         void inline _write(const void *sBuffer, size_t dwBytesToWrite);
         void inline _writeByte(char c);
         void inline _writeUInt(unsigned long long value);
@@ -119,6 +277,11 @@ namespace trace {
         void inline _writeDouble(double value);
         void inline _writeString(const char *str);
 
+        uint64_t _tell(void) const {
+            return m_written + (m_bufPtr - m_buf);
+        }
+        void _mark(Mark::Kind kind, unsigned id, uint64_t begin);
+
     };
 
 } /* namespace trace */
@@ -0,0 +1,293 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Micro-benchmark of trace::Writer call serialization.
+ *
+ * Calls are written to a stream which discards all data, so this measures
+ * encoding only, not compression nor I/O.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "os_time.hpp"
+#include "trace_format.hpp"
+#include "trace_ostream.hpp"
+#include "trace_writer.hpp"
+
+
+using namespace trace;
+
+
+class NullOutStream : public OutStream {
+public:
+    size_t bytes = 0;
+
+    bool write(const void *buffer, size_t length) override {
+        bytes += length;
+        return true;
+    }
+
+    void flush(void) override {}
+};
+
+
+static const EnumValue
+enum_values[] = {
+    {"GL_TRIANGLES", 0x0004},
+    {"GL_UNSIGNED_SHORT", 0x1403},
+    {"GL_FLOAT", 0x1406},
+};
+
+static const EnumSig
+enum_sig = {0, 3, enum_values};
+
+static const char *
+box_member_names[] = {"left", "top", "front", "right", "bottom", "back"};
+
+static const StructSig
+box_sig = {0, "D3D11_BOX", 6, box_member_names};
+
+
+// glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, NULL)
+static const char *
+draw_elements_args[] = {"mode", "count", "type", "indices"};
+
+static const FunctionSig
+draw_elements_sig = {0, "glDrawElements", 4, draw_elements_args};
+
+static void
+writeDrawElements(Writer &writer, unsigned i)
+{
+    unsigned call = writer.beginEnter(&draw_elements_sig, 0);
+    writer.beginArg(0);
+    writer.writeEnum(&enum_sig, 0x0004);
+    writer.endArg();
+    writer.beginArg(1);
+    writer.writeSInt(36 + (i & 7));
+    writer.endArg();
+    writer.beginArg(2);
+    writer.writeEnum(&enum_sig, 0x1403);
+    writer.endArg();
+    writer.beginArg(3);
+    writer.writePointer(0);
+    writer.endArg();
+    writer.endEnter();
+    writer.beginLeave(call);
+    writer.endLeave();
+}
+
+
+// glUniformMatrix4fv(location, 1, GL_FALSE, {16 floats})
+static const char *
+uniform_matrix_args[] = {"location", "count", "transpose", "value"};
+
+static const FunctionSig
+uniform_matrix_sig = {1, "glUniformMatrix4fv", 4, uniform_matrix_args};
+
+static void
+writeUniformMatrix(Writer &writer, unsigned i)
+{
+    unsigned call = writer.beginEnter(&uniform_matrix_sig, 0);
+    writer.beginArg(0);
+    writer.writeSInt(i & 15);
+    writer.endArg();
+    writer.beginArg(1);
+    writer.writeSInt(1);
+    writer.endArg();
+    writer.beginArg(2);
+    writer.writeBool(false);
+    writer.endArg();
+    writer.beginArg(3);
+    writer.beginArray(16);
+    for (unsigned j = 0; j < 16; ++j) {
+        writer.beginElement();
+        writer.writeFloat(float(i + j));
+        writer.endElement();
+    }
+    writer.endArray();
+    writer.endArg();
+    writer.endEnter();
+    writer.beginLeave(call);
+    writer.endLeave();
+}
+
+
+// glBufferSubData(target, offset, 256, blob)
+static const char *
+buffer_sub_data_args[] = {"target", "offset", "size", "data"};
+
+static const FunctionSig
+buffer_sub_data_sig = {2, "glBufferSubData", 4, buffer_sub_data_args};
+
+static void
+writeBufferSubData(Writer &writer, unsigned i)
+{
+    static char data[256];
+    unsigned call = writer.beginEnter(&buffer_sub_data_sig, 0);
+    writer.beginArg(0);
+    writer.writeEnum(&enum_sig, 0x1406);
+    writer.endArg();
+    writer.beginArg(1);
+    writer.writeSInt(i * sizeof data);
+    writer.endArg();
+    writer.beginArg(2);
+    writer.writeSInt(sizeof data);
+    writer.endArg();
+    writer.beginArg(3);
+    writer.writeBlob(data, sizeof data);
+    writer.endArg();
+    writer.endEnter();
+    writer.beginLeave(call);
+    writer.endLeave();
+}
+
+
+// ID3D11DeviceContext::DrawIndexed(this, IndexCount, StartIndexLocation, BaseVertexLocation)
+static const char *
+draw_indexed_args[] = {"this", "IndexCount", "StartIndexLocation", "BaseVertexLocation"};
+
+static const FunctionSig
+draw_indexed_sig = {3, "ID3D11DeviceContext::DrawIndexed", 4, draw_indexed_args};
+
+static void
+writeDrawIndexed(Writer &writer, unsigned i)
+{
+    unsigned call = writer.beginEnter(&draw_indexed_sig, 0);
+    writer.beginArg(0);
+    writer.writePointer(0x7f1234567890ULL);
+    writer.endArg();
+    writer.beginArg(1);
+    writer.writeUInt(36 + (i & 7));
+    writer.endArg();
+    writer.beginArg(2);
+    writer.writeUInt(i * 36);
+    writer.endArg();
+    writer.beginArg(3);
+    writer.writeSInt(0);
+    writer.endArg();
+    writer.endEnter();
+    writer.beginLeave(call);
+    writer.endLeave();
+}
+
+
+// ID3D11DeviceContext::UpdateSubresource(this, pDstResource, DstSubresource, pDstBox, pSrcData, SrcRowPitch, SrcDepthPitch)
+static const char *
+update_subresource_args[] = {"this", "pDstResource", "DstSubresource", "pDstBox", "pSrcData", "SrcRowPitch", "SrcDepthPitch"};
+
+static const FunctionSig
+update_subresource_sig = {4, "ID3D11DeviceContext::UpdateSubresource", 7, update_subresource_args};
+
+static void
+writeUpdateSubresource(Writer &writer, unsigned i)
+{
+    static char data[64];
+    unsigned call = writer.beginEnter(&update_subresource_sig, 0);
+    writer.beginArg(0);
+    writer.writePointer(0x7f1234567890ULL);
+    writer.endArg();
+    writer.beginArg(1);
+    writer.writePointer(0x7f1234560000ULL + i * 16);
+    writer.endArg();
+    writer.beginArg(2);
+    writer.writeUInt(0);
+    writer.endArg();
+    writer.beginArg(3);
+    writer.beginArray(1);
+    writer.beginElement();
+    writer.beginStruct(&box_sig);
+    for (unsigned j = 0; j < 6; ++j) {
+        writer.writeUInt(j < 3 ? 0 : 4);
+    }
+    writer.endStruct();
+    writer.endElement();
+    writer.endArray();
+    writer.endArg();
+    writer.beginArg(4);
+    writer.writeBlob(data, sizeof data);
+    writer.endArg();
+    writer.beginArg(5);
+    writer.writeUInt(16);
+    writer.endArg();
+    writer.beginArg(6);
+    writer.writeUInt(64);
+    writer.endArg();
+    writer.endEnter();
+    writer.beginLeave(call);
+    writer.endLeave();
+}
+
+
+typedef void (*WriteCallFunc)(Writer &writer, unsigned i);
+
+static void
+bench(const char *name, WriteCallFunc func, unsigned count)
+{
+    Writer writer;
+    NullOutStream *stream = new NullOutStream;
+    if (!writer.open(stream, TRACE_VERSION, Properties())) {
+        fprintf(stderr, "error: failed to open writer\n");
+        exit(1);
+    }
+
+    // Warm up, and emit the signatures
+    for (unsigned i = 0; i < 1000; ++i) {
+        func(writer, i);
+    }
+
+    long long start = os::getTime();
+    for (unsigned i = 0; i < count; ++i) {
+        func(writer, i);
+    }
+    writer.flush();
+    long long end = os::getTime();
+
+    double ns = double(end - start) * 1.0e9 / double(os::timeFrequency) / count;
+    printf("%-40s %8.1f ns/call %10.1f MB\n", name, ns, stream->bytes / (1024.0 * 1024.0));
+
+    writer.close();
+}
+
+
+int
+main(int argc, char **argv)
+{
+    unsigned count = 1000000;
+    if (argc > 1) {
+        count = atoi(argv[1]);
+    }
+
+    bench("glDrawElements", writeDrawElements, count);
+    bench("glUniformMatrix4fv", writeUniformMatrix, count);
+    bench("glBufferSubData (256 bytes)", writeBufferSubData, count);
+    bench("ID3D11DeviceContext::DrawIndexed", writeDrawIndexed, count);
+    bench("ID3D11DeviceContext::UpdateSubresource", writeUpdateSubresource, count);
+
+    return 0;
+}
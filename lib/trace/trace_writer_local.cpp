@@ -25,6 +25,7 @@
 
 
 #include <assert.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,11 +34,14 @@
 #include "os.hpp"
 #include "os_thread.hpp"
 #include "os_string.hpp"
+#include "os_time.hpp"
 #include "os_version.hpp"
 #include "trace_option.hpp"
 #include "trace_ostream.hpp"
 #include "trace_writer_local.hpp"
 #include "trace_format.hpp"
+#include "trace_parser.hpp"
+#include "trace_stats.hpp"
 #include "os_backtrace.hpp"
 
 #ifdef _WIN32
@@ -63,13 +67,30 @@ const FunctionSig realloc_sig = {3, "realloc", 2, realloc_args};
 
 static void exceptionCallback(void)
 {
-    localWriter.flush();
+    localWriter.flush(true);
 }
 
 
+#ifndef _WIN32
+static volatile sig_atomic_t dumpSignaled = 0;
+
+static void dumpSignalHandler(int sig)
+{
+    dumpSignaled = 1;
+}
+#endif
+
+
 LocalWriter::LocalWriter() :
     acquired(0),
-    sharedPtrThis(std::make_shared<LocalWriter*>(this))
+    sharedPtrThis(std::make_shared<LocalWriter*>(this)),
+    frameEndCall(~0U),
+    endingFrame(false),
+    dumpRequested(false),
+    frameFilter(false),
+    frameNo(0),
+    capture(CAPTURE_ALL),
+    leaveMuted(false)
 {
     os::String process = os::getProcessName();
     os::log("apitrace: loaded into %s\n", process.str());
@@ -99,6 +120,15 @@ LocalWriter::~LocalWriter()
     os::resetExceptionCallback();
     checkProcessId();
 
+    // The recorder must outlive its stream, and the last compression must be
+    // accounted in the statistics
+    if (recorder || stats::enabled) {
+        close();
+        recorder.reset();
+    }
+
+    stats::write();
+
     os::String process = os::getProcessName();
     os::log("apitrace: unloaded from %s\n", process.str());
 }
@@ -172,7 +202,50 @@ LocalWriter::open(void) {
     os::String processCommandLine = os::getProcessCommandLine();
     properties["process.commandLine"] = processCommandLine;
 
-    if (!Writer::open(lpFileName, TRACE_VERSION, properties)) {
+    setBlobDedup(boolOption(getenv("TRACE_BLOB_DEDUP"), true));
+
+    const char *statsFileName = getenv("TRACE_STATS");
+    if (statsFileName && !stats::enabled) {
+        os::log("apitrace: writing tracing statistics to %s\n", statsFileName);
+        stats::enable(statsFileName);
+        properties["tracer.stats"] = statsFileName;
+    }
+
+    // Frame ends must be resolved again
+    sigFlags.clear();
+
+    const char *framesOption = getenv("TRACE_FRAMES");
+    if (framesOption) {
+        captureFrames = CallSet();
+        captureFrames.merge(framesOption);
+        frameFilter = true;
+        frameNo = 0;
+        beginFrame();
+    }
+
+    const char *recorderFrames = getenv("TRACE_FLIGHT_RECORDER");
+    if (recorderFrames && atoi(recorderFrames) > 0) {
+        os::log("apitrace: recording the last %i frames only\n", atoi(recorderFrames));
+
+        size_t maxStateSize = 256;
+        const char *recorderState = getenv("TRACE_FLIGHT_RECORDER_STATE_MB");
+        if (recorderState && atoi(recorderState) > 0) {
+            maxStateSize = atoi(recorderState);
+        }
+
+        recorder.reset(new FlightRecorder(atoi(recorderFrames), lpFileName, properties,
+                                          maxStateSize << 20));
+        if (!Writer::open(recorder->createStream(), TRACE_VERSION, properties)) {
+            os::log("apitrace: error: failed to start flight recorder\n");
+            os::abort();
+        }
+        recorder->attach(this);
+
+#ifndef _WIN32
+        signal(SIGUSR1, dumpSignalHandler);
+#endif
+    } else if (!Writer::open(createSnappyStream(lpFileName, boolOption(getenv("TRACE_CHECKSUMS"), false)),
+                             TRACE_VERSION, properties)) {
         os::log("apitrace: error: failed to open %s\n", lpFileName);
         os::abort();
     }
@@ -199,6 +272,29 @@ static uintptr_t next_thread_num = 1;
 
 static OS_THREAD_LOCAL uintptr_t thread_num;
 
+/*
+ * Time spent by the current thread inside the tracer for the call being
+ * written, when TRACE_STATS is set.
+ */
+static OS_THREAD_LOCAL const FunctionSig *stats_sig;
+static OS_THREAD_LOCAL long long stats_start;
+static OS_THREAD_LOCAL long long stats_serialization;
+static OS_THREAD_LOCAL long long stats_lock_wait;
+
+static inline bool
+statsLock(std::recursive_mutex &mutex)
+{
+    if (!stats::enabled) {
+        mutex.lock();
+        return false;
+    }
+    long long start = os::getTime();
+    mutex.lock();
+    stats_start = os::getTime();
+    stats_lock_wait += stats_start - start;
+    return true;
+}
+
 void LocalWriter::checkProcessId(void) {
     if (m_file &&
         os::getCurrentProcessId() != pid) {
@@ -213,8 +309,72 @@ void LocalWriter::checkProcessId(void) {
     }
 }
 
+uint8_t LocalWriter::resolveSig(const FunctionSig *sig) {
+    if (sig->id >= sigFlags.size()) {
+        sigFlags.resize(sig->id + 1);
+    }
+
+    uint8_t flags = SIG_RESOLVED;
+    os::BacktraceSampling sampling;
+    if (os::backtrace_is_needed(sig->name, &sampling)) {
+        flags |= SIG_BACKTRACE;
+        if (sampling.calls > 1 || sampling.milliseconds) {
+            flags |= SIG_BACKTRACE_SAMPLED;
+            BacktraceSampler &sampler = backtraceSamplers[sig->id];
+            sampler.sampling = sampling;
+            sampler.count = 0;
+            sampler.next = 0;
+        }
+    }
+
+    if (recorder || frameFilter) {
+        CallFlags callFlags = Parser::lookupCallFlags(sig->name);
+        if (callFlags & CALL_FLAG_END_FRAME) {
+            flags |= SIG_END_FRAME;
+        }
+        if (FlightRecorder::isStateCall(sig->name, callFlags)) {
+            flags |= SIG_STATE;
+        }
+        const char *marker = getenv("TRACE_FLIGHT_RECORDER_MARKER");
+        if (recorder && marker && strcmp(marker, sig->name) == 0) {
+            flags |= SIG_DUMP_MARKER;
+        }
+    }
+
+    sigFlags[sig->id] = flags;
+    return flags;
+}
+
+bool LocalWriter::sampleBacktrace(const FunctionSig *sig) {
+    BacktraceSampler &sampler = backtraceSamplers[sig->id];
+
+    if (sampler.sampling.calls > 1) {
+        unsigned count = sampler.count++;
+        if (sampler.count == sampler.sampling.calls) {
+            sampler.count = 0;
+        }
+        if (count) {
+            return false;
+        }
+    }
+
+    if (sampler.sampling.milliseconds) {
+        long long now = os::getTime();
+        if (now < sampler.next) {
+            return false;
+        }
+        sampler.next = now + sampler.sampling.milliseconds * os::timeFrequency / 1000;
+    }
+
+    return true;
+}
+
 unsigned LocalWriter::beginEnter(const FunctionSig *sig, bool fake) {
-    mutex.lock();
+    stats_serialization = 0;
+    stats_lock_wait = 0;
+    // Calls are only accounted when timed from the start, which excludes the
+    // call that opens the trace
+    stats_sig = statsLock(mutex) ? sig : nullptr;
     ++acquired;
 
     checkProcessId();
@@ -230,10 +390,23 @@ unsigned LocalWriter::beginEnter(const FunctionSig *sig, bool fake) {
 
     assert(this_thread_num);
     unsigned thread_id = this_thread_num - 1;
+    uint8_t flags = lookupSig(sig);
+    bool muted = isMuted(flags);
+    if (muted) {
+        beginMute();
+    }
     unsigned call_no = Writer::beginEnter(sig, thread_id);
-    if (fake) {
+    if (flags & SIG_END_FRAME) {
+        frameEndCall = call_no;
+    }
+    if (flags & SIG_DUMP_MARKER) {
+        dumpRequested = true;
+    }
+    if (muted) {
+        // Nothing to write
+    } else if (fake) {
         writeFlags(FLAG_FAKE);
-    } else if (os::backtrace_is_needed(sig->name)) {
+    } else if (isBacktraceNeeded(sig, flags)) {
         std::vector<RawStackFrame> backtrace = os::get_backtrace();
         beginBacktrace(backtrace.size());
         for (auto & frame : backtrace) {
@@ -246,23 +419,82 @@ unsigned LocalWriter::beginEnter(const FunctionSig *sig, bool fake) {
 
 void LocalWriter::endEnter(void) {
     Writer::endEnter();
+    if (muted) {
+        endMute();
+    }
+    if (stats_sig) {
+        stats_serialization += os::getTime() - stats_start;
+    }
     --acquired;
     mutex.unlock();
 }
 
 void LocalWriter::beginLeave(unsigned call) {
-    mutex.lock();
+    statsLock(mutex);
     ++acquired;
+    endingFrame = call == frameEndCall;
+    leaveMuted = frameFilter && (call & MUTED_CALL_NO);
+    if (leaveMuted) {
+        beginMute();
+    }
     Writer::beginLeave(call);
 }
 
 void LocalWriter::endLeave(void) {
     Writer::endLeave();
+    if (leaveMuted) {
+        endMute();
+    }
+    if (frameFilter && endingFrame) {
+        ++frameNo;
+        beginFrame();
+    }
+    if (recorder) {
+        if (!leaveMuted) {
+            recorder->endCall();
+        }
+        if (endingFrame) {
+            Writer::flush();
+            recorder->endFrame();
+#ifndef _WIN32
+            if (dumpSignaled) {
+                dumpSignaled = 0;
+                dumpRequested = true;
+            }
+#endif
+            if (dumpRequested) {
+                dumpRequested = false;
+                recorder->dump(false);
+            }
+        }
+    }
+    if (stats_sig) {
+        stats_serialization += os::getTime() - stats_start;
+        stats::addCall(stats_sig, stats_serialization, stats_lock_wait);
+        stats_sig = nullptr;
+    }
     --acquired;
     mutex.unlock();
 }
 
-void LocalWriter::flush(void) {
+void LocalWriter::beginFrame(void) {
+    int previous = capture;
+    if (captureFrames.contains(frameNo)) {
+        capture = CAPTURE_ALL;
+    } else if (frameNo < captureFrames.getLast()) {
+        capture = CAPTURE_STATE;
+    } else {
+        capture = CAPTURE_NONE;
+    }
+
+    if (capture == CAPTURE_ALL && previous != CAPTURE_ALL) {
+        os::log("apitrace: capturing from frame %u\n", frameNo);
+    } else if (capture != CAPTURE_ALL && previous == CAPTURE_ALL && frameNo) {
+        os::log("apitrace: stopped capturing at frame %u\n", frameNo);
+    }
+}
+
+void LocalWriter::flush(bool dying) {
     /*
      * Do nothing if the mutex is already acquired (e.g., if a segfault happen
      * while writing the file) as state could be inconsistent, therefore yield
@@ -279,7 +511,11 @@ void LocalWriter::flush(void) {
                 os::log("apitrace: ignoring flush in child process\n");
             } else {
                 os::log("apitrace: flushing trace\n");
-                m_file->flush();
+                Writer::flush();
+                if (recorder && dying) {
+                    recorder->dump(true);
+                }
+                stats::write();
             }
         }
         --acquired;
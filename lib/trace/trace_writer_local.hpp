@@ -32,9 +32,14 @@
 
 #include <stdint.h>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
+#include "os_backtrace.hpp"
 #include "os_thread.hpp"
 #include "os_process.hpp"
+#include "trace_callset.hpp"
+#include "trace_flight_recorder.hpp"
 #include "trace_writer.hpp"
 
 
@@ -81,6 +86,75 @@ namespace trace {
 
         void checkProcessId();
 
+        /**
+         * How to handle each function, indexed by FunctionSig::id, and
+         * resolved on its first call.
+         */
+        enum {
+            SIG_RESOLVED          = 1 << 0,
+            SIG_BACKTRACE         = 1 << 1,
+            SIG_BACKTRACE_SAMPLED = 1 << 2,
+            SIG_END_FRAME         = 1 << 3,
+            SIG_DUMP_MARKER       = 1 << 4,
+            SIG_STATE             = 1 << 5,
+        };
+        std::vector<uint8_t> sigFlags;
+
+        struct BacktraceSampler {
+            os::BacktraceSampling sampling;
+            unsigned count;
+            long long next;
+        };
+        std::unordered_map<Id, BacktraceSampler> backtraceSamplers;
+
+        uint8_t resolveSig(const FunctionSig *sig);
+        bool sampleBacktrace(const FunctionSig *sig);
+
+        inline uint8_t lookupSig(const FunctionSig *sig) {
+            uint8_t flags = sig->id < sigFlags.size() ? sigFlags[sig->id] : 0;
+            if (!(flags & SIG_RESOLVED)) {
+                flags = resolveSig(sig);
+            }
+            return flags;
+        }
+
+        inline bool isBacktraceNeeded(const FunctionSig *sig, uint8_t flags) {
+            if (!(flags & SIG_BACKTRACE)) {
+                return false;
+            }
+            return !(flags & SIG_BACKTRACE_SAMPLED) || sampleBacktrace(sig);
+        }
+
+        /**
+         * For getenv("TRACE_FLIGHT_RECORDER").
+         */
+        std::unique_ptr<FlightRecorder> recorder;
+        unsigned frameEndCall;
+        bool endingFrame;
+        bool dumpRequested;
+
+        /**
+         * For getenv("TRACE_FRAMES").  Before the frames to capture, only
+         * calls which may change their state are written.
+         */
+        enum {
+            CAPTURE_ALL,
+            CAPTURE_STATE,
+            CAPTURE_NONE,
+        };
+        bool frameFilter;
+        CallSet captureFrames;
+        unsigned frameNo;
+        int capture;
+        bool leaveMuted;
+
+        inline bool isMuted(uint8_t flags) {
+            return capture != CAPTURE_ALL &&
+                   (capture == CAPTURE_NONE || !(flags & SIG_STATE));
+        }
+
+        void beginFrame(void);
+
     public:
         /**
          * Should never called directly -- use localWriter singleton below
@@ -111,7 +185,11 @@ namespace trace {
          */
         void endLeave(void);
 
-        void flush(void);
+        /**
+         * In flight recorder mode nothing is written until the process is
+         * about to die, when the recorded frames are dumped.
+         */
+        void flush(bool dying = false);
     };
 
     /**
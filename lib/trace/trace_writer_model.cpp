@@ -132,6 +132,10 @@ public:
             }
         }
         writer.endEnter();
+        if (call->flags & CALL_FLAG_INCOMPLETE) {
+            // Keep it incomplete, as when the process died inside it
+            return;
+        }
         writer.beginLeave(call_no);
         if (call->ret) {
             writer.beginReturn();
@@ -37,6 +37,7 @@
 #include "glretrace.hpp"
 #include "os_time.hpp"
 #include "os_memory.hpp"
+#include "retrace_heap.hpp"
 #include "highlight.hpp"
 #include "metric_writer.hpp"
 
@@ -232,14 +233,19 @@ getQueryResult(GLuint query) {
     return result;
 }
 
-static inline void
-getCurrentVsize(int64_t& vsize) {
-    vsize = os::getVsize();
-}
+/* Last memory usage sample, reused between --pmem-interval samples */
+static os::MemoryUsage memoryUsage = {0, 0};
+static unsigned memoryCallCount = 0;
+static bool memorySampled = false;
 
 static inline void
-getCurrentRss(int64_t& rss) {
-    rss = os::getRss();
+sampleMemoryUsage(void) {
+    if (retrace::profilingHeapUsage) {
+        memoryUsage.vsize = retrace::getHeapUsage();
+        memoryUsage.rss = 0;
+    } else {
+        os::getMemoryUsage(memoryUsage);
+    }
 }
 
 static void
@@ -353,8 +359,12 @@ beginProfile(trace::Call &call, bool isDraw) {
 
     if (retrace::profilingMemoryUsage) {
         CallQuery& query = callQueries.back();
-        query.vsizeStart = os::getVsize();
-        query.rssStart = os::getRss();
+        memorySampled = memoryCallCount++ % retrace::profilingMemoryInterval == 0;
+        if (memorySampled) {
+            sampleMemoryUsage();
+        }
+        query.vsizeStart = memoryUsage.vsize;
+        query.rssStart = memoryUsage.rss;
     }
 }
 
@@ -389,8 +399,11 @@ endProfile(trace::Call &call, bool isDraw) {
 
     if (retrace::profilingMemoryUsage) {
         CallQuery& query = callQueries.back();
-        query.vsizeEnd = os::getVsize();
-        query.rssEnd = os::getRss();
+        if (memorySampled) {
+            sampleMemoryUsage();
+        }
+        query.vsizeEnd = memoryUsage.vsize;
+        query.rssEnd = memoryUsage.rss;
     }
 }
 
@@ -532,11 +545,17 @@ initContext() {
     }
 
     if (retrace::profilingMemoryUsage) {
-        GLint64 currentVsize, currentRss;
-        getCurrentVsize(currentVsize);
-        retrace::profiler.setBaseVsizeUsage(currentVsize);
-        getCurrentRss(currentRss);
-        retrace::profiler.setBaseRssUsage(currentRss);
+        if (retrace::profilingHeapUsage) {
+            static bool warned = false;
+            if (!retrace::supportsHeapUsage() && !warned) {
+                std::cerr << "warning: heap usage profiling is not supported by this build\n";
+                warned = true;
+            }
+            retrace::enableHeapUsage();
+        }
+        sampleMemoryUsage();
+        retrace::profiler.setBaseVsizeUsage(memoryUsage.vsize);
+        retrace::profiler.setBaseRssUsage(memoryUsage.rss);
     }
 }
 
@@ -41,6 +41,7 @@
 #include "trace_model.hpp"
 #include "trace_parser.hpp"
 #include "trace_profiler.hpp"
+#include "trace_timeline.hpp"
 #include "trace_dump.hpp"
 
 #include "scoped_allocator.hpp"
@@ -58,6 +59,7 @@ namespace retrace {
 
 extern trace::AbstractParser *parser;
 extern trace::Profiler profiler;
+extern trace::Timeline timeline;
 
 
 class ScopedAllocator : public ::ScopedAllocator
@@ -173,6 +175,8 @@ extern bool profilingCpuTimes;
 extern bool profilingGpuTimes;
 extern bool profilingPixelsDrawn;
 extern bool profilingMemoryUsage;
+extern bool profilingHeapUsage;
+extern unsigned profilingMemoryInterval;
 
 /**
  * State dumping.
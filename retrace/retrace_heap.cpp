@@ -0,0 +1,231 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <stdlib.h>
+
+#include "retrace_heap.hpp"
+
+#if defined(HAVE_HEAP_HOOKS) && defined(__GLIBC__)
+
+#include <errno.h>
+#include <malloc.h>
+
+#include <atomic>
+
+
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t nmemb, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void __libc_free(void *ptr);
+    void *__libc_memalign(size_t alignment, size_t size);
+    void *__libc_valloc(size_t size);
+    void *__libc_pvalloc(size_t size);
+}
+
+
+// Read on every allocation, from any thread
+static std::atomic<bool> enabled(false);
+static std::atomic<long long> heapUsage(0);
+
+
+static inline bool
+isEnabled(void)
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+
+static inline void
+account(void *ptr, long long sign)
+{
+    if (isEnabled() && ptr) {
+        heapUsage.fetch_add(sign * (long long)malloc_usable_size(ptr), std::memory_order_relaxed);
+    }
+}
+
+
+extern "C" {
+
+void *
+malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    account(ptr, 1);
+    return ptr;
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    void *ptr = __libc_calloc(nmemb, size);
+    account(ptr, 1);
+    return ptr;
+}
+
+void *
+realloc(void *old_ptr, size_t size)
+{
+    if (!isEnabled()) {
+        return __libc_realloc(old_ptr, size);
+    }
+    long long old_size = old_ptr ? (long long)malloc_usable_size(old_ptr) : 0;
+    void *ptr = __libc_realloc(old_ptr, size);
+    // On failure old_ptr is left untouched, unless size was zero
+    if (ptr || size == 0) {
+        long long new_size = ptr ? (long long)malloc_usable_size(ptr) : 0;
+        heapUsage.fetch_add(new_size - old_size, std::memory_order_relaxed);
+    }
+    return ptr;
+}
+
+// Whether or not the C library's own goes through realloc
+void *
+reallocarray(void *old_ptr, size_t nmemb, size_t size)
+{
+    size_t bytes;
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(old_ptr, bytes);
+}
+
+void
+free(void *ptr)
+{
+    account(ptr, -1);
+    __libc_free(ptr);
+}
+
+void *
+memalign(size_t alignment, size_t size)
+{
+    void *ptr = __libc_memalign(alignment, size);
+    account(ptr, 1);
+    return ptr;
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int
+posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) != 0 ||
+        (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void *ptr = memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void *
+valloc(size_t size)
+{
+    void *ptr = __libc_valloc(size);
+    account(ptr, 1);
+    return ptr;
+}
+
+void *
+pvalloc(size_t size)
+{
+    void *ptr = __libc_pvalloc(size);
+    account(ptr, 1);
+    return ptr;
+}
+
+} /* extern "C" */
+
+
+namespace retrace {
+
+
+bool
+supportsHeapUsage(void)
+{
+    return true;
+}
+
+void
+enableHeapUsage(void)
+{
+    if (isEnabled()) {
+        return;
+    }
+#if __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 info = mallinfo2();
+#else
+    struct mallinfo info = mallinfo();
+#endif
+    heapUsage = (long long)info.uordblks + (long long)info.hblkhd;
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+long long
+getHeapUsage(void)
+{
+    return heapUsage.load(std::memory_order_relaxed);
+}
+
+
+} /* namespace retrace */
+
+#else /* !HAVE_HEAP_HOOKS */
+
+namespace retrace {
+
+
+bool
+supportsHeapUsage(void)
+{
+    return false;
+}
+
+void
+enableHeapUsage(void)
+{
+}
+
+long long
+getHeapUsage(void)
+{
+    return 0;
+}
+
+
+} /* namespace retrace */
+
+#endif /* !HAVE_HEAP_HOOKS */
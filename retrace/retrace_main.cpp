@@ -74,6 +74,14 @@ static trace::CallSet snapshotFrequency;
 static unsigned snapshotInterval = 0;
 
 static unsigned dumpStateCallNo = ~0;
+static trace::CallSet dumpStateCalls;
+static bool dumpImagesCompressed = true;
+static bool dumpImagesDedup = false;
+
+// Writer shared by all the dumps when dumping state at several calls
+static StateWriter *dumpStateWriter = nullptr;
+
+static const char *timelineFilename = nullptr;
 
 retrace::Retracer retracer;
 
@@ -83,6 +91,7 @@ namespace retrace {
 
 trace::AbstractParser *parser;
 trace::Profiler profiler;
+trace::Timeline timeline;
 
 
 int verbosity = 0;
@@ -121,6 +130,8 @@ bool profilingGpuTimes = false;
 bool profilingCpuTimes = false;
 bool profilingPixelsDrawn = false;
 bool profilingMemoryUsage = false;
+bool profilingHeapUsage = false;
+unsigned profilingMemoryInterval = 1;
 bool useCallNos = true;
 bool singleThread = false;
 bool ignoreRetvals = false;
@@ -248,6 +259,7 @@ frameComplete(trace::Call &call)
             }
         }
         if (delayUsec > 0) {
+            trace::TimelineScope span(timeline, "frameDelay", call.no);
             os::sleep(delayUsec);
         }
     }
@@ -311,7 +323,11 @@ takeSnapshot(unsigned call_no, int mrt, unsigned snapshot_no, bool backBuffer) {
     assert(dumpingSnapshots);
     assert(snapshotPrefix);
 
-    std::unique_ptr<image::Image> src(dumper->getSnapshot(mrt, backBuffer));
+    std::unique_ptr<image::Image> src;
+    {
+        trace::TimelineScope span(timeline, "getSnapshot", call_no);
+        src.reset(dumper->getSnapshot(mrt, backBuffer));
+    }
     if (!src) {
         /* TODO for mrt>0 we probably don't want to treat this as an error: */
         if (mrt == 0)
@@ -376,6 +392,7 @@ static bool snapshot_done;
 static void
 takeSnapshot(unsigned call_no, bool backBuffer)
 {
+    trace::TimelineScope span(timeline, "snapshot", call_no);
     static unsigned snapshot_no = 0;
     int cnt = dumper->getSnapshotCount();
 
@@ -392,6 +409,33 @@ takeSnapshot(unsigned call_no, bool backBuffer)
 }
 
 
+/**
+ * Close the document written by the multi-call state dumps.
+ */
+static void
+finishDumpState(void)
+{
+    if (dumpStateCalls.empty()) {
+        return;
+    }
+
+    if (!dumpStateWriter) {
+        // Still emit a valid, albeit empty, document
+        dumpStateWriter = stateWriterFactory(std::cout);
+    }
+    delete dumpStateWriter;
+    dumpStateWriter = nullptr;
+    std::cout.flush();
+}
+
+
+static inline trace::Call *
+parseCall(void) {
+    trace::TimelineScope span(timeline, "parse");
+    return parser->parse_call();
+}
+
+
 /**
  * Retrace one call.
  *
@@ -406,9 +450,14 @@ retraceCall(trace::Call *call) {
         return;
     }
 
+    trace::TimelineScope span(timeline, "retraceCall", call->no);
+
     snapshot_done = false;
 
-    retracer.retrace(*call);
+    {
+        trace::TimelineScope span(timeline, "dispatch", call->no);
+        retracer.retrace(*call);
+    }
 
     if (snapshotFrequency.contains(*call) && !snapshot_done) {
         takeSnapshot(call->no, snapshotForceBackbuffer);
@@ -420,15 +469,45 @@ retraceCall(trace::Call *call) {
     // dumpStateCallNo is 0 when fetching default state
     if (call->no == dumpStateCallNo || dumpStateCallNo == 0) {
         if (dumper->canDump()) {
-            StateWriter *writer = stateWriterFactory(std::cout);
-            dumper->dumpState(*writer);
-            delete writer;
+            {
+                trace::TimelineScope span(timeline, "dumpState", call->no);
+                StateWriter *writer =
+                    createDeferredStateWriter(stateWriterFactory(std::cout),
+                                              dumpImagesCompressed,
+                                              dumpImagesDedup);
+                dumper->dumpState(*writer);
+                delete writer;
+            }
             exit(0);
         } else if (dumpStateCallNo != 0) {
             std::cerr << call->no << ": error: failed to dump state\n";
             exit(1);
         }
     }
+
+    if (dumpStateCalls.contains(*call)) {
+        if (dumper->canDump()) {
+            trace::TimelineScope span(timeline, "dumpState", call->no);
+            if (!dumpStateWriter) {
+                dumpStateWriter =
+                    createDeltaStateWriter(
+                        createDeferredStateWriter(stateWriterFactory(std::cout),
+                                                  dumpImagesCompressed,
+                                                  dumpImagesDedup));
+            }
+            dumpStateWriter->beginMember(std::to_string(call->no));
+            dumpStateWriter->beginObject();
+            dumper->dumpState(*dumpStateWriter);
+            dumpStateWriter->endObject();
+            dumpStateWriter->endMember();
+        } else {
+            std::cerr << call->no << ": warning: failed to dump state\n";
+        }
+        if (call->no >= dumpStateCalls.getLast()) {
+            finishDumpState();
+            exit(0);
+        }
+    }
 }
 
 
@@ -530,8 +609,11 @@ public:
         std::unique_lock<std::mutex> lock(mutex);
 
         while (1) {
-            while (!finished && !baton) {
-                wake_cond.wait(lock);
+            if (!finished && !baton) {
+                trace::TimelineScope span(timeline, "waitBaton");
+                while (!finished && !baton) {
+                    wake_cond.wait(lock);
+                }
             }
 
             if (finished) {
@@ -569,14 +651,17 @@ public:
               RetraceWatchdog::Instance().CallProcessed(call->no);
             if (!call->reuse_call)
                 delete call;
-            call = parser->parse_call();
+            call = parseCall();
 
         } while (call && call->thread_id == leg);
 
         if (call) {
             /* Pass the baton */
             assert(call->thread_id != leg);
-            flushRendering();
+            {
+                trace::TimelineScope span(timeline, "flushRendering");
+                flushRendering();
+            }
             race->passBaton(call);
         } else {
             /* Reached the finish line */
@@ -623,6 +708,9 @@ public:
 
 void
 RelayRunner::runnerThread(RelayRunner *_this) {
+    if (timeline.isEnabled()) {
+        timeline.setThreadName("leg " + std::to_string(_this->leg));
+    }
     _this->runRace();
 }
 
@@ -669,7 +757,7 @@ RelayRace::getRunner(unsigned leg) {
 void
 RelayRace::run(void) {
     trace::Call *call;
-    call = parser->parse_call();
+    call = parseCall();
     if (!call) {
         /* Nothing to do */
         return;
@@ -729,6 +817,8 @@ RelayRace::stopRunners(void) {
 
 static void
 mainLoop() {
+    trace::TimelineScope span(timeline, "mainLoop");
+
     addCallbacks(retracer);
 
     long long startTime = 0;
@@ -738,7 +828,7 @@ mainLoop() {
 
     if (singleThread) {
         trace::Call *call;
-        while ((call = parser->parse_call())) {
+        while ((call = parseCall())) {
             retraceCall(call);
             if (watchdogEnabled)
                 RetraceWatchdog::Instance().CallProcessed(call->no);
@@ -749,7 +839,10 @@ mainLoop() {
         RelayRace race;
         race.run();
     }
-    finishRendering();
+    {
+        trace::TimelineScope span(timeline, "finishRendering");
+        finishRendering();
+    }
 
     long long endTime = os::getTime();
     float timeInterval = (endTime - startTime) * (1.0 / os::timeFrequency);
@@ -785,10 +878,12 @@ usage(const char *argv0) {
         "      --pcpu              cpu profiling (cpu times per call)\n"
         "      --pgpu              gpu profiling (gpu times per draw call)\n"
         "      --ppd               pixels drawn profiling (pixels drawn per draw call)\n"
-        "      --pmem              memory usage profiling (vsize rss per call)\n"
+        "      --pmem[=MODE]       memory usage profiling, per call: 'vm' (vsize and rss, default) or 'heap' (bytes allocated)\n"
+        "      --pmem-interval=N   only sample memory usage every N calls (default is 1)\n"
         "      --pcalls            call profiling metrics selection\n"
         "      --pframes           frame profiling metrics selection\n"
         "      --pdrawcalls        draw call profiling metrics selection\n"
+        "      --ptimeline=FILE    write a timeline of where the replayer spends time to FILE, in Chrome trace format\n"
         "      --list-metrics      list all available metrics for TRACE\n"
         "      --query-handling    How query readbacks should be handled: ('skip', 'run', 'check'), default is 'skip'\n"
         "      --query-tolerance   Set a tolerance when comparing recorded query results to evaluated ones, a value >0 enables query-handling 'check'\n"
@@ -811,8 +906,11 @@ usage(const char *argv0) {
         "  -t, --snapshot-threaded encode screenshots on multiple threads\n"
         "      --snapshot-force-backbuffer always read from the backbuffer when taking a snapshot (default read from the current draw buffer)\n"
         "  -v, --verbose           increase output verbosity\n"
-        "  -D, --dump-state=CALL   dump state at specific call no\n"
+        "  -D, --dump-state=CALL   dump state at specific call no, or at a set of calls\n"
+        "                          (only changes are written after the first dump)\n"
         "      --dump-format=FORMAT dump state format (`json` or `ubjson`)\n"
+        "      --dump-images=FORMAT dump state images as `png` (default) or `raw` (uncompressed)\n"
+        "      --dedup-images      dump identical state images once, referring to them by `__id__`/`__ref__`\n"
         "      --min-frame-duration=MICROSECONDS   specify minimum frame rendering duration\n"
         "      --per-frame-delay=MICROSECONDS   add extra delay after each frame (in addition to min-frame-duration)\n"
         "  -w, --wait              waitOnFinish on final frame\n"
@@ -840,9 +938,11 @@ enum {
     PGPU_OPT,
     PPD_OPT,
     PMEM_OPT,
+    PMEM_INTERVAL_OPT,
     PCALLS_OPT,
     PFRAMES_OPT,
     PDRAWCALLS_OPT,
+    PTIMELINE_OPT,
     PLMETRICS_OPT,
     GENPASS_OPT,
     MSAA_NO_RESOLVE_OPT,
@@ -859,6 +959,8 @@ enum {
     SNAPSHOT_INTERVAL_OPT,
     SNAPSHOT_FORCE_BACKBUFFER_OPT,
     DUMP_FORMAT_OPT,
+    DUMP_IMAGES_OPT,
+    DEDUP_IMAGES_OPT,
     MARKERS_OPT,
     MIN_CPU_TIME_OPT,
     QUERY_HANDLING_OPT,
@@ -882,6 +984,8 @@ longOptions[] = {
     {"driver", required_argument, 0, DRIVER_OPT},
     {"dump-state", required_argument, 0, 'D'},
     {"dump-format", required_argument, 0, DUMP_FORMAT_OPT},
+    {"dump-images", required_argument, 0, DUMP_IMAGES_OPT},
+    {"dedup-images", no_argument, 0, DEDUP_IMAGES_OPT},
     {"fullscreen", no_argument, 0, FULLSCREEN_OPT},
     {"headless", no_argument, 0, HEADLESS_OPT},
     {"help", no_argument, 0, 'h'},
@@ -891,10 +995,12 @@ longOptions[] = {
     {"pcpu", no_argument, 0, PCPU_OPT},
     {"pgpu", no_argument, 0, PGPU_OPT},
     {"ppd", no_argument, 0, PPD_OPT},
-    {"pmem", no_argument, 0, PMEM_OPT},
+    {"pmem", optional_argument, 0, PMEM_OPT},
+    {"pmem-interval", required_argument, 0, PMEM_INTERVAL_OPT},
     {"pcalls", required_argument, 0, PCALLS_OPT},
     {"pframes", required_argument, 0, PFRAMES_OPT},
     {"pdrawcalls", required_argument, 0, PDRAWCALLS_OPT},
+    {"ptimeline", required_argument, 0, PTIMELINE_OPT},
     {"query-handling", required_argument, 0, QUERY_HANDLING_OPT},
     {"query-tolerance", required_argument, 0, QUERY_CHECK_TOLARANCE_OPT},
     {"list-metrics", no_argument, 0, PLMETRICS_OPT},
@@ -929,6 +1035,17 @@ static void exceptionCallback(void)
 }
 
 
+/**
+ * Write the --ptimeline output.  Registered with atexit(), as snapshots and
+ * state dumps end the replay by calling exit().
+ */
+static void
+writeTimeline(void)
+{
+    retrace::timeline.write(timelineFilename);
+}
+
+
 static bool
 endsWith(const std::string &s1, const char *s2)
 {
@@ -1167,7 +1284,11 @@ int main(int argc, char **argv)
             useCallNos = trace::boolOption(optarg);
             break;
         case 'D':
-            dumpStateCallNo = atoi(optarg);
+            if (optarg[strspn(optarg, "0123456789")] == '\0') {
+                dumpStateCallNo = atoi(optarg);
+            } else {
+                dumpStateCalls.merge(optarg);
+            }
             dumpingState = true;
             retrace::verbosity = -2;
             break;
@@ -1182,6 +1303,19 @@ int main(int argc, char **argv)
                 return EXIT_FAILURE;
             }
             break;
+        case DUMP_IMAGES_OPT:
+            if (strcasecmp(optarg, "png") == 0) {
+                dumpImagesCompressed = true;
+            } else if (strcasecmp(optarg, "raw") == 0) {
+                dumpImagesCompressed = false;
+            } else {
+                std::cerr << "error: unsupported dump images format `" << optarg << "`\n";
+                return EXIT_FAILURE;
+            }
+            break;
+        case DEDUP_IMAGES_OPT:
+            dumpImagesDedup = true;
+            break;
         case CORE_OPT:
             retrace::setFeatureLevel("3_2_core");
             break;
@@ -1337,6 +1471,17 @@ int main(int argc, char **argv)
             retrace::verbosity = -1;
 
             retrace::profilingMemoryUsage = true;
+            if (optarg == nullptr || strcmp(optarg, "vm") == 0) {
+                retrace::profilingHeapUsage = false;
+            } else if (strcmp(optarg, "heap") == 0) {
+                retrace::profilingHeapUsage = true;
+            } else {
+                std::cerr << "error: unknown memory profiling mode " << optarg << "\n";
+                return 1;
+            }
+            break;
+        case PMEM_INTERVAL_OPT:
+            retrace::profilingMemoryInterval = atoi(optarg) > 0 ? atoi(optarg) : 1;
             break;
         case PCALLS_OPT:
             retrace::debug = 0;
@@ -1359,6 +1504,9 @@ int main(int argc, char **argv)
             retrace::profilingWithBackends = true;
             retrace::profilingDrawCallsMetricsString = optarg;
             break;
+        case PTIMELINE_OPT:
+            timelineFilename = optarg;
+            break;
         case PLMETRICS_OPT:
             retrace::debug = 0;
             retrace::profiling = true;
@@ -1432,6 +1580,12 @@ int main(int argc, char **argv)
         snapshotter = new Snapshotter();
     }
 
+    if (timelineFilename) {
+        retrace::timeline.enable();
+        retrace::timeline.setThreadName("main");
+        atexit(writeTimeline);
+    }
+
     retrace::setUp();
     if (retrace::profiling && !retrace::profilingWithBackends) {
         retrace::profiler.setup(retrace::profilingCpuTimes,
@@ -1479,6 +1633,8 @@ int main(int argc, char **argv)
 
     delete snapshotter;
 
+    finishDumpState();
+
     retrace::cleanUp();
 
 #ifdef _WIN32
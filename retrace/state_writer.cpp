@@ -28,6 +28,7 @@
 #include "state_writer.hpp"
 
 #include <assert.h>
+#include <string.h>
 
 #include <sstream>
 
@@ -40,17 +41,9 @@ StateWriter::~StateWriter()
 
 
 void
-StateWriter::writeImage(image::Image *image,
-                        const ImageDesc & desc)
+StateWriter::writeImageHeader(const image::Image *image,
+                              const ImageDesc & desc)
 {
-    assert(image);
-    if (!image) {
-        writeNull();
-        return;
-    }
-
-    beginObject();
-
     // Tell the GUI this is no ordinary object, but an image
     writeStringMember("__class__", "image");
 
@@ -63,18 +56,122 @@ StateWriter::writeImage(image::Image *image,
     if (!image->label.empty()) {
         writeStringMember("__label__", image->label.c_str());
     }
+}
 
-    beginMember("__data__");
+
+void
+StateWriter::encodeImage(const image::Image *image,
+                         bool compress,
+                         std::string & data)
+{
     std::stringstream ss;
 
     if (image->channelType == image::TYPE_UNORM8) {
-        image->writePNG(ss);
+        image->writePNG(ss, false, compress);
     } else {
         image->writePNM(ss);
     }
 
-    const std::string & s = ss.str();
-    writeBlob(s.data(), s.size());
+    data = ss.str();
+}
+
+
+image::Image *
+StateWriter::copyImage(const image::Image *image)
+{
+    image::Image *copy = new image::Image(image->width, image->height,
+                                          image->channels, image->flipped,
+                                          image->channelType);
+    memcpy(copy->pixels, image->pixels, image->sizeInBytes());
+    copy->label = image->label;
+    return copy;
+}
+
+
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+
+
+static inline uint64_t
+rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+
+static inline uint64_t
+hashRound(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME1;
+}
+
+
+/*
+ * Four independent lanes keep this bound by memory bandwidth rather than by
+ * multiply latency.
+ */
+uint64_t
+StateWriter::hashBytes(const void *data, size_t size, uint64_t seed)
+{
+    uint64_t lanes[4] = {
+        seed + PRIME1 + PRIME2,
+        seed + PRIME2,
+        seed,
+        seed - PRIME1,
+    };
+
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + size;
+
+    while (p + 32 <= end) {
+        for (unsigned i = 0; i < 4; ++i) {
+            uint64_t w;
+            memcpy(&w, p + 8*i, sizeof w);
+            lanes[i] = hashRound(lanes[i], w);
+        }
+        p += 32;
+    }
+
+    uint64_t h = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) +
+                 rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+    h += size;
+
+    while (p < end) {
+        h ^= *p++ * PRIME3;
+        h = rotl64(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+
+void
+StateWriter::writeImage(image::Image *image,
+                        const ImageDesc & desc)
+{
+    assert(image);
+    if (!image) {
+        writeNull();
+        return;
+    }
+
+    beginObject();
+
+    writeImageHeader(image, desc);
+
+    beginMember("__data__");
+    std::string data;
+    encodeImage(image, true, data);
+    writeBlob(data.data(), data.size());
     endMember(); // __data__
 
     endObject();
@@ -29,6 +29,7 @@
 
 
 #include <stddef.h>
+#include <stdint.h>
 #include <wchar.h>
 
 #include <ostream>
@@ -162,7 +163,11 @@ public:
         {}
     };
 
-    void
+    /*
+     * Write an image object.  The image is only borrowed for the duration of
+     * the call, so implementations that defer encoding must copy it.
+     */
+    virtual void
     writeImage(image::Image *image, const ImageDesc & desc);
 
     inline void
@@ -171,6 +176,28 @@ public:
         writeImage(image, desc);
     }
 
+protected:
+    /*
+     * Write the members describing the image, but not its __data__.
+     */
+    void
+    writeImageHeader(const image::Image *image, const ImageDesc & desc);
+
+    /*
+     * Encode the image pixels as they are stored in __data__: PNG for 8bit
+     * unorm images, PNM otherwise.
+     */
+    static void
+    encodeImage(const image::Image *image, bool compress, std::string & data);
+
+    static image::Image *
+    copyImage(const image::Image *image);
+
+    /*
+     * Fast non-cryptographic 64bit hash, for detecting identical content.
+     */
+    static uint64_t
+    hashBytes(const void *data, size_t size, uint64_t seed = 0);
 };
 
 
@@ -180,3 +207,39 @@ createJSONStateWriter(std::ostream &os);
 
 StateWriter *
 createUBJSONStateWriter(std::ostream &os);
+
+
+/*
+ * Wrap another state writer, encoding images on a thread pool while
+ * preserving the output order.
+ *
+ * When dedupImages is set, images with identical contents are only emitted
+ * once: the first occurrence gets an "__id__" member, and later ones an
+ * "__ref__" member with that id instead of "__data__".  This changes the
+ * document layout, so it must only be requested by readers which resolve the
+ * references.
+ *
+ * Takes ownership of the wrapped writer.  The output is only complete once
+ * the returned writer is destroyed.
+ */
+StateWriter *
+createDeferredStateWriter(StateWriter *writer, bool compressImages = true,
+                          bool dedupImages = false);
+
+
+/*
+ * Wrap another state writer for dumping the state at several calls into a
+ * single document.
+ *
+ * Every top-level member is expected to be a whole state dump (as written by
+ * Dumper::dumpState) inside an object.  The first dump is written in full;
+ * subsequent ones only contain the members of each section (parameters,
+ * uniforms, buffers, textures, etc.) whose content changed since the
+ * previous dump, plus a "__base__" member naming the previous dump, and a
+ * "__removed__" array with the [section] or [section, member] paths that no
+ * longer exist.
+ *
+ * Takes ownership of the wrapped writer.
+ */
+StateWriter *
+createDeltaStateWriter(StateWriter *writer);
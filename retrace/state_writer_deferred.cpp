@@ -0,0 +1,454 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * State writer that encodes images asynchronously.
+ *
+ * Nearly all the time spent dumping state goes into compressing images, so
+ * image encoding is handed to a thread pool.  Everything written after a
+ * pending image is queued, and the queue is replayed into the wrapped writer
+ * as soon as the image at its head is ready, so the output is identical to
+ * the synchronous one, unless duplicate images are being deduplicated.
+ */
+
+
+#include "state_writer.hpp"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+
+#include "image.hpp"
+#include "retrace.hpp"
+#include "thread_pool.hpp"
+
+
+namespace {
+
+
+struct ImageKey
+{
+    uint64_t hash;
+    unsigned width;
+    unsigned height;
+    unsigned channels;
+    image::ChannelType channelType;
+    bool flipped;
+
+    bool
+    operator < (const ImageKey &other) const {
+        if (hash != other.hash) return hash < other.hash;
+        if (width != other.width) return width < other.width;
+        if (height != other.height) return height < other.height;
+        if (channels != other.channels) return channels < other.channels;
+        if (channelType != other.channelType) return channelType < other.channelType;
+        return flipped < other.flipped;
+    }
+};
+
+
+struct ImageJob
+{
+    // Kept until the job is destroyed, so that later images with the same
+    // hash can be compared against it
+    image::Image *image;
+    bool compress;
+    unsigned id = 0;
+
+    std::string data;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool done = false;
+
+    ImageJob(image::Image *_image, bool _compress) :
+        image(_image),
+        compress(_compress)
+    {}
+
+    ~ImageJob() {
+        delete image;
+    }
+};
+
+
+class DeferredStateWriter : public StateWriter
+{
+private:
+    enum OpKind {
+        OP_BEGIN_OBJECT,
+        OP_END_OBJECT,
+        OP_BEGIN_MEMBER,
+        OP_END_MEMBER,
+        OP_BEGIN_ARRAY,
+        OP_END_ARRAY,
+        OP_STRING,
+        OP_BLOB,
+        OP_NULL,
+        OP_BOOL,
+        OP_SINT,
+        OP_UINT,
+        OP_FLOAT,
+        OP_DOUBLE,
+        OP_IMAGE,
+    };
+
+    struct Op {
+        OpKind kind;
+        std::string s;
+        union {
+            bool b;
+            signed long long i;
+            unsigned long long u;
+            float f;
+            double d;
+        };
+        std::shared_ptr<ImageJob> job;
+
+        Op(OpKind _kind) : kind(_kind), u(0) {}
+    };
+
+    StateWriter *writer;
+    bool compressImages;
+    bool dedupImages;
+
+    std::deque<Op> ops;
+
+    std::multimap<ImageKey, std::shared_ptr<ImageJob>> images;
+    unsigned nextImageId = 0;
+
+    ThreadPool pool;
+
+    static void
+    encode(std::shared_ptr<ImageJob> job) {
+        std::string data;
+        {
+            trace::TimelineScope span(retrace::timeline, "encodeImage");
+            encodeImage(job->image, job->compress, data);
+        }
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->data.swap(data);
+        job->done = true;
+        job->cond.notify_all();
+    }
+
+    void
+    replay(Op &op) {
+        switch (op.kind) {
+        case OP_BEGIN_OBJECT:
+            writer->beginObject();
+            break;
+        case OP_END_OBJECT:
+            writer->endObject();
+            break;
+        case OP_BEGIN_MEMBER:
+            writer->beginMember(op.s.c_str());
+            break;
+        case OP_END_MEMBER:
+            writer->endMember();
+            break;
+        case OP_BEGIN_ARRAY:
+            writer->beginArray();
+            break;
+        case OP_END_ARRAY:
+            writer->endArray();
+            break;
+        case OP_STRING:
+            writer->writeString(op.s.c_str());
+            break;
+        case OP_BLOB:
+            writer->writeBlob(op.s.data(), op.s.size());
+            break;
+        case OP_NULL:
+            writer->writeNull();
+            break;
+        case OP_BOOL:
+            writer->writeBool(op.b);
+            break;
+        case OP_SINT:
+            writer->writeSInt(op.i);
+            break;
+        case OP_UINT:
+            writer->writeUInt(op.u);
+            break;
+        case OP_FLOAT:
+            writer->writeFloat(op.f);
+            break;
+        case OP_DOUBLE:
+            writer->writeFloat(op.d);
+            break;
+        case OP_IMAGE:
+            writer->writeBlob(op.job->data.data(), op.job->data.size());
+            break;
+        }
+    }
+
+    /*
+     * Replay queued operations, up to the first image which is still being
+     * encoded, unless wait is set.
+     */
+    void
+    drain(bool wait) {
+        while (!ops.empty()) {
+            Op &op = ops.front();
+            if (op.kind == OP_IMAGE) {
+                ImageJob *job = op.job.get();
+                std::unique_lock<std::mutex> lock(job->mutex);
+                if (!job->done) {
+                    if (!wait) {
+                        return;
+                    }
+                    trace::TimelineScope span(retrace::timeline, "waitImage");
+                    job->cond.wait(lock, [job]{ return job->done; });
+                }
+            }
+            replay(op);
+            ops.pop_front();
+        }
+    }
+
+    inline bool
+    direct(void) const {
+        return ops.empty();
+    }
+
+    inline Op &
+    push(OpKind kind) {
+        ops.emplace_back(kind);
+        return ops.back();
+    }
+
+public:
+    DeferredStateWriter(StateWriter *_writer, bool _compressImages, bool _dedupImages) :
+        writer(_writer),
+        compressImages(_compressImages),
+        dedupImages(_dedupImages),
+        pool(std::max(std::thread::hardware_concurrency(), 1U))
+    {
+        assert(writer);
+    }
+
+    ~DeferredStateWriter()
+    {
+        drain(true);
+        delete writer;
+    }
+
+    void
+    beginObject(void) override {
+        if (direct()) {
+            writer->beginObject();
+        } else {
+            push(OP_BEGIN_OBJECT);
+        }
+    }
+
+    void
+    endObject(void) override {
+        if (direct()) {
+            writer->endObject();
+        } else {
+            push(OP_END_OBJECT);
+            drain(false);
+        }
+    }
+
+    void
+    beginMember(const char * name) override {
+        if (direct()) {
+            writer->beginMember(name);
+        } else {
+            push(OP_BEGIN_MEMBER).s = name;
+        }
+    }
+
+    void
+    endMember(void) override {
+        if (direct()) {
+            writer->endMember();
+        } else {
+            push(OP_END_MEMBER);
+        }
+    }
+
+    void
+    beginArray(void) override {
+        if (direct()) {
+            writer->beginArray();
+        } else {
+            push(OP_BEGIN_ARRAY);
+        }
+    }
+
+    void
+    endArray(void) override {
+        if (direct()) {
+            writer->endArray();
+        } else {
+            push(OP_END_ARRAY);
+        }
+    }
+
+    void
+    writeString(const char *s) override {
+        if (direct()) {
+            writer->writeString(s);
+        } else {
+            push(OP_STRING).s = s;
+        }
+    }
+
+    void
+    writeBlob(const void *bytes, size_t size) override {
+        if (direct()) {
+            writer->writeBlob(bytes, size);
+        } else {
+            push(OP_BLOB).s.assign((const char *)bytes, size);
+        }
+    }
+
+    void
+    writeNull(void) override {
+        if (direct()) {
+            writer->writeNull();
+        } else {
+            push(OP_NULL);
+        }
+    }
+
+    void
+    writeBool(bool b) override {
+        if (direct()) {
+            writer->writeBool(b);
+        } else {
+            push(OP_BOOL).b = b;
+        }
+    }
+
+    void
+    writeSInt(signed long long i) override {
+        if (direct()) {
+            writer->writeSInt(i);
+        } else {
+            push(OP_SINT).i = i;
+        }
+    }
+
+    void
+    writeUInt(unsigned long long u) override {
+        if (direct()) {
+            writer->writeUInt(u);
+        } else {
+            push(OP_UINT).u = u;
+        }
+    }
+
+    void
+    writeFloat(float f) override {
+        if (direct()) {
+            writer->writeFloat(f);
+        } else {
+            push(OP_FLOAT).f = f;
+        }
+    }
+
+    void
+    writeFloat(double d) override {
+        if (direct()) {
+            writer->writeFloat(d);
+        } else {
+            push(OP_DOUBLE).d = d;
+        }
+    }
+
+    void
+    writeImage(image::Image *image, const ImageDesc & desc) override {
+        assert(image);
+        if (!image) {
+            writeNull();
+            return;
+        }
+
+        beginObject();
+
+        writeImageHeader(image, desc);
+
+        ImageKey key;
+        if (dedupImages) {
+            key.hash = hashBytes(image->pixels, image->sizeInBytes());
+            key.width = image->width;
+            key.height = image->height;
+            key.channels = image->channels;
+            key.channelType = image->channelType;
+            key.flipped = image->flipped;
+
+            // Only trust the hash once the pixels match too
+            auto range = images.equal_range(key);
+            for (auto it = range.first; it != range.second; ++it) {
+                const image::Image *other = it->second->image;
+                if (memcmp(other->pixels, image->pixels, image->sizeInBytes()) == 0) {
+                    writeIntMember("__ref__", it->second->id);
+                    endObject();
+                    return;
+                }
+            }
+        }
+
+        // The caller frees the image as soon as we return
+        std::shared_ptr<ImageJob> job =
+            std::make_shared<ImageJob>(copyImage(image), compressImages);
+
+        if (dedupImages) {
+            job->id = nextImageId++;
+            images.emplace(key, job);
+            writeIntMember("__id__", job->id);
+        }
+
+        beginMember("__data__");
+        push(OP_IMAGE).job = job;
+        endMember(); // __data__
+
+        endObject();
+
+        pool.enqueue(encode, job);
+    }
+};
+
+
+}
+
+
+StateWriter *
+createDeferredStateWriter(StateWriter *writer, bool compressImages, bool dedupImages)
+{
+    return new DeferredStateWriter(writer, compressImages, dedupImages);
+}
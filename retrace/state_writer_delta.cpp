@@ -0,0 +1,511 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * State writer that turns a sequence of state dumps into deltas.
+ *
+ * Each member of a section is recorded while it is written, and hashed; it
+ * is only forwarded to the wrapped writer if the hash differs from the one
+ * the same member had in the previous dump.
+ */
+
+
+#include "state_writer.hpp"
+
+#include <assert.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "image.hpp"
+
+
+namespace {
+
+
+class DeltaStateWriter : public StateWriter
+{
+private:
+    enum OpKind {
+        OP_BEGIN_OBJECT,
+        OP_END_OBJECT,
+        OP_BEGIN_MEMBER,
+        OP_END_MEMBER,
+        OP_BEGIN_ARRAY,
+        OP_END_ARRAY,
+        OP_STRING,
+        OP_BLOB,
+        OP_NULL,
+        OP_BOOL,
+        OP_SINT,
+        OP_UINT,
+        OP_FLOAT,
+        OP_DOUBLE,
+        OP_IMAGE,
+    };
+
+    struct Op {
+        OpKind kind;
+        std::string s;
+        union {
+            bool b;
+            signed long long i;
+            unsigned long long u;
+            float f;
+            double d;
+        };
+        std::shared_ptr<image::Image> image;
+        ImageDesc desc;
+
+        Op(OpKind _kind) : kind(_kind), u(0) {}
+    };
+
+    // Hash of each member, per section.  Sections which aren't objects are
+    // stored as a single member with an empty name.
+    typedef std::map<std::string, uint64_t> MemberHashes;
+    typedef std::map<std::string, MemberHashes> SectionHashes;
+
+    StateWriter *writer;
+
+    /*
+     * Number of open objects/arrays:
+     * - 0: between dumps
+     * - 1: inside a dump, between sections
+     * - 2: inside a section object, between members
+     */
+    unsigned level = 0;
+
+    bool haveBase = false;
+    std::string baseName;
+    std::string dumpName;
+
+    std::string sectionName;
+    bool sectionIsObject = false;
+    bool sectionOpened = false;
+
+    std::string memberName;
+    bool recording = false;
+    std::vector<Op> ops;
+    uint64_t hash = 0;
+
+    SectionHashes previous;
+    SectionHashes current;
+
+    inline void
+    mix(const void *data, size_t size) {
+        hash = hashBytes(data, size, hash);
+    }
+
+    template<typename T>
+    inline void
+    mixValue(const T &value) {
+        mix(&value, sizeof value);
+    }
+
+    inline Op &
+    push(OpKind kind) {
+        assert(recording);
+        mixValue(kind);
+        ops.emplace_back(kind);
+        return ops.back();
+    }
+
+    void
+    startRecording(const char *name) {
+        assert(!recording);
+        memberName = name;
+        recording = true;
+        ops.clear();
+        hash = 0;
+    }
+
+    void
+    replay(void) {
+        for (Op &op : ops) {
+            switch (op.kind) {
+            case OP_BEGIN_OBJECT:
+                writer->beginObject();
+                break;
+            case OP_END_OBJECT:
+                writer->endObject();
+                break;
+            case OP_BEGIN_MEMBER:
+                writer->beginMember(op.s.c_str());
+                break;
+            case OP_END_MEMBER:
+                writer->endMember();
+                break;
+            case OP_BEGIN_ARRAY:
+                writer->beginArray();
+                break;
+            case OP_END_ARRAY:
+                writer->endArray();
+                break;
+            case OP_STRING:
+                writer->writeString(op.s.c_str());
+                break;
+            case OP_BLOB:
+                writer->writeBlob(op.s.data(), op.s.size());
+                break;
+            case OP_NULL:
+                writer->writeNull();
+                break;
+            case OP_BOOL:
+                writer->writeBool(op.b);
+                break;
+            case OP_SINT:
+                writer->writeSInt(op.i);
+                break;
+            case OP_UINT:
+                writer->writeUInt(op.u);
+                break;
+            case OP_FLOAT:
+                writer->writeFloat(op.f);
+                break;
+            case OP_DOUBLE:
+                writer->writeFloat(op.d);
+                break;
+            case OP_IMAGE:
+                writer->writeImage(op.image.get(), op.desc);
+                break;
+            }
+        }
+    }
+
+    bool
+    changed(const std::string &section, const std::string &member, uint64_t h) const {
+        if (!haveBase) {
+            return true;
+        }
+        auto sit = previous.find(section);
+        if (sit == previous.end()) {
+            return true;
+        }
+        auto mit = sit->second.find(member);
+        return mit == sit->second.end() || mit->second != h;
+    }
+
+    void
+    openSection(void) {
+        if (!sectionOpened) {
+            writer->beginMember(sectionName);
+            writer->beginObject();
+            sectionOpened = true;
+        }
+    }
+
+    void
+    finishMember(void) {
+        assert(recording);
+        recording = false;
+
+        current[sectionName][memberName] = hash;
+
+        if (!changed(sectionName, memberName, hash)) {
+            ops.clear();
+            return;
+        }
+
+        if (sectionIsObject) {
+            openSection();
+            writer->beginMember(memberName);
+            replay();
+            writer->endMember();
+        } else {
+            writer->beginMember(sectionName);
+            replay();
+            writer->endMember();
+        }
+        ops.clear();
+    }
+
+    void
+    writeRemovedPath(bool &opened, const std::string &section, const std::string &member) {
+        if (!opened) {
+            writer->beginMember("__removed__");
+            writer->beginArray();
+            opened = true;
+        }
+
+        writer->beginArray();
+        writer->writeString(section);
+        if (!member.empty()) {
+            writer->writeString(member);
+        }
+        writer->endArray();
+    }
+
+    void
+    writeRemoved(void) {
+        bool opened = false;
+
+        for (auto &section : previous) {
+            auto sit = current.find(section.first);
+            if (sit == current.end()) {
+                writeRemovedPath(opened, section.first, std::string());
+                continue;
+            }
+
+            for (auto &member : section.second) {
+                if (sit->second.find(member.first) == sit->second.end()) {
+                    writeRemovedPath(opened, section.first, member.first);
+                }
+            }
+        }
+
+        if (opened) {
+            writer->endArray();
+            writer->endMember();
+        }
+    }
+
+public:
+    DeltaStateWriter(StateWriter *_writer) :
+        writer(_writer)
+    {
+        assert(writer);
+    }
+
+    ~DeltaStateWriter()
+    {
+        assert(level == 0);
+        delete writer;
+    }
+
+    void
+    beginObject(void) override {
+        switch (level) {
+        case 0:
+            // A new dump
+            writer->beginObject();
+            current.clear();
+            if (haveBase) {
+                writer->writeStringMember("__base__", baseName.c_str());
+            }
+            break;
+        case 1:
+            if (recording && ops.empty()) {
+                // The section value itself
+                recording = false;
+                sectionIsObject = true;
+                current[sectionName];
+                if (!haveBase) {
+                    // Write even empty sections in full dumps
+                    openSection();
+                }
+                break;
+            }
+            // fall-through
+        default:
+            push(OP_BEGIN_OBJECT);
+            break;
+        }
+        ++level;
+    }
+
+    void
+    endObject(void) override {
+        assert(level > 0);
+        --level;
+        if (recording) {
+            push(OP_END_OBJECT);
+            return;
+        }
+        switch (level) {
+        case 0:
+            writeRemoved();
+            writer->endObject();
+            previous.swap(current);
+            current.clear();
+            baseName = dumpName;
+            haveBase = true;
+            break;
+        case 1:
+            assert(sectionIsObject);
+            if (sectionOpened) {
+                writer->endObject();
+            }
+            break;
+        default:
+            assert(0);
+            break;
+        }
+    }
+
+    void
+    beginMember(const char * name) override {
+        if (recording) {
+            push(OP_BEGIN_MEMBER).s = name;
+            mix(name, strlen(name));
+            return;
+        }
+        switch (level) {
+        case 0:
+            dumpName = name;
+            writer->beginMember(name);
+            break;
+        case 1:
+            sectionName = name;
+            sectionIsObject = false;
+            sectionOpened = false;
+            startRecording("");
+            break;
+        case 2:
+            startRecording(name);
+            break;
+        default:
+            assert(0);
+            break;
+        }
+    }
+
+    void
+    endMember(void) override {
+        if (recording &&
+            !(level == 1 && !sectionIsObject) &&
+            !(level == 2 && sectionIsObject)) {
+            push(OP_END_MEMBER);
+            return;
+        }
+        switch (level) {
+        case 0:
+            writer->endMember();
+            break;
+        case 1:
+            if (sectionIsObject) {
+                if (sectionOpened) {
+                    writer->endMember();
+                }
+            } else {
+                finishMember();
+            }
+            break;
+        case 2:
+            finishMember();
+            break;
+        default:
+            assert(0);
+            break;
+        }
+    }
+
+    void
+    beginArray(void) override {
+        assert(level > 0);
+        push(OP_BEGIN_ARRAY);
+        ++level;
+    }
+
+    void
+    endArray(void) override {
+        assert(level > 0);
+        --level;
+        push(OP_END_ARRAY);
+    }
+
+    void
+    writeString(const char *s) override {
+        push(OP_STRING).s = s;
+        mix(s, strlen(s));
+    }
+
+    void
+    writeBlob(const void *bytes, size_t size) override {
+        push(OP_BLOB).s.assign((const char *)bytes, size);
+        mix(bytes, size);
+    }
+
+    void
+    writeNull(void) override {
+        push(OP_NULL);
+    }
+
+    void
+    writeBool(bool b) override {
+        push(OP_BOOL).b = b;
+        mixValue(b);
+    }
+
+    void
+    writeSInt(signed long long i) override {
+        push(OP_SINT).i = i;
+        mixValue(i);
+    }
+
+    void
+    writeUInt(unsigned long long u) override {
+        push(OP_UINT).u = u;
+        mixValue(u);
+    }
+
+    void
+    writeFloat(float f) override {
+        push(OP_FLOAT).f = f;
+        mixValue(f);
+    }
+
+    void
+    writeFloat(double d) override {
+        push(OP_DOUBLE).d = d;
+        mixValue(d);
+    }
+
+    void
+    writeImage(image::Image *image, const ImageDesc & desc) override {
+        assert(image);
+        if (!image) {
+            writeNull();
+            return;
+        }
+
+        // The caller frees the image as soon as we return
+        Op &op = push(OP_IMAGE);
+        op.image.reset(copyImage(image));
+        op.desc = desc;
+
+        mix(image->pixels, image->sizeInBytes());
+        mixValue(image->width);
+        mixValue(image->height);
+        mixValue(image->channels);
+        mixValue(image->channelType);
+        mixValue(image->flipped);
+        mixValue(desc.depth);
+        mix(desc.format.data(), desc.format.size());
+        mix(image->label.data(), image->label.size());
+    }
+};
+
+
+}
+
+
+StateWriter *
+createDeltaStateWriter(StateWriter *writer)
+{
+    return new DeltaStateWriter(writer);
+}
@@ -40,6 +40,7 @@ namespace image {
 static void
 actuallyWritePNG(const os::String& filename, image::Image *image)
 {
+    trace::TimelineScope span(retrace::timeline, "writePNG");
     if (image->writePNG(filename, !retrace::snapshotAlpha) &&
         retrace::verbosity >= 0) {
         std::cout << "Wrote " << filename << "\n";
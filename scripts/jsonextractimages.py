@@ -37,9 +37,19 @@ import sys
 pngSignature = b"\x89\x50\x4E\x47\x0D\x0A\x1A\x0A"
 
 
-def dumpSurfaces(state, memberName):
+def collectImageData(state, memberName, imageData):
+    # Identical images are only dumped once, and referred to afterwards
+    for imageObj in state[memberName].values():
+        if '__id__' in imageObj:
+            imageData[imageObj['__id__']] = imageObj['__data__']
+
+
+def dumpSurfaces(state, memberName, imageData):
     for name, imageObj in state[memberName].items():
-        data = imageObj['__data__']
+        if '__ref__' in imageObj:
+            data = imageData[imageObj['__ref__']]
+        else:
+            data = imageObj['__data__']
         data = base64.b64decode(data)
 
         if data.startswith(pngSignature):
@@ -72,8 +82,12 @@ def main():
     for arg in args:
         state = json.load(open(arg, 'rt'), strict=False)
 
-        dumpSurfaces(state, 'textures')
-        dumpSurfaces(state, 'framebuffer')
+        imageData = {}
+        collectImageData(state, 'textures', imageData)
+        collectImageData(state, 'framebuffer', imageData)
+
+        dumpSurfaces(state, 'textures', imageData)
+        dumpSurfaces(state, 'framebuffer', imageData)
 
 
 
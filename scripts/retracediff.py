@@ -111,11 +111,37 @@ class Retracer:
         p.wait()
         return state.get('parameters', {})
 
+    def dump_states(self, call_nos):
+        '''Get the state dumps at several call nos, in a single replay.'''
+
+        p = self._retrace([
+            '-D', ','.join([str(call_no) for call_no in call_nos]),
+        ])
+        dumps = jsondiff.load(p.stdout, strip_images=False)
+        p.wait()
+
+        # All but the first dump only contain what changed since the previous one
+        states = {}
+        parameters = {}
+        for call_no in sorted(call_nos):
+            dump = dumps.get(str(call_no), {})
+            parameters = dict(parameters)
+            for path in dump.get('__removed__', []):
+                if path[0] == 'parameters':
+                    if len(path) == 1:
+                        parameters = {}
+                    else:
+                        parameters.pop(path[1], None)
+            parameters.update(dump.get('parameters', {}))
+            states[call_no] = parameters
+        return states
+
     def diff_state(self, ref_call_no, src_call_no, stream):
         '''Compare the state between two calls.'''
 
-        ref_state = self.dump_state(ref_call_no)
-        src_state = self.dump_state(src_call_no)
+        states = self.dump_states([ref_call_no, src_call_no])
+        ref_state = states[ref_call_no]
+        src_state = states[src_call_no]
 
         stream.flush()
         differ = jsondiff.Differ(stream)
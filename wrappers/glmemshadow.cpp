@@ -23,10 +23,12 @@
 
 #include "glmemshadow.hpp"
 
+#include <atomic>
 #include <unordered_map>
 #include <algorithm>
 
 #include <assert.h>
+#include <string.h>
 
 #ifdef _WIN32
 
@@ -36,13 +38,16 @@
 
 #include <unistd.h>
 #include <signal.h>
+#include <fcntl.h>
 #include <sys/mman.h>
 
 #endif
 
 #include "gltrace.hpp"
 #include "os_thread.hpp"
+#include "os_time.hpp"
 #include "os.hpp"
+#include "trace_stats.hpp"
 
 static bool sInitialized = false;
 
@@ -51,6 +56,57 @@ static size_t sPageSize;
 
 static std::mutex mutex;
 
+/*
+ * How writes to the shadow memory are detected:
+ *
+ * - PROTECT: pages are write-protected, and the first write to each page
+ *   raises an access violation which marks it dirty.
+ *
+ * - SOFT_DIRTY (Linux only, TRACE_SHADOW_TRACKING=softdirty): pages are left
+ *   writable, and the kernel's soft-dirty bits are collected in batches from
+ *   /proc/self/pagemap before committing, so no signal is raised outside of
+ *   collections.  Reading and clearing the bits is not atomic, so mapped
+ *   pages are write-protected while collecting: a write from another thread
+ *   in between faults as with PROTECT, and is recorded once the collection
+ *   is done, instead of being lost.  Clearing soft-dirty bits also
+ *   write-protects every page of the process in the kernel, so the next
+ *   write to any of them takes a minor fault, and it resets the bits for
+ *   anybody else relying on them (e.g. CRIU).  Collections are therefore
+ *   only done on draws from share groups which have a shadow mapped.
+ */
+enum class Tracking {
+    PROTECT,
+    SOFT_DIRTY,
+};
+
+static Tracking sTracking = Tracking::PROTECT;
+
+// Shadows currently mapped, scanned on every soft-dirty collection
+static std::vector<GLMemoryShadow*> sMappedShadows;
+
+/*
+ * Counters, logged on exit when TRACE_SHADOW_STATS is set.
+ */
+static struct Stats {
+    bool enabled = false;
+    std::atomic<unsigned long long> faults{0};
+    std::atomic<unsigned long long> collections{0};
+    std::atomic<unsigned long long> commits{0};
+    std::atomic<unsigned long long> ranges{0};
+    std::atomic<unsigned long long> bytes{0};
+    std::atomic<long long> time{0};
+
+    ~Stats() {
+        if (enabled) {
+            os::log("apitrace: shadow memory: %llu faults, %llu soft-dirty collections, "
+                    "%llu commits, %llu ranges, %llu bytes, %.3f ms\n",
+                    faults.load(), collections.load(), commits.load(),
+                    ranges.load(), bytes.load(),
+                    time.load() * 1000.0 / os::timeFrequency);
+        }
+    }
+} sStats;
+
 enum class MemProtection {
 #ifdef _WIN32
     NO_ACCESS = PAGE_NOACCESS,
@@ -158,10 +214,86 @@ void PageGuardExceptionHandler(int sig, siginfo_t *si, void *context) {
 }
 #endif
 
+#ifdef __linux__
+
+static int sPagemapFd = -1;
+static int sClearRefsFd = -1;
+
+static const uint64_t PM_SOFT_DIRTY = 1ULL << 55;
+
+static void
+clearSoftDirty(void)
+{
+    // "4" clears the soft-dirty bits of all the process pages
+    if (pwrite(sClearRefsFd, "4", 1, 0) != 1) {
+        os::log("apitrace: error: failed to clear soft-dirty bits\n");
+    }
+}
+
+static bool
+isSoftDirty(const void *addr)
+{
+    uint64_t entry = 0;
+    off_t offset = reinterpret_cast<uintptr_t>(addr) / sPageSize * sizeof entry;
+    if (pread(sPagemapFd, &entry, sizeof entry, offset) != sizeof entry) {
+        return false;
+    }
+    return entry & PM_SOFT_DIRTY;
+}
+
+/*
+ * Check that the kernel supports soft-dirty bits (CONFIG_MEM_SOFT_DIRTY) and
+ * that we may use them.
+ */
+static bool
+initSoftDirty(void)
+{
+    sPagemapFd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    sClearRefsFd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+    if (sPagemapFd < 0 || sClearRefsFd < 0) {
+        return false;
+    }
+
+    volatile uint8_t *probe = reinterpret_cast<volatile uint8_t *>(
+        mmap(nullptr, sPageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (probe == MAP_FAILED) {
+        return false;
+    }
+
+    probe[0] = 1;
+    clearSoftDirty();
+    bool cleared = !isSoftDirty(const_cast<uint8_t *>(probe));
+    probe[0] = 2;
+    bool dirtied = isSoftDirty(const_cast<uint8_t *>(probe));
+
+    munmap(const_cast<uint8_t *>(probe), sPageSize);
+
+    return cleared && dirtied;
+}
+
+#endif /* __linux__ */
+
 void initializeGlobals()
 {
     sPageSize = getSystemPageSize();
 
+    const char *stats = getenv("TRACE_SHADOW_STATS");
+    sStats.enabled = stats && strcmp(stats, "0") != 0;
+
+    const char *tracking = getenv("TRACE_SHADOW_TRACKING");
+    if (tracking && strcmp(tracking, "softdirty") == 0) {
+#ifdef __linux__
+        if (initSoftDirty()) {
+            sTracking = Tracking::SOFT_DIRTY;
+        }
+#endif
+        if (sTracking != Tracking::SOFT_DIRTY) {
+            os::log("apitrace: warning: soft-dirty page tracking unavailable, using page protection\n");
+        }
+    } else if (tracking && strcmp(tracking, "protect") != 0) {
+        os::log("apitrace: warning: unknown TRACE_SHADOW_TRACKING=%s\n", tracking);
+    }
+
 #ifdef _WIN32
     if (AddVectoredExceptionHandler(1, VectoredHandler) == NULL) {
         os::log("apitrace: error: %s: add vectored exception handler failed\n", __FUNCTION__);
@@ -186,6 +318,16 @@ GLMemoryShadow::~GLMemoryShadow()
         sPages.erase(startPage + i);
     }
 
+    // Deleted or respecified while still mapped
+    auto it = std::find(sMappedShadows.begin(), sMappedShadows.end(), this);
+    if (it != sMappedShadows.end()) {
+        sMappedShadows.erase(it);
+        shared_context_res_ptr_t res = sharedRes.lock();
+        if (res) {
+            --res->softDirtyMappings;
+        }
+    }
+
 #ifdef _WIN32
     VirtualFree(shadowMemory, nPages * sPageSize, MEM_RELEASE);
 #else
@@ -206,7 +348,10 @@ bool GLMemoryShadow::init(const void *data, size_t size)
 #ifdef _WIN32
     shadowMemory = reinterpret_cast<uint8_t*>(VirtualAlloc(nullptr, adjustedSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
 #else
-    shadowMemory = reinterpret_cast<uint8_t*>(mmap(nullptr, adjustedSize, PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    shadowMemory = reinterpret_cast<uint8_t*>(mmap(nullptr, adjustedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (shadowMemory == MAP_FAILED) {
+        shadowMemory = nullptr;
+    }
 #endif
 
     if (!shadowMemory) {
@@ -218,7 +363,12 @@ bool GLMemoryShadow::init(const void *data, size_t size)
         memcpy(shadowMemory, data, size);
     }
 
-    memProtect(shadowMemory, adjustedSize, MemProtection::NO_ACCESS);
+    dirtyPages.resize(divRoundUp(nPages, 32));
+
+    // Soft-dirty tracking only write-protects the pages while collecting
+    if (sTracking == Tracking::PROTECT) {
+        memProtect(shadowMemory, adjustedSize, MemProtection::NO_ACCESS);
+    }
 
     {
         std::unique_lock<std::mutex> lock(mutex);
@@ -229,8 +379,6 @@ bool GLMemoryShadow::init(const void *data, size_t size)
         }
     }
 
-    dirtyPages.resize(divRoundUp(nPages, 32));
-
     return true;
 }
 
@@ -245,6 +393,25 @@ void *GLMemoryShadow::map(gltrace::Context *_ctx, void *_glMemory, GLbitfield _f
     mappedStartPage = start / sPageSize;
     mappedEndPage = divRoundUp(start + size, sPageSize);
 
+    if (sTracking == Tracking::SOFT_DIRTY) {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        sMappedShadows.push_back(this);
+        ++_ctx->sharedRes->softDirtyMappings;
+
+        // The buffer may have been updated before the mapping.
+        if (flags & GL_MAP_READ_BIT) {
+            memcpy(shadowMemory + start, glMemory, size);
+        }
+
+        // Don't mistake our own writes (or stale bits from a previous
+        // mapping) for the application's
+        ignoreSoftDirty = true;
+        collectSoftDirty();
+
+        return shadowMemory + start;
+    }
+
     uint8_t *protectStart = shadowMemory + mappedStartPage * sPageSize;
     const size_t protectSize = (mappedEndPage - mappedStartPage) * sPageSize;
 
@@ -262,6 +429,19 @@ void *GLMemoryShadow::map(gltrace::Context *_ctx, void *_glMemory, GLbitfield _f
 
 void GLMemoryShadow::unmap(Callback callback)
 {
+    if (sTracking == Tracking::SOFT_DIRTY) {
+        std::unique_lock<std::mutex> lock(mutex);
+        collectSoftDirty();
+        auto it = std::find(sMappedShadows.begin(), sMappedShadows.end(), this);
+        if (it != sMappedShadows.end()) {
+            sMappedShadows.erase(it);
+            shared_context_res_ptr_t res = sharedRes.lock();
+            if (res) {
+                --res->softDirtyMappings;
+            }
+        }
+    }
+
     if (isDirty) {
         std::unique_lock<std::mutex> lock(mutex);
         commitWrites(callback);
@@ -281,7 +461,9 @@ void GLMemoryShadow::unmap(Callback callback)
         }
     }
 
-    memProtect(shadowMemory, nPages * sPageSize, MemProtection::NO_ACCESS);
+    if (sTracking == Tracking::PROTECT) {
+        memProtect(shadowMemory, nPages * sPageSize, MemProtection::NO_ACCESS);
+    }
 
     sharedRes.reset();
     glMemory = nullptr;
@@ -293,6 +475,8 @@ void GLMemoryShadow::unmap(Callback callback)
 
 void GLMemoryShadow::onAddressWrite(uintptr_t addr, size_t page)
 {
+    ++sStats.faults;
+
     const size_t relativePage = (addr - reinterpret_cast<uintptr_t>(shadowMemory)) / sPageSize;
     if (isPageDirty(relativePage)) {
         // It is possible if writing to the same buffer from two threads
@@ -357,12 +541,16 @@ void GLMemoryShadow::commitWrites(Callback callback)
      * so we need to protect pages before we read from them.
      * The other thread will have to wait until we commit all writes we want.
      */
-    for (size_t i = mappedStartPage; i < mappedEndPage; i++) {
-        if (isPageDirty(i)) {
-            memProtect(shadowMemory + i * sPageSize, sPageSize, MemProtection::READ_ONLY);
+    if (sTracking == Tracking::PROTECT) {
+        for (size_t i = mappedStartPage; i < mappedEndPage; i++) {
+            if (isPageDirty(i)) {
+                memProtect(shadowMemory + i * sPageSize, sPageSize, MemProtection::READ_ONLY);
+            }
         }
     }
 
+    ++sStats.commits;
+
     for (size_t i = mappedStartPage; i < mappedEndPage; i++) {
         if (isPageDirty(i)) {
             // We coalesce consecutive writes into one
@@ -377,11 +565,15 @@ void GLMemoryShadow::commitWrites(Callback callback)
 
                 memcpy(glMemory + glOffset, shadowSlice + shadowOffset, size);
                 callback(shadowSlice + shadowOffset, size);
+                ++sStats.ranges;
+                sStats.bytes += size;
             } else {
                 const size_t size = std::min(sPageSize * pages - glStartOffset, mappedSize);
 
                 memcpy(glMemory, shadowSlice + glStartOffset, size);
                 callback(shadowSlice + glStartOffset, size);
+                ++sStats.ranges;
+                sStats.bytes += size;
             }
         }
     }
@@ -394,6 +586,12 @@ void GLMemoryShadow::commitWrites(Callback callback)
 
 void GLMemoryShadow::updateForReads()
 {
+    if (sTracking == Tracking::SOFT_DIRTY) {
+        memcpy(shadowMemory + mappedStart, glMemory, mappedSize);
+        ignoreSoftDirty = true;
+        return;
+    }
+
     uint8_t *protectStart = shadowMemory + mappedStartPage * sPageSize;
     const size_t protectSize = (mappedEndPage - mappedStartPage) * sPageSize;
 
@@ -406,6 +604,17 @@ void GLMemoryShadow::updateForReads()
 
 void GLMemoryShadow::commitAllWrites(gltrace::Context *_ctx, Callback callback)
 {
+    trace::stats::Scope scope(trace::stats::SUBSYSTEM_GL_MEMORY_SHADOW);
+    long long startTime = sStats.enabled ? os::getTime() : 0;
+
+    // Leave the soft-dirty bits alone unless this share group has something
+    // mapped, as clearing them affects the whole process.  Other groups'
+    // bits stay set until one of their own draws collects them.
+    if (sTracking == Tracking::SOFT_DIRTY && _ctx->sharedRes->softDirtyMappings) {
+        std::unique_lock<std::mutex> lock(mutex);
+        collectSoftDirty();
+    }
+
     if (!_ctx->sharedRes->dirtyShadows.empty()) {
         std::unique_lock<std::mutex> lock(mutex);
 
@@ -415,6 +624,94 @@ void GLMemoryShadow::commitAllWrites(gltrace::Context *_ctx, Callback callback)
 
         _ctx->sharedRes->dirtyShadows.clear();
     }
+
+    if (sStats.enabled) {
+        sStats.time += os::getTime() - startTime;
+    }
+}
+
+/*
+ * Gather the soft-dirty bits of all mapped shadows into their dirtyPages
+ * bitmaps, then clear them.
+ *
+ * Must be called with the mutex held.  Shadows close to each other in the
+ * address space are read with a single pagemap read.
+ */
+void GLMemoryShadow::collectSoftDirty(void)
+{
+#ifdef __linux__
+    if (sMappedShadows.empty()) {
+        return;
+    }
+
+    ++sStats.collections;
+
+    std::sort(sMappedShadows.begin(), sMappedShadows.end(),
+              [](const GLMemoryShadow *a, const GLMemoryShadow *b) {
+                  return a->shadowMemory < b->shadowMemory;
+              });
+
+    // Largest hole, in pages, read through rather than issuing another read
+    static const size_t maxGapPages = 64;
+
+    std::vector<uint64_t> entries;
+
+    // Writes from other threads between reading the bits and clearing them
+    // would be lost, so make them fault until the collection is done.  The
+    // fault handler waits for the mutex, and then marks their pages dirty.
+    for (GLMemoryShadow *shadow : sMappedShadows) {
+        memProtect(shadow->shadowMemory + shadow->mappedStartPage * sPageSize,
+                   (shadow->mappedEndPage - shadow->mappedStartPage) * sPageSize,
+                   MemProtection::READ_ONLY);
+    }
+
+    auto first = sMappedShadows.begin();
+    while (first != sMappedShadows.end()) {
+        const size_t startPage = reinterpret_cast<uintptr_t>((*first)->shadowMemory) / sPageSize;
+        size_t endPage = startPage + (*first)->nPages;
+
+        auto last = first + 1;
+        while (last != sMappedShadows.end()) {
+            const size_t nextPage = reinterpret_cast<uintptr_t>((*last)->shadowMemory) / sPageSize;
+            if (nextPage > endPage + maxGapPages) {
+                break;
+            }
+            endPage = std::max(endPage, nextPage + (*last)->nPages);
+            ++last;
+        }
+
+        entries.resize(endPage - startPage);
+        const size_t bytes = entries.size() * sizeof entries[0];
+        if (pread(sPagemapFd, entries.data(), bytes, startPage * sizeof entries[0]) != ssize_t(bytes)) {
+            os::log("apitrace: error: %s: failed to read pagemap\n", __FUNCTION__);
+            std::fill(entries.begin(), entries.end(), PM_SOFT_DIRTY);
+        }
+
+        for (auto it = first; it != last; ++it) {
+            GLMemoryShadow *shadow = *it;
+            if (shadow->ignoreSoftDirty) {
+                shadow->ignoreSoftDirty = false;
+                continue;
+            }
+            const size_t offset = reinterpret_cast<uintptr_t>(shadow->shadowMemory) / sPageSize - startPage;
+            for (size_t i = shadow->mappedStartPage; i < shadow->mappedEndPage; i++) {
+                if (entries[offset + i] & PM_SOFT_DIRTY) {
+                    shadow->setPageDirty(i);
+                }
+            }
+        }
+
+        first = last;
+    }
+
+    clearSoftDirty();
+
+    for (GLMemoryShadow *shadow : sMappedShadows) {
+        memProtect(shadow->shadowMemory + shadow->mappedStartPage * sPageSize,
+                   (shadow->mappedEndPage - shadow->mappedStartPage) * sPageSize,
+                   MemProtection::READ_WRITE);
+    }
+#endif
 }
 
 void GLMemoryShadow::syncAllForReads(gltrace::Context *_ctx)
@@ -422,11 +719,18 @@ void GLMemoryShadow::syncAllForReads(gltrace::Context *_ctx)
     if (!_ctx->sharedRes->bufferToShadowMemory.empty()) {
         std::unique_lock<std::mutex> lock(mutex);
 
+        bool updated = false;
         for (auto& it : _ctx->sharedRes->bufferToShadowMemory) {
             GLMemoryShadow* memoryShadow = it.second.get();
             if (memoryShadow->getMapFlags() & GL_MAP_READ_BIT) {
                 memoryShadow->updateForReads();
+                updated = true;
             }
         }
+
+        // Reset the soft-dirty bits we just set ourselves
+        if (updated && sTracking == Tracking::SOFT_DIRTY) {
+            collectSoftDirty();
+        }
     }
 }
@@ -63,6 +63,10 @@ private:
     uint32_t pagesToDirtyOnConsecutiveWrites = 1;
     uint32_t lastDirtiedRelativePage = UINT32_MAX - 1;
 
+    // Soft-dirty tracking: pages we wrote ourselves, to be ignored on the
+    // next collection.
+    bool ignoreSoftDirty = false;
+
 public:
 
     typedef void (*Callback)(const void *ptr, size_t size);
@@ -88,4 +92,6 @@ private:
 
     void setPageDirty(size_t relativePage);
     bool isPageDirty(size_t relativePage);
+
+    static void collectSoftDirty(void);
 };
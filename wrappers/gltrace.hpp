@@ -34,9 +34,13 @@
 
 #include "os.hpp"
 
+#include <atomic>
 #include <map>
+#include <set>
+#include <tuple>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 void APIENTRY _fake_glScissor(GLint x, GLint y, GLsizei width, GLsizei height);
 void APIENTRY _fake_glViewport(GLint x, GLint y, GLsizei width, GLsizei height);
@@ -48,6 +52,95 @@ public:
     std::map<GLint, std::unique_ptr<GLMemoryShadow>> bufferToShadowMemory;
 
     std::vector<GLMemoryShadow*> dirtyShadows;
+
+    // Shadows of this share group currently mapped with soft-dirty tracking,
+    // so that draws of other share groups can skip the collection.
+    std::atomic<unsigned> softDirtyMappings{0};
+
+    // Maximum index of element array buffer ranges, as found by
+    // _glDraw_count, keyed by buffer name and then by (offset, count, type,
+    // restart index or -1).
+    typedef std::tuple<GLintptr, GLuint, GLenum, GLint64> IndexRange;
+
+private:
+    // Contexts of a share group may be current on several threads at once,
+    // so the cache below is only ever accessed with this mutex held.
+    std::mutex maxIndexCacheMutex;
+
+    std::map<GLuint, std::map<IndexRange, GLuint>> maxIndexCache;
+
+    // Buffers whose contents may change behind our back (GPU writes,
+    // persistent maps), and whose indices are therefore never cached.
+    std::set<GLuint> uncachedBuffers;
+
+    // Bumped whenever buffer contents change, so that indices read back
+    // while another context wrote the buffer are not cached.
+    unsigned long maxIndexCacheGeneration = 0;
+
+public:
+    // Looks up the maximum index of a range.  On a miss, returns false and
+    // sets ticket to be passed to cacheMaxIndex once the indices are read,
+    // or to 0 if the buffer must not be cached.
+    bool findMaxIndex(GLuint buffer, const IndexRange &range,
+                      GLuint &maxIndex, unsigned long &ticket) {
+        std::lock_guard<std::mutex> lock(maxIndexCacheMutex);
+        ticket = 0;
+        if (uncachedBuffers.count(buffer)) {
+            return false;
+        }
+        auto bit = maxIndexCache.find(buffer);
+        if (bit != maxIndexCache.end()) {
+            auto it = bit->second.find(range);
+            if (it != bit->second.end()) {
+                maxIndex = it->second;
+                return true;
+            }
+        }
+        ticket = maxIndexCacheGeneration + 1;
+        return false;
+    }
+
+    void cacheMaxIndex(GLuint buffer, const IndexRange &range,
+                       GLuint maxIndex, unsigned long ticket) {
+        std::lock_guard<std::mutex> lock(maxIndexCacheMutex);
+        if (ticket != maxIndexCacheGeneration + 1) {
+            return;
+        }
+        std::map<IndexRange, GLuint> &cache = maxIndexCache[buffer];
+        // Bound the number of distinct ranges per buffer
+        if (cache.size() >= 4096) {
+            cache.clear();
+        }
+        cache[range] = maxIndex;
+    }
+
+    void invalidateMaxIndexCache(GLuint buffer) {
+        std::lock_guard<std::mutex> lock(maxIndexCacheMutex);
+        ++maxIndexCacheGeneration;
+        maxIndexCache.erase(buffer);
+    }
+
+    void clearMaxIndexCache(void) {
+        std::lock_guard<std::mutex> lock(maxIndexCacheMutex);
+        ++maxIndexCacheGeneration;
+        maxIndexCache.clear();
+    }
+
+    void disableMaxIndexCache(GLuint buffer) {
+        if (buffer) {
+            std::lock_guard<std::mutex> lock(maxIndexCacheMutex);
+            ++maxIndexCacheGeneration;
+            uncachedBuffers.insert(buffer);
+            maxIndexCache.erase(buffer);
+        }
+    }
+
+    void deleteBuffer(GLuint buffer) {
+        std::lock_guard<std::mutex> lock(maxIndexCacheMutex);
+        ++maxIndexCacheGeneration;
+        uncachedBuffers.erase(buffer);
+        maxIndexCache.erase(buffer);
+    }
 };
 
 class Context {
@@ -71,6 +164,34 @@ public:
     // the data which can be shared between shared contexts
     std::shared_ptr<ShareableContextResources> sharedRes;
 
+    // Buffers bound to each target, as set by the traced calls, so that
+    // buffer writes need not query GL.  Missing entries are unknown, and
+    // queried once.  The element array buffer binding is vertex array
+    // object state, so it is kept per vertex array instead.
+    std::map<GLenum, GLint> bufferBindings;
+    std::map<GLuint, GLint> elementArrayBufferBindings;
+    GLuint vertexArray = 0;
+
+    void deleteBuffer(GLuint buffer) {
+        for (auto &binding : bufferBindings) {
+            if (binding.second == GLint(buffer)) {
+                binding.second = 0;
+            }
+        }
+        auto it = elementArrayBufferBindings.find(vertexArray);
+        if (it != elementArrayBufferBindings.end() &&
+            it->second == GLint(buffer)) {
+            it->second = 0;
+        }
+    }
+
+    void deleteVertexArray(GLuint array) {
+        elementArrayBufferBindings.erase(array);
+        if (array == vertexArray) {
+            vertexArray = 0;
+        }
+    }
+
     Context(void) :
         profile(glfeatures::API_GL, 1, 0),
         sharedRes(std::make_shared<ShareableContextResources>())
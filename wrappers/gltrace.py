@@ -128,6 +128,79 @@ class GlTracer(Tracer):
         "GL_UNIFORM_BUFFER",
     ]
 
+    # Functions which may change the contents of a buffer, mapped to the
+    # parameter holding either its target or its name.  These invalidate the
+    # maximum indices cached by _glDraw_count.
+    buffer_write_functions = {
+        'glBufferData': 'target',
+        'glBufferDataARB': 'target',
+        'glBufferSubData': 'target',
+        'glBufferSubDataARB': 'target',
+        'glBufferStorage': 'target',
+        'glBufferStorageEXT': 'target',
+        'glClearBufferData': 'target',
+        'glClearBufferSubData': 'target',
+        'glCopyBufferSubData': 'writeTarget',
+        'glInvalidateBufferData': 'buffer',
+        'glInvalidateBufferSubData': 'buffer',
+        'glMapBuffer': 'target',
+        'glMapBufferARB': 'target',
+        'glMapBufferOES': 'target',
+        'glMapBufferRange': 'target',
+        'glMapBufferRangeEXT': 'target',
+        'glFlushMappedBufferRange': 'target',
+        'glFlushMappedBufferRangeAPPLE': 'target',
+        'glFlushMappedBufferRangeEXT': 'target',
+        'glUnmapBuffer': 'target',
+        'glUnmapBufferARB': 'target',
+        'glUnmapBufferOES': 'target',
+        'glNamedBufferData': 'buffer',
+        'glNamedBufferDataEXT': 'buffer',
+        'glNamedBufferSubData': 'buffer',
+        'glNamedBufferSubDataEXT': 'buffer',
+        'glNamedBufferStorage': 'buffer',
+        'glNamedBufferStorageEXT': 'buffer',
+        'glClearNamedBufferData': 'buffer',
+        'glClearNamedBufferDataEXT': 'buffer',
+        'glClearNamedBufferSubData': 'buffer',
+        'glClearNamedBufferSubDataEXT': 'buffer',
+        'glCopyNamedBufferSubData': 'writeBuffer',
+        'glNamedCopyBufferSubDataEXT': 'writeBuffer',
+        'glMapNamedBuffer': 'buffer',
+        'glMapNamedBufferEXT': 'buffer',
+        'glMapNamedBufferRange': 'buffer',
+        'glMapNamedBufferRangeEXT': 'buffer',
+        'glFlushMappedNamedBufferRange': 'buffer',
+        'glFlushMappedNamedBufferRangeEXT': 'buffer',
+        'glUnmapNamedBuffer': 'buffer',
+        'glUnmapNamedBufferEXT': 'buffer',
+    }
+
+    # Functions which attach buffers to places where the GPU may write into
+    # them (transform feedback, shader storage, image stores, pixel packing,
+    # queries), after which their indices can no longer be cached.
+    buffer_gpu_write_function_regex = re.compile(r'^gl(' + r'|'.join([
+        r'BindBuffer(ARB)?',
+        r'BindBuffer(Base|Range|Offset)(EXT|NV)?',
+        r'BindBuffers(Base|Range)',
+        r'TransformFeedbackBuffer(Base|Range)',
+        r'(Tex|Texture|MultiTex)Buffer(Range)?(ARB|EXT|OES)?',
+    ]) + r')$')
+
+    # GL_EXT_memory_object functions which back a buffer with memory that
+    # may be written externally, mapped to the parameter holding either its
+    # target or its name
+    memory_object_buffer_functions = [
+        ('glBufferStorageMemEXT', 'target'),
+        ('glNamedBufferStorageMemEXT', 'buffer'),
+    ]
+
+    # Functions which bind a buffer to the generic binding point of target
+    buffer_bind_function_regex = re.compile(r'^gl(' + r'|'.join([
+        r'BindBuffer(ARB)?',
+        r'BindBuffer(Base|Range|Offset)(EXT|NV)?',
+    ]) + r')$')
+
     # Names of the functions that can pack into the current pixel buffer
     # object.  See also the ARB_pixel_buffer_object specification.
     pack_function_regex = re.compile(r'^gl(' + r'|'.join([
@@ -288,6 +361,82 @@ class GlTracer(Tracer):
         print('}')
         print()
 
+        print('static inline bool')
+        print('isGpuWritableBufferTarget(GLenum target) {')
+        print('    switch (target) {')
+        for target in (
+            'GL_ATOMIC_COUNTER_BUFFER',
+            'GL_PIXEL_PACK_BUFFER',
+            'GL_QUERY_BUFFER',
+            'GL_SHADER_STORAGE_BUFFER',
+            'GL_TEXTURE_BUFFER',
+            'GL_TRANSFORM_FEEDBACK_BUFFER',
+        ):
+            print('    case %s:' % target)
+        print('        return true;')
+        print('    default:')
+        print('        return false;')
+        print('    }')
+        print('}')
+        print()
+
+        # Buffer bindings as tracked by the context, so that buffer writes
+        # don't force a round trip to (threaded) drivers
+        print('static std::map<GLuint, GLint> &')
+        print('trackedBufferBindings(gltrace::Context *_ctx, GLenum target, GLuint &key) {')
+        print('    if (target == GL_ELEMENT_ARRAY_BUFFER) {')
+        print('        key = _ctx->vertexArray;')
+        print('        return _ctx->elementArrayBufferBindings;')
+        print('    }')
+        print('    key = target;')
+        print('    return _ctx->bufferBindings;')
+        print('}')
+        print()
+
+        print('static GLint')
+        print('getBoundBuffer(gltrace::Context *_ctx, GLenum target) {')
+        print('    GLuint key;')
+        print('    std::map<GLuint, GLint> &bindings = trackedBufferBindings(_ctx, target, key);')
+        print('    auto it = bindings.find(key);')
+        print('    if (it == bindings.end()) {')
+        print('        it = bindings.emplace(key, _glGetInteger(getBufferBinding(target))).first;')
+        print('    }')
+        print('    return it->second;')
+        print('}')
+        print()
+
+        print('static void')
+        print('setBoundBuffer(gltrace::Context *_ctx, GLenum target, GLuint buffer) {')
+        print('    switch (target) {')
+        for target in self.buffer_targets:
+            print('    case %s:' % target)
+        print('        {')
+        print('            GLuint key;')
+        print('            trackedBufferBindings(_ctx, target, key)[key] = buffer;')
+        print('        }')
+        print('        break;')
+        print('    default:')
+        print('        break;')
+        print('    }')
+        print('}')
+        print()
+
+        print('static void')
+        print('invalidateMaxIndexCache(GLenum target) {')
+        print('    gltrace::Context *_ctx = gltrace::getContext();')
+        print('    switch (target) {')
+        for target in self.buffer_targets:
+            print('    case %s:' % target)
+        print('        _ctx->sharedRes->invalidateMaxIndexCache(getBoundBuffer(_ctx, target));')
+        print('        break;')
+        print('    default:')
+        print('        // e.g. GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD')
+        print('        _ctx->sharedRes->clearMaxIndexCache();')
+        print('        break;')
+        print('    }')
+        print('}')
+        print()
+
         # states such as GL_UNPACK_ROW_LENGTH are not available in GLES
         print('static inline bool')
         print('can_unpack_subimage(void) {')
@@ -317,7 +466,25 @@ class GlTracer(Tracer):
             print()
             
             Tracer.traceApi(self, api)
-            
+
+            # GL_EXT_memory_object buffers are not traced, but may be
+            # written externally, so keep their indices out of the cache
+            for function_name, bufferArg in self.memory_object_buffer_functions:
+                print('static PFN%sPROC _%s_ptr = NULL;' % (function_name.upper(), function_name))
+                print()
+                if bufferArg == 'target':
+                    print('static void APIENTRY _%s_untraced(GLenum target, GLsizeiptr size, GLuint memory, GLuint64 offset) {' % function_name)
+                else:
+                    print('static void APIENTRY _%s_untraced(GLuint buffer, GLsizeiptr size, GLuint memory, GLuint64 offset) {' % function_name)
+                print('    _%s_ptr(%s, size, memory, offset);' % (function_name, bufferArg))
+                print('    gltrace::Context *_ctx = gltrace::getContext();')
+                if bufferArg == 'target':
+                    print('    _ctx->sharedRes->disableMaxIndexCache(getBoundBuffer(_ctx, target));')
+                else:
+                    print('    _ctx->sharedRes->disableMaxIndexCache(buffer);')
+                print('}')
+                print()
+
             print('static %s _wrapProcAddress(%s procName, %s procPtr) {' % (retType, argType, retType))
 
             # Provide fallback functions to missing debug functions
@@ -343,6 +510,11 @@ class GlTracer(Tracer):
                 print('        return (%s)&%s;' % (retType, function.name,))
                 print('    }')
             print('    os::log("apitrace: warning: unknown function \\"%s\\"\\n", (const char *)procName);')
+            for function_name, bufferArg in self.memory_object_buffer_functions:
+                print('    if (strcmp("%s", (const char *)procName) == 0) {' % function_name)
+                print('        _%s_ptr = (PFN%sPROC)procPtr;' % (function_name, function_name.upper()))
+                print('        return (%s)&_%s_untraced;' % (retType, function_name))
+                print('    }')
             print('    return procPtr;')
             print('}')
             print()
@@ -544,6 +716,65 @@ class GlTracer(Tracer):
             print(r'        _ctx->userArraysOnBegin = false;')
             print(r'    }')
         
+        # Keep the maximum indices cached by _glDraw_count up to date
+        if function.name in self.buffer_write_functions:
+            argName = self.buffer_write_functions[function.name]
+            if argName.endswith('arget'):
+                print('    invalidateMaxIndexCache(%s);' % argName)
+            else:
+                print('    gltrace::getContext()->sharedRes->invalidateMaxIndexCache(%s);' % argName)
+        if function.name in ('glBufferStorage', 'glBufferStorageEXT', 'glNamedBufferStorage', 'glNamedBufferStorageEXT'):
+            print('    if (flags & GL_MAP_PERSISTENT_BIT) {')
+            if function.name.startswith('glNamed'):
+                print('        gltrace::getContext()->sharedRes->disableMaxIndexCache(buffer);')
+            else:
+                print('        gltrace::Context *_ctx = gltrace::getContext();')
+                print('        _ctx->sharedRes->disableMaxIndexCache(getBoundBuffer(_ctx, target));')
+            print('    }')
+        if self.buffer_gpu_write_function_regex.match(function.name):
+            argNames = [arg.name for arg in function.args]
+            if 'Tex' in function.name or 'target' not in argNames:
+                # texture buffers may be written with image stores, and
+                # glTransformFeedbackBuffer* have no target
+                print('    {')
+            else:
+                print('    if (isGpuWritableBufferTarget(target)) {')
+            print('        gltrace::Context *_ctx = gltrace::getContext();')
+            if 'buffers' in argNames:
+                print('        for (GLsizei _i = 0; buffers && _i < count; ++_i) {')
+                print('            _ctx->sharedRes->disableMaxIndexCache(buffers[_i]);')
+                print('        }')
+            else:
+                print('        _ctx->sharedRes->disableMaxIndexCache(buffer);')
+            print('    }')
+        if function.name in ('glDeleteBuffers', 'glDeleteBuffersARB'):
+            print('    for (GLsizei _i = 0; buffers && _i < n; ++_i) {')
+            print('        gltrace::getContext()->sharedRes->deleteBuffer(buffers[_i]);')
+            print('        gltrace::getContext()->deleteBuffer(buffers[_i]);')
+            print('    }')
+
+        # Track the buffer bindings used by invalidateMaxIndexCache
+        if self.buffer_bind_function_regex.match(function.name):
+            print('    setBoundBuffer(gltrace::getContext(), target, buffer);')
+        if function.name in ('glBindBuffersBase', 'glBindBuffersRange'):
+            # Whether the generic binding changes too is left to be queried
+            print('    gltrace::getContext()->bufferBindings.erase(target);')
+        if function.name in ('glBindVertexArray', 'glBindVertexArrayAPPLE', 'glBindVertexArrayOES'):
+            print('    gltrace::getContext()->vertexArray = array;')
+        if function.name in ('glDeleteVertexArrays', 'glDeleteVertexArraysAPPLE', 'glDeleteVertexArraysOES'):
+            print('    for (GLsizei _i = 0; arrays && _i < n; ++_i) {')
+            print('        gltrace::getContext()->deleteVertexArray(arrays[_i]);')
+            print('    }')
+        if function.name == 'glVertexArrayElementBuffer':
+            print('    gltrace::getContext()->elementArrayBufferBindings[vaobj] = buffer;')
+        if function.name == 'glPopClientAttrib':
+            # May restore the array and element array buffer bindings
+            print('    {')
+            print('        gltrace::Context *_ctx = gltrace::getContext();')
+            print('        _ctx->bufferBindings.erase(GL_ARRAY_BUFFER);')
+            print('        _ctx->elementArrayBufferBindings.erase(_ctx->vertexArray);')
+            print('    }')
+
         # Emit a fake memcpy on buffer uploads
         if function.name == 'glBufferParameteriAPPLE':
             print('    if (pname == GL_BUFFER_FLUSHING_UNMAP_APPLE && param == GL_FALSE) {')
@@ -27,6 +27,13 @@
 #include "gltrace_arrays.hpp"
 #include "gltrace.hpp"
 
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#else
+#define HAVE_SSE2 0
+#endif
+
 
 /* FIXME take in consideration instancing */
 
@@ -41,6 +48,123 @@ _glDraw_count(gltrace::Context *ctx, const DrawArraysParams &params)
 }
 
 
+/*
+ * Maximum index kernels.
+ *
+ * Restart indices are replaced by zero before taking the maximum, which
+ * keeps the inner loops branch-free.  When primitive restart is disabled
+ * callers pass a restart index which can't match, so the mask is always
+ * empty.
+ */
+
+static GLuint
+_maxIndex(const GLubyte *p, GLuint count, GLuint restart_index)
+{
+    GLuint i = 0;
+    GLuint maxindex = 0;
+#if HAVE_SSE2
+    if (count >= 16) {
+        const __m128i restart = _mm_set1_epi8((char)restart_index);
+        const bool mask = restart_index <= 0xff;
+        __m128i vmax = _mm_setzero_si128();
+        for (; i + 16 <= count; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+            if (mask) {
+                v = _mm_andnot_si128(_mm_cmpeq_epi8(v, restart), v);
+            }
+            vmax = _mm_max_epu8(vmax, v);
+        }
+        alignas(16) GLubyte lanes[16];
+        _mm_store_si128((__m128i *)lanes, vmax);
+        for (unsigned j = 0; j < 16; ++j) {
+            maxindex = std::max<GLuint>(maxindex, lanes[j]);
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        GLuint index = p[i];
+        if (index != restart_index) {
+            maxindex = std::max(maxindex, index);
+        }
+    }
+    return maxindex;
+}
+
+static GLuint
+_maxIndex(const GLushort *p, GLuint count, GLuint restart_index)
+{
+    GLuint i = 0;
+    GLuint maxindex = 0;
+#if HAVE_SSE2
+    if (count >= 8) {
+        // SSE2 only has signed 16bit max, so bias the values
+        const __m128i bias = _mm_set1_epi16((short)0x8000);
+        const __m128i restart = _mm_set1_epi16((short)restart_index);
+        const bool mask = restart_index <= 0xffff;
+        __m128i vmax = bias;
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+            if (mask) {
+                v = _mm_andnot_si128(_mm_cmpeq_epi16(v, restart), v);
+            }
+            vmax = _mm_max_epi16(vmax, _mm_xor_si128(v, bias));
+        }
+        vmax = _mm_xor_si128(vmax, bias);
+        alignas(16) GLushort lanes[8];
+        _mm_store_si128((__m128i *)lanes, vmax);
+        for (unsigned j = 0; j < 8; ++j) {
+            maxindex = std::max<GLuint>(maxindex, lanes[j]);
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        GLuint index = p[i];
+        if (index != restart_index) {
+            maxindex = std::max(maxindex, index);
+        }
+    }
+    return maxindex;
+}
+
+static GLuint
+_maxIndex(const GLuint *p, GLuint count, GLuint restart_index, bool restart_enabled)
+{
+    GLuint i = 0;
+    GLuint maxindex = 0;
+#if HAVE_SSE2
+    if (count >= 4) {
+        // No unsigned 32bit compare nor max in SSE2, so bias the values and
+        // select with signed compares
+        const __m128i bias = _mm_set1_epi32((int)0x80000000);
+        const __m128i restart = _mm_set1_epi32((int)restart_index);
+        __m128i vmax = bias;
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+            if (restart_enabled) {
+                v = _mm_andnot_si128(_mm_cmpeq_epi32(v, restart), v);
+            }
+            v = _mm_xor_si128(v, bias);
+            __m128i gt = _mm_cmpgt_epi32(v, vmax);
+            vmax = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, vmax));
+        }
+        vmax = _mm_xor_si128(vmax, bias);
+        alignas(16) GLuint lanes[4];
+        _mm_store_si128((__m128i *)lanes, vmax);
+        for (unsigned j = 0; j < 4; ++j) {
+            maxindex = std::max(maxindex, lanes[j]);
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        GLuint index = p[i];
+        if (!restart_enabled || index != restart_index) {
+            maxindex = std::max(maxindex, index);
+        }
+    }
+    return maxindex;
+}
+
+
 GLuint
 _glDraw_count(gltrace::Context *ctx, const DrawElementsParams &params)
 {
@@ -63,6 +187,18 @@ _glDraw_count(gltrace::Context *ctx, const DrawElementsParams &params)
         return 0;
     }
 
+    GLboolean restart_enabled = GL_FALSE;
+    GLuint restart_index = 0;
+    if (ctx->features.primitive_restart) {
+        restart_enabled = _glIsEnabled(GL_PRIMITIVE_RESTART);
+        if (restart_enabled) {
+            restart_index = (GLuint)_glGetInteger(GL_PRIMITIVE_RESTART_INDEX);
+        }
+    }
+
+    gltrace::ShareableContextResources::IndexRange range;
+    unsigned long ticket = 0;
+
     GLint element_array_buffer = _element_array_buffer_binding();
     if (element_array_buffer) {
         // Read indices from index buffer object
@@ -73,6 +209,18 @@ _glDraw_count(gltrace::Context *ctx, const DrawElementsParams &params)
         }
 
         GLintptr offset = (GLintptr)indices;
+
+        // Static index buffers are often drawn over and over, so avoid
+        // reading them back from the GPU unless their contents changed.
+        if (ctx->sharedRes->bufferToShadowMemory.count(element_array_buffer) == 0) {
+            range = std::make_tuple(offset, count, type,
+                                    restart_enabled ? GLint64(restart_index) : GLint64(-1));
+            GLuint maxindex;
+            if (ctx->sharedRes->findMaxIndex(element_array_buffer, range, maxindex, ticket)) {
+                return maxindex + params.basevertex + 1;
+            }
+        }
+
         GLsizeiptr size = count*_gl_type_size(type);
         temp = malloc(size);
         if (!temp) {
@@ -89,57 +237,28 @@ _glDraw_count(gltrace::Context *ctx, const DrawElementsParams &params)
 
     GLuint maxindex = 0;
 
-    GLboolean restart_enabled = GL_FALSE;
-    GLuint restart_index = 0;
-    if (ctx->features.primitive_restart) {
-        _glIsEnabled(GL_PRIMITIVE_RESTART);
-        if (restart_enabled) {
-            restart_index = (GLuint)_glGetInteger(GL_PRIMITIVE_RESTART_INDEX);
-        }
-    }
+    // 8/16bit indices can never match ~0U, so no need to test restart_enabled
+    GLuint small_restart_index = restart_enabled ? restart_index : ~0U;
 
-    GLsizei i;
     if (type == GL_UNSIGNED_BYTE) {
-        const GLubyte *p = (const GLubyte *)indices;
-        for (i = 0; i < count; ++i) {
-            GLuint index = p[i];
-            if (restart_enabled && index == restart_index) {
-                continue;
-            }
-            if (index > maxindex) {
-                maxindex = index;
-            }
-        }
+        maxindex = _maxIndex((const GLubyte *)indices, count, small_restart_index);
     } else if (type == GL_UNSIGNED_SHORT) {
-        const GLushort *p = (const GLushort *)indices;
-        for (i = 0; i < count; ++i) {
-            GLuint index = p[i];
-            if (restart_enabled && index == restart_index) {
-                continue;
-            }
-            if (index > maxindex) {
-                maxindex = index;
-            }
-        }
+        maxindex = _maxIndex((const GLushort *)indices, count, small_restart_index);
     } else if (type == GL_UNSIGNED_INT) {
-        const GLuint *p = (const GLuint *)indices;
-        for (i = 0; i < count; ++i) {
-            GLuint index = p[i];
-            if (restart_enabled && index == restart_index) {
-                continue;
-            }
-            if (index > maxindex) {
-                maxindex = index;
-            }
-        }
+        maxindex = _maxIndex((const GLuint *)indices, count, restart_index, restart_enabled);
     } else {
         os::log("apitrace: warning: %s: unknown GLenum 0x%04X\n", __FUNCTION__, type);
+        ticket = 0;
     }
 
     if (element_array_buffer) {
         free(temp);
     }
 
+    if (ticket) {
+        ctx->sharedRes->cacheMaxIndex(element_array_buffer, range, maxindex, ticket);
+    }
+
     maxindex += params.basevertex;
 
     return maxindex + 1;
@@ -28,11 +28,21 @@
 
 #include <assert.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "crc32c.hpp"
+#include "os_process.hpp"
+#include "trace_stats.hpp"
 
 
 #if \
@@ -43,7 +53,17 @@
 
 #  define HAVE_SSE2
 
-// TODO: Detect and leverage SSE 4.1 and 4.2 at runtime
+// The CRC32 instruction of SSE 4.2 is detected and used at runtime
+#  if defined(__GNUC__)
+#    define HAVE_SSE42_DISPATCH
+#    include <nmmintrin.h>
+#    define TARGET_SSE42 __attribute__((target("sse4.2")))
+#  elif defined(_MSC_VER)
+#    define HAVE_SSE42_DISPATCH
+#    include <intrin.h>
+#    include <nmmintrin.h>
+#    define TARGET_SSE42
+#  endif
 
 #endif
 
@@ -59,6 +79,13 @@
 
 #define BLOCK_SIZE 512
 
+// Clean blocks between dirty ones which are still copied, as that is cheaper
+// than emitting and replaying another memcpy call
+#define MAX_GAP_BLOCKS 4
+
+// Minimum amount of memory worth handing to another thread
+#define MIN_PARALLEL_SIZE (1024 * 1024)
+
 
 template< class T >
 static inline T *
@@ -167,6 +194,345 @@ hashBlock(const void *p)
 }
 
 
+#ifdef HAVE_SSE42_DISPATCH
+
+static bool
+haveSSE42(void)
+{
+#if defined(__GNUC__)
+    return __builtin_cpu_supports("sse4.2");
+#else
+    int info[4];
+    __cpuid(info, 1);
+    return info[2] & (1 << 20);
+#endif
+}
+
+
+/*
+ * CRC32 has a latency of 3 cycles but a throughput of 1 per cycle, so
+ * hashing several blocks in lockstep, with independent CRC streams, keeps
+ * the unit busy.
+ */
+#define SSE42_LANES 4
+
+#if defined(__x86_64__) || defined(_M_AMD64)
+typedef uint64_t crc_word_t;
+#  define mm_crc32_word _mm_crc32_u64
+#else
+typedef uint32_t crc_word_t;
+#  define mm_crc32_word _mm_crc32_u32
+#endif
+
+TARGET_SSE42 static void
+hashBlocksSSE42(const uint8_t *p, size_t count, uint32_t *hashes)
+{
+    const size_t stride = BLOCK_SIZE / sizeof(crc_word_t);
+
+    for (; count >= SSE42_LANES; count -= SSE42_LANES) {
+        const crc_word_t *q = (const crc_word_t *)(const void *)p;
+        crc_word_t crc0 = 0xffffffff;
+        crc_word_t crc1 = 0xffffffff;
+        crc_word_t crc2 = 0xffffffff;
+        crc_word_t crc3 = 0xffffffff;
+        for (size_t i = 0; i < stride; ++i) {
+            crc0 = mm_crc32_word(crc0, q[i]);
+            crc1 = mm_crc32_word(crc1, q[i + stride]);
+            crc2 = mm_crc32_word(crc2, q[i + 2 * stride]);
+            crc3 = mm_crc32_word(crc3, q[i + 3 * stride]);
+        }
+        hashes[0] = ~(uint32_t)crc0;
+        hashes[1] = ~(uint32_t)crc1;
+        hashes[2] = ~(uint32_t)crc2;
+        hashes[3] = ~(uint32_t)crc3;
+        hashes += SSE42_LANES;
+        p += SSE42_LANES * BLOCK_SIZE;
+    }
+
+    for (; count; --count) {
+        const crc_word_t *q = (const crc_word_t *)(const void *)p;
+        crc_word_t crc = 0xffffffff;
+        for (size_t i = 0; i < stride; ++i) {
+            crc = mm_crc32_word(crc, q[i]);
+        }
+        *hashes++ = ~(uint32_t)crc;
+        p += BLOCK_SIZE;
+    }
+}
+
+#endif /* HAVE_SSE42_DISPATCH */
+
+
+void
+hashBlocks(const void *p, size_t count, uint32_t *hashes)
+{
+    assert((uintptr_t)p % BLOCK_SIZE == 0);
+
+#ifdef HAVE_SSE42_DISPATCH
+    static const bool sse42 = haveSSE42();
+    if (sse42) {
+        hashBlocksSSE42((const uint8_t *)p, count, hashes);
+        return;
+    }
+#endif
+
+    const uint8_t *q = (const uint8_t *)p;
+    for (size_t i = 0; i < count; ++i) {
+        hashes[i] = hashBlock(q);
+        q += BLOCK_SIZE;
+    }
+}
+
+
+/*
+ * Small pool of threads to hash large resources with.  The calling thread
+ * takes part too, and picks any slice no worker picked, so the pool is never
+ * waited upon when its threads are busy or gone (e.g., after fork).
+ */
+class WorkerPool
+{
+    typedef std::function<void (size_t)> Job;
+
+    // Held for the duration of a job, and when stopping
+    std::mutex jobMutex;
+
+    std::mutex mutex;
+    std::condition_variable wakeCond;
+    std::condition_variable doneCond;
+    bool stopping = false;
+
+    // Each job is published under the mutex with a new generation
+    uint32_t generation = 0;
+    const Job *job = nullptr;
+    size_t numSlices = 0;
+    size_t doneSlices = 0;
+
+    // Generation in the upper half, next slice in the lower one, so that
+    // workers late from an earlier job can't claim slices of the current one
+    std::atomic<uint64_t> cursor;
+
+    std::vector<std::thread> threads;
+    std::atomic<unsigned> numThreads;
+    os::ProcessId pid;
+
+    /*
+     * Run the slices of the given generation nobody claimed yet, returning
+     * how many.
+     */
+    size_t
+    work(uint32_t gen, const Job &func, size_t count)
+    {
+        size_t done = 0;
+        uint64_t next = cursor.load();
+        while (uint32_t(next >> 32) == gen && size_t(uint32_t(next)) < count) {
+            if (cursor.compare_exchange_weak(next, next + 1)) {
+                func(size_t(uint32_t(next)));
+                ++done;
+                next = cursor.load();
+            }
+        }
+        return done;
+    }
+
+    void
+    run(void)
+    {
+        uint32_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wakeCond.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            if (!job) {
+                continue;
+            }
+
+            const Job *func = job;
+            size_t count = numSlices;
+            lock.unlock();
+            size_t done = work(seen, *func, count);
+            lock.lock();
+
+            // Slices are only claimed for the current job, which lasts until
+            // they are all done
+            if (done) {
+                doneSlices += done;
+                if (doneSlices == numSlices) {
+                    doneCond.notify_one();
+                }
+            }
+        }
+    }
+
+public:
+    WorkerPool() :
+        cursor(0),
+        numThreads(0),
+        pid(os::getCurrentProcessId())
+    {
+        unsigned count = std::min(std::thread::hardware_concurrency(), 4U);
+        count = count > 1 ? count - 1 : 0;
+        for (unsigned i = 0; i < count; ++i) {
+            threads.emplace_back(&WorkerPool::run, this);
+        }
+        numThreads = count;
+    }
+
+    unsigned
+    size(void) const
+    {
+        return numThreads + 1;
+    }
+
+    /*
+     * Call job(0) .. job(count - 1), concurrently when the pool is idle.
+     */
+    void
+    parallelFor(size_t count, const Job &_job)
+    {
+        std::unique_lock<std::mutex> busy(jobMutex, std::try_to_lock);
+        if (!busy.owns_lock() || count < 2 || !numThreads) {
+            for (size_t slice = 0; slice < count; ++slice) {
+                _job(slice);
+            }
+            return;
+        }
+
+        assert(count <= UINT32_MAX);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        uint32_t gen = ++generation;
+        job = &_job;
+        numSlices = count;
+        doneSlices = 0;
+        cursor = uint64_t(gen) << 32;
+        wakeCond.notify_all();
+        lock.unlock();
+
+        size_t done = work(gen, _job, count);
+
+        lock.lock();
+        doneSlices += done;
+        doneCond.wait(lock, [&] { return doneSlices == numSlices; });
+        job = nullptr;
+    }
+
+    /*
+     * Stop and join the threads; later jobs run on the calling thread.
+     */
+    void
+    stop(void)
+    {
+        if (os::getCurrentProcessId() != pid) {
+            // The threads, and whoever held the mutexes, didn't survive fork
+            return;
+        }
+
+        std::lock_guard<std::mutex> busy(jobMutex);
+        numThreads = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeCond.notify_all();
+        for (auto & thread : threads) {
+#ifdef _WIN32
+            // At DLL unload, exiting threads wait for the loader lock we hold
+            thread.detach();
+#else
+            thread.join();
+#endif
+        }
+        threads.clear();
+    }
+};
+
+
+static WorkerPool &getWorkerPool(void);
+
+static void
+stopWorkerPool(void)
+{
+    getWorkerPool().stop();
+}
+
+static WorkerPool &
+getWorkerPool(void)
+{
+    // Never destroyed, so that it stays usable, serially, after exit
+    static WorkerPool *pool = [] {
+        WorkerPool *p = new WorkerPool;
+        atexit(stopWorkerPool);
+        return p;
+    }();
+    return *pool;
+}
+
+
+/*
+ * Number of slices, of at least MIN_PARALLEL_SIZE bytes each, to split count
+ * blocks into.
+ */
+static size_t
+countSlices(size_t count)
+{
+    size_t numSlices = count * BLOCK_SIZE / MIN_PARALLEL_SIZE;
+    if (numSlices < 2) {
+        return 1;
+    }
+    return std::min<size_t>(numSlices, getWorkerPool().size());
+}
+
+
+typedef std::function<void (size_t slice, size_t first, size_t last)> SliceFunc;
+
+static void
+forEachSlice(size_t count, size_t numSlices, const SliceFunc &func)
+{
+    if (numSlices < 2) {
+        func(0, 0, count);
+        return;
+    }
+
+    size_t sliceBlocks = (count + numSlices - 1) / numSlices;
+    getWorkerPool().parallelFor(numSlices, [&] (size_t slice) {
+        size_t first = std::min(slice * sliceBlocks, count);
+        size_t last = std::min(first + sliceBlocks, count);
+        func(slice, first, last);
+    });
+}
+
+
+void
+diffBlocks(const void *p, const uint32_t *hashes, size_t first, size_t last,
+           std::vector<BlockRange> &ranges)
+{
+    const uint8_t *q = (const uint8_t *)p + first * BLOCK_SIZE;
+
+    // Hash in batches that stay in the L1 cache
+    const size_t BATCH_SIZE = 64;
+    uint32_t batch[BATCH_SIZE];
+
+    for (size_t i = first; i < last; ) {
+        size_t count = std::min(BATCH_SIZE, last - i);
+        hashBlocks(q, count, batch);
+        for (size_t j = 0; j < count; ++j, ++i) {
+            if (batch[j] == hashes[i]) {
+                continue;
+            }
+            if (!ranges.empty() && i - ranges.back().last <= MAX_GAP_BLOCKS) {
+                ranges.back().last = i + 1;
+            } else {
+                ranges.push_back(BlockRange{i, i + 1});
+            }
+        }
+        q += count * BLOCK_SIZE;
+    }
+}
+
+
 // We must reset the data on discard, otherwise the old data could match just
 // by chance.
 //
@@ -203,33 +569,47 @@ void MemoryShadow::cover(void *_ptr, size_t _size, bool _discard)
             hashPtr[i] = hashPtr[0];
         }
     } else {
-        for (size_t i = 0; i < nBlocks; ++i) {
-            hashPtr[i] = hashBlock(p);
-            p += BLOCK_SIZE;
-        }
+        uint32_t *hashes = hashPtr;
+        forEachSlice(nBlocks, countSlices(nBlocks), [=] (size_t, size_t first, size_t last) {
+            hashBlocks(p + first * BLOCK_SIZE, last - first, hashes + first);
+        });
     }
 }
 
 
 void MemoryShadow::update(Callback callback) const
 {
-    const uint8_t *realStart   = realPtr   + size;
-    const uint8_t *realStop    = realPtr;
+    trace::stats::Scope scope(trace::stats::SUBSYSTEM_MEMORY_SHADOW);
 
     const uint8_t *p = lAlignPtr(realPtr, BLOCK_SIZE);
-    for (size_t i = 0; i < nBlocks; ++i) {
-        uint32_t crc = hashBlock(p);
-        if (crc != hashPtr[i]) {
-            realStart = std::min(realStart, p);
-            realStop  = std::max(realStop,  p + BLOCK_SIZE);
+
+    // Each slice collects its own dirty ranges, in order
+    std::vector<std::vector<BlockRange>> sliceRanges(countSlices(nBlocks));
+    const uint32_t *hashes = hashPtr;
+    forEachSlice(nBlocks, sliceRanges.size(), [&] (size_t slice, size_t first, size_t last) {
+        diffBlocks(p, hashes, first, last, sliceRanges[slice]);
+    });
+
+    // Coalesce the ranges across slices, and copy them
+    BlockRange range = {0, 0};
+    for (const std::vector<BlockRange> &ranges : sliceRanges) {
+        for (const BlockRange &next : ranges) {
+            if (range.last != range.first && next.first - range.last <= MAX_GAP_BLOCKS) {
+                range.last = next.last;
+                continue;
+            }
+            updateRange(p, range, callback);
+            range = next;
         }
-        p += BLOCK_SIZE;
     }
+    updateRange(p, range, callback);
+}
 
-    realStart = std::max(realStart, realPtr);
-    realStop  = std::min(realStop,  realPtr + size);
 
-    // Update the rest
+void MemoryShadow::updateRange(const uint8_t *p, const BlockRange &range, Callback callback) const
+{
+    const uint8_t *realStart = std::max(p + range.first * BLOCK_SIZE, realPtr);
+    const uint8_t *realStop  = std::min(p + range.last  * BLOCK_SIZE, realPtr + size);
     if (realStart < realStop) {
         callback(realStart, realStop - realStart);
     }
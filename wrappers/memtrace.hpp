@@ -31,10 +31,36 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <vector>
+
 
 uint32_t
 hashBlock(const void *p);
 
+/**
+ * Hash count consecutive blocks, with the same result as hashBlock.
+ */
+void
+hashBlocks(const void *p, size_t count, uint32_t *hashes);
+
+
+/**
+ * Half-open range of block indices.
+ */
+struct BlockRange
+{
+    size_t first;
+    size_t last;
+};
+
+/**
+ * Append the ranges of blocks in [first, last) whose hash differs from the
+ * given ones, coalescing ranges separated by a few clean blocks.
+ */
+void
+diffBlocks(const void *p, const uint32_t *hashes, size_t first, size_t last,
+           std::vector<BlockRange> &ranges);
+
 
 class MemoryShadow
 {
@@ -60,4 +86,7 @@ public:
     void cover(void *ptr, size_t size, bool discard);
 
     void update(Callback callback) const;
+
+private:
+    void updateRange(const uint8_t *p, const BlockRange &range, Callback callback) const;
 };
@@ -0,0 +1,207 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "crc32c.hpp"
+#include "memtrace.hpp"
+
+
+static const size_t BLOCK_SIZE = 512;
+
+
+// Block aligned memory, with some slack before and after
+class Buffer
+{
+    std::vector<uint8_t> storage;
+
+public:
+    uint8_t *data;
+
+    Buffer(size_t size) :
+        storage(size + 3 * BLOCK_SIZE)
+    {
+        data = (uint8_t *)(((uintptr_t)storage.data() + 2 * BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1));
+        for (size_t i = 0; i < storage.size(); ++i) {
+            storage[i] = uint8_t(i * 31 + (i >> 9));
+        }
+    }
+};
+
+
+struct Copy
+{
+    const void *ptr;
+    size_t size;
+};
+
+static std::vector<Copy> copies;
+
+static void
+recordCopy(const void *ptr, size_t size)
+{
+    copies.push_back(Copy{ptr, size});
+}
+
+
+TEST(memtrace, hash_blocks)
+{
+    const size_t count = 37;
+    Buffer buffer(count * BLOCK_SIZE);
+
+    for (size_t n = 0; n <= count; ++n) {
+        std::vector<uint32_t> hashes(n);
+        hashBlocks(buffer.data, n, hashes.data());
+        for (size_t i = 0; i < n; ++i) {
+            const uint8_t *block = buffer.data + i * BLOCK_SIZE;
+            EXPECT_EQ(crc32c_8bytes(block, BLOCK_SIZE), hashes[i]) << n << " " << i;
+            EXPECT_EQ(hashBlock(block), hashes[i]) << n << " " << i;
+        }
+    }
+}
+
+
+TEST(memtrace, diff_blocks)
+{
+    const size_t count = 64;
+    Buffer buffer(count * BLOCK_SIZE);
+
+    std::vector<uint32_t> hashes(count);
+    hashBlocks(buffer.data, count, hashes.data());
+
+    // Dirty blocks 3, 5, 6, 20 and 63
+    buffer.data[3 * BLOCK_SIZE + 7] ^= 1;
+    buffer.data[5 * BLOCK_SIZE] ^= 1;
+    buffer.data[6 * BLOCK_SIZE + BLOCK_SIZE - 1] ^= 1;
+    buffer.data[20 * BLOCK_SIZE + 100] ^= 1;
+    buffer.data[63 * BLOCK_SIZE + 1] ^= 1;
+
+    std::vector<BlockRange> ranges;
+    diffBlocks(buffer.data, hashes.data(), 0, count, ranges);
+    ASSERT_EQ(3U, ranges.size());
+    EXPECT_EQ(3U, ranges[0].first);
+    EXPECT_EQ(7U, ranges[0].last);
+    EXPECT_EQ(20U, ranges[1].first);
+    EXPECT_EQ(21U, ranges[1].last);
+    EXPECT_EQ(63U, ranges[2].first);
+    EXPECT_EQ(64U, ranges[2].last);
+
+    // A sub range only sees its own blocks
+    ranges.clear();
+    diffBlocks(buffer.data, hashes.data(), 6, 21, ranges);
+    ASSERT_EQ(2U, ranges.size());
+    EXPECT_EQ(6U, ranges[0].first);
+    EXPECT_EQ(7U, ranges[0].last);
+    EXPECT_EQ(20U, ranges[1].first);
+    EXPECT_EQ(21U, ranges[1].last);
+}
+
+
+TEST(memtrace, update)
+{
+    const size_t size = 100 * BLOCK_SIZE;
+    Buffer buffer(size);
+
+    // Unaligned start and size
+    uint8_t *ptr = buffer.data + 10;
+    MemoryShadow shadow;
+    shadow.cover(ptr, size - 30, false);
+
+    copies.clear();
+    shadow.update(recordCopy);
+    EXPECT_TRUE(copies.empty());
+
+    ptr[0] = ~ptr[0];
+    ptr[50 * BLOCK_SIZE] = ~ptr[50 * BLOCK_SIZE];
+    ptr[size - 31] = ~ptr[size - 31];
+
+    copies.clear();
+    shadow.update(recordCopy);
+    ASSERT_EQ(3U, copies.size());
+    // Clamped to the covered memory
+    EXPECT_EQ(ptr, copies[0].ptr);
+    EXPECT_EQ(BLOCK_SIZE - 10, copies[0].size);
+    EXPECT_EQ(buffer.data + 50 * BLOCK_SIZE, copies[1].ptr);
+    EXPECT_EQ(BLOCK_SIZE, copies[1].size);
+    EXPECT_EQ(ptr + size - 30, (const uint8_t *)copies[2].ptr + copies[2].size);
+}
+
+
+TEST(memtrace, update_parallel)
+{
+    // Large enough to be split across threads
+    const size_t size = 16 * 1024 * 1024;
+    Buffer buffer(size);
+
+    MemoryShadow shadow;
+    shadow.cover(buffer.data, size, false);
+
+    // Dirty every 1000th block, and a run straddling the slices
+    std::vector<size_t> dirty;
+    for (size_t i = 0; i < size / BLOCK_SIZE; i += 1000) {
+        dirty.push_back(i);
+    }
+    for (size_t i = size / BLOCK_SIZE / 2 - 3; i < size / BLOCK_SIZE / 2 + 3; ++i) {
+        dirty.push_back(i);
+    }
+    std::sort(dirty.begin(), dirty.end());
+    for (size_t i : dirty) {
+        buffer.data[i * BLOCK_SIZE + 3] ^= 0x80;
+    }
+
+    copies.clear();
+    shadow.update(recordCopy);
+
+    // Every dirty block is copied exactly once, in order
+    size_t next = 0;
+    const uint8_t *end = buffer.data;
+    for (const Copy &copy : copies) {
+        const uint8_t *start = (const uint8_t *)copy.ptr;
+        EXPECT_GE(start, end);
+        end = start + copy.size;
+        while (next < dirty.size() && buffer.data + dirty[next] * BLOCK_SIZE < end) {
+            EXPECT_GE(buffer.data + dirty[next] * BLOCK_SIZE, start);
+            ++next;
+        }
+    }
+    EXPECT_EQ(dirty.size(), next);
+    EXPECT_LT(copies.size(), dirty.size());
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}